@@ -0,0 +1,114 @@
+/*
+ * File:   AllocationBenchmark.cpp
+ *
+ * Counts heap allocations and time per objective function evaluation for a
+ * catch at age shaped workload. Built and run by the allocation-benchmark
+ * target in the Makefile. It replaces the global operator new, which is why
+ * it is kept out of the main program.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <sys/time.h>
+
+#include "ET4AD.hpp"
+
+/*
+ * Counts every heap allocation in the program.
+ */
+static size_t allocation_count_g = 0;
+
+#if __cplusplus >= 201103L
+
+void* operator new(std::size_t size) {
+#else
+
+void* operator new(std::size_t size) throw (std::bad_alloc) {
+#endif
+    allocation_count_g++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#if __cplusplus >= 201103L
+
+void operator delete(void* p) noexcept {
+#else
+
+void operator delete(void* p) throw () {
+#endif
+    std::free(p);
+}
+
+/**
+ * Reports heap allocations and time per objective function evaluation for
+ * a catch at age shaped workload: runtime std::vector<variable> of size 
+ * nyrs * nages, either rebuilt on every evaluation or kept as members and
+ * reassigned, as CatchAtAge does.
+ */
+template<class T>
+void AllocationBenchmark(int nyrs, int nages, int evaluations, bool rebuild) {
+    typedef ad::Variable<T> variable;
+    variable log_q(-1.0, true);
+    std::vector<variable> log_sel(nages);
+    std::vector<T> effort(nyrs);
+    for (int j = 0; j < nages; j++) {
+        log_sel[j] = static_cast<T> (-0.1 * j);
+        log_sel[j].SetAsIndependent(true);
+    }
+    for (int i = 0; i < nyrs; i++) {
+        effort[i] = 0.5 + 0.01 * i;
+    }
+    T M = 0.2;
+
+    variable f;
+    std::vector<variable> F(nyrs * nages);
+    std::vector<variable> Z(nyrs * nages);
+    std::vector<variable> S(nyrs * nages);
+    size_t start_count = allocation_count_g;
+    timeval start;
+    gettimeofday(&start, NULL);
+    for (int e = 0; e < evaluations; e++) {
+        if (rebuild) {
+            F = std::vector<variable>(nyrs * nages);
+            Z = std::vector<variable>(nyrs * nages);
+            S = std::vector<variable>(nyrs * nages);
+        }
+        for (int i = 0; i < nyrs; i++) {
+            for (int j = 0; j < nages; j++) {
+                F[i * nages + j] = (std::mfexp(log_q) * effort[i]) * std::mfexp(log_sel[j]);
+                Z[i * nages + j] = F[i * nages + j] + M;
+                S[i * nages + j] = std::mfexp(static_cast<T> (-1.0) * Z[i * nages + j]);
+            }
+        }
+        f = 0.0;
+        for (size_t i = 0; i < S.size(); i++) {
+            f += S[i];
+        }
+    }
+    timeval end;
+    gettimeofday(&end, NULL);
+    double seconds = (end.tv_sec - start.tv_sec) + 1e-6 * (end.tv_usec - start.tv_usec);
+
+    std::cout << "Allocation benchmark (" << nyrs << " x " << nages << ", "
+            << evaluations << " evaluations, "
+            << (rebuild ? "rebuilt" : "reused") << " vectors)\n";
+    std::cout << "allocations per evaluation: "
+            << (allocation_count_g - start_count) / static_cast<double> (evaluations) << "\n";
+    std::cout << "time per evaluation (ms): " << 1000.0 * seconds / evaluations << "\n";
+    std::cout << "f = " << f << ", df/dlog_q = " << f.WRT(log_q) << "\n";
+}
+
+/*
+ *
+ */
+int main() {
+    AllocationBenchmark<double>(20, 8, 1000, true);
+    AllocationBenchmark<double>(20, 8, 1000, false);
+    return EXIT_SUCCESS;
+}
@@ -341,7 +341,7 @@ namespace ad {
         }
 
         T ToValue() {
-            std::istringstream ss;
+            std::stringstream ss;
             ss << this->value_m;
             T result;
             return ss >> result ? result : 0;
@@ -350,29 +350,29 @@ namespace ad {
 
         //Friends
         // relational operators
-        template<class TT> friend const int operator==(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator!=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator<(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator>(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator<=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator>=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const long operator %(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
-
-        template<class TT> friend const int operator==(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator!=(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator<(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator>(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator<=(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const int operator>=(TT lhs, const BigFloat<TT>& rhs);
-        template<class TT> friend const long operator%(const TT &lhs, const BigFloat<TT>& rhs);
-
-        template<class TT> friend const int operator==(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator!=(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator<(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator>(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator<=(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator>=(const BigFloat<TT>& lhs, TT rhs);
-        template<class TT> friend const int operator%(const BigFloat<TT>& lhs, const TT &rhs);
+        template<class TT> friend int operator==(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator!=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator<(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator>(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator<=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator>=(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend long operator %(const BigFloat<TT>& lhs, const BigFloat<TT>& rhs);
+
+        template<class TT> friend int operator==(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator!=(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator<(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator>(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator<=(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend int operator>=(TT lhs, const BigFloat<TT>& rhs);
+        template<class TT> friend long operator%(const TT &lhs, const BigFloat<TT>& rhs);
+
+        template<class TT> friend int operator==(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator!=(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator<(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator>(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator<=(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator>=(const BigFloat<TT>& lhs, TT rhs);
+        template<class TT> friend int operator%(const BigFloat<TT>& lhs, const TT &rhs);
 
 
         // binary
@@ -420,7 +420,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator==(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator==(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() == rhs.GetValue());
     }
@@ -432,7 +432,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator!=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator!=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() != rhs.GetValue());
     }
@@ -444,7 +444,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator<(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() < rhs.GetValue());
     }
@@ -455,7 +455,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator>(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() > rhs.GetValue());
     }
@@ -467,7 +467,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator<=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() <= rhs.GetValue());
     }
@@ -479,12 +479,12 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator>=(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
 
         return (lhs.GetValue() >= rhs.GetValue());
     }
 
-    template<class T> const long operator %(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
+    template<class T> long operator %(const BigFloat<T>& lhs, const BigFloat<T>& rhs) {
         return lhs.value_m.Mod(rhs.value_m);
     }
 
@@ -495,7 +495,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator==(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator==(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs == rhs.GetValue());
     }
@@ -507,7 +507,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator!=(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator!=(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs != rhs.GetValue());
     }
@@ -519,7 +519,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator<(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs < rhs.GetValue());
     }
@@ -531,7 +531,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator>(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs > rhs.GetValue());
     }
@@ -543,7 +543,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<=(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator<=(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs <= rhs.GetValue().ToDouble());
     }
@@ -555,12 +555,12 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>=(T lhs, const BigFloat<T>& rhs) {
+    template<class T> inline int operator>=(T lhs, const BigFloat<T>& rhs) {
 
         return (lhs >= rhs.GetValue());
     }
 
-    template<class T> const long operator %(const T& lhs, const BigFloat<T>& rhs) {
+    template<class T> long operator %(const T& lhs, const BigFloat<T>& rhs) {
         return lhs % rhs.ToValue();
     }
 
@@ -571,7 +571,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator==(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator==(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() == rhs);
     }
@@ -583,7 +583,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator!=(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator!=(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() != rhs);
     }
@@ -595,7 +595,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator<(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() < rhs);
     }
@@ -607,7 +607,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator>(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() > rhs);
     }
@@ -619,7 +619,7 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator<=(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator<=(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() <= rhs);
     }
@@ -631,13 +631,13 @@ namespace ad {
      * @param rhs
      * @return 
      */
-    template<class T> inline const int operator>=(const BigFloat<T>& lhs, T rhs) {
+    template<class T> inline int operator>=(const BigFloat<T>& lhs, T rhs) {
 
         return (lhs.GetValue() >= rhs);
     }
 
     
-    template<class T> const int operator %(const BigFloat<T>& lhs, const T& rhs) {
+    template<class T> int operator %(const BigFloat<T>& lhs, const T& rhs) {
         ttmath::Big < TTMATH_BITS(BIGFLOAT_MANTISSA_BITS), TTMATH_BITS(BIGFLOAT_EXPONENT_BITS) > temp(rhs);
         ttmath::Big < TTMATH_BITS(BIGFLOAT_MANTISSA_BITS), TTMATH_BITS(BIGFLOAT_EXPONENT_BITS) > ltemp(lhs.value_m);
         return ltemp.Mod(temp);
@@ -13,9 +13,34 @@
 #include "FunctionMinimizer.hpp"
 #include "ET4AD.hpp"
 
+/**
+ * Derived quantities of the catch at age model, for one variable type.
+ */
+template<class VARIABLE>
+struct CatchAtAgePopulation {
+    std::vector<VARIABLE> log_sel;
+    std::vector<VARIABLE> log_initpop;
+    std::vector<VARIABLE> F;
+    std::vector<VARIABLE> Z;
+    std::vector<VARIABLE> S;
+    std::vector<VARIABLE> N;
+    std::vector<VARIABLE> C;
+
+    void Resize(int nyrs, int nages) {
+        this->log_sel.resize(nages);
+        this->log_initpop.resize(nyrs + nages - 1);
+        this->F.resize(nyrs * nages);
+        this->Z.resize(nyrs * nages);
+        this->S.resize(nyrs * nages);
+        this->N.resize(nyrs * nages);
+        this->C.resize(nyrs * nages);
+    }
+};
+
 template<class T>
 class CatchAtAge : public ad::FunctionMinimizer<T> {
     typedef ad::Variable<T> variable;
+    typedef ad::Dual<T, 64> dual;
 
 
     std::string input_file_path;
@@ -37,6 +62,18 @@ class CatchAtAge : public ad::FunctionMinimizer<T> {
     T M;
     std::vector<T> relwt;
 
+    //parameter values and derived quantities for ObjectiveFunctionValue
+    std::vector<T> log_sel_coff_values;
+    std::vector<T> log_relpop_values;
+    std::vector<T> effort_devs_values;
+    CatchAtAgePopulation<T> population_values;
+
+    //parameters and derived quantities for ObjectiveFunctionGradient
+    std::vector<dual> log_sel_coff_duals;
+    std::vector<dual> log_relpop_duals;
+    std::vector<dual> effort_devs_duals;
+    CatchAtAgePopulation<dual> population_duals;
+
 public:
 
     //Estimated
@@ -46,20 +83,24 @@ public:
     std::vector<variable> log_relpop;
     std::vector<variable> effort_devs;
     //Runtime
-    std::vector<variable> log_sel;
-    std::vector<variable> log_initpop;
-    std::vector<variable> F;
-    std::vector<variable> Z;
-    std::vector<variable> S;
-    std::vector<variable> N;
-    std::vector<variable> C;
-    std::vector<variable> predicted_N;
-    std::vector<variable> ratio_N;
+    CatchAtAgePopulation<variable> population;
+
+    /**
+     * The model reads its data from data_path when it is initialized, by
+     * default catage.dat in the working directory.
+     * 
+     * @param data_path
+     */
+    CatchAtAge(const std::string &data_path = "catage.dat") : input_file_path(data_path) {
+    }
 
     void Initialize() {
         StreamedDataFile<double> input_file;
-        input_file_path = "/Users/matthewsupernaw/NetBeansProjects/ET4AD/catage.dat___";
         input_file.Parse(input_file_path);
+        if (!input_file.HasMore()) {
+            std::cerr << "CatchAtAge: unable to read " << input_file_path << "\n";
+            exit(EXIT_FAILURE);
+        }
 
         this->nyrs = static_cast<int> (input_file.Next());
         this->nages = static_cast<int> (input_file.Next());
@@ -74,15 +115,10 @@ public:
         this->log_popscale = 5.0;
         this->Register(log_popscale);
 
-        this->log_initpop = std::vector<variable > (nyrs + nages - 1);
-        for (int i = 0; i< this->log_initpop.size(); i++) {
-            this->log_initpop[i] = variable();
-        }
-
         std::stringstream ss;
 
         this->log_sel_coff = std::vector<variable > (nages - 1);
-        for (int i = 0; i< this->log_sel_coff.size(); i++) {
+        for (size_t i = 0; i < this->log_sel_coff.size(); i++) {
             ss.str("");
             ss << "log_sel_coff[" << i << "]";
             log_sel_coff[i] = variable();
@@ -92,7 +128,7 @@ public:
         }
 
         this->log_relpop = std::vector<variable > (nyrs + nages - 1);
-        for (int i = 0; i< this->log_relpop.size(); i++) {
+        for (size_t i = 0; i < this->log_relpop.size(); i++) {
             ss.str("");
             ss << "log_relpop[" << i << "]";
             log_relpop[i] = variable();
@@ -103,7 +139,7 @@ public:
 
 
         this->effort_devs = std::vector<variable > (nyrs);
-        for (int i = 0; i< this->effort_devs.size(); i++) {
+        for (size_t i = 0; i < this->effort_devs.size(); i++) {
             ss.str("");
             ss << "effort_devs[" << i << "]";
             effort_devs[i] = variable(0.0);
@@ -112,25 +148,13 @@ public:
             this->Register(effort_devs[i], 3);
 
         }
-        this->log_sel = std::vector<variable > (nages);
-        this->predicted_N = std::vector<variable > (nages);
-        this->ratio_N = std::vector<variable > (nages);
-
-        this->F = std::vector<variable > (nyrs * nages);
-        this->Z = std::vector<variable > (nyrs * nages);
-        this->S = std::vector<variable > (nyrs * nages);
-        this->N = std::vector<variable > (nyrs * nages);
-        this->C = std::vector<variable > (nyrs * nages);
-
+        this->population.Resize(nyrs, nages);
+        this->population_values.Resize(nyrs, nages);
+        this->population_duals.Resize(nyrs, nages);
 
         for (int i = 0; i < nyrs; i++) {
             for (int j = 0; j < nages; j++) {
                 this->obs_catch_at_age[i * nages + j] = input_file.Next();
-                this->F[i * nages + j] = variable();
-                this->Z[i * nages + j] = variable();
-                this->S[i * nages + j] = variable();
-                this->N[i * nages + j] = variable();
-                this->C[i * nages + j] = variable();
             }
         }
 
@@ -158,36 +182,34 @@ public:
 
     }
 
-    void GetMortalityAndSurvivalRates() {
+    template<class VARIABLE>
+    void GetMortalityAndSurvivalRates(const VARIABLE &log_q, const std::vector<VARIABLE> &log_sel_coff,
+            const std::vector<VARIABLE> &effort_devs, CatchAtAgePopulation<VARIABLE> &p) {
 
         int i, j;
         // calculate the selectivity from the sel_coffs
         for (j = 0; j < nages - 1; j++) {
-            log_sel[j] = log_sel_coff[j];
+            p.log_sel[j] = log_sel_coff[j];
 
         }
 
         // the selectivity is the same for the last two age classes
-        log_sel[nages - 1] = log_sel_coff[nages - 2];
+        p.log_sel[nages - 1] = log_sel_coff[nages - 2];
 
 
         // This is the same as F(i,j)=exp(q)*effert(i)*exp(log_sel(j));
         //F = outer_prod(mfexp(log_q) * effort, mfexp(log_sel));
         for (i = 0; i < nyrs; i++) {
             for (j = 0; j < nages; j++) {
-                F[i * nages + j] = (std::mfexp(log_q) * effort[i]) * std::mfexp(log_sel[j]);
-                //                std::cout<<F[i * nages + j]<<" "<<F[i * nages + j].wrt(this->log_q)<<"\n";
-                //                exit(0);
+                p.F[i * nages + j] = (std::mfexp(log_q) * effort[i]) * std::mfexp(p.log_sel[j]);
             }
         }
 
-        //        exit(0);
-
 
         if (this->Phase() == 3) {//active(effort_devs)) {
             for (i = 0; i < nyrs; i++) {
                 for (j = 0; j < nages; j++) {
-                    F[i * nages + j] = F[i * nages + j] * std::mfexp(effort_devs[i]);
+                    p.F[i * nages + j] = p.F[i * nages + j] * std::mfexp(effort_devs[i]);
                 }
             }
         }
@@ -196,52 +218,42 @@ public:
         // get the total mortality
         for (i = 0; i < nyrs; i++) {
             for (j = 0; j < nages; j++) {
-                Z[i * nages + j] = F[i * nages + j] + M;
-                S[i * nages + j] = std::mfexp(static_cast<T> (-1.0) * Z[i * nages + j]);
+                p.Z[i * nages + j] = p.F[i * nages + j] + M;
+                p.S[i * nages + j] = std::mfexp(static_cast<T> (-1.0) * p.Z[i * nages + j]);
             }
 
         }
     }
 
-    void GetNumberAtAge() {
+    template<class VARIABLE>
+    void GetNumberAtAge(const VARIABLE &log_popscale, const std::vector<VARIABLE> &log_relpop,
+            CatchAtAgePopulation<VARIABLE> &p) {
 
         int i, j;
-        for (int i = 0; i < log_initpop.size(); i++) {
-            log_initpop[i] = log_relpop[i] + log_popscale;
+        for (size_t i = 0; i < p.log_initpop.size(); i++) {
+            p.log_initpop[i] = log_relpop[i] + log_popscale;
         }
 
         for (i = 0; i < nyrs; i++) {
-            N[i * nages] = std::mfexp(log_initpop[i]);
+            p.N[i * nages] = std::mfexp(p.log_initpop[i]);
         }
 
         for (j = 1; j < nages; j++) {
-            N[j] = std::mfexp(log_initpop[(nyrs) + j - 1]);
+            p.N[j] = std::mfexp(p.log_initpop[(nyrs) + j - 1]);
         }
 
         for (i = 0; i < nyrs - 1; i++) {
             for (j = 0; j < nages - 1; j++) {
-                N[(i + 1) * nages + (j + 1)] = N[i * nages + j] * S[i * nages + j];
+                p.N[(i + 1) * nages + (j + 1)] = p.N[i * nages + j] * p.S[i * nages + j];
             }
         }
-
-        // calculated predicted numbers at age for next year
-//                for (j = 0; j < nages - 1; j++) {
-//                    predicted_N[j + 1] = N[((nyrs - 1) * nages) + j] * S[((nyrs - 1) * nages) + j];
-//                    //            std::cout << predicted_N[j+1] << " "<<N[((nyrs-1)*nages ) + j] <<" "<<S[((nyrs-1)*nages ) + j]<<"\n";
-//                    ratio_N[j + 1] = predicted_N[j + 1] / N[((nyrs - 1) * nages) + (j + 1)];
-//                    //            std::cout<< ratio_N[j + 1]<<" ";
-//                }
-        //        exit(0);
-        // calculated predicted Biomass for next year for
-        // adjusted profile likelihood
-        //        pred_B = (predicted_N * relwt);
-
     }
 
-    void GetCatchAtAge() {
+    template<class VARIABLE>
+    void GetCatchAtAge(CatchAtAgePopulation<VARIABLE> &p) {
 
-        for (int i = 0; i < C.size(); i++) {
-            C[i] = (F[i] / Z[i])*(((T) 1.0 - S[i]) * N[i]);
+        for (size_t i = 0; i < p.C.size(); i++) {
+            p.C[i] = (p.F[i] / p.Z[i])*(((T) 1.0 - p.S[i]) * p.N[i]);
         }
     }
 
@@ -249,33 +261,30 @@ public:
 #if defined(WIN32) || defined(WIN64) 
         retrun GetTickCount();
 #else
-        timeb tb;
-        ftime(&tb);
-        int nCount = tb.millitm + (tb.time & 0xfffff) * 1000;
+        timeval tv;
+        gettimeofday(&tv, NULL);
+        int nCount = tv.tv_usec / 1000 + (tv.tv_sec & 0xfffff) * 1000;
         return nCount;
 #endif
     }
 
-    void ObjectiveFunction(variable & f) {
-        //
-        //                if(this->function_calls_m == 251){
-        //                    exit(0);
-        //                }
+    /**
+     * The objective function, written once for both the recorded 
+     * (ad::Variable) and the value only (T) evaluation.
+     */
+    template<class VARIABLE>
+    void NegativeLogLikelihood(VARIABLE &f, const VARIABLE &log_q, const VARIABLE &log_popscale,
+            const std::vector<VARIABLE> &log_sel_coff, const std::vector<VARIABLE> &log_relpop,
+            const std::vector<VARIABLE> &effort_devs, CatchAtAgePopulation<VARIABLE> &p) {
         f = 0.0;
 
-        GetMortalityAndSurvivalRates();
-        GetNumberAtAge();
-        GetCatchAtAge();
+        GetMortalityAndSurvivalRates(log_q, log_sel_coff, effort_devs, p);
+        GetNumberAtAge(log_popscale, log_relpop, p);
+        GetCatchAtAge(p);
 
         f += (T) .01 * norm2(log_relpop);
-        //        std::cout << this->log_q << ":" << this->log_popscale << " " << f << "---" << f.wrt(this->log_q) << "\n";
-        //        exit(0);
 
-        variable avg_F = (T) 0.0;
-        for (int i = 0; i < F.size(); i++) {
-            avg_F += F[i];
-        }
-        avg_F /= (double) F.size();
+        VARIABLE avg_F = this->Total(p.F) / (T) p.F.size();
 
 
         if (this->Phase() == this->max_phase_m) {
@@ -286,39 +295,102 @@ public:
             f += (T) 1000. * (std::log(avg_F / (T) .2) * std::log(avg_F / (T) .2));
         }
 
-        variable sum;
-        for (int i = 0; i < C.size(); i++) {
-            sum += ((C[i] - obs_catch_at_age[i])*(C[i] - obs_catch_at_age[i])) / ((T) 0.01 + C[i]);
-            //            std::cout << this->log_q << ":" << this->log_popscale << " " << f << "---" << sum.wrt(this->log_q) << "\n";
-        }
+        VARIABLE sum = this->CatchResiduals(p.C);
 
-        f += (T) 0.5 * T(C.size() + nyrs) * std::log(sum + (T) 0.1 * norm2<variable > (effort_devs));
+        f += (T) 0.5 * T(p.C.size() + nyrs) * std::log(sum + (T) 0.1 * norm2(effort_devs));
+    }
 
-        //std::cout<<f.ExpressionSize()<<"\n";
-        //        std::cout << this->log_q << ":" << this->log_popscale << " " << f << "---" << f.wrt(this->log_q) << "\n";
-        //        exit(0);
-        //        f.Diff(this->log_popscale);
-        //        std::cout<<ad::Variable<T>::misses_g<<"\n";
-        //       std::cout<<"current ="<< f.gv.size()<<"\n";
-        //                std::cout<<f.Diff(this->log_popscale)<<" == "<<f.WRT(this->log_popscale)<<"\n";
+    void ObjectiveFunction(variable & f) {
+        this->NegativeLogLikelihood(f, this->log_q, this->log_popscale, this->log_sel_coff,
+                this->log_relpop, this->effort_devs, this->population);
+    }
+
+    bool ObjectiveFunctionValue(T &f) {
+        CopyValues(this->log_sel_coff, this->log_sel_coff_values);
+        CopyValues(this->log_relpop, this->log_relpop_values);
+        CopyValues(this->effort_devs, this->effort_devs_values);
+        this->NegativeLogLikelihood(f, this->log_q.GetValue(), this->log_popscale.GetValue(),
+                this->log_sel_coff_values, this->log_relpop_values, this->effort_devs_values,
+                this->population_values);
+        return true;
+    }
+
+    bool ObjectiveFunctionGradient(T &f, std::valarray<T> &gradient) {
+        if (gradient.size() > dual::Directions) {
+            return false;
+        }
+        this->CopyDuals(this->log_sel_coff, this->log_sel_coff_duals);
+        this->CopyDuals(this->log_relpop, this->log_relpop_duals);
+        this->CopyDuals(this->effort_devs, this->effort_devs_duals);
+        dual fd;
+        this->NegativeLogLikelihood(fd, this->template MakeDual<dual>(this->log_q),
+                this->template MakeDual<dual>(this->log_popscale), this->log_sel_coff_duals,
+                this->log_relpop_duals, this->effort_devs_duals, this->population_duals);
+        this->ExtractDual(fd, f, gradient);
+        return true;
     }
 
     template<class TT>
-    const TT norm2(std::vector<TT> &vect) {
-        TT ret;// = TT(0.0);
+    const TT norm2(const std::vector<TT> &vect) {
+        TT ret = TT(0.0);
         size_t s= vect.size();
-        for (int i = 0; i < s; i++) {
+        for (size_t i = 0; i < s; i++) {
             ret +=vect[i]*vect[i];//std::pow(vect[i], 2.0);
         }
         return ret;
     }
 
+    /**
+     * norm2 of recorded variables, as one fused reduction.
+     */
+    const variable norm2(const std::vector<variable> &vect) {
+        return ad::Norm2(vect);
+    }
+
+    template<class TT>
+    const TT Total(const std::vector<TT> &vect) {
+        TT ret = TT(0.0);
+        for (size_t i = 0; i < vect.size(); i++) {
+            ret += vect[i];
+        }
+        return ret;
+    }
+
+    /**
+     * Sum of recorded variables, as one fused reduction.
+     */
+    const variable Total(const std::vector<variable> &vect) {
+        return ad::Sum(vect);
+    }
+
+    /**
+     * Sum of the catch at age residuals (C - obs)^2 / (0.01 + C).
+     */
+    template<class TT>
+    const TT CatchResiduals(const std::vector<TT> &C) {
+        TT sum = TT(0.0);
+        for (size_t i = 0; i < C.size(); i++) {
+            sum += ((C[i] - obs_catch_at_age[i])*(C[i] - obs_catch_at_age[i])) / ((T) 0.01 + C[i]);
+        }
+        return sum;
+    }
+
+    /**
+     * Catch at age residuals of recorded variables, as one fused
+     * reduction over the catches and the observations.
+     */
+    const variable CatchResiduals(const std::vector<variable> &C) {
+        ad::array::VariableRange<T> catch_at_age(C);
+        ad::array::ConstantRange<T> observed(obs_catch_at_age);
+        return ad::array::Sum(((catch_at_age - observed)*(catch_at_age - observed)) / ((T) 0.01 + catch_at_age));
+    }
+
     void Finalize() {
 
         std::cout << BOLD << "Estimated number of fish:\n" << DEFAULT_IO;
         for (int i = 0; i < nyrs; i++) {
             for (int j = 0; j < nages; j++) {
-                std::cout << N[(i) * nages + (j)] << "\t";
+                std::cout << population.N[(i) * nages + (j)] << "\t";
             }
             std::cout << std::endl;
         }
@@ -326,7 +398,7 @@ public:
         std::cout << BOLD << "\nEstimated catch:\n" << DEFAULT_IO;
         for (int i = 0; i < nyrs; i++) {
             for (int j = 0; j < nages; j++) {
-                std::cout << C[(i) * nages + (j)] << "\t";
+                std::cout << population.C[(i) * nages + (j)] << "\t";
             }
             std::cout << std::endl;
         }
@@ -343,7 +415,7 @@ public:
         std::cout << BOLD << "\nEstimated Mortality:\n" << DEFAULT_IO;
         for (int i = 0; i < nyrs; i++) {
             for (int j = 0; j < nages; j++) {
-                std::cout << F[(i) * nages + (j)] << "\t";
+                std::cout << population.F[(i) * nages + (j)] << "\t";
             }
             std::cout << std::endl;
         }
@@ -361,9 +433,14 @@ public:
 //                    << "\t" << gradient[i] << "\n";
 //        }
 
-        //                std::valarray<std::valarray<double> > hessian = this->EstimatedHessian();
-
         std::cout << "f = " << this->GetFunctionValue() << "\n";
+
+        std::valarray<T> errors = this->StandardErrors();
+        std::cout << BOLD << "\nStandard errors:\n" << DEFAULT_IO;
+        for (size_t i = 0; i < errors.size(); i++) {
+            std::cout << this->GetActiveParameters().at(i)->GetName() << "\t"
+                    << this->GetActiveParameters().at(i)->GetValue() << "\t" << errors[i] << "\n";
+        }
         
 //        std::ofstream out;
 //        out.open("/Users/matthewsupernaw/NetBeansProjects/catage/dist/Release/Clang-MacOSX/catage.pin");
@@ -379,8 +456,25 @@ public:
 
 private:
 
+    /**
+     * Copies the values of variables into values.
+     */
+    static void CopyValues(const std::vector<variable> &variables, std::vector<T> &values) {
+        values.resize(variables.size());
+        for (size_t i = 0; i < variables.size(); i++) {
+            values[i] = variables[i].GetValue();
+        }
+    }
 
-
+    /**
+     * Copies variables into duals, seeded as in MakeDual.
+     */
+    void CopyDuals(const std::vector<variable> &variables, std::vector<dual> &duals) const {
+        duals.resize(variables.size());
+        for (size_t i = 0; i < variables.size(); i++) {
+            duals[i] = this->template MakeDual<dual>(variables[i]);
+        }
+    }
 
 };
 
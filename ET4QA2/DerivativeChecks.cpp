@@ -0,0 +1,1416 @@
+/*
+ * File:   DerivativeChecks.cpp
+ *
+ * Compares the derivatives computed by ET4AD with central differences of
+ * the function values and across the recording modes. Built and run by the
+ * derivative-checks target in the Makefile; exits with a non-zero status if
+ * any check fails.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "ET4AD.hpp"
+#include "CatchAtAge.hpp"
+
+/*
+ * Names of the recording modes, see SetRecordingMode.
+ */
+static const char* recording_modes_g[] = {"forward", "adjoint tape", "arbitrary order"};
+
+/**
+ * Selects the recording mode of ad::Variable<T>, 0 forward, 1 adjoint
+ * tape, 2 arbitrary order.
+ */
+template<class T>
+void SetRecordingMode(int mode) {
+    ad::Variable<T>::SetUseAdjointTape(mode == 1);
+    ad::Variable<T>::SetSupportArbitraryOrder(mode == 2);
+}
+
+/**
+ * Prints a derivative check and returns true if value is within the
+ * relative tolerance of reference.
+ */
+template<class T>
+bool ReportCheck(const std::string &name, int mode, const T &value, const T &reference, const T &tolerance) {
+    T difference = std::fabs(value - reference) / std::max(T(1.0), std::fabs(reference));
+    bool passed = difference <= tolerance;
+    std::cout << (passed ? "passed " : "FAILED ") << name << " (" << recording_modes_g[mode] << "): "
+            << value << " vs " << reference << "\n";
+    return passed;
+}
+
+/**
+ * Central difference of function with respect to x[i], evaluated on
+ * constant copies of x.
+ */
+template<class T>
+T CentralDifference(ad::Variable<T>(*function)(const std::vector<ad::Variable<T> > &),
+        const std::vector<ad::Variable<T> > &x, size_t i, const T &h) {
+    std::vector<ad::Variable<T> > shifted(x.size());
+    for (size_t k = 0; k < x.size(); k++) {
+        shifted[k] = x[k].GetValue();
+    }
+    shifted[i] = x[i].GetValue() + h;
+    T upper = function(shifted).GetValue();
+    shifted[i] = x[i].GetValue() - h;
+    T lower = function(shifted).GetValue();
+    return (upper - lower) / (static_cast<T> (2.0) * h);
+}
+
+/**
+ * Compares the gradient of function at values with central differences in
+ * every recording mode.
+ */
+template<class T>
+bool GradientCheck(const std::string &name, ad::Variable<T>(*function)(const std::vector<ad::Variable<T> > &),
+        const std::vector<T> &values, const T &tolerance) {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    for (int mode = 0; mode < 3; mode++) {
+        SetRecordingMode<T>(mode);
+        std::vector<variable> x(values.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = values[i];
+            x[i].SetAsIndependent(true);
+        }
+        variable f = function(x);
+        for (size_t i = 0; i < x.size(); i++) {
+            passed &= ReportCheck<T>(name, mode, f.WRT(x[i]), CentralDifference(function, x, i, static_cast<T> (1e-5)), tolerance);
+        }
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * The elementary operations and functions, accumulated into one Variable
+ * through assignments and copies, for the adjoint tape check.
+ */
+template<class T>
+ad::Variable<T> ElementaryFunctions(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    variable f = x[0] * x[1] - x[2] / x[0] + static_cast<T> (2.0) * x[1] - x[2] / static_cast<T> (3.0);
+    variable g = f;
+    f += std::sin(x[0]) * std::cos(x[1]) + std::tan(x[2]);
+    f += std::asin(static_cast<T> (0.5) * x[2]) + std::acos(static_cast<T> (0.3) * x[0]) + std::atan(x[1]);
+    f += std::atan2(x[0], x[1]) + std::atan2(x[2], static_cast<T> (2.0)) + std::atan2(static_cast<T> (2.0), x[1]);
+    f += std::sqrt(x[1]) + std::pow(x[0], x[2]) + std::pow(x[1], static_cast<T> (3.0)) + std::pow(static_cast<T> (2.0), x[2]);
+    f += std::log(x[0]) + std::log10(x[1]) + std::exp(x[2]) + std::mfexp(static_cast<T> (-1.0) * x[0]);
+    f += std::sinh(x[2]) + std::cosh(x[0]) + std::tanh(x[1]) + std::fabs(x[0] - x[1]);
+    f = f * g;
+    return f;
+}
+
+/**
+ * Checks the reverse sweep of the adjoint tape against central
+ * differences and the other recording modes.
+ */
+template<class T>
+bool AdjointTapeCheck() {
+    std::vector<T> values(3);
+    values[0] = 1.1;
+    values[1] = 0.7;
+    values[2] = 0.4;
+    return GradientCheck<T>("elementary functions gradient", ElementaryFunctions<T>, values, 1e-7);
+}
+
+/**
+ * Extended Rosenbrock function plus products of mirrored elements, so each
+ * term touches a few independent variables in changing order, for the
+ * sparse gradient check.
+ */
+template<class T>
+ad::Variable<T> SparseTerms(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    variable f = 0.0;
+    const size_t n = x.size();
+    for (size_t i = 0; i + 1 < n; i++) {
+        variable a = x[i + 1] - x[i] * x[i];
+        variable b = static_cast<T> (1.0) - x[i];
+        f += static_cast<T> (100.0) * a * a + b * b;
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+        f += x[n - 1 - i] * x[i] * x[(i + 3) % n];
+    }
+    return f;
+}
+
+/**
+ * Checks the merge of sorted sparse gradients over a function of many
+ * independent variables against central differences.
+ */
+template<class T>
+bool SparseGradientCheck() {
+    std::vector<T> values(12);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = static_cast<T> (0.9 + 0.05 * i);
+    }
+    return GradientCheck<T>("sparse gradient", SparseTerms<T>, values, 1e-7);
+}
+
+/**
+ * Products of independent variables visited out of order and with
+ * repeats, enough of them to spill the inline storage of IdsSet.
+ */
+template<class T>
+ad::Variable<T> ScatteredTerms(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    variable f = 0.0;
+    const size_t n = x.size();
+    for (size_t i = 0; i < n; i++) {
+        f += x[(7 * i) % n] * x[(11 * i + 5) % n] + std::sin(x[(13 * i + 2) % n]) * x[(7 * i) % n];
+    }
+    return f * f;
+}
+
+/**
+ * Checks gradients whose id sets overflow the inline storage of IdsSet and
+ * are inserted out of order against central differences.
+ */
+template<class T>
+bool IdsSetCheck() {
+    std::vector<T> values(40);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = static_cast<T> (0.5 + 0.02 * i);
+    }
+    return GradientCheck<T>("spilled id set gradient", ScatteredTerms<T>, values, 1e-7);
+}
+
+/**
+ * One large expression over dependent Variables that share independent
+ * variables, for the scatter pass check.
+ */
+template<class T>
+ad::Variable<T> NestedExpression(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    variable y = x[0] * x[1];
+    variable z = std::sin(y) * x[2] + x[0];
+    return y * z + std::pow(y, x[0]) / (z + x[1] * x[1]) - std::exp(static_cast<T> (0.5) * z) * std::atan2(y, z)
+            + std::log(y * y + z * z) * std::sqrt(x[2] + y) - x[0] * x[0] * x[0];
+}
+
+/**
+ * Checks the single scatter pass of forward mode against central
+ * differences.
+ */
+template<class T>
+bool ScatterCheck() {
+    std::vector<T> values(3);
+    values[0] = 0.8;
+    values[1] = 1.3;
+    values[2] = 0.6;
+    return GradientCheck<T>("nested expression gradient", NestedExpression<T>, values, 1e-7);
+}
+
+/**
+ * Work of one thread in ContextCheck.
+ */
+template<class T>
+struct ThreadGradient {
+    int mode;
+    std::vector<T> values;
+    std::vector<T> gradient;
+
+    /**
+     * Records SparseTerms in the thread's own mode and keeps the gradient.
+     */
+    static void* Run(void* argument) {
+        ThreadGradient<T>* work = static_cast<ThreadGradient<T>*> (argument);
+        SetRecordingMode<T>(work->mode);
+        std::vector<ad::Variable<T> > x(work->values.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = work->values[i];
+            x[i].SetAsIndependent(true);
+        }
+        for (int repeat = 0; repeat < 50; repeat++) {
+            ad::Variable<T> f = SparseTerms(x);
+            work->gradient.resize(x.size());
+            for (size_t i = 0; i < x.size(); i++) {
+                work->gradient[i] = f.WRT(x[i]);
+            }
+        }
+        return NULL;
+    }
+};
+
+/**
+ * Runs one thread per recording mode at the same time and compares their
+ * gradients with gradients recorded on the main thread, whose recording
+ * mode must not change.
+ */
+template<class T>
+bool ContextCheck() {
+    bool passed = true;
+    std::vector<ThreadGradient<T> > work(3);
+    for (int mode = 0; mode < 3; mode++) {
+        work[mode].mode = mode;
+        for (size_t i = 0; i < 10; i++) {
+            work[mode].values.push_back(static_cast<T> (0.7 + 0.1 * mode + 0.03 * i));
+        }
+    }
+    std::vector<pthread_t> threads(3);
+    for (int mode = 0; mode < 3; mode++) {
+        pthread_create(&threads[mode], NULL, ThreadGradient<T>::Run, &work[mode]);
+    }
+    for (int mode = 0; mode < 3; mode++) {
+        pthread_join(threads[mode], NULL);
+    }
+    passed &= ReportCheck<T>("main thread mode unchanged", 0,
+            ad::Variable<T>::IsUsingAdjointTape() || ad::Variable<T>::IsSupportingArbitraryOrder(), 0, 0);
+    for (int mode = 0; mode < 3; mode++) {
+        ThreadGradient<T> reference = work[mode];
+        ThreadGradient<T>::Run(&reference);
+        SetRecordingMode<T>(0);
+        for (size_t i = 0; i < reference.gradient.size(); i++) {
+            passed &= ReportCheck<T>("thread gradient", mode, work[mode].gradient[i], reference.gradient[i], 1e-14);
+        }
+    }
+    return passed;
+}
+
+/**
+ * Checks that variables made independent by the Variable(value, true)
+ * constructor get derivatives, and that copies made without any storage
+ * keep them, in every recording mode.
+ */
+template<class T>
+bool IndependentConstructorCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    for (int mode = 0; mode < 3; mode++) {
+        SetRecordingMode<T>(mode);
+        variable x(static_cast<T> (0.7), true);
+        variable y(static_cast<T> (1.9), true);
+        std::vector<variable> copies(3, x);
+        variable f = copies[1] * y + std::sin(x) * std::exp(copies[2]);
+        passed &= ReportCheck<T>("independent constructor d/dx", mode, f.WRT(x),
+                y.GetValue() + (std::cos(x.GetValue()) + std::sin(x.GetValue())) * std::exp(x.GetValue()), 1e-14);
+        passed &= ReportCheck<T>("independent constructor d/dy", mode, f.WRT(y), x.GetValue(), 1e-14);
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Returns x * y + sin(x) by value, for MovedTerms.
+ */
+template<class T>
+ad::Variable<T> ProductTerm(const ad::Variable<T> &x, const ad::Variable<T> &y) {
+    ad::Variable<T> ret = x * y + std::sin(x);
+    return ret;
+}
+
+/**
+ * Terms kept in a growing std::vector, swapped and assigned from
+ * temporaries, so that C++11 builds move Variables where C++98 builds copy
+ * them.
+ */
+template<class T>
+ad::Variable<T> MovedTerms(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    std::vector<variable> terms;
+    for (size_t i = 0; i < x.size(); i++) {
+        for (size_t j = 0; j < x.size(); j++) {
+            terms.push_back(ProductTerm(x[i], x[j]));
+        }
+    }
+    std::swap(terms.front(), terms.back());
+    variable f = 0.0;
+    for (size_t i = 0; i < terms.size(); i++) {
+        variable term;
+        term = ProductTerm(terms[i], x[i % x.size()]);
+        f += term;
+    }
+    return f;
+}
+
+/**
+ * Checks gradients through moved and swapped Variables against central
+ * differences.
+ */
+template<class T>
+bool MoveCheck() {
+    std::vector<T> values(4);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = static_cast<T> (0.3 + 0.2 * i);
+    }
+    return GradientCheck<T>("moved variables gradient", MovedTerms<T>, values, 1e-7);
+}
+
+/**
+ * Checks the derivatives interpreted from the arbitrary order statement
+ * list, before and after a Serialize/Deserialize round trip and in a
+ * single sweep for every independent variable, against the recorded gradient.
+ */
+template<class T>
+bool StatementListCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    std::vector<variable> x(3);
+    x[0] = 1.1;
+    x[1] = 0.7;
+    x[2] = 0.4;
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i].SetAsIndependent(true);
+    }
+    variable f = ElementaryFunctions(x);
+    std::stringstream serialized;
+    f.Serialize(serialized);
+    variable g = f.Deserialize(serialized);
+    passed &= ReportCheck<T>("deserialized value", 2, g.GetValue(), f.GetValue(), 0);
+    for (size_t i = 0; i < x.size(); i++) {
+        passed &= ReportCheck<T>("statement list derivative", 2, f.Diff(x[i]), f.WRT(x[i]), 1e-12);
+        passed &= ReportCheck<T>("deserialized gradient", 2, g.WRT(x[i]), f.WRT(x[i]), 0);
+        passed &= ReportCheck<T>("deserialized statement list derivative", 2, g.Diff(x[i]), f.WRT(x[i]), 1e-12);
+    }
+    std::vector<variable*> wrt(x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        wrt[i] = &x[i];
+    }
+    std::vector<T> derivatives;
+    f.Diff(wrt, derivatives);
+    passed &= ReportCheck<T>("statement list derivative count", 2, derivatives.size(), x.size(), 0);
+    for (size_t i = 0; i < x.size() && i < derivatives.size(); i++) {
+        passed &= ReportCheck<T>("statement list gradient sweep", 2, derivatives[i], f.WRT(x[i]), 1e-12);
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Elementary functions written once over the variable type, for the
+ * comparison of ad::Dual with ad::Variable.
+ */
+template<class VARIABLE, class T>
+VARIABLE DualTerms(const std::vector<VARIABLE> &x) {
+    VARIABLE f = x[0] * x[1] - x[2] / x[3] + static_cast<T> (2.0) * x[4];
+    f += std::sin(x[0]) * std::cos(x[1]) + std::exp(x[2]) * std::log(x[3]) + std::sqrt(x[4]);
+    f += std::pow(x[0], x[2]) + std::pow(x[1], static_cast<T> (3.0)) + std::pow(static_cast<T> (2.0), x[3]);
+    f += std::atan2(x[0], x[4]) + std::tanh(x[1]) + std::mfexp(x[2]) * x[4];
+    return f * f;
+}
+
+/**
+ * Compares ad::Dual gradients with forward mode ad::Variable gradients, in
+ * a direction count that leaves a scalar remainder after the vector lanes,
+ * and checks the pow partials at a negative base.
+ */
+template<class T>
+bool DualCheck() {
+    typedef ad::Dual<T, 5> dual;
+    bool passed = true;
+    std::vector<dual> xd(5);
+    std::vector<ad::Variable<T> > x(5);
+    for (int i = 0; i < 5; i++) {
+        xd[i] = dual(static_cast<T> (0.6 + 0.15 * i), i);
+        x[i] = static_cast<T> (0.6 + 0.15 * i);
+        x[i].SetAsIndependent(true);
+    }
+    dual fd = DualTerms<dual, T>(xd);
+    ad::Variable<T> f = DualTerms<ad::Variable<T>, T>(x);
+    passed &= ReportCheck<T>("dual value", 0, fd.GetValue(), f.GetValue(), 1e-14);
+    for (int i = 0; i < 5; i++) {
+        passed &= ReportCheck<T>("dual gradient", 0, fd.GetGradient(i), f.WRT(x[i]), 1e-12);
+    }
+
+    // pow at a negative base with an integral exponent: d/dx = y * x^(y - 1),
+    // and the exponent partial is taken as zero instead of NaN
+    dual p = std::pow(dual(-2.0, 0), dual(3.0, 1));
+    passed &= ReportCheck<T>("dual pow negative base value", 0, p.GetValue(), -8.0, 0);
+    passed &= ReportCheck<T>("dual pow negative base d/dx", 0, p.GetGradient(0), 12.0, 0);
+    passed &= ReportCheck<T>("dual pow negative base d/dy", 0, p.GetGradient(1), 0.0, 0);
+    dual q = std::pow(static_cast<T> (0.0), dual(2.0, 2));
+    passed &= ReportCheck<T>("dual pow zero base d/dy", 0, q.GetGradient(2), 0.0, 0);
+    return passed;
+}
+
+/**
+ * CatchAtAge with access to its phase and parameters, for CatchAtAgeCheck.
+ */
+template<class T>
+class CatchAtAgeProbe : public CatchAtAge<T> {
+public:
+    using ad::FunctionMinimizer<T>::Hessian;
+    using ad::FunctionMinimizer<T>::EstimatedHessian;
+    using ad::FunctionMinimizer<T>::SparseHessian;
+
+    CatchAtAgeProbe(const std::string &data_path) : CatchAtAge<T>(data_path) {
+    }
+
+    /**
+     * Puts the model in its last phase, so every parameter is active.
+     */
+    void SetLastPhase() {
+        this->phase_m = 3;
+        this->max_phase_m = 3;
+        this->active_parameters_m = this->parameters_m;
+    }
+
+    std::vector<ad::Variable<T>*> &Parameters() {
+        return this->parameters_m;
+    }
+};
+
+/**
+ * A quadratic objective with a known Hessian, for HessianCheck.
+ */
+template<class T>
+class QuadraticModel : public ad::FunctionMinimizer<T> {
+public:
+    using ad::FunctionMinimizer<T>::Hessian;
+    using ad::FunctionMinimizer<T>::StandardErrors;
+    ad::Variable<T> x;
+    ad::Variable<T> y;
+    T a, b, c;
+
+    QuadraticModel() : a(4.0), b(1.5), c(2.0) {
+        x = 0.3;
+        y = -0.2;
+        this->Register(x);
+        this->Register(y);
+        this->active_parameters_m = this->parameters_m;
+        x.SetAsIndependent(true);
+        y.SetAsIndependent(true);
+    }
+
+    void ObjectiveFunction(ad::Variable<T> &f) {
+        f = static_cast<T> (0.5) * (a * x * x + static_cast<T> (2.0) * b * x * y + c * y * y) + std::sin(x);
+    }
+};
+
+/**
+ * Checks FunctionMinimizer::Hessian and StandardErrors on a quadratic with a
+ * known Hessian, and Hessian against EstimatedHessian on CatchAtAge.
+ */
+template<class T>
+bool HessianCheck() {
+    bool passed = true;
+    QuadraticModel<T> quadratic;
+    std::valarray<std::valarray<T> > h = quadratic.Hessian();
+    T hxx = quadratic.a - std::sin(quadratic.x.GetValue());
+    passed &= ReportCheck<T>("quadratic hessian xx", 0, h[0][0], hxx, 1e-14);
+    passed &= ReportCheck<T>("quadratic hessian xy", 0, h[0][1], quadratic.b, 1e-14);
+    passed &= ReportCheck<T>("quadratic hessian yx", 0, h[1][0], quadratic.b, 1e-14);
+    passed &= ReportCheck<T>("quadratic hessian yy", 0, h[1][1], quadratic.c, 1e-14);
+    std::valarray<T> errors = quadratic.StandardErrors();
+    T determinant = hxx * quadratic.c - quadratic.b * quadratic.b;
+    passed &= ReportCheck<T>("quadratic standard error x", 0, errors[0], std::sqrt(quadratic.c / determinant), 1e-14);
+    passed &= ReportCheck<T>("quadratic standard error y", 0, errors[1], std::sqrt(hxx / determinant), 1e-14);
+
+    CatchAtAgeProbe<T> model("catage.dat");
+    model.Initialize();
+    model.SetLastPhase();
+    model.SetVerbose(false);
+    std::vector<ad::Variable<T>*> &parameters = model.Parameters();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        parameters[i]->SetValue(parameters[i]->GetValue() + static_cast<T> (0.01 * std::sin(1.0 + i)));
+        parameters[i]->SetAsIndependent(true);
+    }
+    std::valarray<std::valarray<T> > exact = model.Hessian();
+    std::valarray<std::valarray<T> > estimated = model.EstimatedHessian();
+    T scale = 0;
+    for (size_t i = 0; i < exact.size(); i++) {
+        scale = std::max(scale, std::fabs(exact[i][i]));
+    }
+    T difference = 0;
+    T asymmetry = 0;
+    for (size_t i = 0; i < exact.size(); i++) {
+        for (size_t j = 0; j < exact.size(); j++) {
+            difference = std::max(difference, std::fabs(exact[i][j] - estimated[i][j]));
+            asymmetry = std::max(asymmetry, std::fabs(exact[i][j] - exact[j][i]));
+        }
+    }
+    passed &= ReportCheck<T>("catch at age hessian vs estimated", 0, difference / scale, 0, 1e-6);
+    passed &= ReportCheck<T>("catch at age hessian symmetry", 0, asymmetry / scale, 0, 1e-12);
+    return passed;
+}
+
+/**
+ * Checks ad::HessianVectorProduct against central differences of forward
+ * mode gradients along the direction.
+ */
+template<class T>
+bool HessianVectorProductCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    std::vector<T> values(3);
+    values[0] = 1.1;
+    values[1] = 0.7;
+    values[2] = 0.4;
+    std::vector<T> v(3);
+    v[0] = 0.3;
+    v[1] = -1.2;
+    v[2] = 0.8;
+
+    SetRecordingMode<T>(2);
+    std::vector<variable> x(3);
+    std::vector<variable*> parameters(3);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = values[i];
+        x[i].SetAsIndependent(true);
+        parameters[i] = &x[i];
+    }
+    variable f = ElementaryFunctions(x);
+    std::vector<T> hv = ad::HessianVectorProduct(f, parameters, v);
+
+    SetRecordingMode<T>(0);
+    T h = static_cast<T> (1e-5);
+    std::vector<T> upper(3), lower(3);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i].SetValue(values[i] + h * v[i]);
+    }
+    f = ElementaryFunctions(x);
+    for (size_t i = 0; i < x.size(); i++) {
+        upper[i] = f.WRT(x[i]);
+        x[i].SetValue(values[i] - h * v[i]);
+    }
+    f = ElementaryFunctions(x);
+    for (size_t i = 0; i < x.size(); i++) {
+        lower[i] = f.WRT(x[i]);
+    }
+    for (size_t i = 0; i < x.size(); i++) {
+        passed &= ReportCheck<T>("hessian vector product", 2, hv[i], (upper[i] - lower[i]) / (static_cast<T> (2.0) * h), 1e-6);
+    }
+    return passed;
+}
+
+/**
+ * The Rosenbrock function, for NewtonCheck.
+ */
+template<class T>
+class RosenbrockModel : public ad::FunctionMinimizer<T> {
+public:
+    ad::Variable<T> x;
+    ad::Variable<T> y;
+
+    void Initialize() {
+        x = -1.2;
+        y = 1.0;
+        this->Register(x);
+        this->Register(y);
+    }
+
+    void ObjectiveFunction(ad::Variable<T> &f) {
+        ad::Variable<T> a = y - x * x;
+        ad::Variable<T> b = static_cast<T> (1.0) - x;
+        f = static_cast<T> (100.0) * a * a + b * b;
+    }
+};
+
+/**
+ * Checks that the Newton-CG minimizer finds the minimum of the Rosenbrock
+ * function from the standard starting point.
+ */
+template<class T>
+bool NewtonCheck() {
+    bool passed = true;
+    RosenbrockModel<T> model;
+    model.SetVerbose(false);
+    model.SetTolerance(static_cast<T> (1e-8));
+    model.Run(ad::FunctionMinimizer<T>::NEWTON);
+    passed &= ReportCheck<T>("newton-cg rosenbrock x", 0, model.x.GetValue(), 1.0, 1e-6);
+    passed &= ReportCheck<T>("newton-cg rosenbrock y", 0, model.y.GetValue(), 1.0, 1e-6);
+    return passed;
+}
+
+/**
+ * Checks the compressed CSR Hessian of CatchAtAge against the dense 
+ * Hessian, and the colored CSR Jacobian of a banded system against the
+ * recorded gradients of its rows.
+ */
+template<class T>
+bool SparseCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    CatchAtAgeProbe<T> model("catage.dat");
+    model.Initialize();
+    model.SetLastPhase();
+    model.SetVerbose(false);
+    std::vector<variable*> &parameters = model.Parameters();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        parameters[i]->SetAsIndependent(true);
+    }
+    std::valarray<std::valarray<T> > dense = model.Hessian();
+    ad::CSRMatrix<T> sparse = model.SparseHessian();
+    T scale = 0;
+    T difference = 0;
+    for (size_t i = 0; i < dense.size(); i++) {
+        scale = std::max(scale, std::fabs(dense[i][i]));
+        for (size_t j = 0; j < dense.size(); j++) {
+            difference = std::max(difference, std::fabs(sparse(i, j) - dense[i][j]));
+        }
+    }
+    passed &= ReportCheck<T>("catch at age sparse hessian", 2, difference / scale, 0, 1e-14);
+
+    SetRecordingMode<T>(2);
+    size_t n = 6;
+    std::vector<variable> x(n);
+    std::vector<variable*> wrt(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = static_cast<T> (0.2 + 0.1 * i);
+        x[i].SetAsIndependent(true);
+        wrt[i] = &x[i];
+    }
+    std::vector<variable> f(n - 1);
+    std::vector<variable*> rows(n - 1);
+    for (size_t i = 0; i + 1 < n; i++) {
+        f[i] = x[i] * x[i + 1] + std::sin(x[i]);
+        rows[i] = &f[i];
+    }
+    ad::CSRMatrix<T> jacobian;
+    size_t colors = ad::Jacobian(rows, wrt, jacobian);
+    passed &= ReportCheck<T>("banded jacobian colors", 2, static_cast<T> (colors), 2, 0);
+    for (size_t i = 0; i + 1 < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            passed &= ReportCheck<T>("banded jacobian", 2, jacobian(i, j), f[i].WRT(x[j]), 1e-14);
+        }
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Checks higher order derivatives from Taylor propagation on the statement
+ * tape against closed forms, and a directional series of a product.
+ */
+template<class T>
+bool TaylorCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    variable x(0.7, true);
+    variable y(1.3, true);
+    T xv = x.GetValue();
+    variable e = std::exp(static_cast<T> (2.0) * x);
+    variable s = std::sin(x);
+    variable l = std::log(x);
+    variable r = static_cast<T> (1.0) / (static_cast<T> (1.0) + x);
+    variable q = std::sqrt(x);
+    T factorial = 1.0;
+    for (unsigned int k = 1; k <= 5; k++) {
+        factorial *= static_cast<T> (k);
+        T sign = (k % 2 == 0) ? 1.0 : -1.0;
+        passed &= ReportCheck<T>("taylor exp", 2, e.Diff(x, k), std::pow(static_cast<T> (2.0), static_cast<T> (k)) * std::exp(2.0 * xv), 1e-12);
+        passed &= ReportCheck<T>("taylor sin", 2, s.Diff(x, k), std::sin(xv + k * std::acos(static_cast<T> (-1.0)) / 2.0), 1e-12);
+        passed &= ReportCheck<T>("taylor log", 2, l.Diff(x, k), -sign * (factorial / k) / std::pow(xv, static_cast<T> (k)), 1e-12);
+        passed &= ReportCheck<T>("taylor divide", 2, r.Diff(x, k), sign * factorial / std::pow(1.0 + xv, static_cast<T> (k + 1)), 1e-12);
+    }
+    passed &= ReportCheck<T>("taylor sqrt", 2, q.Diff(x, 3), static_cast<T> (0.375) * std::pow(xv, static_cast<T> (-2.5)), 1e-12);
+    passed &= ReportCheck<T>("taylor first order", 2, s.Diff(x, 1), s.WRT(x), 1e-14);
+
+    // x * y along (1, 1): x y + (x + y) t + t^2
+    variable p = x * y;
+    std::vector<variable*> wrt(2);
+    wrt[0] = &x;
+    wrt[1] = &y;
+    std::vector<T> direction(2, 1.0);
+    std::vector<T> coefficients;
+    p.Taylor(wrt, direction, 3, coefficients);
+    passed &= ReportCheck<T>("taylor direction order 0", 2, coefficients[0], xv * y.GetValue(), 1e-14);
+    passed &= ReportCheck<T>("taylor direction order 1", 2, coefficients[1], xv + y.GetValue(), 1e-14);
+    passed &= ReportCheck<T>("taylor direction order 2", 2, coefficients[2], 1.0, 1e-14);
+    passed &= ReportCheck<T>("taylor direction order 3", 2, coefficients[3], 0.0, 1e-14);
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Checks the value only instantiation of the CatchAtAge objective function
+ * against the recorded one, and the recorded gradient against central
+ * differences of the value only instantiation in every recording mode.
+ */
+template<class T>
+bool CatchAtAgeCheck() {
+    bool passed = true;
+    CatchAtAgeProbe<T> model("catage.dat");
+    model.Initialize();
+    model.SetLastPhase();
+    std::vector<ad::Variable<T>*> &parameters = model.Parameters();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        parameters[i]->SetValue(parameters[i]->GetValue() + static_cast<T> (0.01 * std::sin(1.0 + i)));
+    }
+    for (int mode = 0; mode < 3; mode++) {
+        SetRecordingMode<T>(mode);
+        for (size_t i = 0; i < parameters.size(); i++) {
+            parameters[i]->SetAsIndependent(true);
+        }
+        ad::Variable<T> f;
+        model.ObjectiveFunction(f);
+        T value = 0;
+        model.ObjectiveFunctionValue(value);
+        passed &= ReportCheck<T>("catch at age value", mode, value, f.GetValue(), 1e-12);
+        for (size_t i = 0; i < parameters.size(); i += 5) {
+            T h = static_cast<T> (1e-5);
+            T x = parameters[i]->GetValue();
+            T upper, lower;
+            parameters[i]->SetValue(x + h);
+            model.ObjectiveFunctionValue(upper);
+            parameters[i]->SetValue(x - h);
+            model.ObjectiveFunctionValue(lower);
+            parameters[i]->SetValue(x);
+            passed &= ReportCheck<T>("catch at age gradient", mode, f.WRT(*parameters[i]),
+                    (upper - lower) / (static_cast<T> (2.0) * h), 1e-5);
+        }
+        if (mode == 0) {
+            std::valarray<T> gradient(parameters.size());
+            passed &= ReportCheck<T>("catch at age dual gradient used", mode, model.ObjectiveFunctionGradient(value, gradient), 1, 0);
+            passed &= ReportCheck<T>("catch at age dual value", mode, value, f.GetValue(), 1e-12);
+            for (size_t i = 0; i < parameters.size(); i++) {
+                passed &= ReportCheck<T>("catch at age dual gradient", mode, gradient[i], f.WRT(*parameters[i]), 1e-10);
+            }
+        }
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Predator prey like loop body for CheckpointCheck. It keeps the last 
+ * state it computed, as a loop body caching intermediates would.
+ */
+template<class T>
+class PredatorPreyStep : public ad::Checkpoint<T>::Step {
+    ad::Variable<T> &a_m;
+    ad::Variable<T> &b_m;
+
+public:
+    ad::Variable<T> last;
+
+    PredatorPreyStep(ad::Variable<T> &a, ad::Variable<T> &b) : a_m(a), b_m(b) {
+    }
+
+    void Evaluate(const std::vector<ad::Variable<T> > &in, std::vector<ad::Variable<T> > &out, size_t) {
+        out[0] = in[0] * std::exp(static_cast<T> (-0.01) * a_m) + static_cast<T> (0.01) * b_m * in[1];
+        out[1] = in[1] - static_cast<T> (0.01) * in[0] * in[1] * a_m;
+        last = out[0];
+    }
+};
+
+/**
+ * Compares the gradient of an objective function of the final state of a
+ * checkpointed loop, with f recorded before Checkpoint::Reverse as
+ * documented, against the gradient of the fully recorded loop in every
+ * recording mode. Statements recorded after Reverse must not see the
+ * Variables left by the steps as live. The fully recorded loop copies 
+ * statement lists in arbitrary order mode, so steps is kept small.
+ */
+template<class T>
+bool CheckpointCheck(size_t steps) {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    for (int mode = 0; mode < 3; mode++) {
+        SetRecordingMode<T>(mode);
+        variable a(0.7, true);
+        variable b(1.3, true);
+        PredatorPreyStep<T> step(a, b);
+
+        std::vector<variable> state(2);
+        std::vector<variable> next(2);
+        state[0] = 1.0;
+        state[1] = 2.0;
+        for (size_t i = 0; i < steps; i++) {
+            step.Evaluate(state, next, i);
+            state.swap(next);
+        }
+        variable reference = state[0] * state[0] * a + state[1] * b;
+        T reference_a = reference.WRT(a);
+        T reference_b = reference.WRT(b);
+
+        std::vector<variable*> parameters;
+        parameters.push_back(&a);
+        parameters.push_back(&b);
+        ad::Checkpoint<T> checkpoint(step, steps, parameters);
+        std::vector<T> values(2);
+        values[0] = 1.0;
+        values[1] = 2.0;
+        checkpoint.Forward(values);
+        std::vector<variable> final_state(2);
+        for (size_t k = 0; k < 2; k++) {
+            final_state[k] = values[k];
+            final_state[k].SetAsIndependent(true);
+        }
+        variable f = final_state[0] * final_state[0] * a + final_state[1] * b;
+        std::vector<T> adjoint(2);
+        for (size_t k = 0; k < 2; k++) {
+            adjoint[k] = f.WRT(final_state[k]);
+        }
+        size_t statements = f.GetStatements().size();
+        checkpoint.Reverse(adjoint);
+        passed &= ReportCheck<T>("checkpoint df/da", mode, f.WRT(a) + checkpoint.Adjoint(0), reference_a, 1e-10);
+        passed &= ReportCheck<T>("checkpoint df/db", mode, f.WRT(b) + checkpoint.Adjoint(1), reference_b, 1e-10);
+        passed &= ReportCheck<T>("checkpoint leaves statements", mode,
+                static_cast<T> (f.GetStatements().size()), static_cast<T> (statements), 0);
+
+        // recorded after Reverse: f is still live, and on the adjoint tape
+        // step.last, recorded by the last reversed step, is a constant
+        variable g = f * a + b;
+        passed &= ReportCheck<T>("after checkpoint dg/da", mode, g.WRT(a), f.WRT(a) * a.GetValue() + f.GetValue(), 1e-14);
+        if (mode == 1) {
+            // enough statements to reach the indices used by the steps
+            variable h = 0.0;
+            for (int k = 0; k < 1000; k++) {
+                h += a * b;
+            }
+            h += step.last * a;
+            passed &= ReportCheck<T>("after checkpoint dh/da", mode, h.WRT(a), 1000.0 * b.GetValue() + step.last.GetValue(), 1e-12);
+            passed &= ReportCheck<T>("after checkpoint dh/db", mode, h.WRT(b), 1000.0 * a.GetValue(), 1e-12);
+        }
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Objective function with a branch on a parameter that flips on the way 
+ * to the minimum. Counts the evaluations that record a statement tape.
+ */
+template<class T>
+class BranchModel : public ad::FunctionMinimizer<T> {
+public:
+    ad::Variable<T> x;
+    ad::Variable<T> y;
+    size_t recorded_calls;
+
+    BranchModel() : recorded_calls(0) {
+    }
+
+    void Initialize() {
+        x = -2.0;
+        y = 1.0;
+        this->Register(x);
+        this->Register(y);
+    }
+
+    void ObjectiveFunction(ad::Variable<T> &f) {
+        if (ad::Variable<T>::IsSupportingArbitraryOrder()) {
+            recorded_calls++;
+        }
+        ad::Variable<T> a = x - static_cast<T> (1.0);
+        ad::Variable<T> b = y - static_cast<T> (0.5) * x;
+        f = a * a + static_cast<T> (2.0) * b * b;
+        if (x < static_cast<T> (0.0)) {
+            f += x * x;
+        }
+    }
+};
+
+/**
+ * Checks LBFGS with tape replay against LBFGS calling the model, on a model
+ * whose branch flips, that the model is only recorded again when the
+ * branch flips, and that comparisons are recorded in the context of their
+ * operands' group.
+ */
+template<class T>
+bool ReplayCheck() {
+    bool passed = true;
+    BranchModel<T> called;
+    called.SetVerbose(false);
+    called.Run();
+    BranchModel<T> replayed;
+    replayed.SetVerbose(false);
+    replayed.SetReplayTape(true);
+    replayed.Run();
+    passed &= ReportCheck<T>("replayed lbfgs x", 0, replayed.x.GetValue(), called.x.GetValue(), 1e-6);
+    passed &= ReportCheck<T>("replayed lbfgs y", 0, replayed.y.GetValue(), called.y.GetValue(), 1e-6);
+    passed &= ReportCheck<T>("replayed lbfgs minimum x", 0, replayed.x.GetValue(), 1.0, 1e-4);
+    // recorded once, and again after the branch flips
+    passed &= ReportCheck<T>("replayed lbfgs recordings", 2, static_cast<T> (replayed.recorded_calls), 2, 0);
+
+    typedef ad::Variable<T, 1> variable1;
+    ad::Context<T, 1>& context1 = variable1::GetContext();
+    ad::Context<T>& context0 = ad::Variable<T>::GetContext();
+    context1.GetBranches().clear();
+    context1.SetRecordBranches(true);
+    variable1::SetSupportArbitraryOrder(true);
+    variable1 z(0.5, true);
+    size_t branches0 = context0.GetBranches().size();
+    bool outcome = std::exp(z) > static_cast<T> (1.0);
+    variable1::SetSupportArbitraryOrder(false);
+    context1.SetRecordBranches(false);
+    passed &= ReportCheck<T>("branch recorded in group 1", 2, static_cast<T> (context1.GetBranches().size()), 1, 0);
+    passed &= ReportCheck<T>("branch not recorded in group 0", 2, static_cast<T> (context0.GetBranches().size()),
+            static_cast<T> (branches0), 0);
+    if (!context1.GetBranches().empty()) {
+        ad::Branch<T>& branch = context1.GetBranches()[0];
+        std::vector<int32_t> index(z.GetId() + 1, -1);
+        index[z.GetId()] = 0;
+        std::vector<T> value(1, static_cast<T> (-0.5));
+        passed &= ReportCheck<T>("branch outcome", 2, static_cast<T> (outcome), 1, 0);
+        passed &= ReportCheck<T>("branch flips on replay", 2, static_cast<T> (branch.Replay(index, value)), 0, 0);
+    }
+    context1.GetBranches().clear();
+    return passed;
+}
+
+/**
+ * Checks the source written by StatementTape::GenerateSource for the 
+ * requested scalar type, non-finite constants and constants that must not
+ * be merged with them.
+ */
+template<class T>
+bool GenerateSourceCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    variable x(0.5, true);
+    variable y(1.5, true);
+    T infinity = std::numeric_limits<T>::infinity();
+    T nan = std::numeric_limits<T>::quiet_NaN();
+    variable f = x * static_cast<T> (2.0) + std::exp(y * -infinity) + (y < nan ? x : y) * static_cast<T> (3.0);
+    f += x * nan * static_cast<T> (0.0);
+    std::vector<variable*> wrt(2);
+    wrt[0] = &x;
+    wrt[1] = &y;
+    std::vector<int32_t> index;
+    variable::IndexOf(wrt, index);
+    ad::StatementTape<T> tape;
+    tape.Compile(f.GetStatements());
+    std::ostringstream source;
+    tape.GenerateSource(source, index, 2, "kernel", "float");
+    std::string text = source.str();
+    const char* expected[] = {
+        "void kernel(const float* x, float* f, float* g)",
+        "= -std::numeric_limits<float>::infinity();",
+        "= std::numeric_limits<float>::quiet_NaN();",
+        "= 2;",
+        "= 3;",
+        "= x[0];",
+        "= x[1];",
+        "extern const float kernel_recorded_x[] = {0.5, 1.5};"
+    };
+    for (size_t i = 0; i < sizeof (expected) / sizeof (expected[0]); i++) {
+        bool found = text.find(expected[i]) != std::string::npos;
+        std::cout << (found ? "passed " : "FAILED ") << "generated source contains \"" << expected[i] << "\"\n";
+        passed &= found;
+    }
+    bool no_double = text.find("double") == std::string::npos;
+    std::cout << (no_double ? "passed " : "FAILED ") << "generated source has no double\n";
+    passed &= no_double;
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Checks that compiling a statement list with repeated subexpressions, 
+ * constant subexpressions and identities gives a smaller tape with the 
+ * recorded value and gradient and the exact second derivatives.
+ */
+template<class T>
+bool CompileCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    variable x(0.3, true);
+    variable y(1.7, true);
+    variable f = (x * y + static_cast<T> (0.0)) * static_cast<T> (1.0)
+            + (y * x) * (static_cast<T> (2.0) * static_cast<T> (3.0))
+            + std::sin(x * y) / static_cast<T> (1.0) - std::sin(y * x) * static_cast<T> (0.5);
+    std::vector<variable*> wrt(2);
+    wrt[0] = &x;
+    wrt[1] = &y;
+    std::vector<int32_t> index;
+    variable::IndexOf(wrt, index);
+    ad::StatementTape<T> tape;
+    tape.Compile(f.GetStatements());
+    // x, y, u = x y, 6, 6 u, u + 6 u, sin(u), u + 6 u + sin(u), 0.5, 
+    // 0.5 sin(u) and the difference
+    passed &= ReportCheck<T>("compiled nodes", 2, static_cast<T> (tape.Size()), 11, 0);
+    passed &= ReportCheck<T>("recorded statements", 2,
+            static_cast<T> (f.GetStatements().size() > tape.Size()), 1, 0);
+    passed &= ReportCheck<T>("compiled value", 2, tape.GetValue(), f.GetValue(), 1e-14);
+    std::vector<T> gradient(2);
+    tape.Gradient(index, gradient);
+    passed &= ReportCheck<T>("compiled gradient x", 2, gradient[0], f.WRT(x), 1e-14);
+    passed &= ReportCheck<T>("compiled gradient y", 2, gradient[1], f.WRT(y), 1e-14);
+    // f = 7 u + 0.5 sin(u), u = x y: d2f/dxdy = 7 + 0.5 cos(u) - 0.5 u sin(u)
+    T u = x.GetValue() * y.GetValue();
+    std::vector<T> v(2);
+    v[1] = 1.0;
+    std::vector<T> hv(2);
+    tape.HessianVectorProduct(index, v, hv);
+    passed &= ReportCheck<T>("compiled hessian xy", 2, hv[0], 7.0 + 0.5 * std::cos(u) - 0.5 * u * std::sin(u), 1e-14);
+    passed &= ReportCheck<T>("compiled hessian yy", 2, hv[1], -0.5 * x.GetValue() * x.GetValue() * std::sin(u), 1e-14);
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Checks that the ExpressionGraph grows linearly with an accumulation,
+ * that recorded branch predicates add no nodes and that a Variable 
+ * recorded before a Reset enters later expressions as a constant.
+ */
+template<class T>
+bool ExpressionGraphCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    ad::Context<T>& context = variable::GetContext();
+    ad::ExpressionGraph<T>& graph = context.GetExpressionGraph();
+    graph.Reset();
+    variable x(0.5, true);
+    variable y(1.5, true);
+    const size_t terms = 100;
+    variable sum = 0.0;
+    for (size_t k = 0; k < terms; k++) {
+        sum += x * y * static_cast<T> (k);
+    }
+    T k_sum = static_cast<T> (terms * (terms - 1) / 2);
+    // x, y, k, two products and the sum, plus the leaf of each assignment
+    passed &= ReportCheck<T>("linear graph size", 2, static_cast<T> (graph.Size() <= 7 * terms + 1), 1, 0);
+    passed &= ReportCheck<T>("graph derivative x", 2, sum.Diff(x), k_sum * y.GetValue(), 1e-12);
+    passed &= ReportCheck<T>("graph derivative y", 2, sum.Diff(y), k_sum * x.GetValue(), 1e-12);
+
+    context.GetBranches().clear();
+    context.SetRecordBranches(true);
+    size_t size = graph.Size();
+    bool outcome = sum * x > y;
+    context.SetRecordBranches(false);
+    passed &= ReportCheck<T>("branch adds no graph nodes", 2, static_cast<T> (graph.Size()), static_cast<T> (size), 0);
+    passed &= ReportCheck<T>("branch outcome", 2, static_cast<T> (outcome), 1, 0);
+    if (context.GetBranches().size() == 1) {
+        ad::Branch<T>& branch = context.GetBranches()[0];
+        std::vector<int32_t> index(y.GetId() + 1, -1);
+        index[x.GetId()] = 0;
+        index[y.GetId()] = 1;
+        std::vector<T> values(2);
+        values[0] = 0.01;
+        values[1] = 1.5;
+        // sum x = k_sum x^2 y, below y at x = 0.01
+        passed &= ReportCheck<T>("branch flips on replay", 2, static_cast<T> (branch.Replay(index, values)), 0, 0);
+    } else {
+        passed &= ReportCheck<T>("branch recorded", 2, static_cast<T> (context.GetBranches().size()), 1, 0);
+    }
+    context.GetBranches().clear();
+
+    graph.Reset();
+    variable f = sum * x;
+    passed &= ReportCheck<T>("stale node is a constant", 2, f.Diff(x), sum.GetValue(), 1e-12);
+    passed &= ReportCheck<T>("stale node has no derivative", 2, f.Diff(y), 0, 0);
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Writes a compiled statement tape in the binary tape format and in the
+ * compressed encoding, and compares the gradients of the copies read back
+ * by StatementTape::Read and mapped by MappedTape with the gradient of the
+ * recorded Variable. A file whose last node refers to itself and every 
+ * truncated encoding must be refused.
+ */
+template<class T>
+bool TapeFormatCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    SetRecordingMode<T>(2);
+    std::vector<variable> x(3);
+    std::vector<variable*> wrt;
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = static_cast<T> (0.3 * i + 0.5);
+        x[i].SetAsIndependent(true);
+        wrt.push_back(&x[i]);
+    }
+    variable f = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        variable next = x[(i + 1) % x.size()];
+        f += x[i] * std::log(static_cast<T> (1.0) + next * next)
+                + std::exp(static_cast<T> (-1.0) * x[i]) / (static_cast<T> (1.0) + x[i] * x[i]);
+    }
+    std::vector<int32_t> index;
+    variable::IndexOf(wrt, index);
+    ad::StatementTape<T> tape;
+    f.Compile(tape);
+
+    std::stringstream written;
+    tape.Write(written);
+    std::string bytes = written.str();
+    ad::StatementTape<T> read;
+    passed &= ReportCheck<T>("tape Read", 2, static_cast<T> (read.Read(written)), 1, 0);
+    std::vector<T> gradient(x.size());
+    read.Gradient(index, gradient);
+    for (size_t i = 0; i < x.size(); i++) {
+        passed &= ReportCheck<T>("tape Write/Read gradient", 2, gradient[i], f.WRT(x[i]), 1e-12);
+    }
+
+    std::stringstream encoded;
+    tape.Encode(encoded);
+    std::string encoding = encoded.str();
+    ad::StatementTape<T> decoded;
+    passed &= ReportCheck<T>("tape Decode", 2, static_cast<T> (decoded.Read(encoded)), 1, 0);
+    decoded.Gradient(index, gradient);
+    for (size_t i = 0; i < x.size(); i++) {
+        passed &= ReportCheck<T>("tape Encode/Read gradient", 2, gradient[i], f.WRT(x[i]), 1e-12);
+    }
+    size_t refused = 0;
+    for (size_t length = 0; length < encoding.size(); length++) {
+        std::stringstream truncated(encoding.substr(0, length));
+        ad::StatementTape<T> partial;
+        if (!partial.Read(truncated) && partial.Size() == 0) {
+            refused++;
+        }
+    }
+    passed &= ReportCheck<T>("truncated encodings refused", 2, static_cast<T> (refused),
+            static_cast<T> (encoding.size()), 0);
+
+    const char* path = "TapeFormatCheck.et4t";
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    out.close();
+    ad::MappedTape<T> mapped;
+    passed &= ReportCheck<T>("tape mapped", 2, static_cast<T> (mapped.Open(path)), 1, 0);
+    if (mapped.IsOpen()) {
+        mapped.Gradient(index, gradient);
+        for (size_t i = 0; i < x.size(); i++) {
+            passed &= ReportCheck<T>("mapped tape gradient", 2, gradient[i], f.WRT(x[i]), 1e-12);
+        }
+    }
+    mapped.Close();
+
+    ad::TapeHeader header;
+    std::memcpy(&header, bytes.data(), sizeof (ad::TapeHeader));
+    int32_t last = static_cast<int32_t> (header.nodes - 1);
+    std::memcpy(&bytes[header.offsets[1] + last * sizeof (int32_t)], &last, sizeof (int32_t));
+    out.open(path, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    out.close();
+    passed &= ReportCheck<T>("corrupted tape mapped", 2, static_cast<T> (mapped.Open(path)), 0, 0);
+    passed &= ReportCheck<T>("corrupted tape loaded", 2,
+            static_cast<T> (read.Load(bytes.data(), bytes.size())), 0, 0);
+    std::remove(path);
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Element-wise array expressions, broadcasts, an outer product, a row 
+ * view, an element assignment that refers to itself and a comparison of
+ * an element, summed into one Variable.
+ */
+template<class T>
+ad::Variable<T> ArrayTerms(const std::vector<ad::Variable<T> > &x) {
+    typedef ad::Variable<T> variable;
+    ad::array::VariableVector<T> v(x);
+    ad::array::VariableVector<T> w = std::exp(v * static_cast<T> (0.5)) / (v + static_cast<T> (1.0))
+            - std::log(v) * x[0] + std::mfexp(static_cast<T> (1.0) - v);
+    w[1] = w[1] * w[2];
+    w[2] *= x[1];
+    ad::array::VariableMatrix<T> m = ad::array::outer_prod(v, w);
+    m = m - static_cast<T> (2.0) * m / (m + static_cast<T> (3.0));
+    variable f = ad::array::Sum(w) + ad::array::Sum(m) * static_cast<T> (0.1)
+            + ad::array::Sum(m.Row(1) * m.Column(2));
+    if (v[0] > x[1]) {
+        f += v[0] * x[1];
+    }
+    return f;
+}
+
+/**
+ * Checks array expression gradients in every recording mode, that 
+ * assigning an element in one mode clears the slots of the other modes, 
+ * and the shape check of the binary operations.
+ */
+template<class T>
+bool ArrayCheck() {
+    typedef ad::Variable<T> variable;
+    std::vector<T> values(3);
+    values[0] = 1.1;
+    values[1] = 0.7;
+    values[2] = 0.4;
+    bool passed = GradientCheck<T>("array expression gradient", ArrayTerms<T>, values, 1e-7);
+
+    variable x(0.6, true);
+    variable y(1.3, true);
+    ad::array::VariableVector<T> v(2);
+    SetRecordingMode<T>(0);
+    v[0] = x * x;
+    SetRecordingMode<T>(2);
+    v[1] = x * x;
+    SetRecordingMode<T>(1);
+    v[0] = y * static_cast<T> (3.0);
+    v[1] = y * static_cast<T> (3.0);
+    SetRecordingMode<T>(0);
+    variable g = v[0];
+    passed &= ReportCheck<T>("array element forward slot cleared", 0, g.WRT(x), 0, 0);
+    SetRecordingMode<T>(2);
+    variable h = v[1] * static_cast<T> (1.0);
+    passed &= ReportCheck<T>("array element graph slot cleared", 2, h.Diff(x), 0, 0);
+    SetRecordingMode<T>(0);
+
+    ad::array::VariableVector<T> three(3);
+    ad::array::VariableMatrix<T> matrix(2, 3);
+    passed &= ReportCheck<T>("array size mismatch", 0,
+            static_cast<T> (ad::array::IsConformable(three, v)), 0, 0);
+    passed &= ReportCheck<T>("array shape mismatch", 0,
+            static_cast<T> (ad::array::IsConformable(three, matrix)), 0, 0);
+    passed &= ReportCheck<T>("array row view conforms", 0,
+            static_cast<T> (ad::array::IsConformable(three, matrix.Row(1))), 1, 0);
+    passed &= ReportCheck<T>("array scalar broadcast conforms", 0,
+            static_cast<T> (ad::array::IsConformable(matrix, ad::array::ArrayScalar<T > (2.0))), 1, 0);
+    return passed;
+}
+
+/**
+ * Compares the fused Sum, Dot, Norm2 and SumSquares reductions with the
+ * same sums accumulated element by element, in every recording mode.
+ */
+template<class T>
+bool ReductionCheck() {
+    typedef ad::Variable<T> variable;
+    bool passed = true;
+    for (int mode = 0; mode < 3; mode++) {
+        SetRecordingMode<T>(mode);
+        size_t n = 4;
+        std::vector<variable> x(n);
+        std::vector<variable> y(n);
+        std::vector<T> observed(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = static_cast<T> (0.2 * i + 0.5);
+            x[i].SetAsIndependent(true);
+            observed[i] = static_cast<T> (0.3 * i + 0.1);
+        }
+        for (size_t i = 0; i < n; i++) {
+            y[i] = std::exp(x[i]) * x[(i + 1) % n];
+        }
+
+        variable sum;
+        variable dot;
+        variable norm2;
+        variable squares;
+        for (size_t i = 0; i < n; i++) {
+            sum += x[i];
+            dot += x[i] * y[i];
+            norm2 += x[i] * x[i];
+            squares += (y[i] - observed[i])*(y[i] - observed[i]);
+        }
+        variable reference = sum * dot + std::log(norm2) + squares;
+        variable f = ad::Sum(x) * ad::Dot(x, y) + std::log(ad::Norm2(x)) + ad::SumSquares(y, observed);
+
+        passed &= ReportCheck<T>("reductions value", mode, f.GetValue(), reference.GetValue(), 1e-12);
+        for (size_t i = 0; i < n; i++) {
+            passed &= ReportCheck<T>("reductions gradient", mode, f.WRT(x[i]), reference.WRT(x[i]), 1e-10);
+        }
+        if (mode == 2) {
+            passed &= ReportCheck<T>("reductions second derivative", mode, f.Diff(x[0], 2), reference.Diff(x[0], 2), 1e-10);
+        }
+    }
+    SetRecordingMode<T>(0);
+    return passed;
+}
+
+/**
+ * Sum of the special-function and log-likelihood nodes, for
+ * SpecialFunctionCheck.
+ */
+template<class T>
+ad::Variable<T> SpecialFunctions(const std::vector<ad::Variable<T> > &x) {
+    std::vector<T> counts(3);
+    counts[0] = 3.0;
+    counts[1] = 0.0;
+    counts[2] = 5.0;
+    std::vector<ad::Variable<T> > p(3);
+    ad::Variable<T> total = x[0] + x[1] + x[2];
+    for (size_t i = 0; i < 3; i++) {
+        p[i] = x[i] / total;
+    }
+    ad::Variable<T> f = ad::lgamma(x[0]) + ad::digamma(x[1]) * ad::erf(x[2]) + ad::softplus(x[0] - static_cast<T> (3.0))
+            + ad::log_sum_exp(x[1], static_cast<T> (2.0) * x[2]) + ad::log_sum_exp(x)
+            + ad::dnorm_log(x[0], x[1], x[2]) + ad::dlnorm_log(x[0], static_cast<T> (0.3), x[2])
+            + ad::dpois_log(static_cast<T> (3.0), x[1]) + ad::dmultinom_log(counts, p);
+    return f;
+}
+
+/**
+ * Compares the analytic gradients of the special-function and
+ * log-likelihood nodes with central differences in every recording mode,
+ * and the third derivative of lgamma with the polygamma function. Checks
+ * the polygamma function at negative arguments against the recurrence, 
+ * its poles, and the digamma and trigamma helpers of generated kernels.
+ */
+template<class T>
+bool SpecialFunctionCheck() {
+    typedef ad::Variable<T> variable;
+    std::vector<T> values(3);
+    values[0] = 2.3;
+    values[1] = 1.7;
+    values[2] = 0.8;
+    bool passed = GradientCheck<T>("special functions gradient", SpecialFunctions<T>, values, 1e-7);
+
+    SetRecordingMode<T>(2);
+    variable x(2.3, true);
+    variable g = ad::lgamma(x);
+    passed &= ReportCheck<T>("lgamma third derivative", 2, g.Diff(x, 3), ad::Polygamma(2, x.GetValue()), 1e-10);
+    SetRecordingMode<T>(0);
+
+    // psi(n, x) = psi(n, x + 1) + (-1)^(n + 1) n! / x^(n + 1)
+    const T z = -1.3;
+    T factorial = 1.0;
+    for (unsigned int n = 0; n < 4; n++) {
+        factorial *= n == 0 ? 1.0 : static_cast<T> (n);
+        T recurrence = ad::Polygamma(n, z + 2.0) + (n % 2 == 0 ? -1.0 : 1.0) * factorial
+                * (std::pow(z, -static_cast<T> (n + 1)) + std::pow(z + 1.0, -static_cast<T> (n + 1)));
+        passed &= ReportCheck<T>("polygamma reflection", 0, ad::Polygamma(n, z), recurrence, 1e-10);
+    }
+    T pole = ad::Polygamma(0, static_cast<T> (-2.0));
+    passed &= ReportCheck<T>("polygamma pole is NaN", 0, static_cast<T> (pole != pole), 1, 0);
+    pole = ad::Polygamma(1, static_cast<T> (0.0));
+    passed &= ReportCheck<T>("polygamma pole at zero is NaN", 0, static_cast<T> (pole != pole), 1, 0);
+
+    variable y(-0.5, true);
+    variable d = ad::digamma(y);
+    // psi(-1/2) = 2 - gamma - 2 log 2, psi(1, -1/2) = pi^2 / 2 + 4
+    passed &= ReportCheck<T>("digamma negative value", 0, d.GetValue(), 0.03648997397857652, 1e-12);
+    passed &= ReportCheck<T>("digamma negative derivative", 0, d.WRT(y), 8.934802200544679, 1e-12);
+
+    ad::StatementTape<T> tape;
+    std::stringstream source;
+    tape.GenerateSource(source, std::vector<int32_t>(), 0);
+    passed &= ReportCheck<T>("generated digamma reflection", 0,
+            static_cast<T> (source.str().find("return digamma(1 - x) - pi / std::tan(pi * x);") != std::string::npos), 1, 0);
+    passed &= ReportCheck<T>("generated trigamma reflection", 0,
+            static_cast<T> (source.str().find("return pi * pi / (s * s) - trigamma(1 - x);") != std::string::npos), 1, 0);
+    return passed;
+}
+
+/*
+ *
+ */
+int main() {
+    bool passed = true;
+    passed &= AdjointTapeCheck<double>();
+    passed &= SparseGradientCheck<double>();
+    passed &= IdsSetCheck<double>();
+    passed &= ScatterCheck<double>();
+    passed &= ContextCheck<double>();
+    passed &= IndependentConstructorCheck<double>();
+    passed &= MoveCheck<double>();
+    passed &= StatementListCheck<double>();
+    passed &= DualCheck<double>();
+    passed &= CatchAtAgeCheck<double>();
+    passed &= HessianCheck<double>();
+    passed &= HessianVectorProductCheck<double>();
+    passed &= NewtonCheck<double>();
+    passed &= TaylorCheck<double>();
+    passed &= SparseCheck<double>();
+    passed &= CheckpointCheck<double>(12);
+    passed &= ReplayCheck<double>();
+    passed &= GenerateSourceCheck<double>();
+    passed &= CompileCheck<double>();
+    passed &= ExpressionGraphCheck<double>();
+    passed &= TapeFormatCheck<double>();
+    passed &= ArrayCheck<double>();
+    passed &= ReductionCheck<double>();
+    passed &= SpecialFunctionCheck<double>();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
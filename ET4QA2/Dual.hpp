@@ -0,0 +1,692 @@
+/*
+ * File:   Dual.hpp
+ * Author: matthewsupernaw
+ *
+ * Vector mode forward derivatives with the number of directions fixed at
+ * compile time. Intended for small models where the general ad::Variable
+ * machinery (ids, sparse gradients, tapes) costs more than the arithmetic.
+ */
+
+#ifndef AD_DUAL_HPP
+#define	AD_DUAL_HPP
+
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ad {
+
+    /**
+     * Lane operations on the fixed length gradient of a Dual. Every
+     * derivative rule reduces to one of these, so they are the only place
+     * that needs to be vectorized. The generic version is a plain loop
+     * over a compile time bound, which the compiler unrolls.
+     *
+     * Output may alias either input.
+     */
+    template<class REAL_T, int N>
+    struct DualLanes {
+
+        static inline void Zero(REAL_T* out) {
+            for (int i = 0; i < N; i++) {
+                out[i] = REAL_T(0);
+            }
+        }
+
+        static inline void Copy(REAL_T* out, const REAL_T* x) {
+            for (int i = 0; i < N; i++) {
+                out[i] = x[i];
+            }
+        }
+
+        /**
+         * out = a * x
+         */
+        static inline void Scale(REAL_T* out, const REAL_T& a, const REAL_T* x) {
+            for (int i = 0; i < N; i++) {
+                out[i] = a * x[i];
+            }
+        }
+
+        /**
+         * out = a * x + b * y
+         */
+        static inline void Combine(REAL_T* out, const REAL_T& a, const REAL_T* x,
+                const REAL_T& b, const REAL_T* y) {
+            for (int i = 0; i < N; i++) {
+                out[i] = a * x[i] + b * y[i];
+            }
+        }
+    };
+
+    /**
+     * Double precision lanes. Uses the widest of AVX-512, AVX and SSE2
+     * enabled for the build and finishes the remainder in scalar code.
+     * Since N is a compile time constant, unused loops are removed entirely.
+     */
+    template<int N>
+    struct DualLanes<double, N> {
+
+        static inline void Zero(double* out) {
+            for (int i = 0; i < N; i++) {
+                out[i] = 0.0;
+            }
+        }
+
+        static inline void Copy(double* out, const double* x) {
+            for (int i = 0; i < N; i++) {
+                out[i] = x[i];
+            }
+        }
+
+        static inline void Scale(double* out, const double& a, const double* x) {
+            int i = 0;
+#if defined(__AVX512F__)
+            const __m512d a8 = _mm512_set1_pd(a);
+            for (; i + 8 <= N; i += 8) {
+                _mm512_storeu_pd(out + i, _mm512_mul_pd(a8, _mm512_loadu_pd(x + i)));
+            }
+#endif
+#if defined(__AVX__)
+            const __m256d a4 = _mm256_set1_pd(a);
+            for (; i + 4 <= N; i += 4) {
+                _mm256_storeu_pd(out + i, _mm256_mul_pd(a4, _mm256_loadu_pd(x + i)));
+            }
+#endif
+#if defined(__SSE2__)
+            const __m128d a2 = _mm_set1_pd(a);
+            for (; i + 2 <= N; i += 2) {
+                _mm_storeu_pd(out + i, _mm_mul_pd(a2, _mm_loadu_pd(x + i)));
+            }
+#endif
+            for (; i < N; i++) {
+                out[i] = a * x[i];
+            }
+        }
+
+        static inline void Combine(double* out, const double& a, const double* x,
+                const double& b, const double* y) {
+            int i = 0;
+#if defined(__AVX512F__)
+            const __m512d a8 = _mm512_set1_pd(a);
+            const __m512d b8 = _mm512_set1_pd(b);
+            for (; i + 8 <= N; i += 8) {
+                _mm512_storeu_pd(out + i, _mm512_add_pd(
+                        _mm512_mul_pd(a8, _mm512_loadu_pd(x + i)),
+                        _mm512_mul_pd(b8, _mm512_loadu_pd(y + i))));
+            }
+#endif
+#if defined(__AVX__)
+            const __m256d a4 = _mm256_set1_pd(a);
+            const __m256d b4 = _mm256_set1_pd(b);
+            for (; i + 4 <= N; i += 4) {
+                _mm256_storeu_pd(out + i, _mm256_add_pd(
+                        _mm256_mul_pd(a4, _mm256_loadu_pd(x + i)),
+                        _mm256_mul_pd(b4, _mm256_loadu_pd(y + i))));
+            }
+#endif
+#if defined(__SSE2__)
+            const __m128d a2 = _mm_set1_pd(a);
+            const __m128d b2 = _mm_set1_pd(b);
+            for (; i + 2 <= N; i += 2) {
+                _mm_storeu_pd(out + i, _mm_add_pd(
+                        _mm_mul_pd(a2, _mm_loadu_pd(x + i)),
+                        _mm_mul_pd(b2, _mm_loadu_pd(y + i))));
+            }
+#endif
+            for (; i < N; i++) {
+                out[i] = a * x[i] + b * y[i];
+            }
+        }
+    };
+
+    /**
+     * A value together with its derivatives in N directions, propagated in
+     * forward mode. The gradient is a fixed size array, so a Dual never
+     * allocates, carries no id and records nothing. Direction i is usually
+     * the i'th independent variable, seeded with Dual(value, i).
+     *
+     * Models written as a template over their variable type can be
+     * instantiated with Dual for gradients.
+     */
+    template<class REAL_T, int N>
+    class Dual {
+        REAL_T value_m;
+        REAL_T gradient_m[N];
+
+        typedef DualLanes<REAL_T, N> Lanes;
+
+    public:
+
+        /**
+         * The number of directions carried.
+         */
+        static const int Directions = N;
+
+        /**
+         * Constructor. Zero value and gradient.
+         */
+        Dual() : value_m(0) {
+            Lanes::Zero(this->gradient_m);
+        }
+
+        /**
+         * Constructs a constant; the gradient is zero.
+         *
+         * @param value
+         */
+        Dual(const REAL_T& value) : value_m(value) {
+            Lanes::Zero(this->gradient_m);
+        }
+
+        /**
+         * Constructs an independent variable seeded in direction
+         * "direction", that is a unit gradient in that lane.
+         *
+         * @param value
+         * @param direction - 0 <= direction < N
+         */
+        Dual(const REAL_T& value, int direction) : value_m(value) {
+            Lanes::Zero(this->gradient_m);
+            this->gradient_m[direction] = REAL_T(1);
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline void SetValue(const REAL_T& value) {
+            this->value_m = value;
+        }
+
+        /**
+         * Returns the derivative in direction i.
+         *
+         * @param i
+         * @return
+         */
+        inline const REAL_T GetGradient(int i) const {
+            return this->gradient_m[i];
+        }
+
+        inline void SetGradient(int i, const REAL_T& value) {
+            this->gradient_m[i] = value;
+        }
+
+        /**
+         * Returns the gradient lanes. Used by the free operators.
+         */
+        inline REAL_T* Gradient() {
+            return this->gradient_m;
+        }
+
+        inline const REAL_T* Gradient() const {
+            return this->gradient_m;
+        }
+
+        /**
+         * Sets this Dual to the constant rhs.
+         *
+         * @param rhs
+         * @return
+         */
+        Dual& operator=(const REAL_T& rhs) {
+            this->value_m = rhs;
+            Lanes::Zero(this->gradient_m);
+            return *this;
+        }
+
+        Dual& operator+=(const Dual& rhs) {
+            this->value_m += rhs.value_m;
+            Lanes::Combine(this->gradient_m, REAL_T(1), this->gradient_m, REAL_T(1), rhs.gradient_m);
+            return *this;
+        }
+
+        Dual& operator-=(const Dual& rhs) {
+            this->value_m -= rhs.value_m;
+            Lanes::Combine(this->gradient_m, REAL_T(1), this->gradient_m, REAL_T(-1), rhs.gradient_m);
+            return *this;
+        }
+
+        Dual& operator*=(const Dual& rhs) {
+            Lanes::Combine(this->gradient_m, rhs.value_m, this->gradient_m, this->value_m, rhs.gradient_m);
+            this->value_m *= rhs.value_m;
+            return *this;
+        }
+
+        Dual& operator/=(const Dual& rhs) {
+            REAL_T inverse = REAL_T(1) / rhs.value_m;
+            this->value_m *= inverse;
+            Lanes::Combine(this->gradient_m, inverse, this->gradient_m, -this->value_m * inverse, rhs.gradient_m);
+            return *this;
+        }
+
+        Dual& operator+=(const REAL_T& rhs) {
+            this->value_m += rhs;
+            return *this;
+        }
+
+        Dual& operator-=(const REAL_T& rhs) {
+            this->value_m -= rhs;
+            return *this;
+        }
+
+        Dual& operator*=(const REAL_T& rhs) {
+            this->value_m *= rhs;
+            Lanes::Scale(this->gradient_m, rhs, this->gradient_m);
+            return *this;
+        }
+
+        Dual& operator/=(const REAL_T& rhs) {
+            REAL_T inverse = REAL_T(1) / rhs;
+            this->value_m *= inverse;
+            Lanes::Scale(this->gradient_m, inverse, this->gradient_m);
+            return *this;
+        }
+    };
+
+    template<class REAL_T, int N>
+    const int Dual<REAL_T, N>::Directions;
+
+    /**
+     * Applies the chain rule for a unary function: the result has value
+     * "value" and gradient dx * x.Gradient().
+     */
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> DualChain(const Dual<REAL_T, N>& x, const REAL_T& value, const REAL_T& dx) {
+        Dual<REAL_T, N> ret(value);
+        DualLanes<REAL_T, N>::Scale(ret.Gradient(), dx, x.Gradient());
+        return ret;
+    }
+
+    /**
+     * Applies the chain rule for a binary function: the result has value
+     * "value" and gradient dx * x.Gradient() + dy * y.Gradient().
+     */
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> DualChain(const Dual<REAL_T, N>& x, const REAL_T& dx,
+            const Dual<REAL_T, N>& y, const REAL_T& dy, const REAL_T& value) {
+        Dual<REAL_T, N> ret(value);
+        DualLanes<REAL_T, N>::Combine(ret.Gradient(), dx, x.Gradient(), dy, y.Gradient());
+        return ret;
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator+(const Dual<REAL_T, N>& x) {
+        return x;
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator-(const Dual<REAL_T, N>& x) {
+        return DualChain(x, -x.GetValue(), REAL_T(-1));
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator+(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return DualChain(lhs, REAL_T(1), rhs, REAL_T(1), lhs.GetValue() + rhs.GetValue());
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator+(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        Dual<REAL_T, N> ret(lhs);
+        ret.SetValue(lhs.GetValue() + rhs);
+        return ret;
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator+(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return rhs + lhs;
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator-(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return DualChain(lhs, REAL_T(1), rhs, REAL_T(-1), lhs.GetValue() - rhs.GetValue());
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator-(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        Dual<REAL_T, N> ret(lhs);
+        ret.SetValue(lhs.GetValue() - rhs);
+        return ret;
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator-(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return DualChain(rhs, lhs - rhs.GetValue(), REAL_T(-1));
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator*(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return DualChain(lhs, rhs.GetValue(), rhs, lhs.GetValue(), lhs.GetValue() * rhs.GetValue());
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator*(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return DualChain(lhs, lhs.GetValue() * rhs, rhs);
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator*(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return DualChain(rhs, lhs * rhs.GetValue(), lhs);
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator/(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        REAL_T inverse = REAL_T(1) / rhs.GetValue();
+        REAL_T value = lhs.GetValue() * inverse;
+        return DualChain(lhs, inverse, rhs, -value * inverse, value);
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator/(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        REAL_T inverse = REAL_T(1) / rhs;
+        return DualChain(lhs, lhs.GetValue() * inverse, inverse);
+    }
+
+    template<class REAL_T, int N>
+    inline const Dual<REAL_T, N> operator/(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        REAL_T inverse = REAL_T(1) / rhs.GetValue();
+        REAL_T value = lhs * inverse;
+        return DualChain(rhs, value, -value * inverse);
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator==(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() == rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator!=(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() != rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() < rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() > rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<=(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() <= rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>=(const Dual<REAL_T, N>& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs.GetValue() >= rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator==(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() == rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator!=(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() != rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() < rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() > rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<=(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() <= rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>=(const Dual<REAL_T, N>& lhs, const REAL_T& rhs) {
+        return lhs.GetValue() >= rhs;
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator==(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs == rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator!=(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs != rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs < rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs > rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator<=(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs <= rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    inline bool operator>=(const REAL_T& lhs, const Dual<REAL_T, N>& rhs) {
+        return lhs >= rhs.GetValue();
+    }
+
+    template<class REAL_T, int N>
+    std::ostream& operator<<(std::ostream& out, const Dual<REAL_T, N>& x) {
+        out << x.GetValue();
+        return out;
+    }
+
+}
+
+namespace std {
+
+    /**
+     * Override for the cos function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> cos(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::cos(x.GetValue()), -std::sin(x.GetValue()));
+    }
+
+    /**
+     * Override for the sin function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> sin(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::sin(x.GetValue()), std::cos(x.GetValue()));
+    }
+
+    /**
+     * Override for the tan function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> tan(const ad::Dual<REAL_T, N>& x) {
+        REAL_T value = std::tan(x.GetValue());
+        return ad::DualChain(x, value, REAL_T(1) + value * value);
+    }
+
+    /**
+     * Override for the asin function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> asin(const ad::Dual<REAL_T, N>& x) {
+        REAL_T v = x.GetValue();
+        return ad::DualChain(x, std::asin(v), REAL_T(1) / std::sqrt(REAL_T(1) - v * v));
+    }
+
+    /**
+     * Override for the acos function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> acos(const ad::Dual<REAL_T, N>& x) {
+        REAL_T v = x.GetValue();
+        return ad::DualChain(x, std::acos(v), REAL_T(-1) / std::sqrt(REAL_T(1) - v * v));
+    }
+
+    /**
+     * Override for the atan function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> atan(const ad::Dual<REAL_T, N>& x) {
+        REAL_T v = x.GetValue();
+        return ad::DualChain(x, std::atan(v), REAL_T(1) / (REAL_T(1) + v * v));
+    }
+
+    /**
+     * Override for the atan2 function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> atan2(const ad::Dual<REAL_T, N>& y, const ad::Dual<REAL_T, N>& x) {
+        REAL_T yv = y.GetValue();
+        REAL_T xv = x.GetValue();
+        REAL_T inverse = REAL_T(1) / (xv * xv + yv * yv);
+        return ad::DualChain(y, xv * inverse, x, -yv * inverse, std::atan2(yv, xv));
+    }
+
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> atan2(const ad::Dual<REAL_T, N>& y, const REAL_T& x) {
+        REAL_T yv = y.GetValue();
+        return ad::DualChain(y, std::atan2(yv, x), x / (x * x + yv * yv));
+    }
+
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> atan2(const REAL_T& y, const ad::Dual<REAL_T, N>& x) {
+        REAL_T xv = x.GetValue();
+        return ad::DualChain(x, std::atan2(y, xv), -y / (xv * xv + y * y));
+    }
+
+    /**
+     * Override for the sqrt function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> sqrt(const ad::Dual<REAL_T, N>& x) {
+        REAL_T value = std::sqrt(x.GetValue());
+        return ad::DualChain(x, value, REAL_T(.5) / value);
+    }
+
+    /**
+     * Override for the pow function in namespace std. The partial with 
+     * respect to the exponent, pow(x, y) * log(x), is taken as zero for a
+     * base that is not positive, where log(x) is undefined but pow(x, y)
+     * still has a value for integral y.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> pow(const ad::Dual<REAL_T, N>& x, const ad::Dual<REAL_T, N>& y) {
+        REAL_T xv = x.GetValue();
+        REAL_T yv = y.GetValue();
+        REAL_T value = std::pow(xv, yv);
+        REAL_T dy = xv > REAL_T(0) ? value * std::log(xv) : REAL_T(0);
+        return ad::DualChain(x, yv * std::pow(xv, yv - REAL_T(1)), y, dy, value);
+    }
+
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> pow(const ad::Dual<REAL_T, N>& x, const REAL_T& y) {
+        REAL_T xv = x.GetValue();
+        return ad::DualChain(x, std::pow(xv, y), y * std::pow(xv, y - REAL_T(1)));
+    }
+
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> pow(const REAL_T& x, const ad::Dual<REAL_T, N>& y) {
+        REAL_T value = std::pow(x, y.GetValue());
+        return ad::DualChain(y, value, x > REAL_T(0) ? value * std::log(x) : REAL_T(0));
+    }
+
+    /**
+     * Override for the log function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> log(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::log(x.GetValue()), REAL_T(1) / x.GetValue());
+    }
+
+    /**
+     * Override for the log10 function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> log10(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::log10(x.GetValue()), REAL_T(1) / (x.GetValue() * std::log(REAL_T(10))));
+    }
+
+    /**
+     * Override for the exp function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> exp(const ad::Dual<REAL_T, N>& x) {
+        REAL_T value = std::exp(x.GetValue());
+        return ad::DualChain(x, value, value);
+    }
+
+    /**
+     * Overflow protected exp, see ad::MFExp.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> mfexp(const ad::Dual<REAL_T, N>& x) {
+        REAL_T value = ad::MFExpValue(x.GetValue());
+        return ad::DualChain(x, value, value);
+    }
+
+    /**
+     * Override for the sinh function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> sinh(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::sinh(x.GetValue()), std::cosh(x.GetValue()));
+    }
+
+    /**
+     * Override for the cosh function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> cosh(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::cosh(x.GetValue()), std::sinh(x.GetValue()));
+    }
+
+    /**
+     * Override for the tanh function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> tanh(const ad::Dual<REAL_T, N>& x) {
+        REAL_T value = std::tanh(x.GetValue());
+        return ad::DualChain(x, value, REAL_T(1) - value * value);
+    }
+
+    /**
+     * Override for the fabs function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> fabs(const ad::Dual<REAL_T, N>& x) {
+        return ad::DualChain(x, std::fabs(x.GetValue()), x.GetValue() < REAL_T(0) ? REAL_T(-1) : REAL_T(1));
+    }
+
+    /**
+     * Override for the floor function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> floor(const ad::Dual<REAL_T, N>& x) {
+        return ad::Dual<REAL_T, N>(std::floor(x.GetValue()));
+    }
+
+    /**
+     * Override for the ceil function in namespace std.
+     */
+    template<class REAL_T, int N>
+    inline const ad::Dual<REAL_T, N> ceil(const ad::Dual<REAL_T, N>& x) {
+        return ad::Dual<REAL_T, N>(std::ceil(x.GetValue()));
+    }
+
+}
+
+#endif	/* AD_DUAL_HPP */
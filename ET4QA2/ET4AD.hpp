@@ -61,11 +61,27 @@
 #define	AD_ET4AD_HPP
 
 #include <stdint.h>
+#include <cassert>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <set>
 #include <iostream>
 #include <stack>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <string>
+#include <sstream>
+#if defined(WIN32) || defined(WIN64)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <boost/container/set.hpp>
 #include <tr1/unordered_set>
 #define USE_MM_CACHE_MAP
@@ -84,9 +100,6 @@
 #include <map>
 #endif
 #include <google/dense_hash_set>
-#include <boost/unordered_set.hpp>
-//typedef google::dense_hash_set<uint32_t> IdsSet;
-typedef boost::unordered_set<uint32_t> IdsSet;
 
 
 
@@ -94,6 +107,137 @@ typedef boost::unordered_set<uint32_t> IdsSet;
 
 namespace ad {
 
+    /**
+     * Set of independent variable identifiers an expression depends on. 
+     * Up to INLINE_CAPACITY ids are kept sorted in inline storage, so the
+     * common case never touches the heap. Larger sets spill to a vector 
+     * that is sorted and made unique on demand. Iteration is always in
+     * increasing id order.
+     */
+    class IdsSet {
+    public:
+        typedef const uint32_t* const_iterator;
+        typedef const_iterator iterator;
+
+        static const size_t INLINE_CAPACITY = 16;
+
+    private:
+        uint32_t inline_m[INLINE_CAPACITY];
+        size_t size_m;
+        bool spilled_m;
+        mutable bool normalized_m;
+        mutable std::vector<uint32_t> spill_m;
+
+        inline void Normalize() const {
+            if (!this->normalized_m) {
+                std::sort(this->spill_m.begin(), this->spill_m.end());
+                this->spill_m.erase(std::unique(this->spill_m.begin(),
+                        this->spill_m.end()), this->spill_m.end());
+                this->normalized_m = true;
+            }
+        }
+
+    public:
+
+        IdsSet() : size_m(0), spilled_m(false), normalized_m(true) {
+        }
+
+        IdsSet(const IdsSet &other) : size_m(other.size_m),
+        spilled_m(other.spilled_m), normalized_m(other.normalized_m),
+        spill_m(other.spill_m) {
+            std::copy(other.inline_m, other.inline_m + other.size_m, this->inline_m);
+        }
+
+        IdsSet& operator=(const IdsSet &other) {
+            if (this != &other) {
+                this->size_m = other.size_m;
+                this->spilled_m = other.spilled_m;
+                this->normalized_m = other.normalized_m;
+                this->spill_m = other.spill_m;
+                std::copy(other.inline_m, other.inline_m + other.size_m, this->inline_m);
+            }
+            return *this;
+        }
+
+        /**
+         * Adds id to the set. 
+         * 
+         * @param id
+         */
+        inline void insert(const uint32_t &id) {
+            if (this->spilled_m) {
+                this->spill_m.push_back(id);
+                this->normalized_m = false;
+                return;
+            }
+
+            size_t i = this->size_m;
+            while (i > 0 && this->inline_m[i - 1] > id) {
+                i--;
+            }
+            if (i > 0 && this->inline_m[i - 1] == id) {
+                return;
+            }
+
+            if (this->size_m < INLINE_CAPACITY) {
+                std::copy_backward(this->inline_m + i, this->inline_m + this->size_m,
+                        this->inline_m + this->size_m + 1);
+                this->inline_m[i] = id;
+                this->size_m++;
+            } else {
+                this->spill_m.assign(this->inline_m, this->inline_m + this->size_m);
+                this->spill_m.push_back(id);
+                this->spilled_m = true;
+                this->normalized_m = false;
+            }
+        }
+
+        template<class ITERATOR>
+        inline void insert(ITERATOR first, ITERATOR last) {
+            for (; first != last; ++first) {
+                this->insert(*first);
+            }
+        }
+
+        /**
+         * Removes all ids. Spilled storage keeps its capacity.
+         */
+        inline void clear() {
+            this->size_m = 0;
+            this->spilled_m = false;
+            this->normalized_m = true;
+            this->spill_m.clear();
+        }
+
+        inline size_t size() const {
+            if (this->spilled_m) {
+                this->Normalize();
+                return this->spill_m.size();
+            }
+            return this->size_m;
+        }
+
+        inline bool empty() const {
+            return this->size() == 0;
+        }
+
+        inline const_iterator begin() const {
+            if (this->spilled_m) {
+                this->Normalize();
+                return this->spill_m.empty() ? NULL : &this->spill_m[0];
+            }
+            return this->inline_m;
+        }
+
+        inline const_iterator end() const {
+            if (this->spilled_m) {
+                return this->begin() + this->spill_m.size();
+            }
+            return this->inline_m + this->size_m;
+        }
+
+    };
+
     /**
      * Operation values used for recording expressions into a post-order 
      * expression tree. These operations are used primarily for supporting 
@@ -128,11 +272,178 @@ namespace ad {
         FABS,
         FLOOR,
         CEIL,
+        MFEXP,
         CONSTANT,
         VARIABLE,
+        NODE, //an existing node of the ExpressionGraph, by its position
+        REFERENCE, //the result of an earlier statement of the same list
+        LGAMMA, //added after REFERENCE to keep the codes of stored tapes
+        DIGAMMA,
+        ERF,
         NONE
     };
 
+    /**
+     * True for the operations that take two operands.
+     */
+    inline bool IsBinary(const Operation &op) {
+        return op == PLUS || op == MINUS || op == MULTIPLY || op == DIVIDE
+                || op == ATAN2 || op == POW;
+    }
+
+    /**
+     * Log of the absolute value of the gamma function.
+     */
+    template<class REAL_T>
+    inline const REAL_T LogGamma(const REAL_T &x) {
+#if __cplusplus >= 201103L
+        return std::lgamma(x);
+#else
+        return ::lgamma(x);
+#endif
+    }
+
+    /**
+     * Error function.
+     */
+    template<class REAL_T>
+    inline const REAL_T ErrorFunction(const REAL_T &x) {
+#if __cplusplus >= 201103L
+        return std::erf(x);
+#else
+        return ::erf(x);
+#endif
+    }
+
+    /**
+     * log(1 + x), accurate for small x.
+     */
+    template<class REAL_T>
+    inline const REAL_T LogOnePlus(const REAL_T &x) {
+#if __cplusplus >= 201103L
+        return std::log1p(x);
+#else
+        return ::log1p(x);
+#endif
+    }
+
+    /**
+     * Polygamma function of order n, the (n + 1)th derivative of the log
+     * of the gamma function; order 0 is the digamma function. A negative
+     * argument is taken to 1 - x by the reflection formula
+     * 
+     * psi(n, x) = (-1)^n psi(n, 1 - x) - pi d^n/dx^n cot(pi x),
+     * 
+     * the poles at zero and the negative integers give NaN. The argument
+     * is then shifted above 15 by the recurrence
+     * 
+     * psi(n, x) = psi(n, x + 1) + (-1)^(n + 1) n! / x^(n + 1)
+     * 
+     * and the asymptotic series is summed from there.
+     * 
+     * @param n
+     * @param x
+     * @return 
+     */
+    template<class REAL_T>
+    const REAL_T Polygamma(const unsigned int &n, const REAL_T &x) {
+        //B2, B4, ..., B14
+        static const double bernoulli[] = {1.0 / 6.0, -1.0 / 30.0, 1.0 / 42.0,
+            -1.0 / 30.0, 5.0 / 66.0, -691.0 / 2730.0, 7.0 / 6.0};
+        if (x <= REAL_T(0)) {
+            if (std::floor(x) == x) {
+                return std::numeric_limits<REAL_T>::quiet_NaN();
+            }
+            //d^n/dx^n cot(pi x) = pi^n P_n(cot(pi x)), with P_0(c) = c and
+            //P_(k + 1)(c) = -(1 + c^2) P_k'(c)
+            const REAL_T pi = REAL_T(3.14159265358979323846);
+            std::vector<REAL_T> p(2, REAL_T(0));
+            p[1] = REAL_T(1);
+            for (unsigned int k = 0; k < n; k++) {
+                std::vector<REAL_T> q(p.size() + 1, REAL_T(0));
+                for (size_t j = 1; j < p.size(); j++) {
+                    q[j - 1] -= REAL_T(j) * p[j];
+                    q[j + 1] -= REAL_T(j) * p[j];
+                }
+                p.swap(q);
+            }
+            const REAL_T c = REAL_T(1) / std::tan(pi * x);
+            REAL_T derivative = 0;
+            for (size_t j = p.size(); j-- > 0;) {
+                derivative = derivative * c + p[j];
+            }
+            REAL_T scale = pi;
+            for (unsigned int k = 0; k < n; k++) {
+                scale *= pi;
+            }
+            const REAL_T reflected = Polygamma(n, REAL_T(1) - x);
+            return (n % 2 == 0 ? reflected : -reflected) - scale * derivative;
+        }
+        REAL_T factorial = 1;
+        for (unsigned int k = 2; k <= n; k++) {
+            factorial *= REAL_T(k);
+        }
+        const REAL_T sign = n % 2 == 0 ? REAL_T(-1) : REAL_T(1);
+
+        REAL_T z = x;
+        REAL_T result = 0;
+        while (z < REAL_T(15)) {
+            REAL_T power = REAL_T(1) / z;
+            for (unsigned int k = 0; k < n; k++) {
+                power /= z;
+            }
+            result += sign * factorial * power;
+            z += REAL_T(1);
+        }
+
+        const REAL_T inverse = REAL_T(1) / z;
+        const REAL_T inverse2 = inverse * inverse;
+        if (n == 0) {
+            REAL_T series = 0;
+            REAL_T power = inverse2;
+            for (int k = 0; k < 7; k++) {
+                series += REAL_T(bernoulli[k]) / REAL_T(2 * k + 2) * power;
+                power *= inverse2;
+            }
+            return result + std::log(z) - REAL_T(.5) * inverse - series;
+        }
+
+        //(n - 1)!/z^n + n!/(2 z^(n + 1)) + sum B2k (2k + n - 1)!/((2k)! z^(2k + n))
+        REAL_T power = inverse;
+        for (unsigned int k = 1; k < n; k++) {
+            power *= inverse;
+        }
+        REAL_T series = factorial / REAL_T(n) * power + REAL_T(.5) * factorial * power * inverse;
+        REAL_T ratio = factorial * REAL_T(n + 1) / REAL_T(2); //(n + 1)!/2!
+        power *= inverse2;
+        for (int k = 1; k <= 7; k++) {
+            series += REAL_T(bernoulli[k - 1]) * ratio * power;
+            ratio *= REAL_T(2 * k + n) * REAL_T(2 * k + n + 1) / (REAL_T(2 * k + 1) * REAL_T(2 * k + 2));
+            power *= inverse2;
+        }
+        return result + sign * series;
+    }
+
+    /**
+     * Digamma function, the derivative of the log of the gamma function.
+     */
+    template<class REAL_T>
+    inline const REAL_T Digamma(const REAL_T &x) {
+        return Polygamma(0, x);
+    }
+
+    /**
+     * Comparison operators, for branches recorded by taped comparisons.
+     */
+    enum Comparison {
+        EQUAL_TO = 0,
+        NOT_EQUAL_TO,
+        LESS,
+        GREATER,
+        LESS_EQUAL,
+        GREATER_EQUAL
+    };
+
     /**
      * Statement class is used store the expression in a post-order vector. 
      * Ultimately used for higher order derivatives and expression string 
@@ -167,1835 +478,4586 @@ namespace ad {
     };
 
     /**
-     * Interface class for storing variable information. The point of this class 
-     * is to provide flexibility of the storage for the variables information. 
-     * For instance, it may be desired to store the data in a database or on 
-     * the disk rather than in random access memory. 
+     * Post-order statement list stored as separate arrays. Every statement
+     * has a one byte opcode; only leaves carry data, CONSTANT and VARIABLE
+     * statements append their value to the constant pool and VARIABLE
+     * statements also append their id to the operand array. Operators, the
+     * bulk of a recorded expression, therefore cost one byte instead of a
+     * full Statement. NODE and REFERENCE statements append their target to
+     * the operand array.
+     *
+     * Leaf data is located by counting leaves, so statements are read
+     * sequentially through a const_iterator.
      */
     template<class REAL_T>
-    class VariableStorage {
-        template<class REAL_TT, int> friend class Variable;
-        uint32_t id_m;
+    class StatementList {
+        std::vector<uint8_t> ops_m;
+        std::vector<uint32_t> operands_m;
+        std::vector<REAL_T> constants_m;
+
     public:
 
-        VariableStorage() : id_m(0) {
+        /**
+         * Sequential reader over a StatementList. Dereferencing yields the
+         * statement as a Statement value.
+         */
+        class const_iterator {
+            const StatementList<REAL_T>* list_m;
+            size_t op_m;
+            size_t operand_m;
+            size_t constant_m;
+
+        public:
+
+            const_iterator(const StatementList<REAL_T>* list, size_t op,
+                    size_t operand, size_t constant)
+            : list_m(list), op_m(op), operand_m(operand), constant_m(constant) {
+            }
 
+            inline Operation Op() const {
+                return static_cast<Operation> (list_m->ops_m[op_m]);
+            }
+
+            inline const Statement<REAL_T> operator*() const {
+                Operation op = this->Op();
+                switch (op) {
+                    case CONSTANT:
+                        return Statement<REAL_T > (op, list_m->constants_m[constant_m]);
+                    case VARIABLE:
+                        return Statement<REAL_T > (op, list_m->constants_m[constant_m], list_m->operands_m[operand_m]);
+                    case NODE:
+                    case REFERENCE:
+                        return Statement<REAL_T > (op, REAL_T(0), list_m->operands_m[operand_m]);
+                    default:
+                        return Statement<REAL_T > (op);
+                }
+            }
+
+            inline const_iterator& operator++() {
+                Operation op = this->Op();
+                if (op == CONSTANT) {
+                    constant_m++;
+                } else if (op == VARIABLE) {
+                    constant_m++;
+                    operand_m++;
+                } else if (op == NODE || op == REFERENCE) {
+                    operand_m++;
+                }
+                op_m++;
+                return *this;
+            }
+
+            inline bool operator==(const const_iterator &other) const {
+                return op_m == other.op_m;
+            }
+
+            inline bool operator!=(const const_iterator &other) const {
+                return op_m != other.op_m;
+            }
+        };
+
+        inline void push_back(const Statement<REAL_T> &statement) {
+            this->ops_m.push_back(static_cast<uint8_t> (statement.op_m));
+            if (statement.op_m == CONSTANT) {
+                this->constants_m.push_back(statement.value_m);
+            } else if (statement.op_m == VARIABLE) {
+                this->constants_m.push_back(statement.value_m);
+                this->operands_m.push_back(statement.id_m);
+            } else if (statement.op_m == NODE || statement.op_m == REFERENCE) {
+                this->operands_m.push_back(statement.id_m);
+            }
         }
 
-        virtual ~VariableStorage() {
+        /**
+         * Appends all statements of other, a block copy per array.
+         *
+         * @param other
+         */
+        inline void append(const StatementList<REAL_T> &other) {
+            if (this == &other) {
+                StatementList<REAL_T> copy(other);
+                this->append(copy);
+                return;
+            }
+            this->ops_m.insert(this->ops_m.end(), other.ops_m.begin(), other.ops_m.end());
+            this->operands_m.insert(this->operands_m.end(), other.operands_m.begin(), other.operands_m.end());
+            this->constants_m.insert(this->constants_m.end(), other.constants_m.begin(), other.constants_m.end());
+        }
+
+        /**
+         * Copies the statements of other, reusing the existing buffers.
+         *
+         * @param other
+         */
+        inline void assign(const StatementList<REAL_T> &other) {
+            if (this != &other) {
+                this->ops_m.assign(other.ops_m.begin(), other.ops_m.end());
+                this->operands_m.assign(other.operands_m.begin(), other.operands_m.end());
+                this->constants_m.assign(other.constants_m.begin(), other.constants_m.end());
+            }
+        }
 
+        inline void swap(StatementList<REAL_T> &other) {
+            this->ops_m.swap(other.ops_m);
+            this->operands_m.swap(other.operands_m);
+            this->constants_m.swap(other.constants_m);
         }
 
-        uint32_t GetId() const {
-            return id_m;
+        inline void clear() {
+            this->ops_m.clear();
+            this->operands_m.clear();
+            this->constants_m.clear();
         }
 
-        void SetId(uint32_t id) {
-            this->id_m = id;
+        inline void reserve(size_t size) {
+            this->ops_m.reserve(size);
+        }
+
+        inline size_t size() const {
+            return this->ops_m.size();
         }
 
+        inline bool empty() const {
+            return this->ops_m.empty();
+        }
 
+        inline const_iterator begin() const {
+            return const_iterator(this, 0, 0, 0);
+        }
 
+        inline const_iterator end() const {
+            return const_iterator(this, this->ops_m.size(), this->operands_m.size(), this->constants_m.size());
+        }
 
         /**
-         * Abstract function to set the value for this storage object.
-         * 
-         * @param value
+         * The opcode array, one byte per statement.
          */
-        virtual void SetValue(const REAL_T &value) = 0;
+        inline const std::vector<uint8_t>& Ops() const {
+            return this->ops_m;
+        }
 
         /**
-         * Abstract function to get the value for this storage object.
-         * 
-         * @return 
+         * The ids of the VARIABLE statements and the targets of the NODE and
+         * REFERENCE statements, in order.
          */
-        virtual const REAL_T GetValue() = 0;
+        inline const std::vector<uint32_t>& Operands() const {
+            return this->operands_m;
+        }
 
         /**
-         * Abstract function to return a derivative value for the independent 
-         * variable with id.
-         * 
-         * @param id
-         * @return 
+         * The values of the CONSTANT and VARIABLE statements, in order.
          */
-        virtual const std::pair<bool, REAL_T> GetDerivative(const uint32_t &id) = 0;
+        inline const std::vector<REAL_T>& Constants() const {
+            return this->constants_m;
+        }
 
         /**
-         * Abstract function to set the derivative value with respect to 
-         * independent variable with id.
-         * 
-         * @param id
-         * @param value
-         * @return 
+         * Replaces the contents with the given arrays, used when reading a
+         * serialized list.
          */
-        virtual void SetDerivative(const std::pair<bool, REAL_T> &entry, const uint32_t &id) = 0;
+        inline void SetArrays(std::vector<uint8_t> &ops, std::vector<uint32_t> &operands,
+                std::vector<REAL_T> &constants) {
+            this->ops_m.swap(ops);
+            this->operands_m.swap(operands);
+            this->constants_m.swap(constants);
+        }
 
         /**
-         * Abstract function to add a independent variable id to 
-         * this storage set.
-         * 
-         * @param id
-         * @return 
+         * Bytes held by the statements, excluding unused capacity.
          */
-        virtual void AddId(const uint32_t &id) = 0;
+        inline size_t MemoryUsage() const {
+            return this->ops_m.size() * sizeof (uint8_t) +
+                    this->operands_m.size() * sizeof (uint32_t) +
+                    this->constants_m.size() * sizeof (REAL_T);
+        }
+    };
+
+    /**
+     * The arbitrary order recording of a thread, shared by all of its 
+     * Variables as a directed acyclic graph. Each assignment appends the 
+     * nodes of the assigned expression once and the Variable keeps only the
+     * index of the result node; Variable operands enter as references to 
+     * their existing nodes. Recording time and memory are therefore linear 
+     * in the number of operations, where copying the statements of every 
+     * operand into each result grew quadratically with accumulations such
+     * as sum = sum + term and with every copy of a Variable.
+     * 
+     * As on the AdjointTape, node indices keep increasing across Reset, so 
+     * a Variable holding a node recorded before the reset is recognized and
+     * enters later expressions as a constant. They are 64 bit and never 
+     * wrap around; within a recording a node is addressed by its 32 bit 
+     * position, the index less the first index of the recording.
+     */
+    template<class REAL_T>
+    class ExpressionGraph {
+        std::vector<uint8_t> op_m;
+        //operand positions; for leaves lhs_m is the position in the leaf pool.
+        std::vector<uint32_t> lhs_m;
+        std::vector<uint32_t> rhs_m;
+        std::vector<uint32_t> ids_m; //leaf pool, independent id or 0
+        std::vector<REAL_T> values_m; //leaf pool, value when recorded
+        uint64_t base_m; //index of the first node of this recording
+
+        std::vector<uint32_t> stack_m;
+        std::vector<uint32_t> produced_m; //node of each statement, see Link
+        std::vector<uint32_t> visited_m; //epoch of the last visit, see Sort
+        std::vector<uint32_t> rank_m; //position in the last sorted order
+        uint32_t epoch_m;
+
+        inline uint32_t AddNode(uint8_t op, uint32_t lhs, uint32_t rhs) {
+            this->op_m.push_back(op);
+            this->lhs_m.push_back(lhs);
+            this->rhs_m.push_back(rhs);
+            return static_cast<uint32_t> (this->op_m.size() - 1);
+        }
+
+        inline uint32_t AddLeaf(uint8_t op, uint32_t id, const REAL_T &value) {
+            this->ids_m.push_back(id);
+            this->values_m.push_back(value);
+            return this->AddNode(op, static_cast<uint32_t> (this->ids_m.size() - 1), 0);
+        }
+
+    public:
+
+        ExpressionGraph() : base_m(1), epoch_m(0) {
+        }
 
         /**
-         * Abstract function to merge add id's from another VariableStorage 
-         * to this one.
-         * 
-         * @param id
-         * @return 
+         * Discards all nodes. Variables that refer to nodes recorded before
+         * the reset become constants.
          */
-        virtual void Merge(VariableStorage<REAL_T>* other) = 0;
+        void Reset() {
+            this->base_m += this->op_m.size();
+            this->op_m.clear();
+            this->lhs_m.clear();
+            this->rhs_m.clear();
+            this->ids_m.clear();
+            this->values_m.clear();
+        }
 
         /**
-         * Abstract function to return the size of the derivative info list. 
-         * These are the computed intermediately stored derivatives. 
+         * Returns true if node refers to a node of the current recording.
          * 
+         * @param node
+         * @return 
          */
-        virtual const uint32_t DerivativeInfoSize() = 0;
+        inline bool IsLive(const uint64_t &node) const {
+            return node >= this->base_m && node - this->base_m < this->op_m.size();
+        }
 
         /**
-         * Abstract function to clear the derivative info for this storage.
+         * Position of a live node in the current recording.
          * 
+         * @param node
          * @return 
          */
-        virtual const void ClearDerivativeInfo() = 0;
+        inline uint32_t Position(const uint64_t &node) const {
+            return static_cast<uint32_t> (node - this->base_m);
+        }
 
         /**
-         * Abstract function to add a expression statement to the statement list. 
-         * Statements are the recorded nodes in the expressions computational graph
-         * and are stored in post-order(Post-order expression tree).
-         * @param statement
+         * Number of nodes in the current recording.
          */
-        virtual void AddStatement(const Statement<REAL_T> &statement) = 0;
+        inline size_t Size() const {
+            return this->op_m.size();
+        }
 
         /**
-         * Abstract function to return the size of the statement list size.
+         * Appends the nodes of statements and returns the node of its 
+         * result, or 0 for an empty list. NODE statements refer to live 
+         * nodes of this graph by position, REFERENCE statements to earlier
+         * statements of the list. A list that is a single NODE adds nothing.
+         * 
+         * @param statements
          * @return 
          */
-        virtual const uint32_t ExpressionSize() = 0;
+        uint64_t Link(const StatementList<REAL_T> &statements) {
+            std::vector<uint32_t> &stack = this->stack_m;
+            std::vector<uint32_t> &produced = this->produced_m;
+            stack.clear();
+            produced.clear();
+            for (typename StatementList<REAL_T>::const_iterator it = statements.begin();
+                    it != statements.end(); ++it) {
+                Statement<REAL_T> statement = *it;
+                Operation op = statement.op_m;
+                switch (op) {
+                    case CONSTANT:
+                    case VARIABLE:
+                        stack.push_back(this->AddLeaf(op, statement.id_m, statement.value_m));
+                        break;
+                    case NODE:
+                        stack.push_back(statement.id_m);
+                        break;
+                    case REFERENCE:
+                        stack.push_back(produced[statement.id_m]);
+                        break;
+                    default:
+                    {
+                        uint32_t rhs = 0;
+                        if (IsBinary(op)) {
+                            rhs = stack.back();
+                            stack.pop_back();
+                        }
+                        uint32_t lhs = stack.back();
+                        stack.pop_back();
+                        stack.push_back(this->AddNode(op, lhs, rhs));
+                    }
+                }
+                produced.push_back(stack.back());
+            }
+            if (stack.empty()) {
+                return 0;
+            }
+            return this->base_m + stack.back();
+        }
 
         /**
-         * Abstract function to retrieve a Statement object at a given index.
+         * Writes the nodes reachable from node as a self-contained statement
+         * list, each node once: operands are REFERENCE statements to the 
+         * statements that computed them.
          * 
-         * @param index
-         * @return 
+         * @param node
+         * @param statements
          */
-        virtual Statement<REAL_T> StatementAt(const uint32_t &index) = 0;
+        void Gather(uint64_t node, StatementList<REAL_T> &statements) {
+            statements.clear();
+            if (!this->IsLive(node)) {
+                return;
+            }
+            std::vector<uint32_t> order;
+            this->Sort(node, order);
+            for (size_t k = 0; k < order.size(); k++) {
+                uint32_t i = order[k];
+                Operation op = this->Op(i);
+                if (op == CONSTANT || op == VARIABLE) {
+                    statements.push_back(Statement<REAL_T > (op, this->Value(i), this->Id(i)));
+                } else {
+                    statements.push_back(Statement<REAL_T > (REFERENCE, REAL_T(0), this->rank_m[this->lhs_m[i]]));
+                    if (IsBinary(op)) {
+                        statements.push_back(Statement<REAL_T > (REFERENCE, REAL_T(0), this->rank_m[this->rhs_m[i]]));
+                    }
+                    statements.push_back(Statement<REAL_T > (op));
+                }
+                this->rank_m[i] = static_cast<uint32_t> (statements.size() - 1);
+            }
+        }
 
         /**
-         * Abstract function to clear the statement list.
+         * Writes statements to expanded with every NODE statement replaced
+         * by the gathered nodes it refers to, so the result can be compiled
+         * without linking it into the graph. REFERENCE statements are
+         * renumbered to the expanded list.
+         *
+         * @param statements
+         * @param expanded
          */
-        virtual void ClearExpression() = 0;
-
-        /**
-         * Rests this storage.
+        void Expand(const StatementList<REAL_T> &statements, StatementList<REAL_T> &expanded) {
+            expanded.clear();
+            std::vector<uint32_t> position;
+            position.reserve(statements.size());
+            StatementList<REAL_T> gathered;
+            for (typename StatementList<REAL_T>::const_iterator it = statements.begin();
+                    it != statements.end(); ++it) {
+                Statement<REAL_T> statement = *it;
+                if (statement.op_m == NODE) {
+                    this->Gather(this->base_m + statement.id_m, gathered);
+                    uint32_t offset = static_cast<uint32_t> (expanded.size());
+                    for (typename StatementList<REAL_T>::const_iterator g = gathered.begin();
+                            g != gathered.end(); ++g) {
+                        Statement<REAL_T> node = *g;
+                        if (node.op_m == REFERENCE) {
+                            node.id_m += offset;
+                        }
+                        expanded.push_back(node);
+                    }
+                } else if (statement.op_m == REFERENCE) {
+                    expanded.push_back(Statement<REAL_T > (REFERENCE, REAL_T(0), position[statement.id_m]));
+                } else {
+                    expanded.push_back(statement);
+                }
+                position.push_back(static_cast<uint32_t> (expanded.size() - 1));
+            }
+        }
+
+        /**
+         * Sets order to the positions of the nodes reachable from node, 
+         * operands before the nodes using them, and ranks each of them by 
+         * its place in order, see Rank.
+         * 
+         * @param node - a live node
+         * @param order
          */
-        virtual void Reset() = 0;
+        void Sort(uint64_t node, std::vector<uint32_t> &order) {
+            order.clear();
+            size_t size = this->op_m.size();
+            if (this->visited_m.size() < size) {
+                this->visited_m.resize(size, 0);
+                this->rank_m.resize(size);
+            }
+            if (++this->epoch_m == 0) {
+                std::fill(this->visited_m.begin(), this->visited_m.end(), 0);
+                this->epoch_m = 1;
+            }
+            std::vector<uint32_t> &stack = this->stack_m;
+            stack.clear();
+            stack.push_back(this->Position(node));
+            while (!stack.empty()) {
+                uint32_t i = stack.back();
+                if (this->visited_m[i] == this->epoch_m) {
+                    stack.pop_back();
+                    continue;
+                }
+                Operation op = this->Op(i);
+                bool ready = true;
+                if (op != CONSTANT && op != VARIABLE) {
+                    if (IsBinary(op) && this->visited_m[this->rhs_m[i]] != this->epoch_m) {
+                        stack.push_back(this->rhs_m[i]);
+                        ready = false;
+                    }
+                    if (this->visited_m[this->lhs_m[i]] != this->epoch_m) {
+                        stack.push_back(this->lhs_m[i]);
+                        ready = false;
+                    }
+                }
+                if (ready) {
+                    stack.pop_back();
+                    this->visited_m[i] = this->epoch_m;
+                    this->rank_m[i] = static_cast<uint32_t> (order.size());
+                    order.push_back(i);
+                }
+            }
+        }
 
-    };
+        inline Operation Op(uint32_t position) const {
+            return static_cast<Operation> (this->op_m[position]);
+        }
 
-    /*!
-     * Creates a unique identifier.
-     * @return 
-     */
-    class IDGenerator {
-    public:
-        static IDGenerator * instance();
+        inline uint32_t Lhs(uint32_t position) const {
+            return this->lhs_m[position];
+        }
 
-        const uint32_t next() {
-            return ++_id;
+        inline uint32_t Rhs(uint32_t position) const {
+            return this->rhs_m[position];
         }
 
-        const uint32_t current() {
-            return _id;
+        /**
+         * Place of the node at position in the order of the last Sort.
+         */
+        inline uint32_t Rank(uint32_t position) const {
+            return this->rank_m[position];
         }
-    private:
 
-        IDGenerator() : _id(0) {
+        /**
+         * Id of the leaf at position, 0 for constants.
+         */
+        inline uint32_t Id(uint32_t position) const {
+            return this->ids_m[this->lhs_m[position]];
         }
 
-        uint32_t _id;
+        /**
+         * Recorded value of the leaf at position.
+         */
+        inline const REAL_T& Value(uint32_t position) const {
+            return this->values_m[this->lhs_m[position]];
+        }
     };
 
-    static IDGenerator* only_copy;
+    /**
+     * Sparse matrix in compressed sparse row form. Row i holds the column 
+     * indices columns_m[row_offsets_m[i] .. row_offsets_m[i + 1]), sorted,
+     * and their values.
+     */
+    template<class REAL_T>
+    struct CSRMatrix {
+        std::vector<uint32_t> row_offsets_m;
+        std::vector<uint32_t> columns_m;
+        std::vector<REAL_T> values_m;
 
-    inline IDGenerator *
-    IDGenerator::instance() {
+        inline size_t Rows() const {
+            return this->row_offsets_m.empty() ? 0 : this->row_offsets_m.size() - 1;
+        }
 
-        if (!only_copy) {
-            only_copy = new IDGenerator();
+        inline size_t NonZeros() const {
+            return this->columns_m.size();
         }
 
-        return only_copy;
-    }
+        /**
+         * Sets the pattern from a set of columns per row, values zeroed.
+         * 
+         * @param rows
+         */
+        void Assign(const std::vector<std::set<uint32_t> > &rows) {
+            this->row_offsets_m.resize(rows.size() + 1);
+            this->columns_m.clear();
+            this->row_offsets_m[0] = 0;
+            for (size_t i = 0; i < rows.size(); i++) {
+                this->columns_m.insert(this->columns_m.end(), rows[i].begin(), rows[i].end());
+                this->row_offsets_m[i + 1] = static_cast<uint32_t> (this->columns_m.size());
+            }
+            this->values_m.assign(this->columns_m.size(), REAL_T(0));
+        }
 
-    template<class REAL_T, int group = 0 >
-    class Variable;
+        /**
+         * Returns the entry at (row, column), zero if not in the pattern.
+         */
+        const REAL_T operator()(size_t row, size_t column) const {
+            std::vector<uint32_t>::const_iterator begin = this->columns_m.begin() + this->row_offsets_m[row];
+            std::vector<uint32_t>::const_iterator end = this->columns_m.begin() + this->row_offsets_m[row + 1];
+            std::vector<uint32_t>::const_iterator it = std::lower_bound(begin, end, static_cast<uint32_t> (column));
+            if (it != end && *it == column) {
+                return this->values_m[it - this->columns_m.begin()];
+            }
+            return REAL_T(0);
+        }
+    };
 
     /**
-     * Base class for expression types.
+     * Greedy distance-2 coloring of the columns of a sparsity pattern: two 
+     * columns receive different colors if some row has entries in both, so
+     * the columns of one color are structurally orthogonal and can be 
+     * evaluated together in one sweep. Columns are visited in order of 
+     * decreasing entry count.
+     * 
+     * @param pattern
+     * @param columns - number of columns
+     * @param colors - color of each column
+     * @return number of colors
      */
-    template<class REAL_T, class A>
-    struct ExpressionBase {
-    public:
-
-        ExpressionBase() : id_m(0) {
-
+    template<class REAL_T>
+    size_t ColorColumns(const CSRMatrix<REAL_T> &pattern, size_t columns, std::vector<uint32_t> &colors) {
+        //rows of each column
+        std::vector<std::vector<uint32_t> > column_rows(columns);
+        for (size_t i = 0; i < pattern.Rows(); i++) {
+            for (size_t k = pattern.row_offsets_m[i]; k < pattern.row_offsets_m[i + 1]; k++) {
+                column_rows[pattern.columns_m[k]].push_back(static_cast<uint32_t> (i));
+            }
         }
 
-        ExpressionBase(const uint32_t & id) : id_m(id) {
-
+        std::vector<std::pair<size_t, uint32_t> > order(columns);
+        for (size_t j = 0; j < columns; j++) {
+            order[j] = std::make_pair(column_rows[j].size(), static_cast<uint32_t> (j));
+        }
+        std::sort(order.rbegin(), order.rend());
+
+        const uint32_t uncolored = std::numeric_limits<uint32_t>::max();
+        colors.assign(columns, uncolored);
+        std::vector<size_t> forbidden(columns + 1, columns + 1);
+        size_t ncolors = 0;
+        for (size_t o = 0; o < columns; o++) {
+            uint32_t j = order[o].second;
+            const std::vector<uint32_t> &rows = column_rows[j];
+            for (size_t r = 0; r < rows.size(); r++) {
+                uint32_t i = rows[r];
+                for (size_t k = pattern.row_offsets_m[i]; k < pattern.row_offsets_m[i + 1]; k++) {
+                    uint32_t c = colors[pattern.columns_m[k]];
+                    if (c != uncolored) {
+                        forbidden[c] = j;
+                    }
+                }
+            }
+            uint32_t c = 0;
+            while (forbidden[c] == j) {
+                c++;
+            }
+            colors[j] = c;
+            ncolors = std::max<size_t > (ncolors, c + 1);
         }
+        return ncolors;
+    }
 
-        const A & Cast() const {
-            return static_cast<const A&> (*this);
-        }
+    /**
+     * Returns u with its bytes in reverse order.
+     */
+    template <typename T>
+    inline T ReverseBytes(const T &u) {
+        T ret;
+        const unsigned char* source = reinterpret_cast<const unsigned char*> (&u);
+        unsigned char* dest = reinterpret_cast<unsigned char*> (&ret);
+        for (size_t k = 0; k < sizeof (T); k++) {
+            dest[k] = source[sizeof (T) - k - 1];
+        }
+        return ret;
+    }
 
-        inline const REAL_T GetValue() const {
-            return Cast().GetValue();
-        }
+    /**
+     * Header of the binary tape format written by StatementTape::Write. 
+     * The op, lhs, rhs, id and value columns of the nodes follow as 
+     * contiguous blocks, each at an aligned offset from the start of the 
+     * file, so a mapped file is used in place, see MappedTape. All fields 
+     * are in the byte order of the writing machine, given by byte_order.
+     */
+    struct TapeHeader {
 
-        inline const uint32_t GetId() const {
-            return id_m;
-        }
+        enum {
+            FORMAT_VERSION = 1,
+            NATIVE_ORDER = 0x0102,
+            COLUMN_ALIGNMENT = 16
+        };
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            Cast().GetIdRange(min, max);
-        }
+        char magic[4]; //"ET4T"
+        uint16_t version;
+        uint16_t byte_order; //NATIVE_ORDER as written
+        uint32_t real_size; //sizeof(REAL_T)
+        uint32_t nodes;
+        uint64_t offsets[5]; //of the op, lhs, rhs, id and value columns
+        uint64_t size; //of the whole file
 
         /**
-         * Compute or get the stored derivative with respect to the unique 
-         * identifier id.
+         * Sets the fields and the column offsets for a tape of nodes nodes.
          * 
-         * @param id
-         * @param found
-         * @return 
+         * @param nodes
+         * @param real_size
          */
-        const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return Cast().Derivative(id, found);
+        void Layout(uint32_t nodes, uint32_t real_size) {
+            std::memcpy(this->magic, "ET4T", 4);
+            this->version = FORMAT_VERSION;
+            this->byte_order = NATIVE_ORDER;
+            this->real_size = real_size;
+            this->nodes = nodes;
+            size_t widths[5] = {sizeof (uint8_t), sizeof (int32_t), sizeof (int32_t), sizeof (uint32_t), real_size};
+            uint64_t offset = Align(sizeof (TapeHeader));
+            for (size_t k = 0; k < 5; k++) {
+                this->offsets[k] = offset;
+                offset = Align(offset + uint64_t(nodes) * widths[k]);
+            }
+            this->size = offset;
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            Cast().Push(statements);
+        /**
+         * True if the header was written in the other byte order.
+         */
+        inline bool IsSwapped() const {
+            return this->byte_order == ReverseBytes<uint16_t > (NATIVE_ORDER);
         }
 
-        void PushIds(IdsSet & ids) const {
-            Cast().PushIds(ids);
+        /**
+         * Converts the header of a file written in the other byte order.
+         */
+        void Swap() {
+            this->version = ReverseBytes(this->version);
+            this->byte_order = ReverseBytes(this->byte_order);
+            this->real_size = ReverseBytes(this->real_size);
+            this->nodes = ReverseBytes(this->nodes);
+            for (size_t k = 0; k < 5; k++) {
+                this->offsets[k] = ReverseBytes(this->offsets[k]);
+            }
+            this->size = ReverseBytes(this->size);
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            Cast().PushStorage(ids);
+        /**
+         * Returns true if this is a native order header of a supported 
+         * version for REAL_T of real_size bytes, and its columns lie within
+         * available bytes.
+         * 
+         * @param available
+         * @param real_size
+         * @return 
+         */
+        bool IsValid(size_t available, uint32_t real_size) const {
+            if (std::memcmp(this->magic, "ET4T", 4) != 0 || this->version != FORMAT_VERSION
+                    || this->byte_order != NATIVE_ORDER || this->real_size != real_size
+                    || this->size > available) {
+                return false;
+            }
+            TapeHeader layout;
+            layout.Layout(this->nodes, this->real_size);
+            for (size_t k = 0; k < 5; k++) {
+                if (layout.offsets[k] != this->offsets[k]) {
+                    return false;
+                }
+            }
+            return layout.size == this->size;
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > &ids) const {
-            Cast().PushIds(ids);
+        static inline uint64_t Align(uint64_t offset) {
+            return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
         }
 
-        uint32_t id_m;
-
-    private:
-
-        ExpressionBase& operator=(const ExpressionBase & exp) const {
-
-            return *this;
-        };
+        /**
+         * Returns true if the node columns of a tape are well formed: every
+         * op is a compiled operation and the operands of each node precede
+         * it, -1 marking no operand. A file failing this would send the 
+         * sweeps outside the columns.
+         * 
+         * @param op
+         * @param lhs
+         * @param rhs
+         * @param nodes
+         * @return 
+         */
+        static bool IsValidNodes(const uint8_t* op, const int32_t* lhs,
+                const int32_t* rhs, uint32_t nodes) {
+            for (uint32_t i = 0; i < nodes; i++) {
+                int32_t l = lhs[i];
+                int32_t r = rhs[i];
+                if (op[i] >= NODE || l < -1 || r < -1
+                        || l >= static_cast<int64_t> (i) || r >= static_cast<int64_t> (i)) {
+                    return false;
+                }
+            }
+            return true;
+        }
     };
 
     /**
-     * Expression template for constant values.
-     * 
-     * @param value
+     * A StatementList compiled for second order sweeps. Each statement 
+     * becomes a node holding its value, the indices of its operands and 
+     * its first and second local partial derivatives, evaluated once at 
+     * Compile. The adjoints of all nodes are also computed at Compile, so 
+     * the gradient is available directly and every Hessian-vector product 
+     * (forward-over-reverse) costs one forward tangent sweep and one 
+     * reverse sweep over the nodes.
+     *
+     * Independent variables are addressed through an index vector mapping 
+     * a unique identifier to a position in the caller's arrays, or -1.
      */
     template<class REAL_T>
-    struct Constant : public ExpressionBase<REAL_T, Constant<REAL_T> > {
-
-        Constant(const REAL_T & value) : value_m(value) {
+    class StatementTape {
+        std::vector<uint8_t> op_m;
+        std::vector<int32_t> lhs_m; //operand node, -1 for leaves
+        std::vector<int32_t> rhs_m; //second operand node, -1 for unary nodes
+        std::vector<uint32_t> id_m; //independent id of VARIABLE leaves
+        std::vector<REAL_T> value_m;
+        std::vector<REAL_T> d_lhs_m;
+        std::vector<REAL_T> d_rhs_m;
+        std::vector<REAL_T> d_lhs_lhs_m;
+        std::vector<REAL_T> d_lhs_rhs_m;
+        std::vector<REAL_T> d_rhs_rhs_m;
+        std::vector<REAL_T> adjoint_m;
+        std::vector<REAL_T> tangent_m;
+        std::vector<REAL_T> adjoint_tangent_m;
+        std::vector<REAL_T> taylor_m;
+        std::vector<REAL_T> taylor_scratch_m;
+        std::vector<int32_t> buckets_m; //hash-consing table, used in Compile
+        int32_t nodes_m; //nodes appended so far, used in Compile
+        bool has_second_order_m;
 
+        /**
+         * Sets the first local partials of node i from its operand values.
+         */
+        inline void FirstPartials(size_t i, const REAL_T &x, const REAL_T &y) {
+            LocalPartials(static_cast<Operation> (this->op_m[i]), x, y, this->value_m[i],
+                    this->d_lhs_m[i], this->d_rhs_m[i]);
         }
 
-        inline const REAL_T GetValue() const {
-            return this->value_m;
-
+        /**
+         * Sets the first local partials of all nodes from the node values, 
+         * then the adjoints.
+         */
+        void Prepare() {
+            size_t size = this->op_m.size();
+            this->d_lhs_m.resize(size);
+            this->d_rhs_m.resize(size);
+            this->adjoint_m.assign(size, REAL_T(0));
+            for (size_t i = 0; i < size; i++) {
+                int32_t l = this->lhs_m[i];
+                if (l < 0) {
+                    this->d_lhs_m[i] = 0;
+                    this->d_rhs_m[i] = 0;
+                } else {
+                    int32_t r = this->rhs_m[i];
+                    this->FirstPartials(i, this->value_m[l], r < 0 ? REAL_T(0) : this->value_m[r]);
+                }
+            }
+            this->Reverse();
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return 0;
-        };
+    public:
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, value_m));
+        /**
+         * The first local partials dl and dr of op at operand values x and
+         * y with result v. Linear opcodes do not read the values.
+         */
+        static void LocalPartials(const Operation &op, const REAL_T &x, const REAL_T &y,
+                const REAL_T &v, REAL_T &dl, REAL_T &dr) {
+            dl = 0;
+            dr = 0;
+            switch (op) {
+                case PLUS:
+                    dl = 1;
+                    dr = 1;
+                    break;
+                case MINUS:
+                    dl = 1;
+                    dr = -1;
+                    break;
+                case MULTIPLY:
+                    dl = y;
+                    dr = x;
+                    break;
+                case DIVIDE:
+                    dl = REAL_T(1) / y;
+                    dr = -v / y;
+                    break;
+                case SIN:
+                    dl = std::cos(x);
+                    break;
+                case COS:
+                    dl = -std::sin(x);
+                    break;
+                case TAN:
+                    dl = REAL_T(1) + v * v;
+                    break;
+                case ASIN:
+                    dl = REAL_T(1) / std::sqrt(REAL_T(1) - x * x);
+                    break;
+                case ACOS:
+                    dl = REAL_T(-1) / std::sqrt(REAL_T(1) - x * x);
+                    break;
+                case ATAN:
+                    dl = REAL_T(1) / (REAL_T(1) + x * x);
+                    break;
+                case ATAN2:
+                {
+                    REAL_T r2 = x * x + y * y;
+                    dl = y / r2;
+                    dr = -x / r2;
+                    break;
+                }
+                case SQRT:
+                    dl = REAL_T(.5) / v;
+                    break;
+                case POW:
+                    dl = y * std::pow(x, y - REAL_T(1));
+                    dr = x > REAL_T(0) ? v * std::log(x) : REAL_T(0);
+                    break;
+                case LOG:
+                    dl = REAL_T(1) / x;
+                    break;
+                case LOG10:
+                    dl = REAL_T(1) / (x * std::log(REAL_T(10)));
+                    break;
+                case EXP:
+                case MFEXP:
+                    dl = v;
+                    break;
+                case SINH:
+                    dl = std::cosh(x);
+                    break;
+                case COSH:
+                    dl = std::sinh(x);
+                    break;
+                case TANH:
+                    dl = REAL_T(1) - v * v;
+                    break;
+                case ABS:
+                case FABS:
+                    dl = x < REAL_T(0) ? REAL_T(-1) : REAL_T(1);
+                    break;
+                case LGAMMA:
+                    dl = Digamma(x);
+                    break;
+                case DIGAMMA:
+                    dl = Polygamma(1, x);
+                    break;
+                case ERF:
+                    dl = REAL_T(1.1283791670955125739) * std::exp(-x * x);
+                    break;
+                default:
+                    break;
+            }
         }
 
-        inline void PushIds(IdsSet & ids) const {
+    private:
 
+        /**
+         * Sets the second local partials of node i. Requires the first 
+         * partials.
+         */
+        void SecondPartials(size_t i, const REAL_T &x, const REAL_T &y) {
+            REAL_T v = this->value_m[i];
+            REAL_T dl = this->d_lhs_m[i];
+            REAL_T dr = this->d_rhs_m[i];
+            REAL_T dll = 0, dlr = 0, drr = 0;
+            switch (static_cast<Operation> (this->op_m[i])) {
+                case MULTIPLY:
+                    dlr = 1;
+                    break;
+                case DIVIDE:
+                    dlr = -dl / y;
+                    drr = REAL_T(2) * v / (y * y);
+                    break;
+                case SIN:
+                case COS:
+                    dll = -v;
+                    break;
+                case TAN:
+                    dll = REAL_T(2) * v * dl;
+                    break;
+                case ASIN:
+                case ACOS:
+                    dll = x * dl * dl * dl;
+                    break;
+                case ATAN:
+                    dll = REAL_T(-2) * x * dl * dl;
+                    break;
+                case ATAN2:
+                {
+                    REAL_T r2 = x * x + y * y;
+                    REAL_T r4 = r2 * r2;
+                    dll = REAL_T(-2) * x * y / r4;
+                    dlr = (x * x - y * y) / r4;
+                    drr = REAL_T(2) * x * y / r4;
+                    break;
+                }
+                case SQRT:
+                    dll = REAL_T(-.5) * dl / x;
+                    break;
+                case POW:
+                {
+                    REAL_T log_x = x > REAL_T(0) ? std::log(x) : REAL_T(0);
+                    dll = y * (y - REAL_T(1)) * std::pow(x, y - REAL_T(2));
+                    dlr = std::pow(x, y - REAL_T(1)) * (REAL_T(1) + y * log_x);
+                    drr = dr * log_x;
+                    break;
+                }
+                case LOG:
+                    dll = -dl * dl;
+                    break;
+                case LOG10:
+                    dll = -dl / x;
+                    break;
+                case EXP:
+                case MFEXP:
+                case SINH:
+                case COSH:
+                    dll = v;
+                    break;
+                case TANH:
+                    dll = REAL_T(-2) * v * dl;
+                    break;
+                case LGAMMA:
+                    dll = Polygamma(1, x);
+                    break;
+                case DIGAMMA:
+                    dll = Polygamma(2, x);
+                    break;
+                case ERF:
+                    dll = REAL_T(-2) * x * dl;
+                    break;
+                default:
+                    break;
+            }
+            this->d_lhs_lhs_m[i] = dll;
+            this->d_lhs_rhs_m[i] = dlr;
+            this->d_rhs_rhs_m[i] = drr;
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-
+        /**
+         * Evaluates the second local partials of all nodes, once per 
+         * Compile.
+         */
+        void PrepareSecondOrder() {
+            if (this->has_second_order_m) {
+                return;
+            }
+            size_t size = this->op_m.size();
+            this->d_lhs_lhs_m.resize(size);
+            this->d_lhs_rhs_m.resize(size);
+            this->d_rhs_rhs_m.resize(size);
+            for (size_t i = 0; i < size; i++) {
+                int32_t l = this->lhs_m[i];
+                int32_t r = this->rhs_m[i];
+                if (l < 0) {
+                    this->d_lhs_lhs_m[i] = 0;
+                    this->d_lhs_rhs_m[i] = 0;
+                    this->d_rhs_rhs_m[i] = 0;
+                } else {
+                    this->SecondPartials(i, this->value_m[l], r < 0 ? REAL_T(0) : this->value_m[r]);
+                }
+            }
+            this->has_second_order_m = true;
+        }
+
+        static inline const REAL_T Evaluate(const Operation &op, const REAL_T &x, const REAL_T &y) {
+            switch (op) {
+                case PLUS: return x + y;
+                case MINUS: return x - y;
+                case MULTIPLY: return x * y;
+                case DIVIDE: return x / y;
+                case SIN: return std::sin(x);
+                case COS: return std::cos(x);
+                case TAN: return std::tan(x);
+                case ASIN: return std::asin(x);
+                case ACOS: return std::acos(x);
+                case ATAN: return std::atan(x);
+                case ATAN2: return std::atan2(x, y);
+                case SQRT: return std::sqrt(x);
+                case POW: return std::pow(x, y);
+                case LOG: return std::log(x);
+                case LOG10: return std::log10(x);
+                case EXP: return std::exp(x);
+                case SINH: return std::sinh(x);
+                case COSH: return std::cosh(x);
+                case TANH: return std::tanh(x);
+                case ABS:
+                case FABS: return std::fabs(x);
+                case FLOOR: return std::floor(x);
+                case CEIL: return std::ceil(x);
+                case MFEXP: return MFExpValue(x);
+                case LGAMMA: return LogGamma(x);
+                case DIGAMMA: return Digamma(x);
+                case ERF: return ErrorFunction(x);
+                default: return x;
+            }
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-
+        /**
+         * Value of MFExp, exp bounded by a rational tail beyond +/-60.
+         */
+        static inline const REAL_T MFExpValue(const REAL_T &x) {
+            REAL_T b = REAL_T(60);
+            if (x <= b && x >= REAL_T(-1) * b) {
+                return std::exp(x);
+            } else if (x > b) {
+                return std::exp(b)*(REAL_T(1.) + REAL_T(2.) * (x - b)) / (REAL_T(1.) + x - b);
+            } else {
+                return std::exp(REAL_T(-1) * b)*(REAL_T(1.) - x - b) / (REAL_T(1.) + REAL_T(2.) * (REAL_T(-1) * x - b));
+            }
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
+        /*
+         * Recurrences on truncated Taylor series of degree d. Series are 
+         * arrays of d + 1 coefficients; the zero order coefficient of the
+         * result is set by the caller where noted.
+         */
 
+        /**
+         * c = a * b
+         */
+        static void TaylorMultiply(const REAL_T* a, const REAL_T* b, REAL_T* c, size_t d) {
+            for (size_t k = 0; k <= d; k++) {
+                REAL_T sum = 0;
+                for (size_t j = 0; j <= k; j++) {
+                    sum += a[j] * b[k - j];
+                }
+                c[k] = sum;
+            }
         }
 
-        const REAL_T &value_m;
-
-
-    };
-
-    /**
-     * 
-     * Expression template for addition.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS, class RHS>
-    struct Add : public ExpressionBase<REAL_T, Add<REAL_T, LHS, RHS> > {
-
-        Add(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() + rhs_m.GetValue()) {
-
-
+        /**
+         * c = a / b
+         */
+        static void TaylorDivide(const REAL_T* a, const REAL_T* b, REAL_T* c, size_t d) {
+            for (size_t k = 0; k <= d; k++) {
+                REAL_T sum = a[k];
+                for (size_t j = 1; j <= k; j++) {
+                    sum -= b[j] * c[k - j];
+                }
+                c[k] = sum / b[0];
+            }
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        /**
+         * c = sqrt(a), c[0] set by the caller.
+         */
+        static void TaylorSqrt(const REAL_T* a, REAL_T* c, size_t d) {
+            for (size_t k = 1; k <= d; k++) {
+                REAL_T sum = a[k];
+                for (size_t j = 1; j < k; j++) {
+                    sum -= c[j] * c[k - j];
+                }
+                c[k] = sum / (REAL_T(2) * c[0]);
+            }
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return lhs_m.Derivative(id, found) + rhs_m.Derivative(id, found);
+        /**
+         * e' = e * a', e[0] set by the caller (exp).
+         */
+        static void TaylorExp(const REAL_T* a, REAL_T* e, size_t d) {
+            for (size_t k = 1; k <= d; k++) {
+                REAL_T sum = 0;
+                for (size_t j = 1; j <= k; j++) {
+                    sum += REAL_T(j) * a[j] * e[k - j];
+                }
+                e[k] = sum / REAL_T(k);
+            }
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
-            rhs_m.GetIdRange(min, max);
+        /**
+         * b' * q = a', b[0] set by the caller (log, asin, acos, atan).
+         */
+        static void TaylorSolve(const REAL_T* a, const REAL_T* q, REAL_T* b, size_t d) {
+            for (size_t k = 1; k <= d; k++) {
+                REAL_T sum = REAL_T(k) * a[k];
+                for (size_t j = 1; j < k; j++) {
+                    sum -= REAL_T(j) * b[j] * q[k - j];
+                }
+                b[k] = sum / (REAL_T(k) * q[0]);
+            }
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (PLUS));
+        /**
+         * s' = c * a', c' = sign * s * a', s[0] and c[0] set by the 
+         * caller (sin/cos with sign -1, sinh/cosh with sign 1).
+         */
+        static void TaylorSinCos(const REAL_T* a, REAL_T* s, REAL_T* c, REAL_T sign, size_t d) {
+            for (size_t k = 1; k <= d; k++) {
+                REAL_T ss = 0;
+                REAL_T cc = 0;
+                for (size_t j = 1; j <= k; j++) {
+                    ss += REAL_T(j) * a[j] * c[k - j];
+                    cc += REAL_T(j) * a[j] * s[k - j];
+                }
+                s[k] = ss / REAL_T(k);
+                c[k] = sign * cc / REAL_T(k);
+            }
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * t' = w * a' with w = 1 + sign * t^2, t[0] set by the caller
+         * (tan with sign 1, tanh with sign -1).
+         */
+        static void TaylorTan(const REAL_T* a, REAL_T* t, REAL_T* w, REAL_T sign, size_t d) {
+            w[0] = REAL_T(1) + sign * t[0] * t[0];
+            for (size_t k = 1; k <= d; k++) {
+                REAL_T sum = 0;
+                for (size_t j = 1; j <= k; j++) {
+                    sum += REAL_T(j) * a[j] * w[k - j];
+                }
+                t[k] = sum / REAL_T(k);
+                REAL_T tt = 0;
+                for (size_t j = 0; j <= k; j++) {
+                    tt += t[j] * t[k - j];
+                }
+                w[k] = sign * tt;
+            }
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
-            this->rhs_m.PushStorage(ids);
-        }
-
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * c = f(a) for a univariate f given its derivatives f[k] of order k
+         * at a[0], as the sum of f[k]/k! (a - a[0])^k. c[0] set by the
+         * caller, p and q are scratch.
+         */
+        static void TaylorCompose(const REAL_T* a, const REAL_T* f, REAL_T* c,
+                REAL_T* p, REAL_T* q, size_t d) {
+            //p = (a - a[0])^k
+            p[0] = 0;
+            for (size_t k = 1; k <= d; k++) {
+                p[k] = a[k];
+                c[k] = 0;
+            }
+            REAL_T factorial = 1;
+            for (size_t n = 1; n <= d; n++) {
+                factorial *= REAL_T(n);
+                for (size_t k = n; k <= d; k++) {
+                    c[k] += f[n] / factorial * p[k];
+                }
+                if (n < d) {
+                    TaylorMultiply(p, a, q, d);
+                    for (size_t k = 0; k <= d; k++) {
+                        p[k] = q[k] - a[0] * p[k];
+                    }
+                }
+            }
         }
 
+        /**
+         * Key of a node for hash-consing: the opcode and the canonical 
+         * operands, or for leaves the constant value or the mapped position.
+         */
+        struct NodeKey {
+            uint8_t op;
+            int32_t lhs;
+            int32_t rhs;
+            REAL_T value;
 
+            bool operator<(const NodeKey &other) const {
+                if (this->op != other.op) return this->op < other.op;
+                if (this->lhs != other.lhs) return this->lhs < other.lhs;
+                if (this->rhs != other.rhs) return this->rhs < other.rhs;
+                //NaN constants are equal to each other and after all others
+                bool nan = this->value != this->value;
+                bool other_nan = other.value != other.value;
+                if (nan || other_nan) return !nan && other_nan;
+                return this->value < other.value;
+            }
+        };
 
+        /**
+         * Writes value as a C++ literal of type scalar, non-finite values 
+         * through std::numeric_limits.
+         */
+        static void WriteLiteral(std::ostream &out, const REAL_T &value, const std::string &scalar) {
+            if (value != value) {
+                out << "std::numeric_limits<" << scalar << ">::quiet_NaN()";
+            } else if (value == std::numeric_limits<REAL_T>::infinity()) {
+                out << "std::numeric_limits<" << scalar << ">::infinity()";
+            } else if (value == -std::numeric_limits<REAL_T>::infinity()) {
+                out << "-std::numeric_limits<" << scalar << ">::infinity()";
+            } else {
+                out << value;
+            }
+        }
 
-    private:
+        /**
+         * Hash of a node from its opcode, operands (symmetric for the 
+         * commutative opcodes), id and the bytes of its value. Equal values
+         * with different representations only miss a merge.
+         */
+        static size_t Hash(uint8_t op, int32_t lhs, int32_t rhs, uint32_t id, const REAL_T &value) {
+            if ((op == PLUS || op == MULTIPLY) && rhs < lhs) {
+                std::swap(lhs, rhs);
+            }
+            const uint64_t golden = static_cast<uint64_t> (0x9E3779B9u) << 32 | 0x7F4A7C15u;
+            uint64_t h = (static_cast<uint64_t> (static_cast<uint32_t> (lhs)) << 32 | static_cast<uint32_t> (rhs))
+                    ^ (static_cast<uint64_t> (op) << 56) ^ id;
+            if (lhs < 0) {
+                uint64_t chunk = 0;
+                const unsigned char* bytes = reinterpret_cast<const unsigned char*> (&value);
+                for (size_t i = 0; i < sizeof (REAL_T); i += sizeof (chunk)) {
+                    std::memcpy(&chunk, bytes + i, std::min(sizeof (chunk), sizeof (REAL_T) - i));
+                    h = (h ^ chunk) * golden;
+                }
+            }
+            h *= golden;
+            return static_cast<size_t> (h ^ (h >> 32));
+        }
 
-        const LHS& lhs_m;
-        const RHS& rhs_m;
-        const REAL_T value_m;
-    };
+        /**
+         * Returns the node identical to (op, lhs, rhs, id, value), appending
+         * it if the tape has none yet. Nodes are found through buckets_m, 
+         * an open addressing table of node indices.
+         */
+        int32_t Intern(uint8_t op, int32_t lhs, int32_t rhs, uint32_t id, const REAL_T &value) {
+            size_t mask = this->buckets_m.size() - 1;
+            size_t b = Hash(op, lhs, rhs, id, value) & mask;
+            bool commutative = op == PLUS || op == MULTIPLY;
+            for (int32_t j = this->buckets_m[b]; j >= 0; b = (b + 1) & mask, j = this->buckets_m[b]) {
+                if (this->op_m[j] != op || this->id_m[j] != id) {
+                    continue;
+                }
+                if (lhs < 0) {
+                    if (this->lhs_m[j] < 0 && this->value_m[j] == value) {
+                        return j;
+                    }
+                } else if ((this->lhs_m[j] == lhs && this->rhs_m[j] == rhs)
+                        || (commutative && this->lhs_m[j] == rhs && this->rhs_m[j] == lhs)) {
+                    return j;
+                }
+            }
+            int32_t i = this->nodes_m++;
+            this->op_m[i] = op;
+            this->lhs_m[i] = lhs;
+            this->rhs_m[i] = rhs;
+            this->id_m[i] = id;
+            this->value_m[i] = value;
+            this->buckets_m[b] = i;
+            return i;
+        }
 
-    /**
-     * Operator for addition of two expression templates.
-     * @param a
-     * @param b
-     * @return 
-     */
-    template <class REAL_T, class LHS, class RHS>
-    inline
-    Add<REAL_T, LHS, RHS> operator+(const ExpressionBase<REAL_T, LHS>& a,
-    const ExpressionBase<REAL_T, RHS>& b) {
-        return Add<REAL_T, LHS, RHS > (a.Cast(), b.Cast());
-    }
+        /**
+         * True if node i is the constant c.
+         */
+        inline bool IsConstant(int32_t i, const REAL_T &c) const {
+            return this->op_m[i] == CONSTANT && this->value_m[i] == c;
+        }
 
-    /**
-     * Expression template for subtraction.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS, class RHS>
-    struct Minus : public ExpressionBase<REAL_T, Minus<REAL_T, LHS, RHS> > {
+        /**
+         * Drops nodes not reachable from root, which becomes the last node,
+         * and renumbers operands. Reuses buckets_m for the new positions.
+         * The caller truncates the node arrays to nodes_m.
+         */
+        void Compact(int32_t root) {
+            std::vector<int32_t> &position = this->buckets_m;
+            std::fill(position.begin(), position.begin() + root + 1, -1);
+            position[root] = 0;
+            for (int32_t i = root; i >= 0; i--) {
+                if (position[i] == 0) {
+                    if (this->lhs_m[i] >= 0) position[this->lhs_m[i]] = 0;
+                    if (this->rhs_m[i] >= 0) position[this->rhs_m[i]] = 0;
+                }
+            }
+            int32_t j = 0;
+            for (int32_t i = 0; i <= root; i++) {
+                if (position[i] < 0) {
+                    continue;
+                }
+                position[i] = j;
+                this->op_m[j] = this->op_m[i];
+                this->lhs_m[j] = this->lhs_m[i] < 0 ? -1 : position[this->lhs_m[i]];
+                this->rhs_m[j] = this->rhs_m[i] < 0 ? -1 : position[this->rhs_m[i]];
+                this->id_m[j] = this->id_m[i];
+                this->value_m[j] = this->value_m[i];
+                j++;
+            }
+            this->nodes_m = j;
+        }
 
-        Minus(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() - rhs_m.GetValue()) {
+        static std::string Node(const char* prefix, int32_t i) {
+            std::ostringstream ss;
+            ss << prefix << i;
+            return ss.str();
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        /**
+         * Writes the C++ expression for the value of op applied to a and b.
+         */
+        static void WriteValue(std::ostream &out, const Operation &op, const std::string &a, const std::string &b) {
+            switch (op) {
+                case PLUS: out << a << " + " << b;
+                    break;
+                case MINUS: out << a << " - " << b;
+                    break;
+                case MULTIPLY: out << a << " * " << b;
+                    break;
+                case DIVIDE: out << a << " / " << b;
+                    break;
+                case SIN: out << "std::sin(" << a << ")";
+                    break;
+                case COS: out << "std::cos(" << a << ")";
+                    break;
+                case TAN: out << "std::tan(" << a << ")";
+                    break;
+                case ASIN: out << "std::asin(" << a << ")";
+                    break;
+                case ACOS: out << "std::acos(" << a << ")";
+                    break;
+                case ATAN: out << "std::atan(" << a << ")";
+                    break;
+                case ATAN2: out << "std::atan2(" << a << ", " << b << ")";
+                    break;
+                case SQRT: out << "std::sqrt(" << a << ")";
+                    break;
+                case POW: out << "std::pow(" << a << ", " << b << ")";
+                    break;
+                case LOG: out << "std::log(" << a << ")";
+                    break;
+                case LOG10: out << "std::log10(" << a << ")";
+                    break;
+                case EXP: out << "std::exp(" << a << ")";
+                    break;
+                case MFEXP: out << "mfexp(" << a << ")";
+                    break;
+                case SINH: out << "std::sinh(" << a << ")";
+                    break;
+                case COSH: out << "std::cosh(" << a << ")";
+                    break;
+                case TANH: out << "std::tanh(" << a << ")";
+                    break;
+                case ABS:
+                case FABS: out << "std::fabs(" << a << ")";
+                    break;
+                case FLOOR: out << "std::floor(" << a << ")";
+                    break;
+                case CEIL: out << "std::ceil(" << a << ")";
+                    break;
+                case LGAMMA: out << "::lgamma(" << a << ")";
+                    break;
+                case DIGAMMA: out << "digamma(" << a << ")";
+                    break;
+                case ERF: out << "::erf(" << a << ")";
+                    break;
+                default: out << a;
+                    break;
+            }
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return lhs_m.Derivative(id, found) - rhs_m.Derivative(id, found);
+        /**
+         * Writes the C++ expression for the partial derivative of node 
+         * value v = op(a, b) w.r.t. its left (rhs false) or right operand.
+         * Returns false if the partial is identically zero.
+         */
+        static bool WritePartial(std::ostream &out, const Operation &op, bool rhs,
+                const std::string &a, const std::string &b, const std::string &v) {
+            switch (op) {
+                case PLUS: out << "1";
+                    break;
+                case MINUS: out << (rhs ? "-1" : "1");
+                    break;
+                case MULTIPLY: out << (rhs ? a : b);
+                    break;
+                case DIVIDE:
+                    if (rhs) {
+                        out << "-" << v << " / " << b;
+                    } else {
+                        out << "1 / " << b;
+                    }
+                    break;
+                case SIN: out << "std::cos(" << a << ")";
+                    break;
+                case COS: out << "-std::sin(" << a << ")";
+                    break;
+                case TAN: out << "(1 + " << v << " * " << v << ")";
+                    break;
+                case ASIN: out << "1 / std::sqrt(1 - " << a << " * " << a << ")";
+                    break;
+                case ACOS: out << "-1 / std::sqrt(1 - " << a << " * " << a << ")";
+                    break;
+                case ATAN: out << "1 / (1 + " << a << " * " << a << ")";
+                    break;
+                case ATAN2:
+                    out << (rhs ? "-" : "") << (rhs ? a : b) << " / (" << a << " * " << a << " + " << b << " * " << b << ")";
+                    break;
+                case SQRT: out << "0.5 / " << v;
+                    break;
+                case POW:
+                    if (rhs) {
+                        out << "(" << a << " > 0 ? " << v << " * std::log(" << a << ") : 0)";
+                    } else {
+                        out << b << " * std::pow(" << a << ", " << b << " - 1)";
+                    }
+                    break;
+                case LOG: out << "1 / " << a;
+                    break;
+                case LOG10: out << "1 / (" << a << " * 2.302585092994045684)";
+                    break;
+                case EXP:
+                case MFEXP: out << v;
+                    break;
+                case SINH: out << "std::cosh(" << a << ")";
+                    break;
+                case COSH: out << "std::sinh(" << a << ")";
+                    break;
+                case TANH: out << "(1 - " << v << " * " << v << ")";
+                    break;
+                case ABS:
+                case FABS: out << "(" << a << " < 0 ? -1 : 1)";
+                    break;
+                case LGAMMA: out << "digamma(" << a << ")";
+                    break;
+                case DIGAMMA: out << "trigamma(" << a << ")";
+                    break;
+                case ERF: out << "1.1283791670955125739 * std::exp(-" << a << " * " << a << ")";
+                    break;
+                default:
+                    return false;
+            }
+            return true;
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
-            rhs_m.GetIdRange(min, max);
+        /**
+         * Reverse sweep of the first partials from the last node, into 
+         * adjoint_m, which must be zero.
+         */
+        void Reverse() {
+            size_t size = this->op_m.size();
+            if (size == 0) {
+                return;
+            }
+            this->adjoint_m[size - 1] = REAL_T(1);
+            for (size_t i = size; i-- > 0;) {
+                const REAL_T &a = this->adjoint_m[i];
+                if (this->lhs_m[i] >= 0) {
+                    this->adjoint_m[this->lhs_m[i]] += a * this->d_lhs_m[i];
+                }
+                if (this->rhs_m[i] >= 0) {
+                    this->adjoint_m[this->rhs_m[i]] += a * this->d_rhs_m[i];
+                }
+            }
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (MINUS));
+        /**
+         * Forward tangent sweep in direction v, into tangent_m.
+         */
+        void ForwardTangent(const std::vector<int32_t> &index, const std::vector<REAL_T> &v) {
+            size_t size = this->op_m.size();
+            this->tangent_m.resize(size);
+            for (size_t i = 0; i < size; i++) {
+                int32_t l = this->lhs_m[i];
+                int32_t r = this->rhs_m[i];
+                if (l < 0) {
+                    uint32_t id = this->id_m[i];
+                    this->tangent_m[i] = (id != 0 && id < index.size() && index[id] >= 0) ?
+                            v[index[id]] : REAL_T(0);
+                } else {
+                    REAL_T t = this->d_lhs_m[i] * this->tangent_m[l];
+                    if (r >= 0) {
+                        t += this->d_rhs_m[i] * this->tangent_m[r];
+                    }
+                    this->tangent_m[i] = t;
+                }
+            }
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * Sorted union of two index sets.
+         */
+        static void Union(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+                std::vector<uint32_t> &c) {
+            c.clear();
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(c));
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
-            this->rhs_m.PushStorage(ids);
+        /**
+         * Marks rows x cols, and the transpose, as interacting.
+         */
+        static void Interact(const std::vector<uint32_t> &rows, const std::vector<uint32_t> &cols,
+                std::vector<std::set<uint32_t> > &pattern) {
+            for (size_t i = 0; i < rows.size(); i++) {
+                for (size_t j = 0; j < cols.size(); j++) {
+                    pattern[rows[i]].insert(cols[j]);
+                    pattern[cols[j]].insert(rows[i]);
+                }
+            }
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        static inline bool IsLittleEndian() {
+            uint16_t one = 1;
+            return *reinterpret_cast<const unsigned char*> (&one) == 1;
         }
 
+        static inline void PutVarint(std::vector<char> &buffer, uint32_t value) {
+            while (value >= 0x80) {
+                buffer.push_back(static_cast<char> ((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back(static_cast<char> (value));
+        }
 
-    protected:
+        static inline bool GetVarint(std::streambuf* in, uint32_t &value) {
+            value = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                int c = in->sbumpc();
+                if (c == std::char_traits<char>::eof()) {
+                    return false;
+                }
+                value |= static_cast<uint32_t> (c & 0x7F) << shift;
+                if ((c & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
 
+        /**
+         * Decodes the nodes of a compressed tape following its magic, see 
+         * Encode and Decode.
+         */
+        bool DecodeNodes(std::istream &in) {
+            std::streambuf* buffer = in.rdbuf();
+            uint32_t version, real_size, size;
+            if (!GetVarint(buffer, version) || version != TapeHeader::FORMAT_VERSION
+                    || !GetVarint(buffer, real_size) || real_size != sizeof (REAL_T)
+                    || !GetVarint(buffer, size)) {
+                in.setstate(std::ios::failbit);
+                return false;
+            }
+            this->op_m.clear();
+            this->lhs_m.clear();
+            this->rhs_m.clear();
+            this->id_m.clear();
+            this->value_m.clear();
+            this->d_lhs_m.clear();
+            this->d_rhs_m.clear();
+            this->has_second_order_m = false;
+
+            std::vector<REAL_T> dictionary;
+            uint32_t previous_id = 0;
+            bool ok = true;
+            for (uint32_t i = 0; i < size && ok; i++) {
+                int c = buffer->sbumpc();
+                if (c == std::char_traits<char>::eof() || c >= NONE || c == NODE || c == REFERENCE) {
+                    ok = false;
+                    break;
+                }
+                Operation op = static_cast<Operation> (c);
+                int32_t l = -1, r = -1;
+                uint32_t id = 0;
+                REAL_T value = REAL_T(0);
+                if (op != CONSTANT && op != VARIABLE) {
+                    uint32_t distance;
+                    ok = GetVarint(buffer, distance) && distance < i;
+                    l = static_cast<int32_t> (i - distance - 1);
+                    if (ok && IsBinary(op)) {
+                        ok = GetVarint(buffer, distance) && distance < i;
+                        r = static_cast<int32_t> (i - distance - 1);
+                    }
+                    if (ok) {
+                        value = Evaluate(op, this->value_m[l], r < 0 ? REAL_T(0) : this->value_m[r]);
+                    }
+                } else {
+                    uint32_t zigzag = 0, reference = 0;
+                    if (op == VARIABLE) {
+                        if (!GetVarint(buffer, zigzag)) {
+                            ok = false;
+                            break;
+                        }
+                        int32_t delta = static_cast<int32_t> ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+                        id = previous_id + static_cast<uint32_t> (delta);
+                        previous_id = id;
+                    }
+                    ok = GetVarint(buffer, reference) && reference <= dictionary.size();
+                    if (ok && reference == 0) {
+                        ok = buffer->sgetn(reinterpret_cast<char*> (&value), sizeof (REAL_T)) == sizeof (REAL_T);
+                        if (!IsLittleEndian()) {
+                            value = ReverseBytes(value);
+                        }
+                        dictionary.push_back(value);
+                    } else if (ok) {
+                        value = dictionary[reference - 1];
+                    }
+                }
+                if (!ok) {
+                    break;
+                }
+                this->op_m.push_back(static_cast<uint8_t> (op));
+                this->lhs_m.push_back(l);
+                this->rhs_m.push_back(r);
+                this->id_m.push_back(id);
+                this->value_m.push_back(value);
+                this->d_lhs_m.push_back(REAL_T(0));
+                this->d_rhs_m.push_back(REAL_T(0));
+                if (l >= 0) {
+                    this->FirstPartials(i, this->value_m[l], r < 0 ? REAL_T(0) : this->value_m[r]);
+                }
+            }
+            if (!ok) {
+                in.setstate(std::ios::failbit);
+                this->op_m.clear();
+                this->lhs_m.clear();
+                this->rhs_m.clear();
+                this->id_m.clear();
+                this->value_m.clear();
+                this->d_lhs_m.clear();
+                this->d_rhs_m.clear();
+                this->adjoint_m.clear();
+                return false;
+            }
+            this->adjoint_m.assign(size, REAL_T(0));
+            this->Reverse();
+            return true;
+        }
 
-    private:
+        template<class TT>
+        static void ReadColumn(const char* data, size_t size, bool swapped, std::vector<TT> &column) {
+            column.resize(size);
+            if (size == 0) {
+                return;
+            }
+            std::memcpy(&column[0], data, size * sizeof (TT));
+            if (swapped && sizeof (TT) > 1) {
+                for (size_t i = 0; i < size; i++) {
+                    column[i] = ReverseBytes(column[i]);
+                }
+            }
+        }
 
-        const LHS& lhs_m;
-        const RHS& rhs_m;
-        const REAL_T value_m;
-    };
+        /**
+         * Prepares the node arrays for compiling at most size statements.
+         */
+        void Begin(size_t size) {
+            this->op_m.resize(size);
+            this->lhs_m.resize(size);
+            this->rhs_m.resize(size);
+            this->id_m.resize(size);
+            this->value_m.resize(size);
+            this->nodes_m = 0;
+            this->has_second_order_m = false;
+            size_t buckets = 16;
+            while (buckets < size + size / 2) {
+                buckets <<= 1;
+            }
+            this->buckets_m.assign(buckets, -1);
+        }
 
-    /**
-     * Operator for expression template subtraction.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class LHS, class RHS>
-    inline const
-    Minus<REAL_T, LHS, RHS> operator-(const ExpressionBase<REAL_T, LHS>& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return Minus<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
-    }
+        /**
+         * Interns a leaf; variables that are not independent are constants.
+         */
+        inline int32_t Leaf(Operation op, uint32_t id, const REAL_T &value) {
+            if (op == CONSTANT || id == 0) {
+                return this->Intern(CONSTANT, -1, -1, 0, value);
+            }
+            return this->Intern(VARIABLE, -1, -1, id, value);
+        }
 
-    /**
-     * Expression template for multiplying two expression templates.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS, class RHS>
-    struct Multiply : public ExpressionBase<REAL_T, Multiply<REAL_T, LHS, RHS> > {
+        /**
+         * Returns the node of op applied to nodes l and r (-1 if unary), 
+         * folding constants and dropping identities.
+         */
+        int32_t Apply(Operation op, int32_t l, int32_t r) {
+            REAL_T x = this->value_m[l];
+            REAL_T y = r < 0 ? REAL_T(0) : this->value_m[r];
 
-        Multiply(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() * rhs_m.GetValue()) {
+            if (this->op_m[l] == CONSTANT && (r < 0 || this->op_m[r] == CONSTANT)) {
+                return this->Intern(CONSTANT, -1, -1, 0, Evaluate(op, x, y));
+            }
+            if (((op == MULTIPLY || op == DIVIDE) && this->IsConstant(r, REAL_T(1)))
+                    || ((op == PLUS || op == MINUS) && this->IsConstant(r, REAL_T(0)))) {
+                return l;
+            }
+            if ((op == MULTIPLY && this->IsConstant(l, REAL_T(1)))
+                    || (op == PLUS && this->IsConstant(l, REAL_T(0)))) {
+                return r;
+            }
+            return this->Intern(static_cast<uint8_t> (op), l, r, 0, Evaluate(op, x, y));
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        /**
+         * Drops the nodes not reachable from root (-1 for an empty 
+         * expression), then evaluates first partials and adjoints.
+         */
+        void Finish(int32_t root) {
+            if (root < 0) {
+                this->nodes_m = 0;
+            } else {
+                this->Compact(root);
+            }
+            this->op_m.resize(this->nodes_m);
+            this->lhs_m.resize(this->nodes_m);
+            this->rhs_m.resize(this->nodes_m);
+            this->id_m.resize(this->nodes_m);
+            this->value_m.resize(this->nodes_m);
+            this->Prepare();
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            //            std::cout << "* " << a_.Derivative(id, found) << "*" << b_ << " +" <<a_ << " * " <<  b_.Derivative(id, found) << " \n";
-            return lhs_m.Derivative(id, found) * rhs_m.GetValue() + lhs_m.GetValue() * rhs_m.Derivative(id, found);
-        }
+    public:
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
-            rhs_m.GetIdRange(min, max);
+        StatementTape() : nodes_m(0), has_second_order_m(false) {
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (MULTIPLY));
+        /**
+         * Compiles statements, evaluates all node values, first local 
+         * partials and adjoints. Second partials are evaluated on the first 
+         * Hessian-vector product.
+         * 
+         * The statements are optimized as they are compiled: identical 
+         * subexpressions and leaves are hash-consed into one node, subtrees
+         * over constants only are folded into a constant, x * 1, 1 * x, 
+         * x + 0, 0 + x, x - 0 and x / 1 are reduced to x, and nodes no longer
+         * reachable from the result are dropped. Leaves of variables that 
+         * are not independent (id 0) are treated as constants.
+         * 
+         * REFERENCE statements are resolved to the node of the statement 
+         * they refer to. NODE statements refer to an ExpressionGraph and 
+         * are not allowed here, compile the graph instead.
+         * 
+         * @param statements
+         */
+        void Compile(const StatementList<REAL_T> &statements) {
+            size_t size = statements.size();
+            this->Begin(size);
+            std::vector<int32_t> stack;
+            std::vector<int32_t> produced(size);
+            stack.reserve(64);
+            typename StatementList<REAL_T>::const_iterator it = statements.begin();
+            for (size_t i = 0; i < size; i++, ++it) {
+                Statement<REAL_T> statement = *it;
+                Operation op = statement.op_m;
+                if (op == CONSTANT || op == VARIABLE) {
+                    stack.push_back(this->Leaf(op, statement.id_m, statement.value_m));
+                } else if (op == REFERENCE) {
+                    stack.push_back(produced[statement.id_m]);
+                } else {
+                    int32_t r = -1;
+                    if (IsBinary(op)) {
+                        r = stack.back();
+                        stack.pop_back();
+                    }
+                    int32_t l = stack.back();
+                    stack.pop_back();
+                    stack.push_back(this->Apply(op, l, r));
+                }
+                produced[i] = stack.back();
+            }
+            this->Finish(stack.empty() ? -1 : stack.back());
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * Compiles the nodes of graph reachable from root, as 
+         * Compile(statements) does.
+         * 
+         * @param graph
+         * @param root - a live node of graph
+         */
+        void Compile(ExpressionGraph<REAL_T> &graph, uint64_t root) {
+            std::vector<uint32_t> order;
+            graph.Sort(root, order);
+            size_t size = order.size();
+            this->Begin(size);
+            std::vector<int32_t> produced(size);
+            for (size_t k = 0; k < size; k++) {
+                uint32_t i = order[k];
+                Operation op = graph.Op(i);
+                if (op == CONSTANT || op == VARIABLE) {
+                    produced[k] = this->Leaf(op, graph.Id(i), graph.Value(i));
+                } else {
+                    int32_t l = produced[graph.Rank(graph.Lhs(i))];
+                    int32_t r = IsBinary(op) ? produced[graph.Rank(graph.Rhs(i))] : -1;
+                    produced[k] = this->Apply(op, l, r);
+                }
+            }
+            this->Finish(size == 0 ? -1 : produced[size - 1]);
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
-            this->rhs_m.PushStorage(ids);
+        /**
+         * Re-evaluates the compiled expression, its first partials and 
+         * adjoints at new values x of the mapped independent variables,
+         * without recording. The control flow taken when the statements 
+         * were recorded is assumed to still hold. Reuses all buffers.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param x - new values
+         */
+        void Replay(const std::vector<int32_t> &index, const std::vector<REAL_T> &x) {
+            size_t size = this->op_m.size();
+            for (size_t i = 0; i < size; i++) {
+                int32_t l = this->lhs_m[i];
+                if (l < 0) {
+                    uint32_t id = this->id_m[i];
+                    if (id != 0 && id < index.size() && index[id] >= 0) {
+                        this->value_m[i] = x[index[id]];
+                    }
+                    continue;
+                }
+                int32_t r = this->rhs_m[i];
+                REAL_T a = this->value_m[l];
+                REAL_T b = r < 0 ? REAL_T(0) : this->value_m[r];
+                this->value_m[i] = Evaluate(static_cast<Operation> (this->op_m[i]), a, b);
+                this->FirstPartials(i, a, b);
+            }
+            std::fill(this->adjoint_m.begin(), this->adjoint_m.end(), REAL_T(0));
+            this->has_second_order_m = false;
+            this->Reverse();
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * Writes the compiled tape in the binary tape format, a TapeHeader
+         * followed by the node columns. The file is assembled in one buffer
+         * and written with a single call.
+         * 
+         * @param out - a binary stream
+         */
+        void Write(std::ostream &out) const {
+            TapeHeader header;
+            header.Layout(static_cast<uint32_t> (this->op_m.size()), sizeof (REAL_T));
+            std::vector<char> buffer(static_cast<size_t> (header.size), 0);
+            std::memcpy(&buffer[0], &header, sizeof (TapeHeader));
+            size_t size = this->op_m.size();
+            if (size != 0) {
+                std::memcpy(&buffer[header.offsets[0]], &this->op_m[0], size * sizeof (uint8_t));
+                std::memcpy(&buffer[header.offsets[1]], &this->lhs_m[0], size * sizeof (int32_t));
+                std::memcpy(&buffer[header.offsets[2]], &this->rhs_m[0], size * sizeof (int32_t));
+                std::memcpy(&buffer[header.offsets[3]], &this->id_m[0], size * sizeof (uint32_t));
+                std::memcpy(&buffer[header.offsets[4]], &this->value_m[0], size * sizeof (REAL_T));
+            }
+            out.write(&buffer[0], buffer.size());
         }
 
+        /**
+         * Reads a tape written by Write, see Load, or by Encode, see Decode.
+         * 
+         * @param in - a binary stream
+         * @return false if in does not hold a valid tape for REAL_T
+         */
+        bool Read(std::istream &in) {
+            TapeHeader header;
+            if (!in.read(header.magic, 4)) {
+                return false;
+            }
+            if (std::memcmp(header.magic, "ET4Z", 4) == 0) {
+                return this->DecodeNodes(in);
+            }
+            char* rest_of_header = reinterpret_cast<char*> (&header) + 4;
+            if (std::memcmp(header.magic, "ET4T", 4) != 0
+                    || !in.read(rest_of_header, sizeof (TapeHeader) - 4)) {
+                return false;
+            }
+            TapeHeader raw = header;
+            if (header.IsSwapped()) {
+                header.Swap();
+            }
+            if (header.size < sizeof (TapeHeader)) {
+                return false;
+            }
+            std::vector<char> buffer(static_cast<size_t> (header.size));
+            std::memcpy(&buffer[0], &raw, sizeof (TapeHeader));
+            size_t rest = buffer.size() - sizeof (TapeHeader);
+            if (rest != 0 && !in.read(&buffer[sizeof (TapeHeader)], rest)) {
+                return false;
+            }
+            return this->Load(&buffer[0], buffer.size());
+        }
 
+        /**
+         * Adopts the tape held in data, as written by Write, e.g. the 
+         * contents of a MappedTape, with one bulk copy per column. Columns 
+         * written in the other byte order are converted. The first partials
+         * and adjoints are evaluated from the saved node values, so the 
+         * tape is ready for Gradient, Replay and the second order sweeps.
+         * 
+         * @param data
+         * @param size - bytes available at data
+         * @return false if data is not a valid tape for REAL_T
+         */
+        bool Load(const char* data, size_t size) {
+            if (size < sizeof (TapeHeader)) {
+                return false;
+            }
+            TapeHeader header;
+            std::memcpy(&header, data, sizeof (TapeHeader));
+            bool swapped = header.IsSwapped();
+            if (swapped) {
+                header.Swap();
+            }
+            if (!header.IsValid(size, sizeof (REAL_T))) {
+                return false;
+            }
+            this->ReadColumn(data + header.offsets[0], header.nodes, swapped, this->op_m);
+            this->ReadColumn(data + header.offsets[1], header.nodes, swapped, this->lhs_m);
+            this->ReadColumn(data + header.offsets[2], header.nodes, swapped, this->rhs_m);
+            this->ReadColumn(data + header.offsets[3], header.nodes, swapped, this->id_m);
+            this->ReadColumn(data + header.offsets[4], header.nodes, swapped, this->value_m);
+            if (header.nodes != 0 && !TapeHeader::IsValidNodes(&this->op_m[0], &this->lhs_m[0],
+                    &this->rhs_m[0], header.nodes)) {
+                this->op_m.clear();
+                return false;
+            }
+            this->has_second_order_m = false;
+            this->Prepare();
+            return true;
+        }
 
-    private:
-
-        const LHS& lhs_m;
-        const RHS& rhs_m;
-        const REAL_T value_m;
-    };
-
-    /**
-     * Operator for expression template multiplication.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class LHS, class RHS>
-    inline const
-    Multiply<REAL_T, LHS, RHS> operator*(const ExpressionBase<REAL_T, LHS>& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return Multiply<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
-    }
+        /**
+         * Writes the compiled tape in the compressed tape format, for 
+         * archiving. After the magic "ET4Z" and the varint version, 
+         * sizeof(REAL_T) and node count, each node is its byte opcode 
+         * followed by
+         * 
+         * - operators: the distance back to each operand, as varints,
+         * - VARIABLE leaves: the zig-zag varint delta from the id of the 
+         *   previous VARIABLE leaf, then the value,
+         * - CONSTANT leaves: the value.
+         * 
+         * A value is a varint reference into the dictionary of the values 
+         * written before, or 0 followed by the new value, little endian. 
+         * Operator values are not stored, Decode recomputes them. The 
+         * format needs no library and reads the same on any byte order.
+         * 
+         * @param out - a binary stream
+         */
+        void Encode(std::ostream &out) const {
+            std::vector<char> buffer;
+            size_t size = this->op_m.size();
+            buffer.reserve(16 + 3 * size);
+            buffer.insert(buffer.end(), "ET4Z", "ET4Z" + 4);
+            PutVarint(buffer, TapeHeader::FORMAT_VERSION);
+            PutVarint(buffer, sizeof (REAL_T));
+            PutVarint(buffer, static_cast<uint32_t> (size));
+
+            std::map<std::string, uint32_t> dictionary;
+            uint32_t previous_id = 0;
+            for (size_t i = 0; i < size; i++) {
+                buffer.push_back(static_cast<char> (this->op_m[i]));
+                int32_t l = this->lhs_m[i];
+                if (l >= 0) {
+                    PutVarint(buffer, static_cast<uint32_t> (i - l - 1));
+                    if (this->rhs_m[i] >= 0) {
+                        PutVarint(buffer, static_cast<uint32_t> (i - this->rhs_m[i] - 1));
+                    }
+                    continue;
+                }
+                if (this->op_m[i] == VARIABLE) {
+                    int32_t delta = static_cast<int32_t> (this->id_m[i] - previous_id);
+                    PutVarint(buffer, (static_cast<uint32_t> (delta) << 1) ^ static_cast<uint32_t> (delta >> 31));
+                    previous_id = this->id_m[i];
+                }
+                REAL_T value = IsLittleEndian() ? this->value_m[i] : ReverseBytes(this->value_m[i]);
+                std::string bytes(reinterpret_cast<const char*> (&value), sizeof (REAL_T));
+                std::map<std::string, uint32_t>::iterator it = dictionary.find(bytes);
+                if (it != dictionary.end()) {
+                    PutVarint(buffer, it->second);
+                } else {
+                    uint32_t reference = static_cast<uint32_t> (dictionary.size() + 1);
+                    dictionary[bytes] = reference;
+                    PutVarint(buffer, 0);
+                    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+                }
+            }
+            out.write(&buffer[0], buffer.size());
+        }
 
-    /**
-     * Expression template for division.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS, class RHS>
-    struct Divide : public ExpressionBase<REAL_T, Divide<REAL_T, LHS, RHS> > {
+        /**
+         * Reads a tape written by Encode. Nodes are decoded as they are 
+         * read from in and evaluated on the way, values, first partials 
+         * and finally the adjoints, the same work as a Replay, so the 
+         * compressed file is never held in memory.
+         * 
+         * @param in - a binary stream
+         * @return false if in does not hold a valid compressed tape for 
+         * REAL_T
+         */
+        bool Decode(std::istream &in) {
+            char magic[4];
+            if (!in.read(magic, 4) || std::memcmp(magic, "ET4Z", 4) != 0) {
+                return false;
+            }
+            return this->DecodeNodes(in);
+        }
 
-        Divide(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() / rhs_m.GetValue()) {
+        inline size_t Size() const {
+            return this->op_m.size();
         }
 
+        /**
+         * The value of the compiled expression.
+         */
         inline const REAL_T GetValue() const {
-            return value_m;
+            return this->value_m.empty() ? REAL_T(0) : this->value_m.back();
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return (lhs_m.Derivative(id, found) * rhs_m.GetValue() - lhs_m.GetValue() * rhs_m.Derivative(id, found)) / (rhs_m.GetValue() * rhs_m.GetValue());
+        /**
+         * Writes the compiled expression as a standalone C++ function 
+         * 
+         * void name(const scalar* x, scalar* f, scalar* g)
+         * 
+         * evaluating the value into f and the gradient w.r.t. the n mapped
+         * independent variables into g, as straight-line code: a forward 
+         * section with one constant per node and a reverse section 
+         * accumulating adjoints. Identical subexpressions are hash-consed
+         * into one node, and only nodes that depend on a mapped variable 
+         * get adjoints. Values of unmapped leaves are written as literals, 
+         * so the function is specific to the data it was recorded with.
+         * The constants name_parameters, n, and name_recorded_x, the values
+         * of the mapped variables when recorded, are written with it.
+         * 
+         * @param out
+         * @param index - id to position, -1 if not wanted
+         * @param n - length of x and g
+         * @param name - function name
+         * @param scalar - C++ type of x, f, g and the nodes
+         */
+        void GenerateSource(std::ostream &out, const std::vector<int32_t> &index, size_t n,
+                const std::string &name = "grad", const std::string &scalar = "double") const {
+            size_t size = this->op_m.size();
+            std::vector<int32_t> canonical(size);
+            std::vector<bool> active(size, false);
+            std::vector<int32_t> leaf_of(n, -1); //position to node
+            std::vector<int32_t> position_of(size, -1); //node to position
+            std::map<NodeKey, int32_t> nodes;
+
+            for (size_t i = 0; i < size; i++) {
+                NodeKey key;
+                key.op = this->op_m[i];
+                key.lhs = this->lhs_m[i] < 0 ? -1 : canonical[this->lhs_m[i]];
+                key.rhs = this->rhs_m[i] < 0 ? -1 : canonical[this->rhs_m[i]];
+                key.value = 0;
+                int32_t position = -1;
+                if (key.lhs < 0) {
+                    uint32_t id = this->id_m[i];
+                    if (id != 0 && id < index.size() && index[id] >= 0) {
+                        position = index[id];
+                        key.op = VARIABLE;
+                        key.lhs = position;
+                    } else {
+                        key.op = CONSTANT;
+                        key.value = this->value_m[i];
+                    }
+                }
+                typename std::map<NodeKey, int32_t>::iterator it = nodes.find(key);
+                if (it != nodes.end()) {
+                    canonical[i] = it->second;
+                    continue;
+                }
+                canonical[i] = static_cast<int32_t> (i);
+                nodes[key] = static_cast<int32_t> (i);
+                if (position >= 0) {
+                    active[i] = true;
+                    leaf_of[position] = static_cast<int32_t> (i);
+                    position_of[i] = position;
+                } else if (this->lhs_m[i] >= 0) {
+                    active[i] = active[key.lhs] || (key.rhs >= 0 && active[key.rhs]);
+                }
+            }
+
+            std::streamsize precision = out.precision(std::numeric_limits<REAL_T>::digits10 + 3);
+            out << "//generated from a recorded statement tape, " << nodes.size() << " nodes\n";
+            out << "#include <cmath>\n";
+            out << "#include <limits>\n\n";
+            out << "static inline " << scalar << " mfexp(" << scalar << " x) {\n";
+            out << "    " << scalar << " b = 60;\n";
+            out << "    if (x <= b && x >= -b) return std::exp(x);\n";
+            out << "    if (x > b) return std::exp(b)*(1. + 2. * (x - b)) / (1. + x - b);\n";
+            out << "    return std::exp(-b)*(1. - x - b) / (1. + 2. * (-x - b));\n";
+            out << "}\n\n";
+            out << "static inline " << scalar << " digamma(" << scalar << " x) {\n";
+            out << "    const " << scalar << " pi = 3.14159265358979323846;\n";
+            out << "    if (x <= 0 && std::floor(x) == x) return std::numeric_limits<" << scalar << ">::quiet_NaN();\n";
+            out << "    if (x < 0) return digamma(1 - x) - pi / std::tan(pi * x);\n";
+            out << "    " << scalar << " r = 0;\n";
+            out << "    for (; x < 15; x += 1) r -= 1 / x;\n";
+            out << "    " << scalar << " i2 = 1 / (x * x);\n";
+            out << "    return r + std::log(x) - 0.5 / x - i2 * (1. / 12 - i2 * (1. / 120 - i2 * (1. / 252 - i2 * (1. / 240 - i2 * (1. / 132)))));\n";
+            out << "}\n\n";
+            out << "static inline " << scalar << " trigamma(" << scalar << " x) {\n";
+            out << "    const " << scalar << " pi = 3.14159265358979323846;\n";
+            out << "    if (x <= 0 && std::floor(x) == x) return std::numeric_limits<" << scalar << ">::quiet_NaN();\n";
+            out << "    if (x < 0) {\n";
+            out << "        " << scalar << " s = std::sin(pi * x);\n";
+            out << "        return pi * pi / (s * s) - trigamma(1 - x);\n";
+            out << "    }\n";
+            out << "    " << scalar << " r = 0;\n";
+            out << "    for (; x < 15; x += 1) r += 1 / (x * x);\n";
+            out << "    " << scalar << " i = 1 / x, i2 = i * i;\n";
+            out << "    return r + i + 0.5 * i2 + i * i2 * (1. / 6 - i2 * (1. / 30 - i2 * (1. / 42 - i2 * (1. / 30))));\n";
+            out << "}\n\n";
+            out << "extern const unsigned int " << name << "_parameters = " << n << ";\n";
+            out << "extern const " << scalar << " " << name << "_recorded_x[] = {";
+            for (size_t k = 0; k < n; k++) {
+                out << (k == 0 ? "" : ", ");
+                WriteLiteral(out, leaf_of[k] >= 0 ? this->value_m[leaf_of[k]] : REAL_T(0), scalar);
+            }
+            out << (n == 0 ? "0};\n\n" : "};\n\n");
+            out << "void " << name << "(const " << scalar << "* x, " << scalar << "* f, " << scalar << "* g) {\n";
+
+            for (size_t i = 0; i < size; i++) {
+                if (canonical[i] != static_cast<int32_t> (i)) {
+                    continue;
+                }
+                out << "    const " << scalar << " " << Node("v", i) << " = ";
+                if (this->lhs_m[i] < 0) {
+                    if (active[i]) {
+                        out << "x[" << position_of[i] << "]";
+                    } else {
+                        WriteLiteral(out, this->value_m[i], scalar);
+                    }
+                } else {
+                    WriteValue(out, static_cast<Operation> (this->op_m[i]),
+                            Node("v", canonical[this->lhs_m[i]]),
+                            this->rhs_m[i] < 0 ? std::string() : Node("v", canonical[this->rhs_m[i]]));
+                }
+                out << ";\n";
+            }
+
+            int32_t root = size == 0 ? -1 : canonical[size - 1];
+            if (root < 0) {
+                out << "    *f = 0;\n";
+            } else {
+                out << "    *f = " << Node("v", root) << ";\n";
+            }
+
+            for (size_t i = 0; i < size; i++) {
+                if (canonical[i] == static_cast<int32_t> (i) && active[i]) {
+                    out << "    " << scalar << " " << Node("a", i) << " = " << (static_cast<int32_t> (i) == root ? 1 : 0) << ";\n";
+                }
+            }
+
+            for (size_t i = size; i-- > 0;) {
+                if (canonical[i] != static_cast<int32_t> (i) || !active[i] || this->lhs_m[i] < 0) {
+                    continue;
+                }
+                Operation op = static_cast<Operation> (this->op_m[i]);
+                int32_t l = canonical[this->lhs_m[i]];
+                int32_t r = this->rhs_m[i] < 0 ? -1 : canonical[this->rhs_m[i]];
+                std::string a = Node("v", l);
+                std::string b = r < 0 ? std::string() : Node("v", r);
+                std::string v = Node("v", i);
+                for (int side = 0; side < 2; side++) {
+                    int32_t operand = side == 0 ? l : r;
+                    if (operand < 0 || !active[operand]) {
+                        continue;
+                    }
+                    std::ostringstream partial;
+                    partial.precision(out.precision());
+                    if (WritePartial(partial, op, side == 1, a, b, v)) {
+                        out << "    " << Node("a", operand) << " += " << Node("a", i) << " * (" << partial.str() << ");\n";
+                    }
+                }
+            }
+
+            for (size_t k = 0; k < n; k++) {
+                out << "    g[" << k << "] = ";
+                if (leaf_of[k] >= 0) {
+                    out << Node("a", leaf_of[k]);
+                } else {
+                    out << "0";
+                }
+                out << ";\n";
+            }
+            out << "}\n";
+            out.precision(precision);
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
-            rhs_m.GetIdRange(min, max);
+        /**
+         * Returns the derivative of the compiled expression in direction v,
+         * from one forward tangent sweep.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param v - direction
+         * @return 
+         */
+        const REAL_T DirectionalDerivative(const std::vector<int32_t> &index, const std::vector<REAL_T> &v) {
+            if (this->op_m.empty()) {
+                return REAL_T(0);
+            }
+            this->ForwardTangent(index, v);
+            return this->tangent_m.back();
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (DIVIDE));
+        /**
+         * Positions of the mapped independent variables the compiled 
+         * expression depends on, sorted.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param dependencies
+         */
+        void Dependencies(const std::vector<int32_t> &index, std::vector<uint32_t> &dependencies) const {
+            dependencies.clear();
+            for (size_t i = 0; i < this->op_m.size(); i++) {
+                uint32_t id = this->id_m[i];
+                if (id != 0 && id < index.size() && index[id] >= 0) {
+                    dependencies.push_back(static_cast<uint32_t> (index[id]));
+                }
+            }
+            std::sort(dependencies.begin(), dependencies.end());
+            dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * Detects the sparsity pattern of the Hessian w.r.t. the n mapped 
+         * independent variables. Each node carries the set of variables it
+         * depends on; nonlinear operations mark their operands' sets as 
+         * interacting. The pattern is conservative, a pair marked may 
+         * still have a zero second derivative at this point.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param n
+         * @param pattern - CSR pattern, values are zeroed
+         */
+        void HessianSparsity(const std::vector<int32_t> &index, size_t n, CSRMatrix<REAL_T> &pattern) const {
+            size_t size = this->op_m.size();
+            std::vector<std::vector<uint32_t> > depends(size);
+            std::vector<std::set<uint32_t> > rows(n);
+            std::vector<uint32_t> both;
+
+            for (size_t i = 0; i < size; i++) {
+                int32_t l = this->lhs_m[i];
+                int32_t r = this->rhs_m[i];
+                if (l < 0) {
+                    uint32_t id = this->id_m[i];
+                    if (id != 0 && id < index.size() && index[id] >= 0) {
+                        depends[i].push_back(static_cast<uint32_t> (index[id]));
+                    }
+                    continue;
+                }
+                const std::vector<uint32_t> &a = depends[l];
+                if (r < 0) {
+                    depends[i] = a;
+                    switch (static_cast<Operation> (this->op_m[i])) {
+                        case ABS:
+                        case FABS:
+                        case FLOOR:
+                        case CEIL:
+                            break;
+                        default:
+                            Interact(a, a, rows);
+                            break;
+                    }
+                    continue;
+                }
+                const std::vector<uint32_t> &b = depends[r];
+                Union(a, b, depends[i]);
+                switch (static_cast<Operation> (this->op_m[i])) {
+                    case PLUS:
+                    case MINUS:
+                        break;
+                    case MULTIPLY:
+                        Interact(a, b, rows);
+                        break;
+                    case DIVIDE:
+                        Interact(b, depends[i], rows);
+                        break;
+                    default:
+                        Interact(depends[i], depends[i], rows);
+                        break;
+                }
+            }
+            pattern.Assign(rows);
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
-            this->rhs_m.PushStorage(ids);
+        /**
+         * Computes the Hessian w.r.t. the n mapped independent variables 
+         * in CSR form. The columns are grouped by a distance-2 coloring of
+         * the sparsity pattern, so one Hessian-vector product per color 
+         * recovers all nonzeros.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param n
+         * @param hessian
+         * @return the number of colors, i.e. Hessian-vector products used
+         */
+        size_t SparseHessian(const std::vector<int32_t> &index, size_t n, CSRMatrix<REAL_T> &hessian) {
+            this->HessianSparsity(index, n, hessian);
+            std::vector<uint32_t> colors;
+            size_t ncolors = ColorColumns(hessian, n, colors);
+            std::vector<REAL_T> v(n);
+            std::vector<REAL_T> hv(n);
+            for (size_t c = 0; c < ncolors; c++) {
+                for (size_t j = 0; j < n; j++) {
+                    v[j] = colors[j] == c ? REAL_T(1) : REAL_T(0);
+                }
+                this->HessianVectorProduct(index, v, hv);
+                for (size_t i = 0; i < n; i++) {
+                    for (size_t k = hessian.row_offsets_m[i]; k < hessian.row_offsets_m[i + 1]; k++) {
+                        if (colors[hessian.columns_m[k]] == c) {
+                            hessian.values_m[k] = hv[i];
+                        }
+                    }
+                }
+            }
+            return ncolors;
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
-            this->rhs_m.PushIds(ids);
+        /**
+         * Propagates truncated Taylor series of the given degree through the
+         * tape, for the line x + t * v in the mapped independent variables.
+         * On return coefficients[k] is the k-th Taylor coefficient of the 
+         * result, i.e. the k-th directional derivative divided by k!. Every
+         * operation costs O(degree^2).
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param v - direction
+         * @param degree
+         * @param coefficients - resized to degree + 1
+         */
+        void Taylor(const std::vector<int32_t> &index, const std::vector<REAL_T> &v,
+                size_t degree, std::vector<REAL_T> &coefficients) {
+            size_t size = this->op_m.size();
+            size_t d = degree;
+            size_t stride = d + 1;
+            coefficients.assign(stride, REAL_T(0));
+            if (size == 0) {
+                return;
+            }
+            this->taylor_m.assign(size * stride, REAL_T(0));
+            this->taylor_scratch_m.assign(3 * stride, REAL_T(0));
+            REAL_T* s1 = &this->taylor_scratch_m[0];
+            REAL_T* s2 = s1 + stride;
+            REAL_T* s3 = s2 + stride;
+
+            for (size_t i = 0; i < size; i++) {
+                REAL_T* c = &this->taylor_m[i * stride];
+                int32_t l = this->lhs_m[i];
+                int32_t r = this->rhs_m[i];
+                c[0] = this->value_m[i];
+                if (l < 0) {
+                    uint32_t id = this->id_m[i];
+                    if (d > 0 && id != 0 && id < index.size() && index[id] >= 0) {
+                        c[1] = v[index[id]];
+                    }
+                    continue;
+                }
+                const REAL_T* a = &this->taylor_m[l * stride];
+                const REAL_T* b = r < 0 ? NULL : &this->taylor_m[r * stride];
+                switch (static_cast<Operation> (this->op_m[i])) {
+                    case PLUS:
+                        for (size_t k = 1; k <= d; k++) {
+                            c[k] = a[k] + b[k];
+                        }
+                        break;
+                    case MINUS:
+                        for (size_t k = 1; k <= d; k++) {
+                            c[k] = a[k] - b[k];
+                        }
+                        break;
+                    case MULTIPLY:
+                        TaylorMultiply(a, b, c, d);
+                        break;
+                    case DIVIDE:
+                        TaylorDivide(a, b, c, d);
+                        break;
+                    case SIN:
+                        s1[0] = std::cos(a[0]);
+                        TaylorSinCos(a, c, s1, REAL_T(-1), d);
+                        break;
+                    case COS:
+                        s1[0] = std::sin(a[0]);
+                        TaylorSinCos(a, s1, c, REAL_T(-1), d);
+                        break;
+                    case SINH:
+                        s1[0] = std::cosh(a[0]);
+                        TaylorSinCos(a, c, s1, REAL_T(1), d);
+                        break;
+                    case COSH:
+                        s1[0] = std::sinh(a[0]);
+                        TaylorSinCos(a, s1, c, REAL_T(1), d);
+                        break;
+                    case TAN:
+                        TaylorTan(a, c, s1, REAL_T(1), d);
+                        break;
+                    case TANH:
+                        TaylorTan(a, c, s1, REAL_T(-1), d);
+                        break;
+                    case ASIN:
+                    case ACOS:
+                        //q = sqrt(1 - a^2)
+                        TaylorMultiply(a, a, s1, d);
+                        for (size_t k = 0; k <= d; k++) {
+                            s1[k] = -s1[k];
+                        }
+                        s1[0] += REAL_T(1);
+                        s2[0] = std::sqrt(s1[0]);
+                        TaylorSqrt(s1, s2, d);
+                        if (this->op_m[i] == ACOS) {
+                            for (size_t k = 0; k <= d; k++) {
+                                s2[k] = -s2[k];
+                            }
+                        }
+                        TaylorSolve(a, s2, c, d);
+                        break;
+                    case ATAN:
+                        //q = 1 + a^2
+                        TaylorMultiply(a, a, s1, d);
+                        s1[0] += REAL_T(1);
+                        TaylorSolve(a, s1, c, d);
+                        break;
+                    case ATAN2:
+                    {
+                        //c' * (a^2 + b^2) = b * a' - a * b'
+                        TaylorMultiply(a, a, s1, d);
+                        TaylorMultiply(b, b, s2, d);
+                        for (size_t k = 0; k <= d; k++) {
+                            s1[k] += s2[k];
+                        }
+                        for (size_t k = 1; k <= d; k++) {
+                            REAL_T sum = 0;
+                            for (size_t j = 1; j <= k; j++) {
+                                sum += REAL_T(j) * (b[k - j] * a[j] - a[k - j] * b[j]);
+                            }
+                            for (size_t j = 1; j < k; j++) {
+                                sum -= REAL_T(j) * c[j] * s1[k - j];
+                            }
+                            c[k] = sum / (REAL_T(k) * s1[0]);
+                        }
+                        break;
+                    }
+                    case SQRT:
+                        TaylorSqrt(a, c, d);
+                        break;
+                    case POW:
+                    {
+                        bool constant_exponent = true;
+                        for (size_t k = 1; k <= d; k++) {
+                            if (b[k] != REAL_T(0)) {
+                                constant_exponent = false;
+                            }
+                        }
+                        if (constant_exponent && a[0] != REAL_T(0)) {
+                            //c' * a = y * c * a'
+                            REAL_T y = b[0];
+                            for (size_t k = 1; k <= d; k++) {
+                                REAL_T sum = 0;
+                                for (size_t j = 1; j <= k; j++) {
+                                    sum += (y * REAL_T(j) - REAL_T(k - j)) * a[j] * c[k - j];
+                                }
+                                c[k] = sum / (REAL_T(k) * a[0]);
+                            }
+                        } else {
+                            //exp(b * log(a))
+                            s1[0] = std::log(a[0]);
+                            TaylorSolve(a, a, s1, d);
+                            TaylorMultiply(b, s1, s2, d);
+                            TaylorExp(s2, c, d);
+                        }
+                        break;
+                    }
+                    case LOG:
+                        TaylorSolve(a, a, c, d);
+                        break;
+                    case LOG10:
+                        TaylorSolve(a, a, c, d);
+                        for (size_t k = 1; k <= d; k++) {
+                            c[k] /= std::log(REAL_T(10));
+                        }
+                        break;
+                    case EXP:
+                    case MFEXP:
+                        TaylorExp(a, c, d);
+                        break;
+                    case ABS:
+                    case FABS:
+                        for (size_t k = 1; k <= d; k++) {
+                            c[k] = a[0] < REAL_T(0) ? -a[k] : a[k];
+                        }
+                        break;
+                    case LGAMMA:
+                    case DIGAMMA:
+                    {
+                        //derivatives of order k are polygamma of order k - 1 (LGAMMA) or k
+                        unsigned int shift = this->op_m[i] == DIGAMMA ? 1 : 0;
+                        s3[0] = c[0];
+                        for (size_t k = 1; k <= d; k++) {
+                            s3[k] = Polygamma(static_cast<unsigned int> (k - 1) + shift, a[0]);
+                        }
+                        TaylorCompose(a, s3, c, s1, s2, d);
+                        break;
+                    }
+                    case ERF:
+                    {
+                        //erf^(k + 1) = (-1)^k H_k(x) 2/sqrt(pi) exp(-x^2), H the Hermite polynomials
+                        REAL_T g = REAL_T(1.1283791670955125739) * std::exp(-a[0] * a[0]);
+                        REAL_T h0 = 1, h1 = REAL_T(2) * a[0];
+                        s3[0] = c[0];
+                        for (size_t k = 1; k <= d; k++) {
+                            s3[k] = ((k - 1) % 2 == 0 ? g : -g) * h0;
+                            REAL_T h2 = REAL_T(2) * a[0] * h1 - REAL_T(2 * k) * h0;
+                            h0 = h1;
+                            h1 = h2;
+                        }
+                        TaylorCompose(a, s3, c, s1, s2, d);
+                        break;
+                    }
+                    default:
+                        //floor, ceil: piecewise constant
+                        break;
+                }
+            }
+
+            const REAL_T* result = &this->taylor_m[(size - 1) * stride];
+            for (size_t k = 0; k <= d; k++) {
+                coefficients[k] = result[k];
+            }
         }
 
+        /**
+         * Returns the derivative w.r.t. the independent variable id.
+         * 
+         * @param id
+         * @return 
+         */
+        const REAL_T Derivative(uint32_t id) const {
+            REAL_T ret = 0;
+            if (id == 0) {
+                return ret;
+            }
+            for (size_t i = 0; i < this->id_m.size(); i++) {
+                if (this->id_m[i] == id) {
+                    ret += this->adjoint_m[i];
+                }
+            }
+            return ret;
+        }
 
-    private:
+        /**
+         * Accumulates the gradient w.r.t. the mapped independent variables.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param gradient - sized by the caller, zeroed here
+         */
+        void Gradient(const std::vector<int32_t> &index, std::vector<REAL_T> &gradient) const {
+            std::fill(gradient.begin(), gradient.end(), REAL_T(0));
+            for (size_t i = 0; i < this->op_m.size(); i++) {
+                uint32_t id = this->id_m[i];
+                if (id != 0 && id < index.size() && index[id] >= 0) {
+                    gradient[index[id]] += this->adjoint_m[i];
+                }
+            }
+        }
 
-        const LHS& lhs_m;
-        const RHS& rhs_m;
-        const REAL_T value_m;
+        /**
+         * Computes hv = H * v, H being the Hessian w.r.t. the mapped 
+         * independent variables, by a forward tangent sweep in direction v
+         * followed by a reverse sweep of the adjoint tangents.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param v - direction
+         * @param hv - sized by the caller, zeroed here
+         */
+        void HessianVectorProduct(const std::vector<int32_t> &index, const std::vector<REAL_T> &v,
+                std::vector<REAL_T> &hv) {
+            size_t size = this->op_m.size();
+            std::fill(hv.begin(), hv.end(), REAL_T(0));
+            if (size == 0) {
+                return;
+            }
+            this->PrepareSecondOrder();
+            this->ForwardTangent(index, v);
+            this->adjoint_tangent_m.assign(size, REAL_T(0));
+
+            for (size_t i = size; i-- > 0;) {
+                int32_t l = this->lhs_m[i];
+                int32_t r = this->rhs_m[i];
+                const REAL_T &a = this->adjoint_m[i];
+                const REAL_T &at = this->adjoint_tangent_m[i];
+                if (l < 0) {
+                    uint32_t id = this->id_m[i];
+                    if (id != 0 && id < index.size() && index[id] >= 0) {
+                        hv[index[id]] += at;
+                    }
+                } else if (r < 0) {
+                    this->adjoint_tangent_m[l] += at * this->d_lhs_m[i]
+                            + a * this->d_lhs_lhs_m[i] * this->tangent_m[l];
+                } else {
+                    REAL_T tl = this->tangent_m[l];
+                    REAL_T tr = this->tangent_m[r];
+                    this->adjoint_tangent_m[l] += at * this->d_lhs_m[i]
+                            + a * (this->d_lhs_lhs_m[i] * tl + this->d_lhs_rhs_m[i] * tr);
+                    this->adjoint_tangent_m[r] += at * this->d_rhs_m[i]
+                            + a * (this->d_lhs_rhs_m[i] * tl + this->d_rhs_rhs_m[i] * tr);
+                }
+            }
+        }
     };
 
     /**
-     * Operator for expression template division.
+     * A tape file written by StatementTape::Write, mapped read-only into 
+     * memory. Opening costs no reading or parsing and the node columns are
+     * used in place: the value and the gradient of the saved tape are 
+     * evaluated directly on the mapping, allocating only the adjoints. To 
+     * replay or take second order derivatives, hand Data() to 
+     * StatementTape::Load.
      * 
-     * @param lhs
-     * @param rhs
-     * @return 
+     * Files written in the other byte order are not mapped, see 
+     * StatementTape::Read. Where mmap is not available the file is read 
+     * into memory instead.
      */
-    template <class REAL_T, class LHS, class RHS>
-    inline const
-    Divide<REAL_T, LHS, RHS> operator/(const ExpressionBase<REAL_T, LHS>& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return Divide<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
-    }
+    template<class REAL_T>
+    class MappedTape {
+        const char* data_m;
+        size_t size_m;
+        const TapeHeader* header_m;
+        std::vector<REAL_T> adjoint_m;
+#if defined(WIN32) || defined(WIN64)
+        std::vector<char> buffer_m;
+#endif
 
-    /**
-     * Expression template for adding a constant to a expression template.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS>
-    struct ConstantAdd : public ExpressionBase<REAL_T, ConstantAdd<REAL_T, LHS> > {
+        MappedTape(const MappedTape&);
+        MappedTape& operator=(const MappedTape&);
 
-        ConstantAdd(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() + rhs) {
+        template<class TT>
+        inline const TT* Column(size_t k) const {
+            return reinterpret_cast<const TT*> (this->data_m + this->header_m->offsets[k]);
         }
 
-        inline const REAL_T GetValue() const {
-            //            this->value_m = lhs_m.GetValue() + rhs_m;
-            return value_m;
-        }
+    public:
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return lhs_m.Derivative(id, found);
+        MappedTape() : data_m(NULL), size_m(0), header_m(NULL) {
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
+        MappedTape(const std::string &path) : data_m(NULL), size_m(0), header_m(NULL) {
+            this->Open(path);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
-            statements.push_back(Statement<REAL_T > (PLUS));
+        ~MappedTape() {
+            this->Close();
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
+        /**
+         * Maps the tape file at path.
+         * 
+         * @param path
+         * @return false if the file can not be mapped or is not a valid 
+         * native order tape for REAL_T, including nodes whose operands do
+         * not precede them
+         */
+        bool Open(const std::string &path) {
+            this->Close();
+#if defined(WIN32) || defined(WIN64)
+            std::ifstream in(path.c_str(), std::ios::binary);
+            if (!in.good()) {
+                return false;
+            }
+            in.seekg(0, std::ios::end);
+            this->buffer_m.resize(static_cast<size_t> (in.tellg()));
+            in.seekg(0, std::ios::beg);
+            if (this->buffer_m.empty() || !in.read(&this->buffer_m[0], this->buffer_m.size())) {
+                this->buffer_m.clear();
+                return false;
+            }
+            this->data_m = &this->buffer_m[0];
+            this->size_m = this->buffer_m.size();
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t> (sizeof (TapeHeader))) {
+                ::close(fd);
+                return false;
+            }
+            void* data = ::mmap(NULL, static_cast<size_t> (st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                return false;
+            }
+            this->data_m = static_cast<const char*> (data);
+            this->size_m = static_cast<size_t> (st.st_size);
+#endif
+            this->header_m = reinterpret_cast<const TapeHeader*> (this->data_m);
+            if (this->size_m < sizeof (TapeHeader) || !this->header_m->IsValid(this->size_m, sizeof (REAL_T))
+                    || !TapeHeader::IsValidNodes(this->Ops(), this->Lhs(), this->Rhs(), this->header_m->nodes)) {
+                this->Close();
+                return false;
+            }
+            return true;
         }
 
-        inline inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
+        /**
+         * Unmaps the file.
+         */
+        void Close() {
+#if defined(WIN32) || defined(WIN64)
+            this->buffer_m.clear();
+#else
+            if (this->data_m != NULL) {
+                ::munmap(const_cast<char*> (this->data_m), this->size_m);
+            }
+#endif
+            this->data_m = NULL;
+            this->size_m = 0;
+            this->header_m = NULL;
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
+        inline bool IsOpen() const {
+            return this->data_m != NULL;
         }
 
-
-
-    private:
-        const LHS& lhs_m;
-        REAL_T rhs_m;
-        REAL_T value_m;
-    };
-
-    /**
-     * Operator for adding a constant value to a expression templates.
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class LHS>
-    inline const
-    ConstantAdd<REAL_T, LHS> operator+(const ExpressionBase<REAL_T, LHS>& lhs,
-    const REAL_T& rhs) {
-        return ConstantAdd<REAL_T, LHS > (lhs.Cast(), rhs);
-    }
-
-    template <class REAL_T, class RHS>
-    inline const
-    ConstantAdd<REAL_T, RHS> operator+(const REAL_T& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return ConstantAdd<REAL_T, RHS > (rhs.Cast(), lhs);
-    }
-
-    /**
-     * Expression template for subtracting a constant from a expression 
-     * template.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS>
-    struct ConstantMinus : public ExpressionBase<REAL_T, ConstantMinus<REAL_T, LHS> > {
-
-        ConstantMinus(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() - rhs_m) {
+        /**
+         * The mapped file, for StatementTape::Load.
+         */
+        inline const char* Data() const {
+            return this->data_m;
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        inline size_t Size() const {
+            return this->size_m;
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return lhs_m.Derivative(id, found);
+        /**
+         * Number of nodes of the saved tape.
+         */
+        inline size_t Nodes() const {
+            return this->header_m == NULL ? 0 : this->header_m->nodes;
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
+        inline const uint8_t* Ops() const {
+            return this->Column<uint8_t > (0);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
-            statements.push_back(Statement<REAL_T > (MINUS));
+        inline const int32_t* Lhs() const {
+            return this->Column<int32_t > (1);
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
+        inline const int32_t* Rhs() const {
+            return this->Column<int32_t > (2);
         }
 
-        inline inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->rhs_m.PushStorage(ids);
+        inline const uint32_t* Ids() const {
+            return this->Column<uint32_t > (3);
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
+        inline const REAL_T* Values() const {
+            return this->Column<REAL_T > (4);
         }
 
+        /**
+         * The value of the saved expression.
+         */
+        inline const REAL_T GetValue() const {
+            return this->Nodes() == 0 ? REAL_T(0) : this->Values()[this->Nodes() - 1];
+        }
 
-
-
-    private:
-        const LHS& lhs_m;
-        REAL_T rhs_m;
-        REAL_T value_m;
+        /**
+         * Accumulates the gradient of the saved expression w.r.t. the 
+         * mapped independent variables in one reverse sweep over the 
+         * mapping, evaluating the local partials from the saved values.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param gradient - sized by the caller, zeroed here
+         */
+        void Gradient(const std::vector<int32_t> &index, std::vector<REAL_T> &gradient) {
+            std::fill(gradient.begin(), gradient.end(), REAL_T(0));
+            size_t size = this->Nodes();
+            if (size == 0) {
+                return;
+            }
+            const uint8_t* op = this->Ops();
+            const int32_t* lhs = this->Lhs();
+            const int32_t* rhs = this->Rhs();
+            const uint32_t* ids = this->Ids();
+            const REAL_T* value = this->Values();
+            this->adjoint_m.assign(size, REAL_T(0));
+            this->adjoint_m[size - 1] = REAL_T(1);
+            for (size_t i = size; i-- > 0;) {
+                const REAL_T a = this->adjoint_m[i];
+                int32_t l = lhs[i];
+                if (l < 0) {
+                    uint32_t id = ids[i];
+                    if (id != 0 && id < index.size() && index[id] >= 0) {
+                        gradient[index[id]] += a;
+                    }
+                    continue;
+                }
+                int32_t r = rhs[i];
+                REAL_T dl, dr;
+                StatementTape<REAL_T>::LocalPartials(static_cast<Operation> (op[i]), value[l],
+                        r < 0 ? REAL_T(0) : value[r], value[i], dl, dr);
+                this->adjoint_m[l] += a * dl;
+                if (r >= 0) {
+                    this->adjoint_m[r] += a * dr;
+                }
+            }
+        }
     };
 
     /**
-     * Expression template for subtracting a expression template from a 
-     * constant.
-     * 
-     * @param lhs
-     * @param rhs
+     * Interface class for storing variable information. The point of this class 
+     * is to provide flexibility of the storage for the variables information. 
+     * For instance, it may be desired to store the data in a database or on 
+     * the disk rather than in random access memory. 
      */
-    template <class REAL_T, class RHS>
-    struct MinusConstant : public ExpressionBase<REAL_T, MinusConstant<REAL_T, RHS> > {
-
-        MinusConstant(const REAL_T & lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : rhs_m(rhs.Cast()), lhs_m(lhs), value_m(lhs_m - rhs_m.GetValue()) {
-        }
+    template<class REAL_T>
+    class VariableStorage {
+        template<class REAL_TT, int> friend class Variable;
+        uint32_t id_m;
+    public:
 
-        inline const REAL_T GetValue() const {
-            return value_m;
-        }
+        VariableStorage() : id_m(0) {
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return -1.0 * rhs_m.Derivative(id, found);
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            rhs_m.GetIdRange(min, max);
-        }
+        virtual ~VariableStorage() {
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (MINUS));
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->rhs_m.PushIds(ids);
+        uint32_t GetId() const {
+            return id_m;
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->rhs_m.PushStorage(ids);
+        void SetId(uint32_t id) {
+            this->id_m = id;
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->rhs_m.PushIds(ids);
-        }
 
 
-    private:
-        const RHS& rhs_m;
-        const REAL_T lhs_m;
-        const REAL_T value_m;
 
-    };
+        /**
+         * Abstract function to set the value for this storage object.
+         * 
+         * @param value
+         */
+        virtual void SetValue(const REAL_T &value) = 0;
 
-    /**
-     * Operator for subtracting a constant from a expression template.
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class LHS>
-    inline const
-    ConstantMinus<REAL_T, LHS> operator-(const ExpressionBase<REAL_T, LHS>& lhs,
-    const REAL_T& rhs) {
-        return ConstantMinus<REAL_T, LHS > (lhs.Cast(), rhs);
-    }
+        /**
+         * Abstract function to get the value for this storage object.
+         * 
+         * @return 
+         */
+        virtual const REAL_T GetValue() = 0;
 
-    /**
-     * Operator for subtracting a expression template from a constant.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class RHS>
-    inline const
-    MinusConstant<REAL_T, RHS> operator-(const REAL_T& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return MinusConstant<REAL_T, RHS > (lhs, rhs.Cast());
-    }
+        /**
+         * Abstract function to return a derivative value for the independent 
+         * variable with id.
+         * 
+         * @param id
+         * @return 
+         */
+        virtual const std::pair<bool, REAL_T> GetDerivative(const uint32_t &id) = 0;
 
-    /**
-     * Expression template for multiplying a constant by a expression template.
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS>
-    struct ConstantTimes : public ExpressionBase<REAL_T, ConstantTimes<REAL_T, LHS> > {
+        /**
+         * Abstract function to set the derivative value with respect to 
+         * independent variable with id.
+         * 
+         * @param id
+         * @param value
+         * @return 
+         */
+        virtual void SetDerivative(const std::pair<bool, REAL_T> &entry, const uint32_t &id) = 0;
 
-        ConstantTimes(const REAL_T & lhs, const ExpressionBase<REAL_T, LHS>& rhs)
-        : lhs_m(lhs), rhs_m(rhs.Cast()), value_m(lhs_m * rhs_m.GetValue()) {
-        }
+        /**
+         * Abstract function to add a independent variable id to 
+         * this storage set.
+         * 
+         * @param id
+         * @return 
+         */
+        virtual void AddId(const uint32_t &id) = 0;
 
-        inline const REAL_T GetValue() const {
-            return value_m;
-        }
+        /**
+         * Abstract function to merge add id's from another VariableStorage 
+         * to this one.
+         * 
+         * @param id
+         * @return 
+         */
+        virtual void Merge(VariableStorage<REAL_T>* other) = 0;
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return rhs_m.Derivative(id, found) * lhs_m;
-        }
+        /**
+         * Abstract function to return the size of the derivative info list. 
+         * These are the computed intermediately stored derivatives. 
+         * 
+         */
+        virtual uint32_t DerivativeInfoSize() = 0;
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            rhs_m.GetIdRange(min, max);
-        }
+        /**
+         * Abstract function to clear the derivative info for this storage.
+         * 
+         * @return 
+         */
+        virtual void ClearDerivativeInfo() = 0;
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (MULTIPLY));
-        }
-
-        inline void PushIds(IdsSet & ids) const {
-            this->rhs_m.PushIds(ids);
-        }
+        /**
+         * Abstract function to add a expression statement to the statement list. 
+         * Statements are the recorded nodes in the expressions computational graph
+         * and are stored in post-order(Post-order expression tree).
+         * @param statement
+         */
+        virtual void AddStatement(const Statement<REAL_T> &statement) = 0;
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->rhs_m.PushStorage(ids);
-        }
+        /**
+         * Abstract function to return the size of the statement list size.
+         * @return 
+         */
+        virtual uint32_t ExpressionSize() = 0;
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->rhs_m.PushIds(ids);
-        }
+        /**
+         * Abstract function to retrieve a Statement object at a given index.
+         * 
+         * @param index
+         * @return 
+         */
+        virtual Statement<REAL_T> StatementAt(const uint32_t &index) = 0;
 
+        /**
+         * Abstract function to clear the statement list.
+         */
+        virtual void ClearExpression() = 0;
 
+        /**
+         * Rests this storage.
+         */
+        virtual void Reset() = 0;
 
-    private:
-        const REAL_T lhs_m;
-        const LHS& rhs_m;
-        const REAL_T value_m;
     };
 
     /**
-     * Expression template for multiplying a expression template by a constant.
-     * @param lhs
-     * @param rhs
+     * Adjoint tape used for reverse mode derivative accumulation. Each
+     * recorded statement stores only the local partial derivatives of its
+     * result with respect to its operands. A single reverse sweep over the
+     * tape yields the derivative of a result w.r.t. every independent
+     * variable, so the cost of a gradient is a small multiple of the cost of
+     * a function evaluation regardless of the number of parameters.
+     *
+     * Independent variables are referenced by their unique identifier,
+     * dependent variables by the index of the statement that produced them.
+     * Statement indices grow monotonically across calls to Reset, so a
+     * Variable holding an index from a previous recording is treated as a
+     * constant. They are 64 bit and never wrap around, a wrapped counter 
+     * would hand out indices still held by Variables of earlier recordings.
+     * Skip leaves a gap in the indices of a recording, for statements 
+     * recorded on another tape in between.
+     *
+     * Each thread's Context owns one tape.
      */
-    template <class REAL_T, class LHS>
-    struct TimesConstant : public ExpressionBase<REAL_T, TimesConstant<REAL_T, LHS> > {
+    template<class REAL_T>
+    class AdjointTape {
+        //begin offset of each statement into operands_m and partials_m.
+        std::vector<uint32_t> offsets_m;
+        //operand slot, independent variables are flagged with INDEPENDENT.
+        std::vector<uint32_t> operands_m;
+        //local partial derivative w.r.t. each operand.
+        std::vector<REAL_T> partials_m;
 
-        TimesConstant(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() * rhs_m) {
+        std::vector<REAL_T> adjoints_m;
+        std::vector<REAL_T> independent_adjoints_m;
+
+        uint64_t base_m; //index of the first statement of this recording
+        uint64_t next_m; //index of the next statement
+        uint32_t max_id_m; //largest independent id on the tape
+
+        //first index and slot of each run of consecutive indices in this
+        //recording, a new run starts after a Skip.
+        std::vector<uint64_t> run_index_m;
+        std::vector<uint32_t> run_slot_m;
+
+        bool swept_m;
+        uint64_t swept_index_m;
+        size_t swept_size_m;
+
+        static const uint32_t INDEPENDENT = 0x80000000;
+
+    public:
+
+        AdjointTape() : base_m(1), next_m(1), max_id_m(0), swept_m(false),
+        swept_index_m(0), swept_size_m(0) {
+            this->offsets_m.push_back(0);
+            this->run_index_m.push_back(this->base_m);
+            this->run_slot_m.push_back(0);
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        /**
+         * Discards all recorded statements. Variables that refer to
+         * statements recorded before the reset become constants.
+         */
+        void Reset() {
+            this->offsets_m.clear();
+            this->offsets_m.push_back(0);
+            this->operands_m.clear();
+            this->partials_m.clear();
+            this->max_id_m = 0;
+            this->swept_m = false;
+            this->base_m = this->next_m;
+            this->run_index_m.assign(1, this->base_m);
+            this->run_slot_m.assign(1, 0);
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return rhs_m * lhs_m.Derivative(id, found);
+        /**
+         * Discards all recorded statements and numbers the next statements
+         * after those of other, so no Variable recorded on other is live on
+         * this tape.
+         *
+         * @param other
+         */
+        void Follow(const AdjointTape<REAL_T> &other) {
+            if (other.next_m > this->next_m) {
+                this->next_m = other.next_m;
+            }
+            this->Reset();
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
+        /**
+         * Numbers the next statement after those of other, keeping the 
+         * current recording. The indices in between are never live on this
+         * tape, so Variables recorded on other stay constants here.
+         *
+         * @param other
+         */
+        void Skip(const AdjointTape<REAL_T> &other) {
+            if (other.next_m <= this->next_m) {
+                return;
+            }
+            if (this->Size() == 0) {
+                this->base_m = other.next_m;
+                this->run_index_m.assign(1, this->base_m);
+            } else if (this->run_slot_m.back() == this->Size()) {
+                this->run_index_m.back() = other.next_m;
+            } else {
+                this->run_index_m.push_back(other.next_m);
+                this->run_slot_m.push_back(static_cast<uint32_t> (this->Size()));
+            }
+            this->next_m = other.next_m;
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
-            statements.push_back(Statement<REAL_T > (MULTIPLY));
+        /**
+         * Exchanges the recordings of this tape and other.
+         *
+         * @param other
+         */
+        void Swap(AdjointTape<REAL_T> &other) {
+            this->offsets_m.swap(other.offsets_m);
+            this->operands_m.swap(other.operands_m);
+            this->partials_m.swap(other.partials_m);
+            this->adjoints_m.swap(other.adjoints_m);
+            this->independent_adjoints_m.swap(other.independent_adjoints_m);
+            this->run_index_m.swap(other.run_index_m);
+            this->run_slot_m.swap(other.run_slot_m);
+            std::swap(this->base_m, other.base_m);
+            std::swap(this->next_m, other.next_m);
+            std::swap(this->max_id_m, other.max_id_m);
+            std::swap(this->swept_m, other.swept_m);
+            std::swap(this->swept_index_m, other.swept_index_m);
+            std::swap(this->swept_size_m, other.swept_size_m);
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
+        /**
+         * Finds the slot of the statement at index in the current 
+         * recording. Returns false if index is not live on this tape.
+         *
+         * @param index
+         * @param slot
+         * @return
+         */
+        inline bool Slot(const uint64_t &index, uint32_t &slot) const {
+            if (index < this->base_m || index >= this->next_m) {
+                return false;
+            }
+            size_t r = this->run_index_m.size() - 1;
+            if (index < this->run_index_m[r]) {
+                r = std::upper_bound(this->run_index_m.begin(), this->run_index_m.end(), index)
+                        - this->run_index_m.begin() - 1;
+            }
+            uint64_t s = this->run_slot_m[r] + (index - this->run_index_m[r]);
+            uint64_t end = r + 1 < this->run_slot_m.size() ? this->run_slot_m[r + 1] : this->Size();
+            if (s >= end) {
+                return false;
+            }
+            slot = static_cast<uint32_t> (s);
+            return true;
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
+        /**
+         * Returns true if index refers to a statement in the current
+         * recording.
+         *
+         * @param index
+         * @return
+         */
+        inline bool IsLive(const uint64_t &index) const {
+            uint32_t slot;
+            return this->Slot(index, slot);
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
+        /**
+         * Adds the partial derivative of the statement being recorded w.r.t.
+         * the independent variable with unique identifier id.
+         *
+         * @param id
+         * @param partial
+         */
+        inline void PushIndependent(const uint32_t &id, const REAL_T &partial) {
+            if (id > this->max_id_m) {
+                this->max_id_m = id;
+            }
+            this->operands_m.push_back(id | INDEPENDENT);
+            this->partials_m.push_back(partial);
         }
 
+        /**
+         * Adds the partial derivative of the statement being recorded w.r.t.
+         * the result of the statement at index. Indices that are not part of
+         * the current recording are ignored.
+         *
+         * @param index
+         * @param partial
+         */
+        inline void PushDependent(const uint64_t &index, const REAL_T &partial) {
+            uint32_t slot;
+            if (this->Slot(index, slot)) {
+                this->operands_m.push_back(slot);
+                this->partials_m.push_back(partial);
+            }
+        }
+
+        /**
+         * Closes the statement being recorded and returns the index of its
+         * result. If no active operands were pushed the result is a constant
+         * and zero is returned.
+         *
+         * @return
+         */
+        inline uint64_t Commit() {
+            if (this->operands_m.size() == this->offsets_m.back()) {
+                return 0;
+            }
+            this->offsets_m.push_back(static_cast<uint32_t> (this->operands_m.size()));
+            return this->next_m++;
+        }
+
+        /**
+         * Number of statements in the current recording.
+         *
+         * @return
+         */
+        size_t Size() const {
+            return this->offsets_m.size() - 1;
+        }
+
+        /**
+         * Reverse sweep seeded with the statement at index. Afterwards the
+         * adjoint of every independent variable holds the derivative of that
+         * statement's result w.r.t. the independent variable.
+         *
+         * @param index
+         */
+        void Reverse(const uint64_t &index) {
+            if (this->swept_m && this->swept_index_m == index
+                    && this->swept_size_m == this->Size()) {
+                return;
+            }
+
+            this->independent_adjoints_m.assign(this->max_id_m + 1, static_cast<REAL_T> (0.0));
+
+            uint32_t seed;
+            if (this->Slot(index, seed)) {
+                this->adjoints_m.assign(seed + 1, static_cast<REAL_T> (0.0));
+                this->adjoints_m[seed] = static_cast<REAL_T> (1.0);
+
+                for (int64_t s = seed; s >= 0; s--) {
+                    const REAL_T a = this->adjoints_m[s];
+                    if (a == static_cast<REAL_T> (0.0)) {
+                        continue;
+                    }
+                    const uint32_t end = this->offsets_m[s + 1];
+                    for (uint32_t j = this->offsets_m[s]; j < end; j++) {
+                        const uint32_t operand = this->operands_m[j];
+                        if (operand & INDEPENDENT) {
+                            this->independent_adjoints_m[operand & ~INDEPENDENT] += a * this->partials_m[j];
+                        } else {
+                            this->adjoints_m[operand] += a * this->partials_m[j];
+                        }
+                    }
+                }
+            }
+
+            this->swept_m = true;
+            this->swept_index_m = index;
+            this->swept_size_m = this->Size();
+        }
+
+        /**
+         * Returns the derivative of the result of the statement at index
+         * w.r.t. the independent variable with unique identifier id. The
+         * reverse sweep is only run if the tape or the seed changed since the
+         * last call.
+         *
+         * @param index
+         * @param id
+         * @return
+         */
+        const REAL_T Adjoint(const uint64_t &index, const uint32_t &id) {
+            this->Reverse(index);
+            if (id < this->independent_adjoints_m.size()) {
+                return this->independent_adjoints_m[id];
+            }
+            return static_cast<REAL_T> (0.0);
+        }
 
-    private:
-        const LHS& lhs_m;
-        const REAL_T rhs_m;
-        const REAL_T value_m;
     };
 
     /**
-     * Operator for multiplying a expression template by a constant.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
+     * Sparse gradient storage. Entries are (id, derivative) pairs kept sorted
+     * by the unique identifier of the independent variable, so a Variable
+     * only holds entries for the independent variables it actually depends
+     * on. Lookups are a binary search and two gradients are added with a
+     * single linear merge.
      */
-    template <class REAL_T, class LHS>
-    inline const
-    TimesConstant<REAL_T, LHS> operator*(const ExpressionBase<REAL_T, LHS>& lhs,
-    const REAL_T& rhs) {
-        return TimesConstant<REAL_T, LHS > (lhs.Cast(), rhs);
-    }
+    template<class REAL_T>
+    class SparseGradient {
+    public:
+        typedef std::pair<uint32_t, REAL_T> Entry;
+        typedef typename std::vector<Entry>::iterator iterator;
+        typedef typename std::vector<Entry>::const_iterator const_iterator;
 
-    /**
-     * Operator for multiplying a constant by a expression template.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
-     */
-    template <class REAL_T, class RHS>
-    inline const
-    ConstantTimes<REAL_T, RHS> operator*(const REAL_T& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return ConstantTimes<REAL_T, RHS > (lhs, rhs.Cast());
-    }
+    private:
+        std::vector<Entry> entries_m;
 
-    /**
-     * Expression template for dividing a constant by a expression template.
-     * 
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class RHS>
-    struct ConstantDivide : public ExpressionBase<REAL_T, ConstantDivide<REAL_T, RHS> > {
+        struct EntryLess {
 
-        ConstantDivide(const REAL_T & lhs, const ExpressionBase<REAL_T, RHS>& rhs)
-        : rhs_m(rhs.Cast()), lhs_m(lhs), value_m(lhs_m / rhs_m.GetValue()) {
+            inline bool operator()(const Entry &a, const Entry &b) const {
+                return a.first < b.first;
+            }
+
+            inline bool operator()(const Entry &a, const uint32_t &id) const {
+                return a.first < id;
+            }
+        };
+
+    public:
+
+        /**
+         * Finds the derivative w.r.t. the independent variable with unique
+         * identifier id.
+         * 
+         * @param id
+         * @param value set to the derivative if found
+         * @return true if an entry exists for id
+         */
+        inline bool Find(const uint32_t &id, REAL_T &value) const {
+            const_iterator it = std::lower_bound(this->entries_m.begin(),
+                    this->entries_m.end(), id, EntryLess());
+            if (it != this->entries_m.end() && it->first == id) {
+                value = it->second;
+                return true;
+            }
+            return false;
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        /**
+         * Appends an entry. Call Sort afterwards if entries were not pushed
+         * in increasing id order.
+         * 
+         * @param id
+         * @param value
+         */
+        inline void PushBack(const uint32_t &id, const REAL_T &value) {
+            this->entries_m.push_back(Entry(id, value));
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return ( -rhs_m.Derivative(id, found) * lhs_m) / (rhs_m.GetValue() * rhs_m.GetValue());
+        /**
+         * Restores increasing id order after unordered calls to PushBack.
+         */
+        inline void Sort() {
+            std::sort(this->entries_m.begin(), this->entries_m.end(), EntryLess());
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            rhs_m.GetIdRange(min, max);
+        /**
+         * Sorts the entries by id and sums entries that share an id. Entries
+         * that are already strictly increasing are left untouched.
+         */
+        void Consolidate() {
+            size_t size = this->entries_m.size();
+            size_t i = 1;
+            while (i < size && this->entries_m[i - 1].first < this->entries_m[i].first) {
+                i++;
+            }
+            if (i >= size) {
+                return;
+            }
+
+            this->Sort();
+            size_t last = 0;
+            for (i = 1; i < size; i++) {
+                if (this->entries_m[i].first == this->entries_m[last].first) {
+                    this->entries_m[last].second += this->entries_m[i].second;
+                } else {
+                    this->entries_m[++last] = this->entries_m[i];
+                }
+            }
+            this->entries_m.resize(last + 1);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
-            this->rhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (DIVIDE));
+        /**
+         * Sets this gradient to a + b, merging both sorted entry lists.
+         * 
+         * @param a
+         * @param b
+         */
+        void Sum(const SparseGradient<REAL_T> &a, const SparseGradient<REAL_T> &b) {
+            this->entries_m.clear();
+            this->entries_m.reserve(a.Size() + b.Size());
+            const_iterator ait = a.begin();
+            const_iterator bit = b.begin();
+            while (ait != a.end() && bit != b.end()) {
+                if (ait->first < bit->first) {
+                    this->entries_m.push_back(*ait++);
+                } else if (bit->first < ait->first) {
+                    this->entries_m.push_back(*bit++);
+                } else {
+                    this->entries_m.push_back(Entry(ait->first, ait->second + bit->second));
+                    ++ait;
+                    ++bit;
+                }
+            }
+            this->entries_m.insert(this->entries_m.end(), ait, a.end());
+            this->entries_m.insert(this->entries_m.end(), bit, b.end());
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->rhs_m.PushIds(ids);
+        /**
+         * Copies the entries of other, reusing the existing buffer when it
+         * is large enough.
+         * 
+         * @param other
+         */
+        inline void Assign(const SparseGradient<REAL_T> &other) {
+            if (this != &other) {
+                this->entries_m.assign(other.entries_m.begin(), other.entries_m.end());
+            }
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->rhs_m.PushStorage(ids);
+        /**
+         * Exchanges buffers with other in constant time.
+         * 
+         * @param other
+         */
+        inline void Swap(SparseGradient<REAL_T> &other) {
+            this->entries_m.swap(other.entries_m);
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->rhs_m.PushIds(ids);
+        inline void Reserve(const size_t &size) {
+            this->entries_m.reserve(size);
         }
 
+        inline void Clear() {
+            this->entries_m.clear();
+        }
 
+        inline size_t Size() const {
+            return this->entries_m.size();
+        }
 
-    private:
-        const RHS& rhs_m;
-        REAL_T lhs_m;
-        REAL_T value_m;
-    };
+        inline bool Empty() const {
+            return this->entries_m.empty();
+        }
 
-    /**
-     * Expression template for dividing a expression template by a constant.
-     * @param lhs
-     * @param rhs
-     */
-    template <class REAL_T, class LHS>
-    struct DivideConstant : public ExpressionBase<REAL_T, DivideConstant<REAL_T, LHS> > {
+        inline const Entry& operator[](const size_t &index) const {
+            return this->entries_m[index];
+        }
 
-        DivideConstant(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
-        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() / rhs_m) {
+        inline iterator begin() {
+            return this->entries_m.begin();
         }
 
-        inline const REAL_T GetValue() const {
-            return value_m;
+        inline iterator end() {
+            return this->entries_m.end();
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return (lhs_m.Derivative(id, found) * rhs_m) / (rhs_m * rhs_m);
+        inline const_iterator begin() const {
+            return this->entries_m.begin();
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            lhs_m.GetIdRange(min, max);
+        inline const_iterator end() const {
+            return this->entries_m.end();
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->lhs_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
-            statements.push_back(Statement<REAL_T > (DIVIDE));
-        }
+    };
 
-        inline void PushIds(IdsSet & ids) const {
-            this->lhs_m.PushIds(ids);
+    /**
+     * A comparison taken while branches were being recorded, with both 
+     * operands compiled so the comparison can be re-evaluated when a 
+     * statement tape is replayed at new values. If the outcome changes, the
+     * recorded control flow no longer holds and the model must be retaped.
+     */
+    template<class REAL_T>
+    struct Branch {
+        Comparison comparison_m;
+        bool outcome_m;
+        StatementTape<REAL_T> lhs_m;
+        StatementTape<REAL_T> rhs_m;
+
+        static bool Compare(const Comparison &comparison, const REAL_T &lhs, const REAL_T &rhs) {
+            switch (comparison) {
+                case EQUAL_TO: return lhs == rhs;
+                case NOT_EQUAL_TO: return lhs != rhs;
+                case LESS: return lhs < rhs;
+                case GREATER: return lhs > rhs;
+                case LESS_EQUAL: return lhs <= rhs;
+                case GREATER_EQUAL: return lhs >= rhs;
+            }
+            return false;
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->lhs_m.PushStorage(ids);
+        /**
+         * Re-evaluates the comparison at new values x of the mapped 
+         * independent variables. Returns true if the outcome is unchanged.
+         * 
+         * @param index - id to position, -1 if not wanted
+         * @param x
+         * @return 
+         */
+        bool Replay(const std::vector<int32_t> &index, const std::vector<REAL_T> &x) {
+            this->lhs_m.Replay(index, x);
+            this->rhs_m.Replay(index, x);
+            return Compare(this->comparison_m, this->lhs_m.GetValue(), this->rhs_m.GetValue()) == this->outcome_m;
         }
+    };
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->lhs_m.PushIds(ids);
-        }
+    /**
+     * Finds where a comparison is recorded. The operands of a comparison 
+     * are searched for a Variable whose context is recording branches, so
+     * the branch goes to the context of the Variable's group.
+     */
+    template<class REAL_T>
+    struct BranchRecorder {
+        std::vector<Branch<REAL_T> >* branches_m;
+        ExpressionGraph<REAL_T>* graph_m; //graph of the operand nodes
 
+        BranchRecorder() : branches_m(NULL), graph_m(NULL) {
+        }
 
-    private:
-        const LHS& lhs_m;
-        REAL_T rhs_m;
-        REAL_T value_m;
+        /**
+         * Number of contexts of the calling thread that are recording 
+         * branches. While it is zero comparisons skip the search.
+         * 
+         * @return 
+         */
+        static uint32_t& Recording() {
+#if __cplusplus >= 201103L
+            static thread_local uint32_t recording = 0;
+#else
+            static __thread uint32_t recording = 0;
+#endif
+            return recording;
+        }
     };
 
     /**
-     * Operator for dividing a expression template by a constant.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
+     * Scratch space used while computing forward mode gradients, so
+     * assignments do not allocate once the buffers have grown. Each
+     * thread's Context owns one workspace.
      */
-    template <class REAL_T, class LHS>
-    inline const
-    DivideConstant<REAL_T, LHS> operator/(const ExpressionBase<REAL_T, LHS>& lhs,
-    const REAL_T& rhs) {
-        return DivideConstant<REAL_T, LHS > (lhs.Cast(), rhs);
-    }
+    template<class REAL_T>
+    struct GradientWorkspace {
+        SparseGradient<REAL_T> entries_m;
+        SparseGradient<REAL_T> sum_m;
+        StatementList<REAL_T> statements_m; //scratch for arbitrary order assignments.
+        StatementTape<REAL_T> tape_m; //scratch for Diff.
+        std::vector<int32_t> index_m; //scratch for Diff, id to position.
+    };
 
     /**
-     * Operator for dividing a constant by a expression template.
-     * 
-     * @param lhs
-     * @param rhs
-     * @return 
+     * Automatic differentiation context of a thread. Holds the unique 
+     * identifier space, the recording flags, the adjoint tape, the 
+     * arbitrary order expression graph and the forward mode workspace. 
+     * Each thread has its own context for every REAL_T and group, so 
+     * models evaluated on different threads share no mutable state. A new thread starts with the default settings; the
+     * flags must be set on the thread that evaluates the model.
      */
-    template <class REAL_T, class RHS>
-    inline const
-    ConstantDivide<REAL_T, RHS> operator/(const REAL_T& lhs,
-    const ExpressionBase<REAL_T, RHS>& rhs) {
-        return ConstantDivide<REAL_T, RHS > (lhs, rhs.Cast());
-    }
+    template<class REAL_T, int group = 0 >
+    class Context {
+        uint32_t id_m; //last unique identifier issued
+        bool is_recording_m;
+        bool is_supporting_arbitrary_order_m;
+        bool is_using_adjoint_tape_m;
+        bool is_recording_branches_m;
+        AdjointTape<REAL_T> tape_m;
+        ExpressionGraph<REAL_T> graph_m;
+        GradientWorkspace<REAL_T> workspace_m;
+        std::vector<Branch<REAL_T> > branches_m;
+
+        Context() : id_m(0), is_recording_m(true),
+        is_supporting_arbitrary_order_m(false), is_using_adjoint_tape_m(false),
+        is_recording_branches_m(false) {
+        }
 
-    /**
-     * Expression template for taking the sine of an expression.
-     * 
-     * @param a
-     */
-    template <class REAL_T, class EXPR>
-    struct Sin : public ExpressionBase<REAL_T, Sin<REAL_T, EXPR> > {
+    public:
 
-        Sin(const ExpressionBase<REAL_T, EXPR>& a)
-        : expr_m(a.Cast()) {
+        /**
+         * Returns the context of the calling thread.
+         * 
+         * @return 
+         */
+        static Context<REAL_T, group>& Instance() {
+#if __cplusplus >= 201103L
+            static thread_local Context<REAL_T, group> context;
+            return context;
+#else
+            static __thread Context<REAL_T, group>* context = NULL;
+            if (!context) {
+                context = new Context<REAL_T, group>();
+            }
+            return *context;
+#endif
         }
 
-        inline const REAL_T GetValue() const {
-            return std::sin(expr_m.GetValue());
+        /**
+         * Issues a new unique identifier for an independent variable.
+         * 
+         * @return 
+         */
+        inline uint32_t NextId() {
+            return ++this->id_m;
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+        /**
+         * The last unique identifier issued.
+         * 
+         * @return 
+         */
+        inline uint32_t CurrentId() const {
+            return this->id_m;
+        }
 
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                return dx * std::cos(expr_m.GetValue());
-            } else {
-                return 0.0;
-            }
+        inline bool IsRecording() const {
+            return this->is_recording_m;
         }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+        inline void SetRecording(const bool &is_recording) {
+            this->is_recording_m = is_recording;
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (SIN));
+        inline bool IsSupportingArbitraryOrder() const {
+            return this->is_supporting_arbitrary_order_m;
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+        inline void SetSupportArbitraryOrder(const bool &support_arbitrary_order) {
+            this->is_supporting_arbitrary_order_m = support_arbitrary_order;
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+        inline bool IsUsingAdjointTape() const {
+            return this->is_using_adjoint_tape_m;
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+        inline void SetUseAdjointTape(const bool &use_adjoint_tape) {
+            this->is_using_adjoint_tape_m = use_adjoint_tape;
         }
 
+        inline AdjointTape<REAL_T>& GetAdjointTape() {
+            return this->tape_m;
+        }
 
+        /**
+         * The arbitrary order recording shared by the Variables of this
+         * thread.
+         */
+        inline ExpressionGraph<REAL_T>& GetExpressionGraph() {
+            return this->graph_m;
+        }
+
+        inline GradientWorkspace<REAL_T>& GetGradientWorkspace() {
+            return this->workspace_m;
+        }
+
+        /**
+         * If true, comparisons of expressions are recorded as branches.
+         */
+        inline bool IsRecordingBranches() const {
+            return this->is_recording_branches_m;
+        }
+
+        inline void SetRecordBranches(const bool &record_branches) {
+            if (record_branches != this->is_recording_branches_m) {
+                if (record_branches) {
+                    BranchRecorder<REAL_T>::Recording()++;
+                } else {
+                    BranchRecorder<REAL_T>::Recording()--;
+                }
+            }
+            this->is_recording_branches_m = record_branches;
+        }
+
+        /**
+         * Branches recorded since the last clear.
+         */
+        inline std::vector<Branch<REAL_T> >& GetBranches() {
+            return this->branches_m;
+        }
 
-    private:
-        const EXPR& expr_m;
     };
 
+    template<class REAL_T, int group = 0 >
+    class Variable;
+
     /**
-     * Expression template for taking the cosine of an expression.
-     * 
-     * @param expr
+     * Base class for expression types.
      */
-    template <class REAL_T, class EXPR>
-    struct Cos : public ExpressionBase<REAL_T, Cos<REAL_T, EXPR> > {
+    template<class REAL_T, class A>
+    struct ExpressionBase {
+    public:
+
+        ExpressionBase() : id_m(0) {
 
-        Cos(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
         }
 
-        inline const REAL_T GetValue() const {
-            return std::cos(expr_m.GetValue());
+        ExpressionBase(const uint32_t & id) : id_m(id) {
+
         }
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+        const A & Cast() const {
+            return static_cast<const A&> (*this);
+        }
 
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                return dx*-1.0 * std::sin(expr_m.GetValue());
-            } else {
-                return 0.0;
-            }
+        inline const REAL_T GetValue() const {
+            return Cast().GetValue();
+        }
+
+        inline uint32_t GetId() const {
+            return id_m;
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            Cast().GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (COS));
+        /**
+         * Compute or get the stored derivative with respect to the unique 
+         * identifier id.
+         * 
+         * @param id
+         * @param found
+         * @return 
+         */
+        const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            return Cast().Derivative(id, found);
         }
 
-        inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+        void Push(StatementList<REAL_T> &statements) const {
+            Cast().Push(statements);
         }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+        void PushIds(IdsSet & ids) const {
+            Cast().PushIds(ids);
         }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+        /**
+         * Pushes the partial derivatives of this expression w.r.t. its 
+         * Variable operands, scaled by coefficient, onto tape. Each node 
+         * computes its local partials once and passes coefficient times the
+         * partial down to its operands, so one traversal reaches every 
+         * Variable leaf. tape is either the AdjointTape (reverse mode) or
+         * the GradientWorkspace (forward mode).
+         * 
+         * @param tape
+         * @param coefficient
+         */
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            Cast().PushAdjoints(tape, coefficient);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            Cast().PushStorage(ids);
         }
 
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > &ids) const {
+            Cast().PushIds(ids);
+        }
 
+        uint32_t id_m;
 
     private:
-        const EXPR& expr_m;
+
+        ExpressionBase& operator=(const ExpressionBase & exp) const {
+
+            return *this;
+        };
     };
 
     /**
-     * Expression template for computing the tangent of a expression template.
+     * Expression template for constant values.
      * 
-     * @param expr
+     * @param value
      */
-    template <class REAL_T, class EXPR>
-    struct Tan : public ExpressionBase<REAL_T, Tan<REAL_T, EXPR> > {
+    template<class REAL_T>
+    struct Constant : public ExpressionBase<REAL_T, Constant<REAL_T> > {
+
+        Constant(const REAL_T & value) : value_m(value) {
 
-        Tan(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::tan(expr_m.GetValue());
+            return this->value_m;
+
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            return 0;
+        };
 
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr_m.GetValue();
-                return dx * ((1.0 / std::cos(v))*(1.0 / std::cos(v)));
-            } else {
-                return 0.0;
-            }
-        }
-
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, value_m));
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (TAN));
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &, const REAL_T &) const {
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+
         }
 
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+
+        }
+
+        const REAL_T &value_m;
+
 
-    private:
-        const EXPR& expr_m;
     };
 
     /**
-     * Expression template for computing the inverse Sine of an expression 
-     * template.
      * 
-     * @param expr
+     * Expression template for addition.
+     * 
+     * @param lhs
+     * @param rhs
      */
-    template <class REAL_T, class EXPR>
-    struct ASin : public ExpressionBase<REAL_T, ASin<REAL_T, EXPR> > {
-
-        ASin(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+    template <class REAL_T, class LHS, class RHS>
+    struct Add : public ExpressionBase<REAL_T, Add<REAL_T, LHS, RHS> > {
+
+        Add(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() + rhs_m.GetValue()) {
+
+
         }
 
         inline const REAL_T GetValue() const {
-            return std::asin(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr_m.GetValue();
-                return (dx * static_cast<REAL_T> (1.0) / std::pow((static_cast<REAL_T> (1.0) - std::pow(v, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
-            } else {
-                return 0.0;
-            }
+            return lhs_m.Derivative(id, found) + rhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (ASIN));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (PLUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient);
+            this->rhs_m.PushAdjoints(tape, coefficient);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
 
 
+
     private:
-        const EXPR& expr_m;
+
+        const LHS& lhs_m;
+        const RHS& rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the inverse cosine of an expression
-     * template.
-     * 
+     * Operator for addition of two expression templates.
      * @param a
+     * @param b
+     * @return 
      */
-    template <class REAL_T, class EXPR>
-    struct ACos : public ExpressionBase<REAL_T, ACos<REAL_T, EXPR> > {
+    template <class REAL_T, class LHS, class RHS>
+    inline
+    Add<REAL_T, LHS, RHS> operator+(const ExpressionBase<REAL_T, LHS>& a,
+    const ExpressionBase<REAL_T, RHS>& b) {
+        return Add<REAL_T, LHS, RHS > (a.Cast(), b.Cast());
+    }
 
-        ACos(const ExpressionBase<REAL_T, EXPR>& a)
-        : expr_m(a.Cast()) {
+    /**
+     * Expression template for subtraction.
+     * 
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS, class RHS>
+    struct Minus : public ExpressionBase<REAL_T, Minus<REAL_T, LHS, RHS> > {
+
+        Minus(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() - rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::acos(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr_m.GetValue();
-                return (dx * static_cast<REAL_T> (-1.0) / std::pow((static_cast<REAL_T> (1.0) - std::pow(v, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
-            } else {
-                return 0.0;
-            }
+            return lhs_m.Derivative(id, found) - rhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (ACOS));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient);
+            this->rhs_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
 
+    protected:
+
 
     private:
-        const EXPR& expr_m;
+
+        const LHS& lhs_m;
+        const RHS& rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the inverse tangent of an expression 
-     * template.
-     * @param expr
+     * Operator for expression template subtraction.
+     * 
+     * @param lhs
+     * @param rhs
+     * @return 
      */
-    template <class REAL_T, class EXPR>
-    struct ATan : public ExpressionBase<REAL_T, ATan<REAL_T, EXPR> > {
+    template <class REAL_T, class LHS, class RHS>
+    inline const
+    Minus<REAL_T, LHS, RHS> operator-(const ExpressionBase<REAL_T, LHS>& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return Minus<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+    }
 
-        ATan(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+    /**
+     * Expression template for multiplying two expression templates.
+     * 
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS, class RHS>
+    struct Multiply : public ExpressionBase<REAL_T, Multiply<REAL_T, LHS, RHS> > {
+
+        Multiply(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() * rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::atan(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr_m.GetValue();
-                return (dx * 1.0 / (v * v + 1.0));
-            } else {
-                return 0.0;
-            }
+            //            std::cout << "* " << a_.Derivative(id, found) << "*" << b_ << " +" <<a_ << " * " <<  b_.Derivative(id, found) << " \n";
+            return lhs_m.Derivative(id, found) * rhs_m.GetValue() + lhs_m.GetValue() * rhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (ATAN));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient * rhs_m.GetValue());
+            this->rhs_m.PushAdjoints(tape, coefficient * lhs_m.GetValue());
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
 
+
     private:
-        const EXPR& expr_m;
+
+        const LHS& lhs_m;
+        const RHS& rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the two argument inverse tangent,
-     * where both arguments are expression templates. 
+     * Operator for expression template multiplication.
      * 
+     * @param lhs
+     * @param rhs
+     * @return 
      */
-    template <class REAL_T, class EXPR1, class EXPR2>
-    struct ATan2 : public ExpressionBase<REAL_T, ATan2<REAL_T, EXPR1, EXPR2> > {
+    template <class REAL_T, class LHS, class RHS>
+    inline const
+    Multiply<REAL_T, LHS, RHS> operator*(const ExpressionBase<REAL_T, LHS>& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return Multiply<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+    }
 
-        ATan2(const ExpressionBase<REAL_T, EXPR1>& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
-        : expr1_m(expr1.Cast()), expr2_m(expr2.Cast()) {
+    /**
+     * Expression template for division.
+     * 
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS, class RHS>
+    struct Divide : public ExpressionBase<REAL_T, Divide<REAL_T, LHS, RHS> > {
+
+        Divide(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()), value_m(lhs_m.GetValue() / rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::atan2(expr1_m.GetValue(), expr2_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            REAL_T dx = expr1_m.Derivative(id, found);
-
-            if (found) {
-                REAL_T v = expr1_m.GetValue();
-                REAL_T v2 = expr2_m.GetValue();
-
-                return ((v2 * dx) / (v * v + (v2 * v2)));
-            } else {
-                return 0.0;
-            }
+            return (lhs_m.Derivative(id, found) * rhs_m.GetValue() - lhs_m.GetValue() * rhs_m.Derivative(id, found)) / (rhs_m.GetValue() * rhs_m.GetValue());
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr1_m.GetIdRange(min, max);
-            expr2_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr1_m.Push(statements);
-            this->expr2_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (ATAN));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (DIVIDE));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T r = rhs_m.GetValue();
+            this->lhs_m.PushAdjoints(tape, coefficient / r);
+            this->rhs_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient * value_m / r);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr1_m.PushIds(ids);
-            this->expr2_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr1_m.PushStorage(ids);
-            this->expr2_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr1_m.PushIds(ids);
-            this->expr2_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
 
     private:
 
-        const EXPR1& expr1_m;
-        const EXPR2& expr2_m;
+        const LHS& lhs_m;
+        const RHS& rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     *Expression template for computing the two argument inverse tangent, where
-     * the second argument is a constant. 
+     * Operator for expression template division.
      * 
+     * @param lhs
+     * @param rhs
+     * @return 
      */
-    template <class REAL_T, class EXPR1>
-    struct ATan2Constant : public ExpressionBase<REAL_T, ATan2Constant<REAL_T, EXPR1> > {
-
-        ATan2Constant(const ExpressionBase<REAL_T, EXPR1>& expr1, const REAL_T & expr2)
-        : expr1_m(expr1.Cast()), expr2_m(expr2) {
-        }
+    template <class REAL_T, class LHS, class RHS>
+    inline const
+    Divide<REAL_T, LHS, RHS> operator/(const ExpressionBase<REAL_T, LHS>& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return Divide<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+    }
 
-        inline const REAL_T GetValue() const {
-            return std::atan2(expr1_m.GetValue(), expr2_m);
-        }
+    /**
+     * Expression template for adding a constant to a expression template.
+     * 
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS>
+    struct ConstantAdd : public ExpressionBase<REAL_T, ConstantAdd<REAL_T, LHS> > {
 
-        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            REAL_T dx = expr1_m.Derivative(id, found);
+        ConstantAdd(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() + rhs) {
+        }
 
-            if (found) {
-                REAL_T v = expr1_m.GetValue();
-                REAL_T v2 = expr2_m;
+        inline const REAL_T GetValue() const {
+            //            this->value_m = lhs_m.GetValue() + rhs_m;
+            return value_m;
+        }
 
-                return ((v2 * dx) / (v * v + (v2 * v2)));
-            } else {
-                return 0.0;
-            }
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            return lhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr1_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr1_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, expr2_m));
-            statements.push_back(Statement<REAL_T > (ATAN2));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
+            statements.push_back(Statement<REAL_T > (PLUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr1_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr1_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr1_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
 
-    private:
 
-        const EXPR1& expr1_m;
-        const REAL_T& expr2_m;
+    private:
+        const LHS& lhs_m;
+        REAL_T rhs_m;
+        REAL_T value_m;
     };
 
     /**
-     *Expression template for computing the two argument inverse tangent,
-     * where the first argument is a constant. 
+     * Operator for adding a constant value to a expression templates.
+     * @param lhs
+     * @param rhs
+     * @return 
+     */
+    template <class REAL_T, class LHS>
+    inline const
+    ConstantAdd<REAL_T, LHS> operator+(const ExpressionBase<REAL_T, LHS>& lhs,
+    const REAL_T& rhs) {
+        return ConstantAdd<REAL_T, LHS > (lhs.Cast(), rhs);
+    }
+
+    template <class REAL_T, class RHS>
+    inline const
+    ConstantAdd<REAL_T, RHS> operator+(const REAL_T& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return ConstantAdd<REAL_T, RHS > (rhs.Cast(), lhs);
+    }
+
+    /**
+     * Expression template for subtracting a constant from a expression 
+     * template.
      * 
+     * @param lhs
+     * @param rhs
      */
-    template <class REAL_T, class EXPR2>
-    struct ConstantATan2 : public ExpressionBase<REAL_T, ConstantATan2<REAL_T, EXPR2> > {
+    template <class REAL_T, class LHS>
+    struct ConstantMinus : public ExpressionBase<REAL_T, ConstantMinus<REAL_T, LHS> > {
 
-        ConstantATan2(const REAL_T& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
-        : expr1_m(expr1), expr2_m(expr2.Cast()) {
+        ConstantMinus(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() - rhs_m) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::atan2(expr1_m, expr2_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            REAL_T dx = 0;
-
-            if (found) {
-                REAL_T v = expr1_m;
-                REAL_T v2 = expr2_m.GetValue();
-
-                return ((v2 * dx) / (v * v + (v2 * v2)));
-            } else {
-                return 0.0;
-            }
+            return lhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr2_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, expr1_m));
-            expr2_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (ATAN2));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr2_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr2_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr2_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
 
-    private:
 
-        const REAL_T& expr1_m;
-        const ExpressionBase<REAL_T, EXPR2>& expr2_m;
+
+    private:
+        const LHS& lhs_m;
+        REAL_T rhs_m;
+        REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the square root of an expression
-     * template.
-     * @param a
+     * Expression template for subtracting a expression template from a 
+     * constant.
+     * 
+     * @param lhs
+     * @param rhs
      */
-    template <class REAL_T, class EXPR>
-    struct Sqrt : public ExpressionBase<REAL_T, Sqrt<REAL_T, EXPR> > {
+    template <class REAL_T, class RHS>
+    struct MinusConstant : public ExpressionBase<REAL_T, MinusConstant<REAL_T, RHS> > {
 
-        Sqrt(const ExpressionBase<REAL_T, EXPR>& a)
-        : expr_m(a.Cast()) {
+        MinusConstant(const REAL_T & lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : rhs_m(rhs.Cast()), lhs_m(lhs), value_m(lhs_m - rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::sqrt(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                return dx * .5 / std::sqrt(expr_m.GetValue());
-            } else {
-                return 0.0;
-            }
+            return -1.0 * rhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (SQRT));
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->rhs_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
+
     private:
-        const EXPR& expr_m;
+        const RHS& rhs_m;
+        const REAL_T lhs_m;
+        const REAL_T value_m;
+
     };
 
     /**
-     *Expression template for computing the power of a expression template,
-     * where both arguments are expression templates. 
+     * Operator for subtracting a constant from a expression template.
+     * @param lhs
+     * @param rhs
+     * @return 
      */
-    template <class REAL_T, class EXPR1, class EXPR2>
-    struct Pow : public ExpressionBase<REAL_T, Pow<REAL_T, EXPR1, EXPR2> > {
+    template <class REAL_T, class LHS>
+    inline const
+    ConstantMinus<REAL_T, LHS> operator-(const ExpressionBase<REAL_T, LHS>& lhs,
+    const REAL_T& rhs) {
+        return ConstantMinus<REAL_T, LHS > (lhs.Cast(), rhs);
+    }
 
-        Pow(const ExpressionBase<REAL_T, EXPR1>& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
-        : expr1_m(expr1.Cast()), expr2_m(expr2.Cast()) {
+    /**
+     * Operator for subtracting a expression template from a constant.
+     * 
+     * @param lhs
+     * @param rhs
+     * @return 
+     */
+    template <class REAL_T, class RHS>
+    inline const
+    MinusConstant<REAL_T, RHS> operator-(const REAL_T& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return MinusConstant<REAL_T, RHS > (lhs, rhs.Cast());
+    }
+
+    /**
+     * Expression template for multiplying a constant by a expression template.
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS>
+    struct ConstantTimes : public ExpressionBase<REAL_T, ConstantTimes<REAL_T, LHS> > {
+
+        ConstantTimes(const REAL_T & lhs, const ExpressionBase<REAL_T, LHS>& rhs)
+        : lhs_m(lhs), rhs_m(rhs.Cast()), value_m(lhs_m * rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::pow(expr1_m.GetValue(), expr2_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            REAL_T dx = expr1_m.Derivative(id, found);
-            REAL_T dx2 = expr2_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr1_m.GetValue();
-                REAL_T v2 = expr2_m.GetValue();
-
-                return (dx * v2) *std::pow(v, (v2 - static_cast<REAL_T> (1.0)));
-            } else {
-                return 0.0;
-            }
+            return rhs_m.Derivative(id, found) * lhs_m;
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr1_m.GetIdRange(min, max);
-            expr2_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr1_m.Push(statements);
-            this->expr2_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (POW));
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->rhs_m.PushAdjoints(tape, coefficient * lhs_m);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr1_m.PushIds(ids);
-            this->expr2_m.Push(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr1_m.PushStorage(ids);
-            this->expr2_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr1_m.PushIds(ids);
-            this->expr2_m.Push(ids);
+            this->rhs_m.PushIds(ids);
         }
 
 
-    private:
 
-        const EXPR1& expr1_m;
-        const EXPR2& expr2_m;
+    private:
+        const REAL_T lhs_m;
+        const LHS& rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the power of a expression template, 
-     * where the second argument(the power) is a constant.
-     * 
-     * @param expr
-     * @param constant
+     * Expression template for multiplying a expression template by a constant.
+     * @param lhs
+     * @param rhs
      */
-    template <class REAL_T, class EXPR>
-    struct PowConstant : public ExpressionBase<REAL_T, PowConstant<REAL_T, EXPR> > {
+    template <class REAL_T, class LHS>
+    struct TimesConstant : public ExpressionBase<REAL_T, TimesConstant<REAL_T, LHS> > {
 
-        PowConstant(const ExpressionBase<REAL_T, EXPR>& expr, const REAL_T & constant)
-        : expr_m(expr.Cast()), constant_m(constant) {
+        TimesConstant(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() * rhs_m) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::pow(expr_m.GetValue(), constant_m);
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            REAL_T dx = expr_m.Derivative(id, found);
-            if (found) {
-                REAL_T v = expr_m.GetValue();
-                REAL_T v2 = constant_m;
-
-                return (dx * v2) *std::pow(v, (v2 - static_cast<REAL_T> (1.0)));
-            } else {
-                return 0.0;
-            }
+            return rhs_m * lhs_m.Derivative(id, found);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CONSTANT, constant_m));
-            statements.push_back(Statement<REAL_T > (POW));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient * rhs_m);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
-    private:
 
-        const EXPR& expr_m;
-        const REAL_T& constant_m;
+    private:
+        const LHS& lhs_m;
+        const REAL_T rhs_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template to compute the the value of a constant raised to 
-     * an expression template.
+     * Operator for multiplying a expression template by a constant.
      * 
-     * @param constant
-     * @param expr
+     * @param lhs
+     * @param rhs
+     * @return 
      */
-    template <class REAL_T, class EXPR>
-    struct ConstantPow : public ExpressionBase<REAL_T, ConstantPow<REAL_T, EXPR> > {
+    template <class REAL_T, class LHS>
+    inline const
+    TimesConstant<REAL_T, LHS> operator*(const ExpressionBase<REAL_T, LHS>& lhs,
+    const REAL_T& rhs) {
+        return TimesConstant<REAL_T, LHS > (lhs.Cast(), rhs);
+    }
 
-        ConstantPow(const REAL_T& constant, const ExpressionBase<REAL_T, EXPR>& expr)
-        : constant_m(constant), expr_m(expr.Cast()) {
+    /**
+     * Operator for multiplying a constant by a expression template.
+     * 
+     * @param lhs
+     * @param rhs
+     * @return 
+     */
+    template <class REAL_T, class RHS>
+    inline const
+    ConstantTimes<REAL_T, RHS> operator*(const REAL_T& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return ConstantTimes<REAL_T, RHS > (lhs, rhs.Cast());
+    }
+
+    /**
+     * Expression template for dividing a constant by a expression template.
+     * 
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class RHS>
+    struct ConstantDivide : public ExpressionBase<REAL_T, ConstantDivide<REAL_T, RHS> > {
+
+        ConstantDivide(const REAL_T & lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : rhs_m(rhs.Cast()), lhs_m(lhs), value_m(lhs_m / rhs_m.GetValue()) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::pow(constant_m, expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            //          REAL_t dx = 0.0;
-            //            if (found) {
-            //                REAL_t v = a_;
-            //                REAL_t v2 = b_.GetValue();
-            //
-            //                return (dx * v2) *std::pow(v, (v2 - 1.0));
-            //            } else {
-            //                return 0.0;
-            //            }
-            return 0.0;
+            return ( -rhs_m.Derivative(id, found) * lhs_m) / (rhs_m.GetValue() * rhs_m.GetValue());
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.push_back(Statement<REAL_T > (CONSTANT, constant_m));
-            this->expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (POW));
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, lhs_m));
+            this->rhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (DIVIDE));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->rhs_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient * value_m / rhs_m.GetValue());
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
         }
 
-    private:
 
-        const REAL_T& constant_m;
-        const ExpressionBase<REAL_T, EXPR>& expr_m;
+
+    private:
+        const RHS& rhs_m;
+        REAL_T lhs_m;
+        REAL_T value_m;
     };
 
     /**
-     * Expression template to compute the log of an expression template.
-     * @param expr
+     * Expression template for dividing a expression template by a constant.
+     * @param lhs
+     * @param rhs
      */
-    template <class REAL_T, class EXPR>
-    struct Log : public ExpressionBase<REAL_T, Log<REAL_T, EXPR> > {
+    template <class REAL_T, class LHS>
+    struct DivideConstant : public ExpressionBase<REAL_T, DivideConstant<REAL_T, LHS> > {
 
-        Log(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        DivideConstant(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T & rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs), value_m(lhs_m.GetValue() / rhs_m) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::log(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-
-            REAL_T dx = expr_m.Derivative(id, found);
-
-            if (found) {
-                return (dx) / expr_m.GetValue();
-            } else {
-                return 0.0;
-            }
+            return (lhs_m.Derivative(id, found) * rhs_m) / (rhs_m * rhs_m);
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            lhs_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (LOG));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->lhs_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, rhs_m));
+            statements.push_back(Statement<REAL_T > (DIVIDE));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient / rhs_m);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->lhs_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->lhs_m.PushIds(ids);
         }
 
 
     private:
-        const EXPR& expr_m;
+        const LHS& lhs_m;
+        REAL_T rhs_m;
+        REAL_T value_m;
     };
 
     /**
-     * Expression template to compute the log base 10 of an expression 
-     * template.
+     * Operator for dividing a expression template by a constant.
      * 
-     * @param expr
+     * @param lhs
+     * @param rhs
+     * @return 
+     */
+    template <class REAL_T, class LHS>
+    inline const
+    DivideConstant<REAL_T, LHS> operator/(const ExpressionBase<REAL_T, LHS>& lhs,
+    const REAL_T& rhs) {
+        return DivideConstant<REAL_T, LHS > (lhs.Cast(), rhs);
+    }
+
+    /**
+     * Operator for dividing a constant by a expression template.
+     * 
+     * @param lhs
+     * @param rhs
+     * @return 
+     */
+    template <class REAL_T, class RHS>
+    inline const
+    ConstantDivide<REAL_T, RHS> operator/(const REAL_T& lhs,
+    const ExpressionBase<REAL_T, RHS>& rhs) {
+        return ConstantDivide<REAL_T, RHS > (lhs, rhs.Cast());
+    }
+
+    /**
+     * Expression template for taking the sine of an expression.
+     * 
+     * @param a
      */
     template <class REAL_T, class EXPR>
-    struct Log10 : public ExpressionBase<REAL_T, Log10<REAL_T, EXPR> > {
+    struct Sin : public ExpressionBase<REAL_T, Sin<REAL_T, EXPR> > {
 
-        Log10(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        Sin(const ExpressionBase<REAL_T, EXPR>& a)
+        : expr_m(a.Cast()), value_m(std::sin(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::log10(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
             REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
-                return (dx * 1.0) / (expr_m.GetValue() * std::log(10.0));
+                return dx * std::cos(expr_m.GetValue());
             } else {
                 return 0.0;
             }
@@ -2005,9 +5067,14 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (LOG10));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (SIN));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * std::cos(expr_m.GetValue()));
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2023,32 +5090,33 @@ namespace ad {
         }
 
 
+
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template to compute e raised to a expression template.
+     * Expression template for taking the cosine of an expression.
+     * 
      * @param expr
      */
     template <class REAL_T, class EXPR>
-    struct Exp : public ExpressionBase<REAL_T, Exp<REAL_T, EXPR> > {
+    struct Cos : public ExpressionBase<REAL_T, Cos<REAL_T, EXPR> > {
 
-        Exp(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        Cos(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::cos(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::exp(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
-            bool f = false;
-            REAL_T dx = expr_m.Derivative(id, f);
-            if (f) {
-                found = true;
-                return dx * std::exp(expr_m.GetValue());
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx*-1.0 * std::sin(expr_m.GetValue());
             } else {
                 return 0.0;
             }
@@ -2058,9 +5126,14 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (EXP));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (COS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient * std::sin(expr_m.GetValue()));
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2076,50 +5149,34 @@ namespace ad {
         }
 
 
+
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template used to protect overflow in exp calculations. 
-     * 
-     * Author: Dave Fournier.
-     * Original implementation in ADMB.
-     * 
-     * Source: http://admb-project.org/documentation/api/mfexp_8cpp_source.html
+     * Expression template for computing the tangent of a expression template.
      * 
      * @param expr
      */
     template <class REAL_T, class EXPR>
-    struct MFExp : public ExpressionBase<REAL_T, MFExp<REAL_T, EXPR> > {
+    struct Tan : public ExpressionBase<REAL_T, Tan<REAL_T, EXPR> > {
 
-        MFExp(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()), value_m(Compute(expr.GetValue())) {
+        Tan(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::tan(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
             return value_m;
-            //
-            //            return std::exp(expr_m.GetValue());
-        }
-
-        const REAL_T Compute(const REAL_T & value) {
-            REAL_T x = value;
-            REAL_T b = REAL_T(60);
-            if (x <= b && x >= REAL_T(-1) * b) {
-                return std::exp(x);
-            } else if (x > b) {
-                return std::exp(b)*(REAL_T(1.) + REAL_T(2.) * (x - b)) / (REAL_T(1.) + x - b);
-            } else {
-                return std::exp(REAL_T(-1) * b)*(REAL_T(1.) - x - b) / (REAL_T(1.) + REAL_T(2.) * (REAL_T(-1) * x - b));
-            }
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
             REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
-                return dx * this->GetValue();
+                REAL_T v = expr_m.GetValue();
+                return dx * ((1.0 / std::cos(v))*(1.0 / std::cos(v)));
             } else {
                 return 0.0;
             }
@@ -2129,12 +5186,17 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (EXP));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (TAN));
         }
 
-        inline void PushIds(IdsSet & ids) const {
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * (static_cast<REAL_T> (1.0) + value_m * value_m));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
             this->expr_m.PushIds(ids);
         }
 
@@ -2146,33 +5208,35 @@ namespace ad {
             this->expr_m.PushIds(ids);
         }
 
+
     private:
         const EXPR& expr_m;
-        REAL_T value_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the hyperbolic sine of an expression 
+     * Expression template for computing the inverse Sine of an expression 
      * template.
      * 
      * @param expr
      */
     template <class REAL_T, class EXPR>
-    struct Sinh : public ExpressionBase<REAL_T, Sinh<REAL_T, EXPR> > {
+    struct ASin : public ExpressionBase<REAL_T, ASin<REAL_T, EXPR> > {
 
-        Sinh(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        ASin(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::asin(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::sinh(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
             REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
-                return dx * std::cosh(expr_m.GetValue());
+                REAL_T v = expr_m.GetValue();
+                return (dx * static_cast<REAL_T> (1.0) / std::pow((static_cast<REAL_T> (1.0) - std::pow(v, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
             } else {
                 return 0.0;
             }
@@ -2182,9 +5246,15 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (SINH));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ASIN));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr_m.GetValue();
+            this->expr_m.PushAdjoints(tape, coefficient / std::sqrt(static_cast<REAL_T> (1.0) - v * v));
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2200,30 +5270,35 @@ namespace ad {
         }
 
 
+
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the hyperbolic cosine of an 
-     * expression template.
+     * Expression template for computing the inverse cosine of an expression
+     * template.
+     * 
+     * @param a
      */
     template <class REAL_T, class EXPR>
-    struct Cosh : public ExpressionBase<REAL_T, Cosh<REAL_T, EXPR> > {
+    struct ACos : public ExpressionBase<REAL_T, ACos<REAL_T, EXPR> > {
 
-        Cosh(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        ACos(const ExpressionBase<REAL_T, EXPR>& a)
+        : expr_m(a.Cast()), value_m(std::acos(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::cosh(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
             REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
-                return dx * std::sinh(expr_m.GetValue());
+                REAL_T v = expr_m.GetValue();
+                return (dx * static_cast<REAL_T> (-1.0) / std::pow((static_cast<REAL_T> (1.0) - std::pow(v, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
             } else {
                 return 0.0;
             }
@@ -2233,9 +5308,15 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (COSH));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ACOS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr_m.GetValue();
+            this->expr_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient / std::sqrt(static_cast<REAL_T> (1.0) - v * v));
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2251,25 +5332,26 @@ namespace ad {
         }
 
 
+
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for computing the hyperbolic tangent of an expresison
+     * Expression template for computing the inverse tangent of an expression 
      * template.
-     * 
      * @param expr
      */
     template <class REAL_T, class EXPR>
-    struct Tanh : public ExpressionBase<REAL_T, Tanh<REAL_T, EXPR> > {
+    struct ATan : public ExpressionBase<REAL_T, ATan<REAL_T, EXPR> > {
 
-        Tanh(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        ATan(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::atan(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::tanh(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
@@ -2277,7 +5359,7 @@ namespace ad {
             REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
                 REAL_T v = expr_m.GetValue();
-                return dx * (1.0 / std::cosh(v))*(1.0 / std::cosh(v));
+                return (dx * 1.0 / (v * v + 1.0));
             } else {
                 return 0.0;
             }
@@ -2287,9 +5369,15 @@ namespace ad {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (TANH));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ATAN));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr_m.GetValue();
+            this->expr_m.PushAdjoints(tape, coefficient / (v * v + static_cast<REAL_T> (1.0)));
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2304,133 +5392,255 @@ namespace ad {
             this->expr_m.PushIds(ids);
         }
 
+
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for handling the absolute value of a expression 
-     * template.
-     * @param expr
+     * Expression template for computing the two argument inverse tangent,
+     * where both arguments are expression templates. 
+     * 
      */
-    template <class REAL_T, class EXPR>
-    struct Fabs : public ExpressionBase<REAL_T, Fabs<REAL_T, EXPR> > {
+    template <class REAL_T, class EXPR1, class EXPR2>
+    struct ATan2 : public ExpressionBase<REAL_T, ATan2<REAL_T, EXPR1, EXPR2> > {
 
-        Fabs(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        ATan2(const ExpressionBase<REAL_T, EXPR1>& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
+        : expr1_m(expr1.Cast()), expr2_m(expr2.Cast()), value_m(std::atan2(expr1_m.GetValue(), expr2_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::fabs(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr1_m.Derivative(id, found);
+            REAL_T dx2 = expr2_m.Derivative(id, found);
 
-            REAL_T dx = expr_m.Derivative(id, found);
             if (found) {
-                REAL_T v = expr_m.GetValue();
-                return (dx * v) / std::fabs(v);
+                REAL_T v = expr1_m.GetValue();
+                REAL_T v2 = expr2_m.GetValue();
+
+                return ((v2 * dx - v * dx2) / (v * v + (v2 * v2)));
             } else {
                 return 0.0;
             }
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            expr1_m.GetIdRange(min, max);
+            expr2_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (FABS));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr1_m.Push(statements);
+            this->expr2_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ATAN2));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr1_m.GetValue();
+            REAL_T v2 = expr2_m.GetValue();
+            REAL_T d = v * v + v2 * v2;
+            this->expr1_m.PushAdjoints(tape, coefficient * v2 / d);
+            this->expr2_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient * v / d);
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->expr1_m.PushIds(ids);
+            this->expr2_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->expr1_m.PushStorage(ids);
+            this->expr2_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->expr1_m.PushIds(ids);
+            this->expr2_m.PushIds(ids);
         }
 
+
     private:
-        const EXPR& expr_m;
+
+        const EXPR1& expr1_m;
+        const EXPR2& expr2_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for handling the floor of an expression template.
+     *Expression template for computing the two argument inverse tangent, where
+     * the second argument is a constant. 
      * 
-     * @param a
      */
-    template <class REAL_T, class EXPR>
-    struct Floor : public ExpressionBase<REAL_T, Floor<REAL_T, EXPR> > {
+    template <class REAL_T, class EXPR1>
+    struct ATan2Constant : public ExpressionBase<REAL_T, ATan2Constant<REAL_T, EXPR1> > {
 
-        Floor(const ExpressionBase<REAL_T, EXPR>& a)
-        : expr_m(a.Cast()) {
+        ATan2Constant(const ExpressionBase<REAL_T, EXPR1>& expr1, const REAL_T & expr2)
+        : expr1_m(expr1.Cast()), expr2_m(expr2), value_m(std::atan2(expr1_m.GetValue(), expr2_m)) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::floor(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return 0.0;
+            REAL_T dx = expr1_m.Derivative(id, found);
+
+            if (found) {
+                REAL_T v = expr1_m.GetValue();
+                REAL_T v2 = expr2_m;
+
+                return ((v2 * dx) / (v * v + (v2 * v2)));
+            } else {
+                return 0.0;
+            }
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
-            expr_m.GetIdRange(min, max);
+            expr1_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (FLOOR));
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr1_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, expr2_m));
+            statements.push_back(Statement<REAL_T > (ATAN2));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr1_m.GetValue();
+            REAL_T v2 = expr2_m;
+            this->expr1_m.PushAdjoints(tape, coefficient * v2 / (v * v + v2 * v2));
         }
 
         inline void PushIds(IdsSet & ids) const {
-            this->expr_m.PushIds(ids);
+            this->expr1_m.PushIds(ids);
         }
 
         inline void PushStorage(VariableStorage<REAL_T> * ids) const {
-            this->expr_m.PushStorage(ids);
+            this->expr1_m.PushStorage(ids);
         }
 
         inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            this->expr_m.PushIds(ids);
+            this->expr1_m.PushIds(ids);
         }
 
+
     private:
-        const EXPR& expr_m;
+
+        const EXPR1& expr1_m;
+        const REAL_T& expr2_m;
+        const REAL_T value_m;
     };
 
     /**
-     * Expression template for handling the ceiling of an expression template.
-     * @param expr
+     *Expression template for computing the two argument inverse tangent,
+     * where the first argument is a constant. 
+     * 
+     */
+    template <class REAL_T, class EXPR2>
+    struct ConstantATan2 : public ExpressionBase<REAL_T, ConstantATan2<REAL_T, EXPR2> > {
+
+        ConstantATan2(const REAL_T& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
+        : expr1_m(expr1), expr2_m(expr2.Cast()), value_m(std::atan2(expr1_m, expr2_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx2 = expr2_m.Derivative(id, found);
+
+            if (found) {
+                REAL_T v = expr1_m;
+                REAL_T v2 = expr2_m.GetValue();
+
+                return ((static_cast<REAL_T> (-1.0) * v * dx2) / (v * v + (v2 * v2)));
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr2_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, expr1_m));
+            expr2_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ATAN2));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr1_m;
+            REAL_T v2 = expr2_m.GetValue();
+            this->expr2_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient * v / (v * v + v2 * v2));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr2_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr2_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr2_m.PushIds(ids);
+        }
+
+
+    private:
+
+        const REAL_T& expr1_m;
+        const ExpressionBase<REAL_T, EXPR2>& expr2_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for computing the square root of an expression
+     * template.
+     * @param a
      */
     template <class REAL_T, class EXPR>
-    struct Ceil : public ExpressionBase<REAL_T, Ceil<REAL_T, EXPR> > {
+    struct Sqrt : public ExpressionBase<REAL_T, Sqrt<REAL_T, EXPR> > {
 
-        Ceil(const ExpressionBase<REAL_T, EXPR>& expr)
-        : expr_m(expr.Cast()) {
+        Sqrt(const ExpressionBase<REAL_T, EXPR>& a)
+        : expr_m(a.Cast()), value_m(std::sqrt(expr_m.GetValue())) {
         }
 
         inline const REAL_T GetValue() const {
-            return std::ceil(expr_m.GetValue());
+            return value_m;
         }
 
         inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
-            return 0.0;
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * .5 / std::sqrt(expr_m.GetValue());
+            } else {
+                return 0.0;
+            }
         }
 
         void GetIdRange(uint32_t &min, uint32_t & max) const {
             expr_m.GetIdRange(min, max);
         }
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
+        void Push(StatementList<REAL_T> &statements) const {
             expr_m.Push(statements);
-            statements.push_back(Statement<REAL_T > (CEIL));
+            statements.push_back(Statement<REAL_T > (SQRT));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * static_cast<REAL_T> (.5) / value_m);
         }
 
         inline void PushIds(IdsSet & ids) const {
@@ -2447,2288 +5657,6145 @@ namespace ad {
 
     private:
         const EXPR& expr_m;
+        const REAL_T value_m;
     };
 
+    /**
+     *Expression template for computing the power of a expression template,
+     * where both arguments are expression templates. 
+     */
+    template <class REAL_T, class EXPR1, class EXPR2>
+    struct Pow : public ExpressionBase<REAL_T, Pow<REAL_T, EXPR1, EXPR2> > {
 
-}
-
+        Pow(const ExpressionBase<REAL_T, EXPR1>& expr1, const ExpressionBase<REAL_T, EXPR2>& expr2)
+        : expr1_m(expr1.Cast()), expr2_m(expr2.Cast()), value_m(std::pow(expr1_m.GetValue(), expr2_m.GetValue())) {
+        }
 
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
 
-/**
- * Utility functions added to the standard name space. Mostly cmath overloads 
- * for expressions.
- */
-namespace std {
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr1_m.Derivative(id, found);
+            REAL_T dx2 = expr2_m.Derivative(id, found);
+            if (found) {
+                REAL_T v = expr1_m.GetValue();
+                REAL_T v2 = expr2_m.GetValue();
 
-    /**
-     * Write the expression value to std::ostream out.
-     * @param out
-     * @param exp
-     * @return 
-     */
-    template<class REAL_T, class A>
-    inline std::ostream& operator<<(std::ostream &out, const ad::ExpressionBase<REAL_T, A> &exp) {
-        out << exp.GetValue();
-        return out;
-    }
+                REAL_T d = (dx * v2) *std::pow(v, (v2 - static_cast<REAL_T> (1.0)));
+                if (dx2 != static_cast<REAL_T> (0.0) && v > static_cast<REAL_T> (0.0)) {
+                    d += dx2 * value_m * std::log(v);
+                }
+                return d;
+            } else {
+                return 0.0;
+            }
+        }
 
-    /**
-     * Override for the sin function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::Sin<REAL_T, EXPR> sin(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Sin<REAL_T, EXPR > (expr.Cast());
-    }
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr1_m.GetIdRange(min, max);
+            expr2_m.GetIdRange(min, max);
+        }
 
-    /**
-     * Override for the cos function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::Cos<REAL_T, EXPR> cos(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Cos<REAL_T, EXPR > (expr.Cast());
-    }
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr1_m.Push(statements);
+            this->expr2_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (POW));
+        }
 
-    /**
-     * Override for the tan function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::Tan<REAL_T, EXPR> tan(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Tan<REAL_T, EXPR > (expr.Cast());
-    }
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr1_m.GetValue();
+            REAL_T v2 = expr2_m.GetValue();
+            this->expr1_m.PushAdjoints(tape, coefficient * v2 * std::pow(v, v2 - static_cast<REAL_T> (1.0)));
+            if (v > static_cast<REAL_T> (0.0)) {
+                this->expr2_m.PushAdjoints(tape, coefficient * value_m * std::log(v));
+            }
+        }
 
-    /**
-     * Override for the asin function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::ASin<REAL_T, EXPR> asin(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::ASin<REAL_T, EXPR > (expr.Cast());
-    }
+        inline void PushIds(IdsSet & ids) const {
+            this->expr1_m.PushIds(ids);
+            this->expr2_m.PushIds(ids);
+        }
 
-    /**
-     * Override for the asin function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::ACos<REAL_T, EXPR> acos(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::ACos<REAL_T, EXPR > (expr.Cast());
-    }
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr1_m.PushStorage(ids);
+            this->expr2_m.PushStorage(ids);
+        }
 
-    /**
-     * Override for the atan function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::ATan<REAL_T, EXPR> atan(const ad::ExpressionBase<REAL_T, EXPR>& a) {
-        return ad::ATan<REAL_T, EXPR > (a.Cast());
-    }
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr1_m.PushIds(ids);
+            this->expr2_m.Push(ids);
+        }
 
-    /**
-     * Override for the atan2 function in namespace std.
-     * 
-     * @param expr1
-     * @param expr2
-     * @return 
-     */
-    template <class REAL_T, class EXPR1, class EXPR2>
-    inline
-    ad::ATan2<REAL_T, EXPR1, EXPR2> atan2(const ad::ExpressionBase<REAL_T, EXPR1>& expr1,
-    const ad::ExpressionBase<REAL_T, EXPR2>& expr2) {
-        return ad::ATan2<REAL_T, EXPR1, EXPR2 > (expr1.Cast(), expr2.Cast());
-    }
 
-    /**
-     * Override for the atan2 function in namespace std.
-     * 
-     * @param expr1
-     * @param val
-     * @return 
-     */
-    template <class REAL_T, class EXPR>
-    inline
-    ad::ATan2Constant<REAL_T, EXPR> atan2(const ad::ExpressionBase<REAL_T, EXPR>& expr,
-    const REAL_T& val) {
-        return ad::ATan2Constant<REAL_T, EXPR > (expr.Cast(), val);
-    }
+    private:
 
-    /**
-     * Override for the atan2 function in namespace std.
-     * 
-     * @param expr1
-     * @param expr2
-     * @return 
-     */
-    template <class REAL_T, class EXPR>
-    inline
-    ad::ConstantATan2<REAL_T, EXPR> atan2(const REAL_T& val,
-    const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::ConstantATan2<REAL_T, EXPR > (val, expr.Cast());
-    }
+        const EXPR1& expr1_m;
+        const EXPR2& expr2_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the sqrt function in namespace std.
+     * Expression template for computing the power of a expression template, 
+     * where the second argument(the power) is a constant.
      * 
      * @param expr
-     * @return 
+     * @param constant
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Sqrt<REAL_T, EXPR> sqrt(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Sqrt<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct PowConstant : public ExpressionBase<REAL_T, PowConstant<REAL_T, EXPR> > {
 
-    /**
-     * Override for the pow function in namespace std.
-     * 
-     * @param expr1
-     * @param expr2
-     * @return 
-     */
-    template <class REAL_T, class EXPR1, class EXPR2>
-    inline
-    ad::Pow<REAL_T, EXPR1, EXPR2> pow(const ad::ExpressionBase<REAL_T, EXPR1>& expr1,
-    const ad::ExpressionBase<REAL_T, EXPR2>& expr2) {
-        return ad::Pow<REAL_T, EXPR1, EXPR2 > (expr1.Cast(), expr2.Cast());
-    }
+        PowConstant(const ExpressionBase<REAL_T, EXPR>& expr, const REAL_T & constant)
+        : expr_m(expr.Cast()), constant_m(constant), value_m(std::pow(expr_m.GetValue(), constant_m)) {
+        }
 
-    /**
-     * Override for the pow function in namespace std.
-     * 
-     * @param expr1
-     * @param val
-     * @return 
-     */
-    template <class REAL_T, class EXPR>
-    inline
-    ad::PowConstant<REAL_T, EXPR> pow(const ad::ExpressionBase<REAL_T, EXPR>& expr,
-    const REAL_T& val) {
-        return ad::PowConstant<REAL_T, EXPR > (expr.Cast(), val);
-    }
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
 
-    /**
-     * Override for the pow function in namespace std.
-     * 
-     * @param val
-     * @param expr2
-     * @return 
-     */
-    template <class REAL_T, class EXPR>
-    inline
-    ad::ConstantPow<REAL_T, EXPR> pow(const REAL_T& val,
-    const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::ConstantPow<REAL_T, EXPR > (val, expr.Cast());
-    }
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                REAL_T v = expr_m.GetValue();
+                REAL_T v2 = constant_m;
+
+                return (dx * v2) *std::pow(v, (v2 - static_cast<REAL_T> (1.0)));
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, constant_m));
+            statements.push_back(Statement<REAL_T > (POW));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            REAL_T v = expr_m.GetValue();
+            this->expr_m.PushAdjoints(tape, coefficient * constant_m * std::pow(v, constant_m - static_cast<REAL_T> (1.0)));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+
+        const EXPR& expr_m;
+        const REAL_T& constant_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the log function in namespace std.
+     * Expression template to compute the the value of a constant raised to 
+     * an expression template.
      * 
+     * @param constant
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Log<REAL_T, EXPR> log(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Log<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct ConstantPow : public ExpressionBase<REAL_T, ConstantPow<REAL_T, EXPR> > {
 
-    /**
-     * Override for the log function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::Log10<REAL_T, EXPR> log10(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Log10<REAL_T, EXPR > (expr.Cast());
-    }
+        ConstantPow(const REAL_T& constant, const ExpressionBase<REAL_T, EXPR>& expr)
+        : constant_m(constant), expr_m(expr.Cast()), value_m(std::pow(constant_m, expr_m.GetValue())) {
+        }
 
-    /**
-     * Override for the exp function in namespace std.
-     * 
-     * @param expr
-     * @return 
-     */
-    template<class REAL_T, class EXPR>
-    inline const ad::Exp<REAL_T, EXPR> exp(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Exp<REAL_T, EXPR > (expr.Cast());
-    }
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
 
-    template<class REAL_T, class EXPR>
-    inline const const ad::MFExp<REAL_T, EXPR> mfexp(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::MFExp<REAL_T, EXPR > (expr.Cast());
-    }
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * this->GetValue() * std::log(constant_m);
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, constant_m));
+            this->expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (POW));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * value_m * std::log(constant_m));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+
+        const REAL_T& constant_m;
+        const ExpressionBase<REAL_T, EXPR>& expr_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the sinh function in namespace std.
-     * 
+     * Expression template to compute the log of an expression template.
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Sinh<REAL_T, EXPR> sinh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Sinh<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct Log : public ExpressionBase<REAL_T, Log<REAL_T, EXPR> > {
+
+        Log(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::log(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+
+            if (found) {
+                return (dx) / expr_m.GetValue();
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient / expr_m.GetValue());
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the cosh function in namespace std.
+     * Expression template to compute the log base 10 of an expression 
+     * template.
      * 
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Cosh<REAL_T, EXPR> cosh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Cosh<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct Log10 : public ExpressionBase<REAL_T, Log10<REAL_T, EXPR> > {
+
+        Log10(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::log10(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return (dx * 1.0) / (expr_m.GetValue() * std::log(10.0));
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG10));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient / (expr_m.GetValue() * std::log(static_cast<REAL_T> (10.0))));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the tanh function in namespace std.
-     * 
+     * Expression template to compute e raised to a expression template.
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Tanh<REAL_T, EXPR> tanh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Tanh<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct Exp : public ExpressionBase<REAL_T, Exp<REAL_T, EXPR> > {
+
+        Exp(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::exp(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            bool f = false;
+            REAL_T dx = expr_m.Derivative(id, f);
+            if (f) {
+                found = true;
+                return dx * std::exp(expr_m.GetValue());
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (EXP));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * value_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Override for the fabs function in namespace std.
+     * exp(x) for |x| <= 60, continued beyond by a rational function that
+     * levels off instead of overflowing, as mfexp in ADMB.
      * 
-     * @param expr
+     * @param x
      * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Fabs<REAL_T, EXPR> fabs(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Fabs<REAL_T, EXPR > (expr.Cast());
+    template<class REAL_T>
+    inline REAL_T MFExpValue(const REAL_T &x) {
+        REAL_T b = REAL_T(60);
+        if (x <= b && x >= REAL_T(-1) * b) {
+            return std::exp(x);
+        } else if (x > b) {
+            return std::exp(b)*(REAL_T(1.) + REAL_T(2.) * (x - b)) / (REAL_T(1.) + x - b);
+        } else {
+            return std::exp(REAL_T(-1) * b)*(REAL_T(1.) - x - b) / (REAL_T(1.) + REAL_T(2.) * (REAL_T(-1) * x - b));
+        }
     }
 
     /**
-     * Override for the floor function in namespace std.
+     * Expression template used to protect overflow in exp calculations. 
+     * 
+     * Author: Dave Fournier.
+     * Original implementation in ADMB.
+     * 
+     * Source: http://admb-project.org/documentation/api/mfexp_8cpp_source.html
      * 
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Floor<REAL_T, EXPR> floor(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Floor<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct MFExp : public ExpressionBase<REAL_T, MFExp<REAL_T, EXPR> > {
 
-    /**
-     * Override for the ceil function in namespace std.
+        MFExp(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(Compute(expr.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+            //
+            //            return std::exp(expr_m.GetValue());
+        }
+
+        const REAL_T Compute(const REAL_T & value) {
+            return MFExpValue(value);
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * this->GetValue();
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MFEXP));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * this->value_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        REAL_T value_m;
+    };
+
+    /**
+     * Expression template for computing the hyperbolic sine of an expression 
+     * template.
      * 
      * @param expr
-     * @return 
      */
-    template<class REAL_T, class EXPR>
-    inline const ad::Ceil<REAL_T, EXPR> ceil(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
-        return ad::Ceil<REAL_T, EXPR > (expr.Cast());
-    }
+    template <class REAL_T, class EXPR>
+    struct Sinh : public ExpressionBase<REAL_T, Sinh<REAL_T, EXPR> > {
+
+        Sinh(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::sinh(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
 
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * std::cosh(expr_m.GetValue());
+            } else {
+                return 0.0;
+            }
+        }
 
-}
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
 
-namespace ad {
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (SINH));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * std::cosh(expr_m.GetValue()));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
 
     /**
-     * Default implementation of the abstract VariableStorage class.
+     * Expression template for computing the hyperbolic cosine of an 
+     * expression template.
      */
-    template<class REAL_T>
-    class DefaultStorage : public VariableStorage<REAL_T> {
-        typedef std::vector<std::pair<bool, REAL_T> > GradientVector;
-        GradientVector g;
+    template <class REAL_T, class EXPR>
+    struct Cosh : public ExpressionBase<REAL_T, Cosh<REAL_T, EXPR> > {
+
+        Cosh(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::cosh(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * std::sinh(expr_m.GetValue());
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (COSH));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * std::sinh(expr_m.GetValue()));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for computing the hyperbolic tangent of an expresison
+     * template.
+     * 
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct Tanh : public ExpressionBase<REAL_T, Tanh<REAL_T, EXPR> > {
+
+        Tanh(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::tanh(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                REAL_T v = expr_m.GetValue();
+                return dx * (1.0 / std::cosh(v))*(1.0 / std::cosh(v));
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (TANH));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * (static_cast<REAL_T> (1.0) - value_m * value_m));
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for handling the absolute value of a expression 
+     * template.
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct Fabs : public ExpressionBase<REAL_T, Fabs<REAL_T, EXPR> > {
+
+        Fabs(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::fabs(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                REAL_T v = expr_m.GetValue();
+                return (dx * v) / std::fabs(v);
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (FABS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            if (expr_m.GetValue() < static_cast<REAL_T> (0.0)) {
+                this->expr_m.PushAdjoints(tape, static_cast<REAL_T> (-1.0) * coefficient);
+            } else {
+                this->expr_m.PushAdjoints(tape, coefficient);
+            }
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for handling the floor of an expression template.
+     * 
+     * @param a
+     */
+    template <class REAL_T, class EXPR>
+    struct Floor : public ExpressionBase<REAL_T, Floor<REAL_T, EXPR> > {
+
+        Floor(const ExpressionBase<REAL_T, EXPR>& a)
+        : expr_m(a.Cast()), value_m(std::floor(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (FLOOR));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for handling the ceiling of an expression template.
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct Ceil : public ExpressionBase<REAL_T, Ceil<REAL_T, EXPR> > {
+
+        Ceil(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(std::ceil(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CEIL));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        const REAL_T value_m;
+    };
+
+    /**
+     * Expression template for a constant held by value, for REAL_T
+     * arguments of the likelihood functions.
+     *
+     * @param value
+     */
+    template<class REAL_T>
+    struct Literal : public ExpressionBase<REAL_T, Literal<REAL_T> > {
+
+        Literal(const REAL_T & value) : value_m(value) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return this->value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &, bool &) const {
+            return 0;
+        }
+
+        void GetIdRange(uint32_t &, uint32_t &) const {
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, value_m));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &, const REAL_T &) const {
+        }
+
+        inline void PushIds(IdsSet &) const {
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> *) const {
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > &) const {
+        }
+
+    private:
+        REAL_T value_m;
+    };
+
+    /**
+     * How a node holds an operand. Expressions are held by reference,
+     * Literals are created by the functions below and are held by value.
+     */
+    template<class T>
+    struct OperandType {
+        typedef const T& type;
+    };
+
+    template<class REAL_T>
+    struct OperandType<Literal<REAL_T> > {
+        typedef const Literal<REAL_T> type;
+    };
+
+    /**
+     * Expression template for the log of the gamma function of an
+     * expression template.
+     *
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct LGamma : public ExpressionBase<REAL_T, LGamma<REAL_T, EXPR> > {
+
+        LGamma(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(LogGamma(expr_m.GetValue())),
+        dx_m(Digamma(expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * dx_m;
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LGAMMA));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * this->dx_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+    };
+
+    /**
+     * Expression template for the digamma function of an expression
+     * template.
+     *
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct DigammaFunction : public ExpressionBase<REAL_T, DigammaFunction<REAL_T, EXPR> > {
+
+        DigammaFunction(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(Digamma(expr_m.GetValue())),
+        dx_m(Polygamma(1, expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * dx_m;
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (DIGAMMA));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * this->dx_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+    };
+
+    /**
+     * Expression template for the error function of an expression template.
+     *
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct Erf : public ExpressionBase<REAL_T, Erf<REAL_T, EXPR> > {
+
+        Erf(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()), value_m(ErrorFunction(expr_m.GetValue())),
+        dx_m(REAL_T(1.1283791670955125739) * std::exp(-expr_m.GetValue() * expr_m.GetValue())) {
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * dx_m;
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            expr_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (ERF));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * this->dx_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+    };
+
+    /**
+     * Expression template for log(1 + exp(x)), evaluated without overflow.
+     * The derivative is the logistic function of x.
+     *
+     * @param expr
+     */
+    template <class REAL_T, class EXPR>
+    struct Softplus : public ExpressionBase<REAL_T, Softplus<REAL_T, EXPR> > {
+
+        Softplus(const ExpressionBase<REAL_T, EXPR>& expr)
+        : expr_m(expr.Cast()) {
+            const REAL_T x = expr_m.GetValue();
+            if (x > REAL_T(0)) {
+                const REAL_T e = std::exp(-x);
+                value_m = x + LogOnePlus(e);
+                dx_m = REAL_T(1) / (REAL_T(1) + e);
+            } else {
+                const REAL_T e = std::exp(x);
+                value_m = LogOnePlus(e);
+                dx_m = e / (REAL_T(1) + e);
+            }
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            REAL_T dx = expr_m.Derivative(id, found);
+            if (found) {
+                return dx * dx_m;
+            } else {
+                return 0.0;
+            }
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            expr_m.GetIdRange(min, max);
+        }
+
+        /**
+         * Pushed as x + log(1 + exp(-x)) for positive x and as
+         * log(1 + exp(x)) otherwise.
+         */
+        void Push(StatementList<REAL_T> &statements) const {
+            const bool positive = expr_m.GetValue() > REAL_T(0);
+            if (positive) {
+                expr_m.Push(statements);
+            }
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(1)));
+            if (positive) {
+                statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(-1)));
+                expr_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (MULTIPLY));
+            } else {
+                expr_m.Push(statements);
+            }
+            statements.push_back(Statement<REAL_T > (EXP));
+            statements.push_back(Statement<REAL_T > (PLUS));
+            statements.push_back(Statement<REAL_T > (LOG));
+            if (positive) {
+                statements.push_back(Statement<REAL_T > (PLUS));
+            }
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->expr_m.PushAdjoints(tape, coefficient * this->dx_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->expr_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->expr_m.PushIds(ids);
+        }
+
+    private:
+        const EXPR& expr_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+    };
+
+    /**
+     * Expression template for log(exp(lhs) + exp(rhs)), evaluated as
+     * max + log(1 + exp(min - max)) so it does not overflow.
+     *
+     * @param lhs
+     * @param rhs
+     */
+    template <class REAL_T, class LHS, class RHS>
+    struct LogSumExp : public ExpressionBase<REAL_T, LogSumExp<REAL_T, LHS, RHS> > {
+
+        LogSumExp(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs)
+        : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+            const REAL_T a = lhs_m.GetValue();
+            const REAL_T b = rhs_m.GetValue();
+            const REAL_T e = std::exp(-std::fabs(a - b));
+            value_m = std::max(a, b) + LogOnePlus(e);
+            const REAL_T p = REAL_T(1) / (REAL_T(1) + e);
+            dl_m = a >= b ? p : REAL_T(1) - p;
+            dr_m = REAL_T(1) - dl_m;
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            bool fl = false, fr = false;
+            REAL_T dl = lhs_m.Derivative(id, fl);
+            REAL_T dr = rhs_m.Derivative(id, fr);
+            if (fl || fr) {
+                found = true;
+                return dl * dl_m + dr * dr_m;
+            }
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            lhs_m.GetIdRange(min, max);
+            rhs_m.GetIdRange(min, max);
+        }
+
+        /**
+         * Pushed as max + log(1 + exp(min - max)) with the operands
+         * ordered by their values at recording.
+         */
+        void Push(StatementList<REAL_T> &statements) const {
+            if (lhs_m.GetValue() >= rhs_m.GetValue()) {
+                this->Push(statements, lhs_m, rhs_m);
+            } else {
+                this->Push(statements, rhs_m, lhs_m);
+            }
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->lhs_m.PushAdjoints(tape, coefficient * this->dl_m);
+            this->rhs_m.PushAdjoints(tape, coefficient * this->dr_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->lhs_m.PushStorage(ids);
+            this->rhs_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->lhs_m.PushIds(ids);
+            this->rhs_m.PushIds(ids);
+        }
+
+    private:
+
+        template<class MAX, class MIN>
+        static void Push(StatementList<REAL_T> &statements, const MAX &max, const MIN &min) {
+            max.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(1)));
+            min.Push(statements);
+            max.Push(statements);
+            statements.push_back(Statement<REAL_T > (MINUS));
+            statements.push_back(Statement<REAL_T > (EXP));
+            statements.push_back(Statement<REAL_T > (PLUS));
+            statements.push_back(Statement<REAL_T > (LOG));
+            statements.push_back(Statement<REAL_T > (PLUS));
+        }
+
+        typename OperandType<LHS>::type lhs_m;
+        typename OperandType<RHS>::type rhs_m;
+        REAL_T value_m;
+        REAL_T dl_m;
+        REAL_T dr_m;
+    };
+
+    /**
+     * Expression template for the log of the normal density of x with mean
+     * mu and standard deviation sigma,
+     *
+     * -log(sqrt(2 pi)) - log(sigma) - z^2 / 2, z = (x - mu) / sigma.
+     *
+     * @param x
+     * @param mu
+     * @param sigma
+     */
+    template <class REAL_T, class X, class MU, class SIGMA>
+    struct DNormLog : public ExpressionBase<REAL_T, DNormLog<REAL_T, X, MU, SIGMA> > {
+
+        DNormLog(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu,
+                const ExpressionBase<REAL_T, SIGMA>& sigma)
+        : x_m(x.Cast()), mu_m(mu.Cast()), sigma_m(sigma.Cast()) {
+            const REAL_T s = sigma_m.GetValue();
+            const REAL_T z = (x_m.GetValue() - mu_m.GetValue()) / s;
+            value_m = REAL_T(-0.91893853320467274178) - std::log(s) - REAL_T(.5) * z * z;
+            dx_m = -z / s;
+            dmu_m = z / s;
+            dsigma_m = (z * z - REAL_T(1)) / s;
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            bool fx = false, fmu = false, fsigma = false;
+            REAL_T dx = x_m.Derivative(id, fx);
+            REAL_T dmu = mu_m.Derivative(id, fmu);
+            REAL_T dsigma = sigma_m.Derivative(id, fsigma);
+            if (fx || fmu || fsigma) {
+                found = true;
+                return dx * dx_m + dmu * dmu_m + dsigma * dsigma_m;
+            }
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            x_m.GetIdRange(min, max);
+            mu_m.GetIdRange(min, max);
+            sigma_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(-0.91893853320467274178)));
+            sigma_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG));
+            statements.push_back(Statement<REAL_T > (MINUS));
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(.5)));
+            for (int k = 0; k < 2; k++) {
+                x_m.Push(statements);
+                mu_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (MINUS));
+                sigma_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (DIVIDE));
+            }
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->x_m.PushAdjoints(tape, coefficient * this->dx_m);
+            this->mu_m.PushAdjoints(tape, coefficient * this->dmu_m);
+            this->sigma_m.PushAdjoints(tape, coefficient * this->dsigma_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->x_m.PushIds(ids);
+            this->mu_m.PushIds(ids);
+            this->sigma_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->x_m.PushStorage(ids);
+            this->mu_m.PushStorage(ids);
+            this->sigma_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->x_m.PushIds(ids);
+            this->mu_m.PushIds(ids);
+            this->sigma_m.PushIds(ids);
+        }
+
+    private:
+        typename OperandType<X>::type x_m;
+        typename OperandType<MU>::type mu_m;
+        typename OperandType<SIGMA>::type sigma_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+        REAL_T dmu_m;
+        REAL_T dsigma_m;
+    };
+
+    /**
+     * Expression template for the log of the lognormal density of x with
+     * log mean mu and log standard deviation sigma,
+     *
+     * -log(x) - log(sqrt(2 pi)) - log(sigma) - z^2 / 2,
+     * z = (log(x) - mu) / sigma.
+     *
+     * @param x
+     * @param mu
+     * @param sigma
+     */
+    template <class REAL_T, class X, class MU, class SIGMA>
+    struct DLNormLog : public ExpressionBase<REAL_T, DLNormLog<REAL_T, X, MU, SIGMA> > {
+
+        DLNormLog(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu,
+                const ExpressionBase<REAL_T, SIGMA>& sigma)
+        : x_m(x.Cast()), mu_m(mu.Cast()), sigma_m(sigma.Cast()) {
+            const REAL_T xv = x_m.GetValue();
+            const REAL_T log_x = std::log(xv);
+            const REAL_T s = sigma_m.GetValue();
+            const REAL_T z = (log_x - mu_m.GetValue()) / s;
+            value_m = -log_x + REAL_T(-0.91893853320467274178) - std::log(s) - REAL_T(.5) * z * z;
+            dx_m = -(REAL_T(1) + z / s) / xv;
+            dmu_m = z / s;
+            dsigma_m = (z * z - REAL_T(1)) / s;
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            bool fx = false, fmu = false, fsigma = false;
+            REAL_T dx = x_m.Derivative(id, fx);
+            REAL_T dmu = mu_m.Derivative(id, fmu);
+            REAL_T dsigma = sigma_m.Derivative(id, fsigma);
+            if (fx || fmu || fsigma) {
+                found = true;
+                return dx * dx_m + dmu * dmu_m + dsigma * dsigma_m;
+            }
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            x_m.GetIdRange(min, max);
+            mu_m.GetIdRange(min, max);
+            sigma_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(-0.91893853320467274178)));
+            x_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG));
+            statements.push_back(Statement<REAL_T > (MINUS));
+            sigma_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG));
+            statements.push_back(Statement<REAL_T > (MINUS));
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(.5)));
+            for (int k = 0; k < 2; k++) {
+                x_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (LOG));
+                mu_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (MINUS));
+                sigma_m.Push(statements);
+                statements.push_back(Statement<REAL_T > (DIVIDE));
+            }
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->x_m.PushAdjoints(tape, coefficient * this->dx_m);
+            this->mu_m.PushAdjoints(tape, coefficient * this->dmu_m);
+            this->sigma_m.PushAdjoints(tape, coefficient * this->dsigma_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->x_m.PushIds(ids);
+            this->mu_m.PushIds(ids);
+            this->sigma_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->x_m.PushStorage(ids);
+            this->mu_m.PushStorage(ids);
+            this->sigma_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->x_m.PushIds(ids);
+            this->mu_m.PushIds(ids);
+            this->sigma_m.PushIds(ids);
+        }
+
+    private:
+        typename OperandType<X>::type x_m;
+        typename OperandType<MU>::type mu_m;
+        typename OperandType<SIGMA>::type sigma_m;
+        REAL_T value_m;
+        REAL_T dx_m;
+        REAL_T dmu_m;
+        REAL_T dsigma_m;
+    };
+
+    /**
+     * Expression template for the log of the Poisson probability of k with
+     * mean lambda,
+     *
+     * k log(lambda) - lambda - lgamma(k + 1).
+     *
+     * k log(lambda) is taken as zero for k = 0.
+     *
+     * @param k
+     * @param lambda
+     */
+    template <class REAL_T, class K, class LAMBDA>
+    struct DPoisLog : public ExpressionBase<REAL_T, DPoisLog<REAL_T, K, LAMBDA> > {
+
+        DPoisLog(const ExpressionBase<REAL_T, K>& k, const ExpressionBase<REAL_T, LAMBDA>& lambda)
+        : k_m(k.Cast()), lambda_m(lambda.Cast()) {
+            const REAL_T kv = k_m.GetValue();
+            const REAL_T l = lambda_m.GetValue();
+            const REAL_T log_lambda = kv == REAL_T(0) ? REAL_T(0) : std::log(l);
+            value_m = kv * log_lambda - l - LogGamma(kv + REAL_T(1));
+            dk_m = log_lambda - Digamma(kv + REAL_T(1));
+            dlambda_m = kv / l - REAL_T(1);
+        }
+
+        inline const REAL_T GetValue() const {
+            return value_m;
+        }
+
+        inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+            bool fk = false, flambda = false;
+            REAL_T dk = k_m.Derivative(id, fk);
+            REAL_T dlambda = lambda_m.Derivative(id, flambda);
+            if (fk || flambda) {
+                found = true;
+                return dk * dk_m + dlambda * dlambda_m;
+            }
+            return 0.0;
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+            k_m.GetIdRange(min, max);
+            lambda_m.GetIdRange(min, max);
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            k_m.Push(statements);
+            lambda_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (LOG));
+            statements.push_back(Statement<REAL_T > (MULTIPLY));
+            lambda_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (MINUS));
+            k_m.Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(1)));
+            statements.push_back(Statement<REAL_T > (PLUS));
+            statements.push_back(Statement<REAL_T > (LGAMMA));
+            statements.push_back(Statement<REAL_T > (MINUS));
+        }
+
+        template<class TAPE>
+        inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+            this->k_m.PushAdjoints(tape, coefficient * this->dk_m);
+            this->lambda_m.PushAdjoints(tape, coefficient * this->dlambda_m);
+        }
+
+        inline void PushIds(IdsSet & ids) const {
+            this->k_m.PushIds(ids);
+            this->lambda_m.PushIds(ids);
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            this->k_m.PushStorage(ids);
+            this->lambda_m.PushStorage(ids);
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            this->k_m.PushIds(ids);
+            this->lambda_m.PushIds(ids);
+        }
+
+    private:
+        typename OperandType<K>::type k_m;
+        typename OperandType<LAMBDA>::type lambda_m;
+        REAL_T value_m;
+        REAL_T dk_m;
+        REAL_T dlambda_m;
+    };
+
+    /**
+     * Log of the gamma function of an expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const LGamma<REAL_T, EXPR> lgamma(const ExpressionBase<REAL_T, EXPR>& expr) {
+        return LGamma<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Digamma function of an expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const DigammaFunction<REAL_T, EXPR> digamma(const ExpressionBase<REAL_T, EXPR>& expr) {
+        return DigammaFunction<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Error function of an expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const Erf<REAL_T, EXPR> erf(const ExpressionBase<REAL_T, EXPR>& expr) {
+        return Erf<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * log(1 + exp(expr)), without overflow.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const Softplus<REAL_T, EXPR> softplus(const ExpressionBase<REAL_T, EXPR>& expr) {
+        return Softplus<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * log(exp(lhs) + exp(rhs)), without overflow.
+     *
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    template<class REAL_T, class LHS, class RHS>
+    inline const LogSumExp<REAL_T, LHS, RHS> log_sum_exp(const ExpressionBase<REAL_T, LHS>& lhs, const ExpressionBase<REAL_T, RHS>& rhs) {
+        return LogSumExp<REAL_T, LHS, RHS> (lhs.Cast(), rhs.Cast());
+    }
+
+    template<class REAL_T, class LHS>
+    inline const LogSumExp<REAL_T, LHS, Literal<REAL_T> > log_sum_exp(const ExpressionBase<REAL_T, LHS>& lhs, const REAL_T &rhs) {
+        return LogSumExp<REAL_T, LHS, Literal<REAL_T> > (lhs.Cast(), Literal<REAL_T > (rhs));
+    }
+
+    template<class REAL_T, class RHS>
+    inline const LogSumExp<REAL_T, Literal<REAL_T>, RHS> log_sum_exp(const REAL_T &lhs, const ExpressionBase<REAL_T, RHS>& rhs) {
+        return LogSumExp<REAL_T, Literal<REAL_T>, RHS> (Literal<REAL_T > (lhs), rhs.Cast());
+    }
+
+    /**
+     * Log of the normal density of x with mean mu and standard deviation
+     * sigma. Any of the arguments may be a constant.
+     *
+     * @param x
+     * @param mu
+     * @param sigma
+     * @return
+     */
+    template<class REAL_T, class X, class MU, class SIGMA>
+    inline const DNormLog<REAL_T, X, MU, SIGMA> dnorm_log(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DNormLog<REAL_T, X, MU, SIGMA> (x.Cast(), mu.Cast(), sigma.Cast());
+    }
+
+    template<class REAL_T, class X, class MU>
+    inline const DNormLog<REAL_T, X, MU, Literal<REAL_T> > dnorm_log(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu, const REAL_T &sigma) {
+        return DNormLog<REAL_T, X, MU, Literal<REAL_T> > (x.Cast(), mu.Cast(), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class X, class SIGMA>
+    inline const DNormLog<REAL_T, X, Literal<REAL_T>, SIGMA> dnorm_log(const ExpressionBase<REAL_T, X>& x, const REAL_T &mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DNormLog<REAL_T, X, Literal<REAL_T>, SIGMA> (x.Cast(), Literal<REAL_T > (mu), sigma.Cast());
+    }
+
+    template<class REAL_T, class X>
+    inline const DNormLog<REAL_T, X, Literal<REAL_T>, Literal<REAL_T> > dnorm_log(const ExpressionBase<REAL_T, X>& x, const REAL_T &mu, const REAL_T &sigma) {
+        return DNormLog<REAL_T, X, Literal<REAL_T>, Literal<REAL_T> > (x.Cast(), Literal<REAL_T > (mu), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class MU, class SIGMA>
+    inline const DNormLog<REAL_T, Literal<REAL_T>, MU, SIGMA> dnorm_log(const REAL_T &x, const ExpressionBase<REAL_T, MU>& mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DNormLog<REAL_T, Literal<REAL_T>, MU, SIGMA> (Literal<REAL_T > (x), mu.Cast(), sigma.Cast());
+    }
+
+    template<class REAL_T, class MU>
+    inline const DNormLog<REAL_T, Literal<REAL_T>, MU, Literal<REAL_T> > dnorm_log(const REAL_T &x, const ExpressionBase<REAL_T, MU>& mu, const REAL_T &sigma) {
+        return DNormLog<REAL_T, Literal<REAL_T>, MU, Literal<REAL_T> > (Literal<REAL_T > (x), mu.Cast(), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class SIGMA>
+    inline const DNormLog<REAL_T, Literal<REAL_T>, Literal<REAL_T>, SIGMA> dnorm_log(const REAL_T &x, const REAL_T &mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DNormLog<REAL_T, Literal<REAL_T>, Literal<REAL_T>, SIGMA> (Literal<REAL_T > (x), Literal<REAL_T > (mu), sigma.Cast());
+    }
+
+    /**
+     * Log of the lognormal density of x with log mean mu and log standard
+     * deviation sigma. Any of the arguments may be a constant.
+     *
+     * @param x
+     * @param mu
+     * @param sigma
+     * @return
+     */
+    template<class REAL_T, class X, class MU, class SIGMA>
+    inline const DLNormLog<REAL_T, X, MU, SIGMA> dlnorm_log(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DLNormLog<REAL_T, X, MU, SIGMA> (x.Cast(), mu.Cast(), sigma.Cast());
+    }
+
+    template<class REAL_T, class X, class MU>
+    inline const DLNormLog<REAL_T, X, MU, Literal<REAL_T> > dlnorm_log(const ExpressionBase<REAL_T, X>& x, const ExpressionBase<REAL_T, MU>& mu, const REAL_T &sigma) {
+        return DLNormLog<REAL_T, X, MU, Literal<REAL_T> > (x.Cast(), mu.Cast(), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class X, class SIGMA>
+    inline const DLNormLog<REAL_T, X, Literal<REAL_T>, SIGMA> dlnorm_log(const ExpressionBase<REAL_T, X>& x, const REAL_T &mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DLNormLog<REAL_T, X, Literal<REAL_T>, SIGMA> (x.Cast(), Literal<REAL_T > (mu), sigma.Cast());
+    }
+
+    template<class REAL_T, class X>
+    inline const DLNormLog<REAL_T, X, Literal<REAL_T>, Literal<REAL_T> > dlnorm_log(const ExpressionBase<REAL_T, X>& x, const REAL_T &mu, const REAL_T &sigma) {
+        return DLNormLog<REAL_T, X, Literal<REAL_T>, Literal<REAL_T> > (x.Cast(), Literal<REAL_T > (mu), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class MU, class SIGMA>
+    inline const DLNormLog<REAL_T, Literal<REAL_T>, MU, SIGMA> dlnorm_log(const REAL_T &x, const ExpressionBase<REAL_T, MU>& mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DLNormLog<REAL_T, Literal<REAL_T>, MU, SIGMA> (Literal<REAL_T > (x), mu.Cast(), sigma.Cast());
+    }
+
+    template<class REAL_T, class MU>
+    inline const DLNormLog<REAL_T, Literal<REAL_T>, MU, Literal<REAL_T> > dlnorm_log(const REAL_T &x, const ExpressionBase<REAL_T, MU>& mu, const REAL_T &sigma) {
+        return DLNormLog<REAL_T, Literal<REAL_T>, MU, Literal<REAL_T> > (Literal<REAL_T > (x), mu.Cast(), Literal<REAL_T > (sigma));
+    }
+
+    template<class REAL_T, class SIGMA>
+    inline const DLNormLog<REAL_T, Literal<REAL_T>, Literal<REAL_T>, SIGMA> dlnorm_log(const REAL_T &x, const REAL_T &mu, const ExpressionBase<REAL_T, SIGMA>& sigma) {
+        return DLNormLog<REAL_T, Literal<REAL_T>, Literal<REAL_T>, SIGMA> (Literal<REAL_T > (x), Literal<REAL_T > (mu), sigma.Cast());
+    }
+
+    /**
+     * Log of the Poisson probability of k with mean lambda. Either
+     * argument may be a constant.
+     *
+     * @param k
+     * @param lambda
+     * @return
+     */
+    template<class REAL_T, class K, class LAMBDA>
+    inline const DPoisLog<REAL_T, K, LAMBDA> dpois_log(const ExpressionBase<REAL_T, K>& k, const ExpressionBase<REAL_T, LAMBDA>& lambda) {
+        return DPoisLog<REAL_T, K, LAMBDA> (k.Cast(), lambda.Cast());
+    }
+
+    template<class REAL_T, class K>
+    inline const DPoisLog<REAL_T, K, Literal<REAL_T> > dpois_log(const ExpressionBase<REAL_T, K>& k, const REAL_T &lambda) {
+        return DPoisLog<REAL_T, K, Literal<REAL_T> > (k.Cast(), Literal<REAL_T > (lambda));
+    }
+
+    template<class REAL_T, class LAMBDA>
+    inline const DPoisLog<REAL_T, Literal<REAL_T>, LAMBDA> dpois_log(const REAL_T &k, const ExpressionBase<REAL_T, LAMBDA>& lambda) {
+        return DPoisLog<REAL_T, Literal<REAL_T>, LAMBDA> (Literal<REAL_T > (k), lambda.Cast());
+    }
+
+
+
+}
+
+
+
+/**
+ * Utility functions added to the standard name space. Mostly cmath overloads 
+ * for expressions.
+ */
+namespace std {
+
+    /**
+     * Write the expression value to std::ostream out.
+     * @param out
+     * @param exp
+     * @return 
+     */
+    template<class REAL_T, class A>
+    inline std::ostream& operator<<(std::ostream &out, const ad::ExpressionBase<REAL_T, A> &exp) {
+        out << exp.GetValue();
+        return out;
+    }
+
+    /**
+     * Override for the sin function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Sin<REAL_T, EXPR> sin(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Sin<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the cos function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Cos<REAL_T, EXPR> cos(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Cos<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the tan function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Tan<REAL_T, EXPR> tan(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Tan<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the asin function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::ASin<REAL_T, EXPR> asin(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::ASin<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the asin function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::ACos<REAL_T, EXPR> acos(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::ACos<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the atan function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::ATan<REAL_T, EXPR> atan(const ad::ExpressionBase<REAL_T, EXPR>& a) {
+        return ad::ATan<REAL_T, EXPR > (a.Cast());
+    }
+
+    /**
+     * Override for the atan2 function in namespace std.
+     * 
+     * @param expr1
+     * @param expr2
+     * @return 
+     */
+    template <class REAL_T, class EXPR1, class EXPR2>
+    inline
+    ad::ATan2<REAL_T, EXPR1, EXPR2> atan2(const ad::ExpressionBase<REAL_T, EXPR1>& expr1,
+    const ad::ExpressionBase<REAL_T, EXPR2>& expr2) {
+        return ad::ATan2<REAL_T, EXPR1, EXPR2 > (expr1.Cast(), expr2.Cast());
+    }
+
+    /**
+     * Override for the atan2 function in namespace std.
+     * 
+     * @param expr1
+     * @param val
+     * @return 
+     */
+    template <class REAL_T, class EXPR>
+    inline
+    ad::ATan2Constant<REAL_T, EXPR> atan2(const ad::ExpressionBase<REAL_T, EXPR>& expr,
+    const REAL_T& val) {
+        return ad::ATan2Constant<REAL_T, EXPR > (expr.Cast(), val);
+    }
+
+    /**
+     * Override for the atan2 function in namespace std.
+     * 
+     * @param expr1
+     * @param expr2
+     * @return 
+     */
+    template <class REAL_T, class EXPR>
+    inline
+    ad::ConstantATan2<REAL_T, EXPR> atan2(const REAL_T& val,
+    const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::ConstantATan2<REAL_T, EXPR > (val, expr.Cast());
+    }
+
+    /**
+     * Override for the sqrt function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Sqrt<REAL_T, EXPR> sqrt(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Sqrt<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the pow function in namespace std.
+     * 
+     * @param expr1
+     * @param expr2
+     * @return 
+     */
+    template <class REAL_T, class EXPR1, class EXPR2>
+    inline
+    ad::Pow<REAL_T, EXPR1, EXPR2> pow(const ad::ExpressionBase<REAL_T, EXPR1>& expr1,
+    const ad::ExpressionBase<REAL_T, EXPR2>& expr2) {
+        return ad::Pow<REAL_T, EXPR1, EXPR2 > (expr1.Cast(), expr2.Cast());
+    }
+
+    /**
+     * Override for the pow function in namespace std.
+     * 
+     * @param expr1
+     * @param val
+     * @return 
+     */
+    template <class REAL_T, class EXPR>
+    inline
+    ad::PowConstant<REAL_T, EXPR> pow(const ad::ExpressionBase<REAL_T, EXPR>& expr,
+    const REAL_T& val) {
+        return ad::PowConstant<REAL_T, EXPR > (expr.Cast(), val);
+    }
+
+    /**
+     * Override for the pow function in namespace std.
+     * 
+     * @param val
+     * @param expr2
+     * @return 
+     */
+    template <class REAL_T, class EXPR>
+    inline
+    ad::ConstantPow<REAL_T, EXPR> pow(const REAL_T& val,
+    const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::ConstantPow<REAL_T, EXPR > (val, expr.Cast());
+    }
+
+    /**
+     * Override for the log function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Log<REAL_T, EXPR> log(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Log<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the log function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Log10<REAL_T, EXPR> log10(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Log10<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the exp function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Exp<REAL_T, EXPR> exp(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Exp<REAL_T, EXPR > (expr.Cast());
+    }
+
+    template<class REAL_T, class EXPR>
+    inline const ad::MFExp<REAL_T, EXPR> mfexp(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::MFExp<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * mfexp of a plain value, for models evaluated without recording.
+     * 
+     * @param x
+     * @return 
+     */
+    inline float mfexp(const float &x) {
+        return ad::MFExpValue(x);
+    }
+
+    inline double mfexp(const double &x) {
+        return ad::MFExpValue(x);
+    }
+
+    inline long double mfexp(const long double &x) {
+        return ad::MFExpValue(x);
+    }
+
+    /**
+     * Override for the sinh function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Sinh<REAL_T, EXPR> sinh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Sinh<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the cosh function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Cosh<REAL_T, EXPR> cosh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Cosh<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the tanh function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Tanh<REAL_T, EXPR> tanh(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Tanh<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the fabs function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Fabs<REAL_T, EXPR> fabs(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Fabs<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the floor function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Floor<REAL_T, EXPR> floor(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Floor<REAL_T, EXPR > (expr.Cast());
+    }
+
+    /**
+     * Override for the ceil function in namespace std.
+     * 
+     * @param expr
+     * @return 
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::Ceil<REAL_T, EXPR> ceil(const ad::ExpressionBase<REAL_T, EXPR>& expr) {
+        return ad::Ceil<REAL_T, EXPR > (expr.Cast());
+    }
+
+
+
+}
+
+namespace ad {
+
+    /**
+     * Default implementation of the abstract VariableStorage class.
+     */
+    template<class REAL_T>
+    class DefaultStorage : public VariableStorage<REAL_T> {
+        typedef std::vector<std::pair<bool, REAL_T> > GradientVector;
+        GradientVector g;
+
+        typedef IdsSet indepedndent_variables;
+        typedef IdsSet::iterator indepedndent_variables_iterator;
+        typedef IdsSet::const_iterator const_indepedndent_variables_iterator;
+        indepedndent_variables ids_m;
+
+        typedef std::vector<Statement<REAL_T> > ExpressionStatements;
+        ExpressionStatements statements_m;
+
+        REAL_T value_m;
+    public:
+
+        DefaultStorage() : value_m(0) {
+
+        }
+
+        void SetValue(const REAL_T &value) {
+            this->value_m = value;
+        }
+
+        const REAL_T GetValue() {
+            return this->value_m;
+        }
+
+        const std::pair<bool, REAL_T> GetDerivative(const uint32_t &id) {
+
+            if (id> this->g.size()) {
+                return g[id];
+            } else {
+                return std::pair<bool, REAL_T > (false, 0);
+            }
+
+        }
+
+        void SetDerivative(const std::pair<bool, REAL_T> &entry, const uint32_t &id) {
+
+            if (g.size() < id) {
+                g.resize(id + 1);
+            }
+            g[id] = entry;
+        }
+
+        void AddId(const uint32_t &id) {
+            this->ids_m.insert(id);
+        }
+
+        void Merge(VariableStorage<REAL_T>* other) {
+            DefaultStorage<REAL_T>* ds = (DefaultStorage<REAL_T>*)other;
+            this->ids_m.insert(ds->ids_m.begin(), ds->ids_m.end());
+        }
+
+        uint32_t DerivativeInfoSize() {
+            return this->g.size();
+        }
+
+        void ClearDerivativeInfo() {
+            this->g.clear();
+        }
+
+        void AddStatement(const Statement<REAL_T> &statement) {
+            this->statements_m.push_back(statement);
+        }
+
+        uint32_t ExpressionSize() {
+            return this->statements_m.size();
+        }
+
+        Statement<REAL_T> StatementAt(const uint32_t &index) {
+            //            if(index >= this->statements_m.size()){
+            //                std::cout<<"Error Statement<REAL_T> StatementAt(const uint32_t &index), index out of bounds."
+            //            }
+
+            return this->statements_m[index];
+        }
+
+        void ClearExpression() {
+            this->statements_m.clear();
+        }
+
+        void Reset() {
+            this->g.clear();
+            this->ids_m.clear();
+            this->statements_m.clear();
+        }
+
+    };
+
+    /**
+     * Variable class used for calculations and storage of computed derivatives.
+     * 
+     * Derivatives are only computed for variables marked as independent 
+     * variables. To make a variable independent use:
+     * 
+     * constructor:
+     * 
+     * Variable(const REAL_T& value, bool is_independent = false)
+     * 
+     * or
+     * 
+     * Member Function:
+     * 
+     * void SetAsIndependent(const bool &is_independent)
+     * 
+     * 
+     * 
+     */
+    template<class REAL_T, int group>
+    class Variable : public ExpressionBase<REAL_T, Variable<REAL_T, group> > {
+        VariableStorage<REAL_T>* storage; //allocated on first use, see GetStorage.
+        REAL_T value_m;
+
+        std::string name_m;
+        bool bounded_m;
+        REAL_T min_boundary_m;
+        REAL_T max_boundary_m;
+        bool is_independent_m;
+        uint32_t iv_id_m; //id when is a independent variable.
+        uint64_t tape_index_m; //statement index on the adjoint tape.
+
+        //        uint32_t iv_min; //if this variable is caching derivatives, this is the min independent variable.
+        //        uint32_t iv_max; //if this variable is caching derivatives, this is the max independent variable.
+
+
+        //        static std::set<uint32_t> independent_variables_g;
+
+
+        typedef SparseGradient<REAL_T> GradientVector;
+        GradientVector g;
+        //        GradientMap gradients_m;
+
+        typedef IdsSet indepedndent_variables;
+        typedef IdsSet::iterator indepedndent_variables_iterator;
+        typedef IdsSet::const_iterator const_indepedndent_variables_iterator;
+        //        std::vector<bool> has_m;
+        typedef StatementList<REAL_T> ExpressionStatements;
+        uint64_t node_m; //node on the ExpressionGraph, for arbitrary order.
+
+        template <typename TT >
+        TT SwapBytes(const TT &u) {
+
+            union {
+                TT u;
+                unsigned char u8[sizeof (TT)];
+            } source, dest;
+
+            source.u = u;
+
+            for (size_t k = 0; k < sizeof (TT); k++)
+                dest.u8[k] = source.u8[sizeof (TT) - k - 1];
+
+            return dest.u;
+        }
+
+
+    public:
+        static uint32_t misses_g;
+
+        /**
+         * Default conclassor.
+         */
+        Variable() : ExpressionBase<REAL_T, Variable<REAL_T, group> >(0),
+        storage(NULL),
+        value_m(0.0),
+        bounded_m(false),
+        is_independent_m(false),
+        iv_id_m(0),
+        tape_index_m(0),
+        node_m(0) {
+
+            //            iv_min = std::numeric_limits<uint32_t>::max();
+            //            iv_max = std::numeric_limits<uint32_t>::min();
+            //this->ids_m.set_empty_key(NULL);
+        }
+
+        /**
+         * Conclass a variable with a initial value. Optional parameter to make
+         * it a independent variable.
+         * 
+         * @param value
+         * @param is_independent
+         */
+        Variable(const REAL_T& value, bool is_independent = false) : storage(NULL), value_m(value), bounded_m(false), is_independent_m(false), iv_id_m(0), tape_index_m(0), node_m(0) {
+            //this->ids_m.set_empty_key(NULL);
+            //            iv_min = std::numeric_limits<uint32_t>::max();
+            //            iv_max = std::numeric_limits<uint32_t>::min();
+            if (is_independent) {
+                //                this->id_m = IDGenerator::instance()->next();
+                this->SetAsIndependent(is_independent);
+                this->bounded_m = false;
+                this->min_boundary_m = std::numeric_limits<REAL_T>::min();
+                this->max_boundary_m = std::numeric_limits<REAL_T>::max();
+                //                Variable::independent_variables_g.insert(this->GetId());
+            }
+
+        }
+
+        /**
+         * Copy conclassor. 
+         * 
+         * @param rhs
+         */
+        Variable(const Variable& orig) : ExpressionBase<REAL_T, Variable<REAL_T, group> >(orig.GetId()), storage(NULL), node_m(0) {
+
+            value_m = orig.GetValue();
+            this->id_m = orig.GetId();
+            this->iv_id_m = orig.iv_id_m;
+            this->tape_index_m = orig.tape_index_m;
+            //            orig.PushIds(ids_m);
+            //this->ids_m.set_empty_key(NULL);
+            g = orig.g;
+            //            has_m = orig.has_m;
+#if defined(USE_HASH_TABLE)
+            this->gradients_m = HashTable(orig.gradients_m);
+#else
+            //            this->gradients_m.insert(orig.gradients_m.begin(), orig.gradients_m.end());
+#endif
+            this->is_independent_m = orig.is_independent_m;
+            this->bounded_m = orig.bounded_m;
+            this->min_boundary_m = orig.min_boundary_m;
+            this->max_boundary_m = orig.max_boundary_m;
+            //            iv_min = orig.iv_min;
+            //            iv_max = orig.iv_max;
+            if (Variable::IsSupportingArbitraryOrder()) {
+                this->node_m = orig.node_m;
+            }
+
+        }
+
+#if __cplusplus >= 201103L
+
+        /**
+         * Move constructor. Takes over the gradient and storage buffers of 
+         * orig instead of copying them.
+         * 
+         * @param orig
+         */
+        Variable(Variable&& orig) noexcept : storage(orig.storage),
+        value_m(orig.value_m),
+        name_m(std::move(orig.name_m)),
+        bounded_m(orig.bounded_m),
+        min_boundary_m(orig.min_boundary_m),
+        max_boundary_m(orig.max_boundary_m),
+        is_independent_m(orig.is_independent_m),
+        iv_id_m(orig.iv_id_m),
+        tape_index_m(orig.tape_index_m),
+        g(std::move(orig.g)),
+        node_m(orig.node_m) {
+            this->id_m = orig.GetId();
+            orig.storage = NULL;
+        }
+#endif
+
+        /**
+         * Conclasss a variable from expression expr.
+         * @param rhs
+         */
+        template<class T>
+        Variable(const ExpressionBase<REAL_T, T>& expr) : storage(NULL), is_independent_m(false), iv_id_m(0), tape_index_m(0), node_m(0) {
+
+            //has_m.resize(IDGenerator::instance()->current() + 1);
+
+            this->bounded_m = false;
+            //            iv_min = std::numeric_limits<uint32_t>::max();
+            //            iv_max = std::numeric_limits<uint32_t>::min();
+            Context<REAL_T, group>& context = Variable::GetContext();
+            if (context.IsRecording()) {
+                //                this->id_m = expr.GetId();
+                //                ind_iterator it;
+                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                //                    bool found = false;
+                //#if defined(USE_HASH_TABLE)
+                //                    this->gradients_m.Insert(*it)->value = expr.Derivative(*it, found);
+                //#else
+                //                    this->gradients_m[(*it)] = expr.Derivative(*it, found);
+                //#endif
+                //                
+                //            }
+
+                if (context.IsUsingAdjointTape()) {
+                    this->RecordAdjoint(expr, context);
+                } else {
+                    this->AssignGradient(expr, context);
+                }
+                if (context.IsSupportingArbitraryOrder()) {
+                    this->AssignStatements(expr, context);
+                }
+            }
+            value_m = expr.GetValue();
+
+        }
+
+        ~Variable() {
+            delete storage;
+#if !defined(USE_HASH_TABLE)
+            //            if (this->is_independent_m) {
+            //                this->independent_variables_g.erase(this->GetId());
+            //            }
+            //            this->statements_m.clear();
+            //            this->gradients_m.clear();
+
+#endif
+        }
+
+        /**
+         * Returns the VariableStorage for this variable. Most variables never
+         * touch their storage, so it is only allocated on the first call
+         * rather than in every constructor.
+         *
+         * @return
+         */
+        VariableStorage<REAL_T>* GetStorage() {
+            if (this->storage == NULL) {
+                this->storage = new DefaultStorage<REAL_T>();
+            }
+            return this->storage;
+        }
+
+        /**
+         * Number of nodes of the recorded expression of this variable, for
+         * arbitrary order.
+         */
+        size_t Size() {
+            if (!Variable::GetExpressionGraph().IsLive(this->node_m)) {
+                return 0;
+            }
+            std::vector<uint32_t> order;
+            Variable::GetExpressionGraph().Sort(this->node_m, order);
+            return order.size();
+        }
+
+        /**
+         * Control function. If true, derivatives are computed. If false
+         * expressions are only evaluated.
+         * 
+         * @param is_recording
+         */
+        static void SetRecording(const bool &is_recording) {
+            Context<REAL_T, group>::Instance().SetRecording(is_recording);
+        }
+
+        /**
+         * If true, derivatives are calculated and stored. If false,
+         * expressions are evaluated for value only.
+         * 
+         * @return 
+         */
+        static bool IsRecording() {
+            return Context<REAL_T, group>::Instance().IsRecording();
+        }
+
+        /**
+         * If set to true, the expression is recorded into a vector of 
+         * statements that can be manipulated to compute derivatives of 
+         * arbitrary order. This functionality is costly and is rarely required,
+         * thus default setting is false.
+         * 
+         * @param support_arbitrary_order
+         */
+        static void SetSupportArbitraryOrder(const bool &support_arbitrary_order) {
+            Context<REAL_T, group>::Instance().SetSupportArbitraryOrder(support_arbitrary_order);
+        }
+
+        /*
+         * If true, expressions are recorded into a vector of statements that 
+         * can be used later to compute derivatives of arbitrary order, or
+         * be used to build expression strings.
+         * 
+         */
+        static bool IsSupportingArbitraryOrder() {
+            return Context<REAL_T, group>::Instance().IsSupportingArbitraryOrder();
+        }
+
+        /**
+         * If set to true, expressions record their local partial derivatives
+         * on the per-thread AdjointTape instead of computing a forward mode 
+         * derivative for every independent variable. Derivatives are then 
+         * obtained with a single reverse sweep the first time WRT is called
+         * on the result. Default setting is false.
+         * 
+         * @param use_adjoint_tape
+         */
+        static void SetUseAdjointTape(const bool &use_adjoint_tape) {
+            Context<REAL_T, group>::Instance().SetUseAdjointTape(use_adjoint_tape);
+        }
+
+        /**
+         * If true, derivatives are computed in reverse mode using the 
+         * AdjointTape.
+         * 
+         * @return 
+         */
+        static bool IsUsingAdjointTape() {
+            return Context<REAL_T, group>::Instance().IsUsingAdjointTape();
+        }
+
+        /**
+         * Returns the adjoint tape for the calling thread.
+         * 
+         * @return 
+         */
+        static AdjointTape<REAL_T>& GetAdjointTape() {
+            return Context<REAL_T, group>::Instance().GetAdjointTape();
+        }
+
+        /**
+         * Returns the automatic differentiation context of the calling 
+         * thread.
+         * 
+         * @return 
+         */
+        static Context<REAL_T, group>& GetContext() {
+            return Context<REAL_T, group>::Instance();
+        }
+
+        /**
+         * Returns the arbitrary order ExpressionGraph of the calling thread.
+         * 
+         * @return 
+         */
+        static ExpressionGraph<REAL_T>& GetExpressionGraph() {
+            return Context<REAL_T, group>::Instance().GetExpressionGraph();
+        }
+
+        /**
+         * Returns the value of this variable.
+         * 
+         * @return 
+         */
+        inline const REAL_T GetValue() const {
+            return this->value_m;
+        }
+
+        /**
+         * Returns the statements recorded for this variable when arbitrary 
+         * order is supported, gathered from the ExpressionGraph as a 
+         * self-contained list in which every node appears once.
+         * 
+         * @return 
+         */
+        ExpressionStatements GetStatements() const {
+            ExpressionStatements statements;
+            if (this->GetId() != 0) {
+                statements.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
+            } else {
+                Variable::GetExpressionGraph().Gather(this->node_m, statements);
+            }
+            return statements;
+        }
+
+        /**
+         * The node of this variable on the ExpressionGraph, 0 if none.
+         */
+        inline uint64_t GetNode() const {
+            return this->node_m;
+        }
+
+        /**
+         * Sets the value of this variable. If the variable is bounded, 
+         * the value will be set between the min and max boundary. If the
+         * value is less than the minimum boundary, the variables value is 
+         * set to minimum boundary. If the  value is greater than the maximum
+         * boundary, the variables value is set to maximum boundary. If the 
+         * value is signaling nan, the value is set to the mid point between
+         * the min and max boundary. 
+         * 
+         * @param value
+         */
+        void SetValue(const REAL_T &value) {
+            if (this->bounded_m) {
+                if (value != value) {//nan
+                    this->value_m = this->min_boundary_m + (this->max_boundary_m - this->min_boundary_m) / 2.0;
+
+                    return;
+                }
+
+                if (value<this->min_boundary_m) {
+                    this->value_m = this->min_boundary_m;
+                } else if (value>this->max_boundary_m) {
+                    this->value_m = this->max_boundary_m;
+
+
+                } else {
+                    this->value_m = value;
+                }
+            } else {
+                this->value_m = value;
+            }
+        }
+
+        /**
+         * Returns the name of this variable. Names are not initialized and 
+         * if it is not set this function will return a empty string.
+         * @return 
+         */
+        std::string GetName() const {
+            return name_m;
+        }
+
+        /**
+         * Set the name of this variable.
+         * 
+         * @param name
+         */
+        void SetName(std::string name) {
+            this->name_m = name;
+        }
+
+        /**
+         * Returns true if this variable is bounded. Otherwise,
+         * false.
+         * 
+         * @return 
+         */
+        bool IsBounded() {
+            return this->bounded_m;
+        }
+
+        /**
+         * Set the min and max boundary for this variable. 
+         * @param min
+         * @param max
+         */
+        void SetBounds(const REAL_T& min, const REAL_T& max) {
+            this->bounded_m = true;
+            this->max_boundary_m = max;
+            this->min_boundary_m = min;
+            this->SetValue(this->GetValue());
+        }
+
+        /**
+         * Return the minimum boundary for this variable. The default value 
+         * is the results of std::numeric_limits<REAL_t>::min().
+         * 
+         * @return 
+         */
+        const REAL_T GetMinBoundary() {
+            return this->min_boundary_m;
+        }
+
+        /**
+         * Return the maximum boundary for this variable. The default value 
+         * is the results of std::numeric_limits<REAL_t>::max().
+         * 
+         * @return 
+         */
+        const REAL_T GetMaxBoundary() {
+            return this->max_boundary_m;
+        }
+
+        /**
+         * Make this Variable an independent variable. If set to true,
+         * the Variables unique identifier is registered in the static set
+         * of independent variables. During function evaluations, gradient 
+         * information is accumulated in post-order wrt to variables in the 
+         * static set of independent variables. If set false, this Variables 
+         * unique identifier will be removed from the set, if it existed.
+         * 
+         * 
+         * To access the derivative wrt to a Variable, call function:
+         * 
+         * const REAL_t wrt(const Variable & ind)
+         * 
+         * 
+         * @param is_independent
+         */
+        void SetAsIndependent(const bool &is_independent) {
+            if (this->iv_id_m == 0) {
+                this->iv_id_m = Context<REAL_T, group>::Instance().NextId();
+                this->node_m = 0;
+                //                this->id_m = iv_id_m;
+                //                if (this->iv_min == std::numeric_limits<uint32_t>::max() && this->iv_max == std::numeric_limits<uint32_t>::min()) {
+                //                    this->iv_max = this->GetId();
+                //                    this->iv_min = this->GetId();
+                //                }
+            }
+            if (this->is_independent_m && !is_independent) {
+                //                Variable::independent_variables_g.erase(this->GetId());
+                this->id_m = 0;
+                this->is_independent_m = false;
+            }
+
+            if (!this->is_independent_m && is_independent) {
+                //                Variable::independent_variables_g.insert(this->GetId());
+                this->id_m = this->iv_id_m;
+                this->is_independent_m = true;
+            }
+        }
+
+        bool IsIndependent() {
+            return this->is_independent_m;
+        }
+
+        /**
+         * Returns the derivative with respect to a variables who's
+         * unique identifier is equal to the parameter id.
+         * 
+         * @param id
+         * @param found
+         * @return 
+         */
+        const REAL_T Derivative(const uint32_t &id, bool &found) const {
+
+
+
+            if (this->Cast().id_m == id) {
+                found = true;
+                return 1.0;
+
+            } else {
+
+#if defined(USE_HASH_TABLE)
+                HashTable::Cell* entry = this->gradients_m.Lookup(id);
+
+                if (entry != NULL) {
+                    return entry->value;
+                } else {
+                    return 0.0;
+                }
+
+#else
+
+                //                if(id < this->g.size()){
+                //                    if(g[id] != 0){
+                //                        found = true;
+                //                    }
+                //                    
+                //                    return g[id];
+                //                }
+
+                //                std::find(this->ids_m.begin(),this->ids_m.end(),id );
+
+                //                if (ad::binary_search(ids_m.begin(), ids_m.end(), id)) {
+                //                    found = true;
+                //                    return g[id];
+                //                } else {
+                //                    return 0.0;
+                //                }
+                //                
+                REAL_T value;
+                if (this->g.Find(id, value)) {
+                    found = true;
+                    return value;
+                } else {
+                    return 0.0;
+                }
+                //                if (this->ids_m.find(id) != this->ids_m.end()) {
+                //                    found = true;
+                //                    return g[id].second;
+                //                } else {
+                //                    return 0.0;
+                //                }
+
+                //                 const_grads_iterator git = this->gradients_m.find(id);
+                //                if (git != this->gradients_m.end()) {
+                //                    found = true;
+                //                    return git->second;
+                //                } else {
+                //                    Variable<REAL_T>::misses_g++;
+                //                    return 0.0;
+                //                }
+            }
+
+#endif
+
+
+        }
+
+        void GetIdRange(uint32_t &min, uint32_t & max) const {
+
+            if (this->iv_min < min) {
+                min = this->iv_min;
+            }
+
+            if (this->iv_max > max) {
+                max = this->iv_max;
+            }
+
+            if (this->GetId() > 0) {
+                if (this->GetId() < min) {
+                    min = this->GetId();
+                }
+
+                //                if (this->GetId()) {
+                //                    max = this->GetId();
+                //                }
+            }
+            //
+            //                        if (min == std::numeric_limits<uint32_t>::max()) {
+            //                            min = max;
+            //                        }
+
+            //            std::cout << min << " " << max << "\n";
+
+
+
+        }
+
+        void Push(StatementList<REAL_T> &statements) const {
+            ExpressionGraph<REAL_T>& graph = Variable::GetExpressionGraph();
+            if (this->GetId() == 0 && graph.IsLive(this->node_m)) {
+                statements.push_back(Statement<REAL_T > (NODE, REAL_T(0), graph.Position(this->node_m)));
+                return;
+            }
+            //independent variables are always leaves, and a variable 
+            //recorded without a live node enters as a constant.
+            statements.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
+        }
+
+        inline void PushAdjoints(AdjointTape<REAL_T> &tape, const REAL_T &coefficient) const {
+            if (this->GetId() != 0) {
+                tape.PushIndependent(this->GetId(), coefficient);
+            } else {
+                tape.PushDependent(this->tape_index_m, coefficient);
+            }
+        }
+
+        inline void PushAdjoints(GradientWorkspace<REAL_T> &workspace, const REAL_T &coefficient) const {
+            if (this->GetId() != 0) {
+                workspace.entries_m.PushBack(this->GetId(), coefficient);
+            } else {
+                typename GradientVector::const_iterator it;
+                for (it = this->g.begin(); it != this->g.end(); ++it) {
+                    workspace.entries_m.PushBack(it->first, coefficient * it->second);
+                }
+            }
+        }
+
+        inline void PushAdjoints(BranchRecorder<REAL_T> &recorder, const REAL_T &) const {
+            Context<REAL_T, group>& context = Variable::GetContext();
+            if (context.IsRecordingBranches()) {
+                recorder.branches_m = &context.GetBranches();
+                recorder.graph_m = &context.GetExpressionGraph();
+            }
+        }
+
+        inline void PushIds(IdsSet &ids) const {
+            if (this->GetId() != 0) {
+                //                uint32_t id = uint32_t
+                ids.insert(this->GetId());
+            } else {
+                typename GradientVector::const_iterator it;
+                for (it = this->g.begin(); it != this->g.end(); ++it) {
+                    ids.insert(it->first);
+                }
+            }
+        }
+
+        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+
+            if (Variable<REAL_T, group>::IsRecording()) {
+
+                if (this->GetId() != 0) {
+                    ids->AddId(this->GetId());
+                }
+
+                if (this->storage == NULL) {
+                    return;
+                }
+
+                if (this->GetId() == 0) {
+                    ids->Merge(this->storage);
+                }
+
+                for (int i = 0; i < this->storage->DerivativeInfoSize(); i++) {
+                    ids->SetDerivative(this->storage->GetDerivative(i), i);
+                }
+
+                if (Variable<REAL_T, group>::IsSupportingArbitraryOrder()) {
+                    for (int i = 0; i < this->storage->ExpressionSize(); i++) {
+                        ids->AddStatement(this->storage->StatementAt(i));
+                    }
+                }
+
+            }
+        }
+
+        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
+            typename GradientVector::const_iterator it;
+            for (it = this->g.begin(); it != this->g.end(); ++it) {
+                if (it->first < ids.size()) {
+                    ids[it->first].first = true;
+                }
+            }
+        }
+
+        /**
+         * Finds the derivative in the encapsulated gradient map 
+         * w.r.t a variable. 
+         * 
+         * @param ind
+         * @return 
+         */
+        const REAL_T WRT(const Variable & ind) {
+
+            if (Variable::IsUsingAdjointTape()) {
+                if (this->GetId() != 0) {
+                    return this->GetId() == ind.GetId() ? 1.0 : 0.0;
+                }
+                return Variable::GetAdjointTape().Adjoint(this->tape_index_m, ind.GetId());
+            }
+
+#if defined(USE_HASH_TABLE)
+            HashTable::Cell* entry = this->gradients_m.Lookup(ind.GetId());
+
+            if (entry != NULL) {
+                return entry->value;
+            } else {
+                return 0.0;
+            }
+#else
+
+            REAL_T value;
+            if (this->g.Find(ind.GetId(), value)) {
+                return value;
+            } else {
+                return 0.0;
+            }
+            //            if (this->ids_m.find(ind.GetId()) != this->ids_m.end()) {
+            //                //                found = true;
+            //                return g[ind.GetId()].second;
+            //            } else {
+            //                return 0.0;
+            //            }
+
+            //            const_grads_iterator git = this->gradients_m.find(ind.GetId());
+            //            if (git != this->gradients_m.end()) {
+            //                return git->second;
+            //            } else {
+            //                return 0;
+            //            }
+#endif
+        }
+
+        /**
+         * Finds the derivative in the encapsulated gradient map 
+         * w.r.t a variable. 
+         * @param ind
+         * @return 
+         */
+        const REAL_T WRT(const Variable & ind) const {
+
+            if (Variable::IsUsingAdjointTape()) {
+                if (this->GetId() != 0) {
+                    return this->GetId() == ind.GetId() ? 1.0 : 0.0;
+                }
+                return Variable::GetAdjointTape().Adjoint(this->tape_index_m, ind.GetId());
+            }
+
+#if defined(USE_HASH_TABLE)
+            HashTable::Cell* entry = this->gradients_m.Lookup(ind.GetId());
+
+            if (entry != NULL) {
+                return entry->value;
+            } else {
+                return 0.0;
+            }
+#else
+
+            REAL_T value;
+            if (this->g.Find(ind.GetId(), value)) {
+                return value;
+            } else {
+                return 0.0;
+            }
+            //            if (this->ids_m.find(ind.GetId()) != this->ids_m.end()) {
+            //                //                found = true;
+            //                return g[ind.GetId()].second;
+            //            } else {
+            //                return 0.0;
+            //            }
+            //            const_grads_iterator git = this->gradients_m.find(ind.GetId());
+            //            if (git != this->gradients_m.end()) {
+            //                return git->second;
+            //            } else {
+            //                return 0;
+            //            }
+#endif
+        }
+
+        void Serialize(std::ostream &out) {
+
+            bool little_endian = true;
+
+            int num = 1;
+            if (*(char *) &num == 1) {
+                little_endian = true;
+            } else {
+                little_endian = false;
+            }
+
+            //id stuff
+            uint32_t id = this->GetId();
+
+
+            if (!little_endian) {
+                id = SwapBytes<uint32_t > (id);
+            }
+
+            out.write(reinterpret_cast<const char*> (&id), sizeof (uint32_t));
+
+            //name
+            uint32_t namesize = (uint32_t)this->GetName().size();
+
+            if (!little_endian) {
+                namesize = SwapBytes<uint32_t > (namesize);
+            }
+            out.write(reinterpret_cast<const char*> (&namesize), sizeof (uint32_t));
+
+
+            out.write(this->GetName().data(), namesize);
+            //is independent
+            if (this->IsIndependent()) {
+                out << '1';
+            } else {
+                out << '0';
+            }
+            //value stuff
+
+            //bounded
+            if (this->IsBounded()) {
+                out << '1';
+            } else {
+                out << '0';
+            }
+            //min
+            REAL_T value = this->GetMinBoundary();
+            if (!little_endian) {
+                value = SwapBytes<REAL_T > (value);
+            }
+
+            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+
+            //max
+            value = this->GetMaxBoundary();
+
+            if (!little_endian) {
+                value = SwapBytes<REAL_T > (value);
+            }
+            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+
+            //actual value
+            value = this->GetValue();
+
+            if (!little_endian) {
+                value = SwapBytes<REAL_T > (value);
+            }
+            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+
+            //derivative info, one (id, value) pair per entry
+            uint32_t dsize = this->g.Size();
+
+
+            if (!little_endian) {
+                dsize = SwapBytes<uint32_t > (dsize);
+            }
+            out.write(reinterpret_cast<const char*> (&dsize), sizeof (dsize));
+
+
+            for (size_t i = 0; i < this->g.Size(); i++) {
+
+                id = this->g[i].first;
+                value = this->g[i].second;
+
+                if (!little_endian) {
+                    id = SwapBytes<uint32_t > (id);
+                }
+
+                out.write(reinterpret_cast<const char*> (&id), sizeof (id));
+
+                if (!little_endian) {
+                    value = SwapBytes<REAL_T > (value);
+                }
+
+                out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+
+            }
+
+            //statements, one block per array
+            ExpressionStatements statements = this->GetStatements();
+            this->WriteBlock(out, statements.Ops(), little_endian);
+            this->WriteBlock(out, statements.Operands(), little_endian);
+            this->WriteBlock(out, statements.Constants(), little_endian);
+
+        }
+
+        const Variable<REAL_T, group> Deserialize(std::istream &in) {
+
+
+            Variable v;
+
+            bool little_endian = true;
+
+            int num = 1;
+            if (*(char *) &num == 1) {
+                little_endian = true;
+            } else {
+                little_endian = false;
+            }
+
+            if (!in.good()) {
+                std::cout << "Error in Deserialize(std::istream &in), cannot read stream!";
+                return v;
+            }
+
+
+
+            //read id
+            uint32_t* id;
+            char idc[sizeof (uint32_t) ];
+            in.read(idc, sizeof (uint32_t));
+            id = reinterpret_cast<uint32_t*> (idc);
+
+            if (!little_endian) {
+                v.id_m = SwapBytes<uint32_t > (*id);
+            } else {
+                v.id_m = *id;
+            }
+
+            //read name
+            uint32_t* ns;
+            uint32_t name_size;
+            char nsc[sizeof (uint32_t) ];
+            in.read(nsc, sizeof (uint32_t));
+            ns = reinterpret_cast<uint32_t*> (nsc);
+
+            if (!little_endian) {
+                name_size = SwapBytes<uint32_t > (*ns);
+            } else {
+                name_size = *ns;
+            }
+
+            char namec[name_size + 1];
+            namec[name_size] = '\0';
+            in.read(namec, name_size);
+            v.SetName(std::string(namec));
+
+
+
+
+            //is independent
+            char inde;
+            in >> inde;
+
+            if (inde == '1') {
+                v.is_independent_m = true;
+            } else {
+                v.is_independent_m = false;
+            }
+
+            //is bounded
+            char bounded;
+            in >> bounded;
+
+            if (bounded == '1') {
+                v.bounded_m = true;
+            } else {
+                v.bounded_m = false;
+            }
+
+
+            //values min,max,actual
+            REAL_T* value_ptr;
+            REAL_T value;
+            char valc[sizeof (REAL_T)];
+            in.read(valc, sizeof (REAL_T));
+            value_ptr = reinterpret_cast<REAL_T*> (valc);
+            if (!little_endian) {
+                value = SwapBytes<uint32_t > (*value_ptr);
+            } else {
+                value = *value_ptr;
+            }
+            v.min_boundary_m = value;
+
+            in.read(valc, sizeof (REAL_T));
+            value_ptr = reinterpret_cast<REAL_T*> (valc);
+
+            if (!little_endian) {
+                value = SwapBytes<uint32_t > (*value_ptr);
+            } else {
+                value = *value_ptr;
+            }
+            v.max_boundary_m = value;
+
+
+            in.read(valc, sizeof (REAL_T));
+            value_ptr = reinterpret_cast<REAL_T*> (valc);
+
+            if (!little_endian) {
+                value = SwapBytes<uint32_t > (*value_ptr);
+            } else {
+                value = *value_ptr;
+            }
+            v.value_m = value;
+
+
+            //gradients
+            uint32_t* gsize;
+            uint32_t gs;
+            char gsizec[sizeof (uint32_t) ];
+            in.read(gsizec, sizeof (uint32_t));
+            gsize = reinterpret_cast<uint32_t*> (gsizec);
+            if (!little_endian) {
+                gs = SwapBytes<uint32_t > (*gsize);
+            } else {
+                gs = *gsize;
+            }
+
+
+
+            v.g.Clear();
+            v.g.Reserve(gs);
+
+
+            for (uint32_t i = 0; i < gs; i++) {
+
+                uint32_t gid;
+                in.read(idc, sizeof (uint32_t));
+                id = reinterpret_cast<uint32_t*> (idc);
+                if (!little_endian) {
+                    gid = SwapBytes<uint32_t > (*id);
+                } else {
+                    gid = *id;
+                }
+
+
+                in.read(valc, sizeof (REAL_T));
+                value_ptr = reinterpret_cast<REAL_T*> (valc);
+                if (!little_endian) {
+                    value = SwapBytes<uint32_t > (*value_ptr);
+                } else {
+                    value = *value_ptr;
+                }
+
+                //                std::cout << v[] << "\n";
+                v.g.PushBack(gid, value);
+
+            }
+
+            //statements
+            std::vector<uint8_t> ops;
+            std::vector<uint32_t> operands;
+            std::vector<REAL_T> constants;
+            this->ReadBlock(in, ops, little_endian);
+            this->ReadBlock(in, operands, little_endian);
+            this->ReadBlock(in, constants, little_endian);
+            ExpressionStatements statements;
+            statements.SetArrays(ops, operands, constants);
+            if (v.GetId() == 0) {
+                v.node_m = Variable::GetExpressionGraph().Link(statements);
+            }
+
+            return v;
+
+        }
+
+        /**
+         * Set the variable equal to the real type rhs.
+         * 
+         * The gradient map will be cleared.
+         * 
+         * @param rhs
+         * @return 
+         */
+        Variable& operator=(const REAL_T& rhs) {
+            this->SetValue(rhs);
+            //            iv_min = std::numeric_limits<uint32_t>::max();
+            //            iv_max = std::numeric_limits<uint32_t>::min();
+
+#if defined(USE_HASH_TABLE)
+            this->gradients_m.Clear();
+#else
+            //            this->gradients_m.clear();
+            this->g.Clear();
+            this->tape_index_m = 0;
+            this->node_m = 0;
+#endif
+
+            return *this;
+        }
+
+        /**
+         * Sets the value of this Variable to that of rhs. Derivatives 
+         * are stored in the encapsulated gradient map.
+         * 
+         * @param rhs
+         * @return 
+         */
+        Variable& operator=(const Variable& other) {
+            //                        this->id = other.getId();
+            //has_m.resize(IDGenerator::instance()->current() + 1);
+            this->SetValue(other.GetValue());
+
+            //            this->gradients.clear();
+            Context<REAL_T, group>& context = Variable::GetContext();
+            if (context.IsRecording()) {
+
+#if defined(USE_HASH_TABLE)
+                ind_iterator it;
+                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                    bool found = false;
+                    this->gradients_m.Insert(*it)->value = other.Derivative(*it, found);
+                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+                }
+#else
+                //                this->gradients.insert(rhs.gradients.begin(), rhs.gradients.end());
+                //                ind_iterator it;
+                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                //                    bool found = false;
+                //                    this->gradients_m[(*it)] = other.Derivative(*it, found);
+                //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+                //                }
+                // other.GetIdRange(this->iv_min, this->iv_max);
+                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
+                if (context.IsUsingAdjointTape()) {
+                    if (other.GetId() != 0) {
+                        this->RecordAdjoint(other, context);
+                    } else {
+                        this->tape_index_m = other.tape_index_m;
+                    }
+                } else {
+                    if (other.GetId() != 0) {
+                        this->g.Clear();
+                        this->g.PushBack(other.GetId(), static_cast<REAL_T> (1.0));
+                    } else {
+                        this->g.Assign(other.g);
+                    }
+                }
+
+
+#endif
+
+                if (context.IsSupportingArbitraryOrder()) {
+                    this->AssignStatements(other, context);
+                }
+
+            }
+            this->is_independent_m = other.is_independent_m;
+            return *this;
+        }
+
+#if __cplusplus >= 201103L
+
+        /**
+         * Move assignment. Same result as copy assignment, but in forward 
+         * mode the gradient buffers are exchanged rather than copied.
+         * 
+         * @param other
+         * @return 
+         */
+        Variable& operator=(Variable&& other) {
+            Context<REAL_T, group>& context = Variable::GetContext();
+            if (this == &other || !context.IsRecording() || context.IsUsingAdjointTape()
+                    || context.IsSupportingArbitraryOrder() || other.GetId() != 0) {
+                return *this = static_cast<const Variable&> (other);
+            }
+            this->SetValue(other.GetValue());
+            this->g.Swap(other.g);
+            this->is_independent_m = other.is_independent_m;
+            return *this;
+        }
+#endif
+
+        /**
+         * Set the Variables value to the result of the expression rhs. 
+         * Derivatives are calculated and stored in the encapsulated 
+         * gradient map.
+         * @param rhs
+         * @return 
+         */
+        template<class T>
+        Variable& operator=(const ExpressionBase<REAL_T, T>& expr) {
+
+            //            this->id_m = expr.GetId();
+            //has_m.resize(IDGenerator::instance()->current() + 1);
+            Context<REAL_T, group>& context = Variable::GetContext();
+            if (context.IsRecording()) {
+                //                ind_iterator it; // = this->gradients.lower_bound();
+#if defined(USE_HASH_TABLE)
+                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                    bool found = false;
+                    this->gradients_m.Insert(*it)->value = expr.Derivative(*it, found);
+                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+                }
+#else
+                //                                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                //                                    bool found = false;
+                //                                    this->gradients_m[(*it)] = expr.Derivative(*it, found);
+                //                                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+                //                                }
+#endif
 
-        typedef IdsSet indepedndent_variables;
-        typedef IdsSet::iterator indepedndent_variables_iterator;
-        typedef IdsSet::const_iterator const_indepedndent_variables_iterator;
-        indepedndent_variables ids_m;
+                if (context.IsUsingAdjointTape()) {
+                    this->RecordAdjoint(expr, context);
+                } else {
+//                                ids_m.clear();
+                    //                ids_m.set_empty_key(NULL);
+                    this->AssignGradient(expr, context);
+                }
+                //                expr.GetIdRange(this->iv_min, this->iv_max);
+                if (context.IsSupportingArbitraryOrder()) {
+                    this->AssignStatements(expr, context);
+                }
 
-        typedef std::vector<Statement<REAL_T> > ExpressionStatements;
-        ExpressionStatements statements_m;
 
-        REAL_T value_m;
-    public:
+            }
+            this->SetValue(expr.GetValue());
+            return *this;
+        }
 
-        DefaultStorage() : value_m(0) {
+        /**
+         * 
+         * @param rhs
+         * @return 
+         */
+        template<class T>
+        Variable& operator+=(const ExpressionBase<REAL_T, T>& rhs) {
+            if (Variable::IsRecording() && Variable::IsUsingAdjointTape()) {
+                return *this = (*this + rhs);
+            }
+            //            return *this = (*this +rhs);
+            //has_m.resize(IDGenerator::instance()->current() + 1);
+            if (Variable::IsRecording()) {
 
-        }
+#if defined(USE_HASH_TABLE)
+                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                    bool found = false;
+                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value + rhs.Derivative(*it, found);
+                }
+#else
+                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                //                    bool found = false;
+                //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] + rhs.Derivative(*it, found);
+                //                }
+#endif
 
-        void SetValue(const REAL_T &value) {
-            this->value_m = value;
-        }
+                // rhs.GetIdRange(this->iv_min, this->iv_max);
 
-        const REAL_T GetValue() {
-            return this->value_m;
-        }
+                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
+                this->AccumulateGradient(rhs);
 
-        const std::pair<bool, REAL_T> GetDerivative(const uint32_t &id) {
+                if (Variable::IsSupportingArbitraryOrder()) {
+                    this->AccumulateStatements(rhs, PLUS);
+                }
 
-            if (id> this->g.size()) {
-                return g[id];
-            } else {
-                return std::pair<bool, REAL_T > (false, 0);
             }
-
+            this->value_m += rhs.GetValue();
+            return *this;
         }
 
-        void SetDerivative(const std::pair<bool, REAL_T> &entry, const uint32_t &id) {
-
-            if (g.size() < id) {
-                g.resize(id + 1);
+        Variable& operator+=(Variable& rhs) {
+            if (Variable::IsRecording() && Variable::IsUsingAdjointTape()) {
+                return *this = (*this + rhs);
             }
-            g[id] = entry;
-        }
+            if (Variable::IsRecording()) {
+                //has_m.resize(IDGenerator::instance()->current() + 1);
 
-        void AddId(const uint32_t &id) {
-            this->ids_m.insert(id);
-        }
+#if defined(USE_HASH_TABLE)
+                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                    bool found = false;
+                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value + rhs.Derivative(*it, found);
+                }
+#else
+                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+                //                    bool found = false;
+                //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] + rhs.Derivative(*it, found);
+                //                }
+#endif
 
-        void Merge(VariableStorage<REAL_T>* other) {
-            DefaultStorage<REAL_T>* ds = (DefaultStorage<REAL_T>*)other;
-            this->ids_m.insert(ds->ids_m.begin(), ds->ids_m.end());
-        }
+                // rhs.GetIdRange(this->iv_min, this->iv_max);
+                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
+                this->AccumulateGradient(rhs);
 
-        const uint32_t DerivativeInfoSize() {
-            return this->g.size();
-        }
+                if (Variable::IsSupportingArbitraryOrder()) {
+                    this->AccumulateStatements(rhs, PLUS);
+                }
 
-        const void ClearDerivativeInfo() {
-            this->g.clear();
+            }
+            //            rhs.GetIdRange(this->iv_min, this->iv_max);
+            this->value_m += rhs.GetValue();
+            return *this;
         }
 
-        void AddStatement(const Statement<REAL_T> &statement) {
-            this->statements_m.push_back(statement);
+        template<class T>
+        Variable& operator-=(const ExpressionBase<REAL_T, T>& rhs) {
+            return *this = (*this -rhs);
+            //            if (Variable::IsRecording()) {
+            //                ind_iterator it;
+            //#if defined(USE_HASH_TABLE)
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m.Insert((*it))->value = (this->gradients_m.Lookup(*it)->value - rhs.Derivative(*it, found));
+            //                }
+            //#else
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] - rhs.Derivative(*it, found));
+            //                }
+            //#endif
+            //                if (Variable::IsSupportingArbitraryOrder()) {
+            //                    rhs.Push(this->statements_m);
+            //                    this->statements_m.push_back(Statement(MINUS));
+            //                }
+            //            }
+            //            this->value_m -= rhs.GetValue();
+            //            return *this;
         }
 
-        const uint32_t ExpressionSize() {
-            return this->statements_m.size();
+        Variable& operator-=(Variable& rhs) {
+            return *this = (*this - rhs);
         }
 
-        Statement<REAL_T> StatementAt(const uint32_t &index) {
-            //            if(index >= this->statements_m.size()){
-            //                std::cout<<"Error Statement<REAL_T> StatementAt(const uint32_t &index), index out of bounds."
+        template<class T>
+        Variable& operator*=(const ExpressionBase<REAL_T, T>& rhs) {
+            return *this = (*this * rhs);
+            //            if (Variable::IsRecording()) {
+            //                ind_iterator it;
+            //#if defined(USE_HASH_TABLE)
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
+            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+            //                }
+            //#else
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
+            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+            //                }
+            //#endif
+            //                if (Variable::IsSupportingArbitraryOrder()) {
+            //                    rhs.Push(this->statements_m);
+            //                    this->statements_m.push_back(Statement(MULTIPLY));
+            //                }
             //            }
-
-            return this->statements_m[index];
+            //            this->value_m *= rhs.GetValue();
+            return *this;
         }
 
-        void ClearExpression() {
-            this->statements_m.clear();
+        Variable& operator*=(Variable& rhs) {
+            return *this = (*this * rhs);
         }
 
-        void Reset() {
-            this->g.clear();
-            this->ids_m.clear();
-            this->statements_m.clear();
+        template<class T>
+        Variable& operator/=(const ExpressionBase<REAL_T, T>& rhs) {
+            return *this = (*this / rhs);
+            //            if (Variable::IsRecording()) {
+            //                ind_iterator it;
+            //#if defined(USE_HASH_TABLE)
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m.Insert(*it)->value = (this->gradients_m.Lookup(*it)->value * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
+            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+            //                }
+            //#else
+            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
+            //                    bool found = false;
+            //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
+            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+            //                }
+            //#endif
+            //                if (Variable::IsSupportingArbitraryOrder()) {
+            //                    rhs.Push(this->statements_m);
+            //                    this->statements_m.push_back(Statement(DIVIDE));
+            //                }
+            //            }
+            //            this->value_m /= rhs.GetValue();
+            return *this;
         }
 
-    };
-
-    /**
-     * Variable class used for calculations and storage of computed derivatives.
-     * 
-     * Derivatives are only computed for variables marked as independent 
-     * variables. To make a variable independent use:
-     * 
-     * constructor:
-     * 
-     * Variable(const REAL_T& value, bool is_independent = false)
-     * 
-     * or
-     * 
-     * Member Function:
-     * 
-     * void SetAsIndependent(const bool &is_independent)
-     * 
-     * 
-     * 
-     */
-    template<class REAL_T, int group>
-    class Variable : public ExpressionBase<REAL_T, Variable<REAL_T, group> > {
-        VariableStorage<REAL_T>* storage;
-        REAL_T value_m;
-
-        std::string name_m;
-        bool bounded_m;
-        REAL_T min_boundary_m;
-        REAL_T max_boundary_m;
-        bool is_independent_m;
-        uint32_t iv_id_m; //id when is a independent variable.
-
-        //        uint32_t iv_min; //if this variable is caching derivatives, this is the min independent variable.
-        //        uint32_t iv_max; //if this variable is caching derivatives, this is the max independent variable.
-
-
-        //        static std::set<uint32_t> independent_variables_g;
-        static bool is_recording_g;
-
-        static bool is_supporting_arbitrary_order;
-
-
-        typedef std::vector<std::pair<bool, REAL_T> > GradientVector;
-        GradientVector g;
-        //        GradientMap gradients_m;
-
-        typedef IdsSet indepedndent_variables;
-        typedef IdsSet::iterator indepedndent_variables_iterator;
-        typedef IdsSet::const_iterator const_indepedndent_variables_iterator;
-        indepedndent_variables ids_m;
-        //        std::vector<bool> has_m;
-        typedef std::vector<Statement<REAL_T> > ExpressionStatements;
-        ExpressionStatements statements_m;
-
-        template <typename TT >
-        TT SwapBytes(const TT &u) {
-
-            union {
-                TT u;
-                unsigned char u8[sizeof (TT)];
-            } source, dest;
+        Variable& operator/=(Variable& rhs) {
+            return *this = (*this / rhs);
+        }
 
-            source.u = u;
+        // And likewise for a Constant on the rhs
 
-            for (size_t k = 0; k < sizeof (TT); k++)
-                dest.u8[k] = source.u8[sizeof (TT) - k - 1];
+        Variable& operator+=(const REAL_T& rhs) {
+            if (Variable::IsRecording()) {
+                if (Variable::IsSupportingArbitraryOrder()) {
+                    this->AccumulateStatements(rhs, PLUS);
+                }
+            }
+            value_m += rhs;
+            return *this;
+        }
 
-            return dest.u;
+        Variable& operator-=(const REAL_T& rhs) {
+
+            if (Variable::IsRecording()) {
+                if (Variable::IsSupportingArbitraryOrder()) {
+                    this->AccumulateStatements(rhs, MINUS);
+                }
+            }
+            value_m -= rhs;
+            return *this;
         }
 
+        Variable& operator*=(const REAL_T& rhs) {
+            return *this = (*this * rhs);
+        }
 
-    public:
-        static uint32_t misses_g;
+        Variable& operator/=(const REAL_T& rhs) {
+            return *this = (*this / rhs);
+        }
 
         /**
-         * Default conclassor.
+         * Returns the derivative of this Variable w.r.t. wrt from the 
+         * statements recorded with arbitrary order support. The statements 
+         * are compiled to an operand indexed tape and differentiated in one
+         * reverse sweep.
+         * 
+         * @param wrt
+         * @return 
          */
-        Variable() : ExpressionBase<REAL_T, Variable<REAL_T> >(0),
-        value_m(0.0),
-        bounded_m(false),
-        is_independent_m(false),
-        storage(new DefaultStorage<REAL_T>()),
-        iv_id_m(0) {
-
-            //            iv_min = std::numeric_limits<uint32_t>::max();
-            //            iv_max = std::numeric_limits<uint32_t>::min();
-            //this->ids_m.set_empty_key(NULL);
-            if (Variable::is_recording_g) {
-                if (Variable::IsSupportingArbitraryOrder()) {
-                    this->statements_m.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
-                }
+        const REAL_T Diff(const Variable &wrt) {
+            if (wrt.GetId() == 0) {
+                return 0.0;
             }
+            StatementTape<REAL_T>& tape = Variable::GetContext().GetGradientWorkspace().tape_m;
+            this->Compile(tape);
+            return tape.Derivative(wrt.GetId());
         }
 
         /**
-         * Conclass a variable with a initial value. Optional parameter to make
-         * it a independent variable.
+         * Compiles the expression recorded for this Variable with arbitrary
+         * order support into tape. Independent variables and variables 
+         * without a live node compile to a single leaf.
          * 
-         * @param value
-         * @param is_independent
+         * @param tape
          */
-        Variable(const REAL_T& value, bool is_independent = false) : storage(new DefaultStorage<REAL_T>()), value_m(value), is_independent_m(is_independent), iv_id_m(0) {
-            //this->ids_m.set_empty_key(NULL);
-            //            iv_min = std::numeric_limits<uint32_t>::max();
-            //            iv_max = std::numeric_limits<uint32_t>::min();
-            if (is_independent) {
-                //                this->id_m = IDGenerator::instance()->next();
-                this->SetAsIndependent(is_independent);
-                this->bounded_m = false;
-                this->min_boundary_m = std::numeric_limits<REAL_T>::min();
-                this->max_boundary_m = std::numeric_limits<REAL_T>::max();
-                //                Variable::independent_variables_g.insert(this->GetId());
-                if (Variable::IsSupportingArbitraryOrder()) {
-                    this->statements_m.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
-                }
+        void Compile(StatementTape<REAL_T> &tape) const {
+            ExpressionGraph<REAL_T>& graph = Variable::GetExpressionGraph();
+            if (this->GetId() != 0 || !graph.IsLive(this->node_m)) {
+                StatementList<REAL_T> leaf;
+                leaf.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
+                tape.Compile(leaf);
+                return;
             }
-
+            tape.Compile(graph, this->node_m);
         }
 
         /**
-         * Copy conclassor. 
+         * Writes the expression recorded for this Variable with arbitrary 
+         * order support as a compiled tape in the binary tape format, see 
+         * StatementTape::Write and MappedTape, or compressed, see 
+         * StatementTape::Encode. StatementTape::Read reads either.
          * 
-         * @param rhs
+         * @param out - a binary stream
+         * @param compressed
          */
-        Variable(const Variable& orig) : storage(new DefaultStorage<REAL_T>()) {
-
-            value_m = orig.GetValue();
-            this->id_m = orig.GetId();
-            this->iv_id_m = orig.iv_id_m;
-            //            orig.PushIds(ids_m);
-            //this->ids_m.set_empty_key(NULL);
-            ids_m.insert(orig.ids_m.begin(), orig.ids_m.end()); // = orig.ids_m;
-            //            g = orig.g;
-            g.reserve(orig.g.size());
-            g.insert(g.begin(), orig.g.begin(), orig.g.end());
-            //            has_m = orig.has_m;
-#if defined(USE_HASH_TABLE)
-            this->gradients_m = HashTable(orig.gradients_m);
-#else
-            //            this->gradients_m.insert(orig.gradients_m.begin(), orig.gradients_m.end());
-#endif
-            this->is_independent_m = orig.is_independent_m;
-            this->bounded_m = orig.bounded_m;
-            this->min_boundary_m = orig.min_boundary_m;
-            this->max_boundary_m = orig.max_boundary_m;
-            //            iv_min = orig.iv_min;
-            //            iv_max = orig.iv_max;
-            if (Variable::IsSupportingArbitraryOrder()) {
-                orig.Push(this->statements_m);
+        void WriteTape(std::ostream &out, bool compressed = false) const {
+            StatementTape<REAL_T> tape;
+            this->Compile(tape);
+            if (compressed) {
+                tape.Encode(out);
+            } else {
+                tape.Write(out);
             }
-
         }
 
         /**
-         * Conclasss a variable from expression expr.
-         * @param rhs
+         * Computes the derivatives of this Variable w.r.t. every Variable 
+         * in wrt in a single reverse sweep over the recorded statements.
+         * 
+         * @param wrt
+         * @param derivatives - resized to wrt.size()
          */
-        template<class T>
-        Variable(const ExpressionBase<REAL_T, T>& expr) : storage(new DefaultStorage<REAL_T>()) {
-
-            //has_m.resize(IDGenerator::instance()->current() + 1);
+        void Diff(const std::vector<Variable*> &wrt, std::vector<REAL_T> &derivatives) {
+            derivatives.resize(wrt.size());
+            std::fill(derivatives.begin(), derivatives.end(), REAL_T(0));
+            GradientWorkspace<REAL_T>& workspace = Variable::GetContext().GetGradientWorkspace();
+            std::vector<int32_t>& index = workspace.index_m;
+            Variable::IndexOf(wrt, index);
+            this->Compile(workspace.tape_m);
+            workspace.tape_m.Gradient(index, derivatives);
+        }
 
-            this->bounded_m = false;
-            //            iv_min = std::numeric_limits<uint32_t>::max();
-            //            iv_max = std::numeric_limits<uint32_t>::min();
-            if (Variable::is_recording_g) {
-                //                this->id_m = expr.GetId();
-                //                ind_iterator it;
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //#if defined(USE_HASH_TABLE)
-                //                    this->gradients_m.Insert(*it)->value = expr.Derivative(*it, found);
-                //#else
-                //                    this->gradients_m[(*it)] = expr.Derivative(*it, found);
-                //#endif
-                //                
-                //            }
+        /**
+         * Computes the sparse Hessian of this Variable w.r.t. the Variables
+         * in wrt from the recorded statements, using one Hessian-vector 
+         * product per color of the sparsity pattern.
+         * 
+         * @param wrt
+         * @param hessian
+         * @return the number of Hessian-vector products used
+         */
+        size_t Hessian(const std::vector<Variable*> &wrt, CSRMatrix<REAL_T> &hessian) {
+            GradientWorkspace<REAL_T>& workspace = Variable::GetContext().GetGradientWorkspace();
+            Variable::IndexOf(wrt, workspace.index_m);
+            this->Compile(workspace.tape_m);
+            return workspace.tape_m.SparseHessian(workspace.index_m, wrt.size(), hessian);
+        }
 
-                //this->ids_m.set_empty_key(NULL);
-                expr.PushIds(ids_m);
-                //expr.GetIdRange(this->iv_min, this->iv_max);
-                indepedndent_variables_iterator it;
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = false;
-                    this->g[*it].first = true;
-                    this->g[*it].second = expr.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
+        /**
+         * Maps the unique identifier of each Variable in wrt to its position.
+         * 
+         * @param wrt
+         * @param index
+         */
+        static void IndexOf(const std::vector<Variable*> &wrt, std::vector<int32_t> &index) {
+            index.clear();
+            for (size_t i = 0; i < wrt.size(); i++) {
+                uint32_t id = wrt[i]->GetId();
+                if (id >= index.size()) {
+                    index.resize(id + 1, -1);
                 }
-                if (Variable::IsSupportingArbitraryOrder()) {
-                    expr.Push(this->statements_m);
+                if (id != 0) {
+                    index[id] = static_cast<int32_t> (i);
                 }
             }
-            value_m = expr.GetValue();
+        }
 
+        /**
+         * Returns the derivative of the given order of this Variable w.r.t.
+         * wrt, by Taylor propagation through the recorded statements.
+         * 
+         * @param wrt
+         * @param order
+         * @return 
+         */
+        const REAL_T Diff(const Variable &wrt, unsigned int order) {
+            if (order == 0) {
+                return this->GetValue();
+            }
+            std::vector<Variable*> direction_of(1, const_cast<Variable*> (&wrt));
+            std::vector<REAL_T> direction(1, REAL_T(1));
+            std::vector<REAL_T> coefficients;
+            this->Taylor(direction_of, direction, order, coefficients);
+            REAL_T factorial = 1;
+            for (unsigned int k = 2; k <= order; k++) {
+                factorial *= REAL_T(k);
+            }
+            return factorial * coefficients[order];
         }
 
-        ~Variable() {
-            delete storage;
-#if !defined(USE_HASH_TABLE)
-            //            if (this->is_independent_m) {
-            //                this->independent_variables_g.erase(this->GetId());
-            //            }
-            //            this->statements_m.clear();
-            //            this->gradients_m.clear();
+        /**
+         * Computes the Taylor coefficients up to degree of this Variable 
+         * along the direction given for the Variables in wrt. The k-th 
+         * directional derivative is k! * coefficients[k].
+         * 
+         * @param wrt
+         * @param direction
+         * @param degree
+         * @param coefficients - resized to degree + 1
+         */
+        void Taylor(const std::vector<Variable*> &wrt, const std::vector<REAL_T> &direction,
+                size_t degree, std::vector<REAL_T> &coefficients) {
+            GradientWorkspace<REAL_T>& workspace = Variable::GetContext().GetGradientWorkspace();
+            std::vector<int32_t>& index = workspace.index_m;
+            Variable::IndexOf(wrt, index);
+            this->Compile(workspace.tape_m);
+            workspace.tape_m.Taylor(index, direction, degree, coefficients);
+        }
 
-#endif
+    private:
+
+        /**
+         * Writes a block as its element count followed by the elements, 
+         * little endian.
+         */
+        template<class TT>
+        void WriteBlock(std::ostream &out, const std::vector<TT> &block, bool little_endian) {
+            uint32_t size = static_cast<uint32_t> (block.size());
+            uint32_t ssize = little_endian ? size : SwapBytes<uint32_t > (size);
+            out.write(reinterpret_cast<const char*> (&ssize), sizeof (uint32_t));
+            if (size == 0) {
+                return;
+            }
+            if (little_endian || sizeof (TT) == 1) {
+                out.write(reinterpret_cast<const char*> (&block[0]), size * sizeof (TT));
+            } else {
+                for (uint32_t i = 0; i < size; i++) {
+                    TT value = SwapBytes<TT > (block[i]);
+                    out.write(reinterpret_cast<const char*> (&value), sizeof (TT));
+                }
+            }
         }
 
-        size_t Size() {
-            return this->statements_m.size();
+        /**
+         * Reads a block written by WriteBlock.
+         */
+        template<class TT>
+        void ReadBlock(std::istream &in, std::vector<TT> &block, bool little_endian) {
+            uint32_t size = 0;
+            in.read(reinterpret_cast<char*> (&size), sizeof (uint32_t));
+            if (!little_endian) {
+                size = SwapBytes<uint32_t > (size);
+            }
+            block.resize(size);
+            if (size == 0) {
+                return;
+            }
+            in.read(reinterpret_cast<char*> (&block[0]), size * sizeof (TT));
+            if (!little_endian && sizeof (TT) > 1) {
+                for (uint32_t i = 0; i < size; i++) {
+                    block[i] = SwapBytes<TT > (block[i]);
+                }
+            }
         }
 
         /**
-         * Control function. If true, derivatives are computed. If false
-         * expressions are only evaluated.
+         * Records the local partial derivatives of expr on the adjoint tape. 
+         * This Variable becomes the result of the recorded statement.
          * 
-         * @param is_recording
+         * @param expr
+         * @param context
          */
-        static void SetRecording(const bool &is_recording) {
-            Variable::is_recording_g = is_recording;
+        template<class T>
+        inline void RecordAdjoint(const ExpressionBase<REAL_T, T>& expr,
+                Context<REAL_T, group>& context) {
+            AdjointTape<REAL_T>& tape = context.GetAdjointTape();
+            expr.PushAdjoints(tape, static_cast<REAL_T> (1.0));
+            this->tape_index_m = tape.Commit();
         }
 
         /**
-         * If true, derivatives are calculated and stored. If false,
-         * expressions are evaluated for value only.
+         * Computes the derivatives of expr w.r.t. the independent variables
+         * it depends on into the workspace entries. The expression is 
+         * traversed once, each node scattering its local partial times the
+         * gradient of the Variable leaves below it, and the scattered 
+         * entries are then summed per id.
          * 
-         * @return 
+         * @param expr
+         * @param workspace
          */
-        static bool IsRecording() {
-            return Variable::is_recording_g;
+        template<class T>
+        static inline void ComputeGradient(const ExpressionBase<REAL_T, T>& expr,
+                GradientWorkspace<REAL_T>& workspace) {
+            workspace.entries_m.Clear();
+            expr.PushAdjoints(workspace, static_cast<REAL_T> (1.0));
+            workspace.entries_m.Consolidate();
         }
 
         /**
-         * If set to true, the expression is recorded into a vector of 
-         * statements that can be manipulated to compute derivatives of 
-         * arbitrary order. This functionality is costly and is rarely required,
-         * thus default setting is false.
+         * Sets the gradient of this Variable to that of expr. The gradient
+         * is computed into the workspace first, since expr may refer to this
+         * Variable.
          * 
-         * @param support_arbitrary_order
+         * @param expr
+         * @param context
          */
-        static void SetSupportArbitraryOrder(const bool &support_arbitrary_order) {
-            Variable::is_supporting_arbitrary_order = support_arbitrary_order;
+        template<class T>
+        inline void AssignGradient(const ExpressionBase<REAL_T, T>& expr,
+                Context<REAL_T, group>& context) {
+            GradientWorkspace<REAL_T>& workspace = context.GetGradientWorkspace();
+            Variable::ComputeGradient(expr, workspace);
+            this->g.Assign(workspace.entries_m);
         }
 
-        /*
-         * If true, expressions are recorded into a vector of statements that 
-         * can be used later to compute derivatives of arbitrary order, or
-         * be used to build expression strings.
+        /**
+         * Records expr on the ExpressionGraph and makes its result the node
+         * of this Variable. Operand Variables enter by node, so only the 
+         * operations of expr itself are added.
          * 
+         * @param expr
+         * @param context
          */
-        static bool IsSupportingArbitraryOrder() {
-            return Variable::is_supporting_arbitrary_order;
+        template<class T>
+        inline void AssignStatements(const ExpressionBase<REAL_T, T>& expr,
+                Context<REAL_T, group>& context) {
+            StatementList<REAL_T>& statements = context.GetGradientWorkspace().statements_m;
+            statements.clear();
+            expr.Push(statements);
+            this->node_m = context.GetExpressionGraph().Link(statements);
         }
 
         /**
-         * Returns the value of this variable.
+         * Records this op rhs on the ExpressionGraph and makes its result 
+         * the node of this Variable.
          * 
-         * @return 
+         * @param rhs
+         * @param op
          */
-        inline const REAL_T GetValue() const {
-            return this->value_m;
+        template<class T>
+        inline void AccumulateStatements(const ExpressionBase<REAL_T, T>& rhs, Operation op) {
+            Context<REAL_T, group>& context = Variable::GetContext();
+            StatementList<REAL_T>& statements = context.GetGradientWorkspace().statements_m;
+            statements.clear();
+            this->Push(statements);
+            rhs.Push(statements);
+            statements.push_back(Statement<REAL_T > (op));
+            this->node_m = context.GetExpressionGraph().Link(statements);
+        }
+
+        inline void AccumulateStatements(const REAL_T &rhs, Operation op) {
+            Context<REAL_T, group>& context = Variable::GetContext();
+            StatementList<REAL_T>& statements = context.GetGradientWorkspace().statements_m;
+            statements.clear();
+            this->Push(statements);
+            statements.push_back(Statement<REAL_T > (CONSTANT, rhs));
+            statements.push_back(Statement<REAL_T > (op));
+            this->node_m = context.GetExpressionGraph().Link(statements);
         }
 
         /**
-         * Sets the value of this variable. If the variable is bounded, 
-         * the value will be set between the min and max boundary. If the
-         * value is less than the minimum boundary, the variables value is 
-         * set to minimum boundary. If the  value is greater than the maximum
-         * boundary, the variables value is set to maximum boundary. If the 
-         * value is signaling nan, the value is set to the mid point between
-         * the min and max boundary. 
+         * Adds the gradient of expr to the gradient of this Variable.
          * 
-         * @param value
+         * @param expr
          */
-        void SetValue(const REAL_T &value) {
-            if (this->bounded_m) {
-                if (value != value) {//nan
-                    this->value_m = this->min_boundary_m + (this->max_boundary_m - this->min_boundary_m) / 2.0;
+        template<class T>
+        inline void AccumulateGradient(const ExpressionBase<REAL_T, T>& expr) {
+            GradientWorkspace<REAL_T>& workspace = Variable::GetContext().GetGradientWorkspace();
+            Variable::ComputeGradient(expr, workspace);
+            workspace.sum_m.Sum(this->g, workspace.entries_m);
+            this->g.Assign(workspace.sum_m);
+        }
 
-                    return;
+    };
+
+    //list of independent variables by unique identifier.
+    //    template<class REAL_T>
+    //    std::set<uint32_t> Variable<REAL_T>::independent_variables_g;
+
+    template<class REAL_T, int group>
+    uint32_t Variable<REAL_T, group>::misses_g = 0;
+
+    /**
+     * Computes the product of the Hessian of f w.r.t. parameters and the 
+     * direction v by forward-over-reverse differentiation of the statements
+     * recorded in f. The cost is a small multiple of one gradient 
+     * evaluation. f must have been recorded with arbitrary order support,
+     * see Variable::SetSupportArbitraryOrder.
+     * 
+     * @param f
+     * @param parameters
+     * @param v
+     * @return H * v
+     */
+    template<class REAL_T, int group>
+    const std::vector<REAL_T> HessianVectorProduct(const Variable<REAL_T, group> &f,
+            const std::vector<Variable<REAL_T, group>* > &parameters, const std::vector<REAL_T> &v) {
+        StatementTape<REAL_T> tape;
+        f.Compile(tape);
+
+        std::vector<int32_t> index;
+        Variable<REAL_T, group>::IndexOf(parameters, index);
+
+        std::vector<REAL_T> hv(parameters.size());
+        tape.HessianVectorProduct(index, v, hv);
+        return hv;
+    }
+
+    /**
+     * Computes the sparse Jacobian of the Variables f w.r.t. the Variables
+     * x, from the statements recorded in each f[i]. The columns are 
+     * grouped by a distance-2 coloring of the dependency pattern and each
+     * color costs one forward tangent sweep over the statements of every
+     * row, O(colors) sweeps instead of O(x.size()).
+     * 
+     * @param f
+     * @param x
+     * @param jacobian
+     * @return the number of colors
+     */
+    template<class REAL_T, int group>
+    size_t Jacobian(const std::vector<Variable<REAL_T, group>* > &f,
+            const std::vector<Variable<REAL_T, group>* > &x, CSRMatrix<REAL_T> &jacobian) {
+        size_t m = f.size();
+        size_t n = x.size();
+        std::vector<int32_t> index;
+        Variable<REAL_T, group>::IndexOf(x, index);
+
+        std::vector<StatementTape<REAL_T> > tapes(m);
+        std::vector<std::set<uint32_t> > rows(m);
+        std::vector<uint32_t> dependencies;
+        for (size_t i = 0; i < m; i++) {
+            f[i]->Compile(tapes[i]);
+            tapes[i].Dependencies(index, dependencies);
+            rows[i].insert(dependencies.begin(), dependencies.end());
+        }
+        jacobian.Assign(rows);
+
+        std::vector<uint32_t> colors;
+        size_t ncolors = ColorColumns(jacobian, n, colors);
+        std::vector<REAL_T> v(n);
+        for (size_t c = 0; c < ncolors; c++) {
+            for (size_t j = 0; j < n; j++) {
+                v[j] = colors[j] == c ? REAL_T(1) : REAL_T(0);
+            }
+            for (size_t i = 0; i < m; i++) {
+                size_t k = jacobian.row_offsets_m[i];
+                while (k < jacobian.row_offsets_m[i + 1] && colors[jacobian.columns_m[k]] != c) {
+                    k++;
+                }
+                if (k < jacobian.row_offsets_m[i + 1]) {
+                    jacobian.values_m[k] = tapes[i].DirectionalDerivative(index, v);
                 }
+            }
+        }
+        return ncolors;
+    }
 
-                if (value<this->min_boundary_m) {
-                    this->value_m = this->min_boundary_m;
-                } else if (value>this->max_boundary_m) {
-                    this->value_m = this->max_boundary_m;
+    /**
+     * Binomial (revolve) checkpointing for long time stepping loops. The 
+     * loop body is given as a Step, which advances a state vector from 
+     * step i to step i + 1 and may read any parameters. Forward runs the 
+     * loop without recording. Reverse then propagates an adjoint of the 
+     * final state back to the initial state and to the parameters by 
+     * recording one step at a time, recomputing states from at most 
+     * snapshots stored states. Only one step is ever recorded, and with 
+     * the default of log2(steps) snapshots the number of stored states 
+     * grows logarithmically while each step is recomputed O(log(steps)) 
+     * times. In adjoint tape mode the steps are recorded on a tape owned 
+     * by the Checkpoint, so f may be recorded on the thread's adjoint tape
+     * before Reverse. The steps are never recorded for arbitrary order.
+     * 
+     * Typical use:
+     * 
+     * checkpoint.Forward(state);                  //state becomes final state
+     * f = Objective(final, parameters);           //final: independent copy
+     * adjoint[k] = f.WRT(final[k]);
+     * checkpoint.Reverse(adjoint);               //adjoint of initial state
+     * gradient[j] = f.WRT(*parameters[j]) + checkpoint.Adjoint(j);
+     */
+    template<class REAL_T, int group = 0 >
+    class Checkpoint {
+    public:
+        typedef Variable<REAL_T, group> variable;
 
+        /**
+         * The body of the checkpointed loop.
+         */
+        class Step {
+        public:
 
-                } else {
-                    this->value_m = value;
+            virtual ~Step() {
+            }
+
+            /**
+             * Sets out to the state after step i, given the state in before 
+             * it. out has the size of in.
+             * 
+             * @param in
+             * @param out
+             * @param i
+             */
+            virtual void Evaluate(const std::vector<variable> &in, std::vector<variable> &out, size_t i) = 0;
+        };
+
+        /**
+         * 
+         * @param step - loop body
+         * @param steps - number of iterations
+         * @param parameters - Variables read by the step, whose adjoints are
+         * accumulated by Reverse
+         * @param snapshots - stored states, 0 for log2(steps)
+         */
+        Checkpoint(Step &step, size_t steps, const std::vector<variable*> &parameters, size_t snapshots = 0)
+        : step_m(step), steps_m(steps), snapshots_m(snapshots), parameters_m(parameters),
+        evaluations_m(0), stored_m(0), max_stored_m(0) {
+            if (this->snapshots_m == 0) {
+                while ((size_t(1) << this->snapshots_m) < this->steps_m) {
+                    this->snapshots_m++;
                 }
-            } else {
-                this->value_m = value;
             }
         }
 
         /**
-         * Returns the name of this variable. Names are not initialized and 
-         * if it is not set this function will return a empty string.
-         * @return 
+         * Runs all steps from the initial state without recording. On return
+         * state holds the final state, which Reverse starts from.
+         * 
+         * @param state
          */
-        std::string GetName() const {
-            return name_m;
+        void Forward(std::vector<REAL_T> &state) {
+            this->initial_m = state;
+            this->Advance(state, 0, this->steps_m);
         }
 
         /**
-         * Set the name of this variable.
+         * Propagates the adjoint of the final state back through all steps.
+         * On return adjoint holds the adjoint of the initial state and 
+         * Adjoint(j) the adjoint of parameters[j].
          * 
-         * @param name
+         * @param adjoint - adjoint of the final state
          */
-        void SetName(std::string name) {
-            this->name_m = name;
+        void Reverse(std::vector<REAL_T> &adjoint) {
+            this->parameter_adjoints_m.assign(this->parameters_m.size(), REAL_T(0));
+            this->stored_m = 1;
+            this->max_stored_m = 1;
+            if (this->steps_m == 0) {
+                return;
+            }
+            bool is_recording = variable::IsRecording();
+            bool is_arbitrary_order = variable::IsSupportingArbitraryOrder();
+            bool use_tape = variable::IsUsingAdjointTape();
+            //only first order adjoints are needed, so the steps leave no 
+            //statements behind
+            variable::SetSupportArbitraryOrder(false);
+            if (use_tape) {
+                //steps are recorded on a tape of their own, so the caller's
+                //recording, e.g. of the objective function, is kept
+                this->tape_m.Follow(variable::GetAdjointTape());
+                variable::GetAdjointTape().Swap(this->tape_m);
+            }
+            size_t n = this->initial_m.size();
+            if (this->in_m.size() != n) {
+                this->in_m.resize(n);
+                this->out_m.resize(n);
+                for (size_t k = 0; k < n; k++) {
+                    this->in_m[k].SetAsIndependent(true);
+                }
+            }
+            this->ReverseSegment(this->initial_m, 0, this->steps_m, this->snapshots_m, adjoint);
+            if (use_tape) {
+                //the caller's next statements are numbered after the steps,
+                //so Variables left by the steps never become live again
+                variable::GetAdjointTape().Swap(this->tape_m);
+                variable::GetAdjointTape().Skip(this->tape_m);
+            }
+            variable::SetSupportArbitraryOrder(is_arbitrary_order);
+            variable::SetRecording(is_recording);
+        }
+
+        /**
+         * Adjoint of parameters[j] after Reverse.
+         */
+        const REAL_T Adjoint(size_t j) const {
+            return this->parameter_adjoints_m[j];
+        }
+
+        /**
+         * Number of step evaluations so far, recorded or not.
+         */
+        size_t Evaluations() const {
+            return this->evaluations_m;
         }
 
         /**
-         * Returns true if this variable is bounded. Otherwise,
-         * false.
-         * 
-         * @return 
+         * Largest number of states held at once during the last Reverse.
          */
-        bool IsBounded() {
-            return this->bounded_m;
+        size_t MaxStoredStates() const {
+            return this->max_stored_m;
         }
 
+    private:
+
         /**
-         * Set the min and max boundary for this variable. 
-         * @param min
-         * @param max
+         * Advances state from step from through count steps, unrecorded.
          */
-        void SetBounds(const REAL_T& min, const REAL_T& max) {
-            this->bounded_m = true;
-            this->max_boundary_m = max;
-            this->min_boundary_m = min;
-            this->SetValue(this->GetValue());
+        void Advance(std::vector<REAL_T> &state, size_t from, size_t count) {
+            if (count == 0) {
+                return;
+            }
+            bool is_recording = variable::IsRecording();
+            variable::SetRecording(false);
+            size_t n = state.size();
+            std::vector<variable> in(n);
+            std::vector<variable> out(n);
+            for (size_t k = 0; k < n; k++) {
+                in[k] = state[k];
+            }
+            for (size_t i = from; i < from + count; i++) {
+                this->step_m.Evaluate(in, out, i);
+                this->evaluations_m++;
+                in.swap(out);
+            }
+            for (size_t k = 0; k < n; k++) {
+                state[k] = in[k].GetValue();
+            }
+            variable::SetRecording(is_recording);
         }
 
         /**
-         * Return the minimum boundary for this variable. The default value 
-         * is the results of std::numeric_limits<REAL_t>::min().
-         * 
-         * @return 
+         * Number of steps reversible with s snapshots and t recomputations
+         * of each step, (s + t)! / (s! t!).
          */
-        const REAL_T GetMinBoundary() {
-            return this->min_boundary_m;
+        static size_t Beta(size_t s, size_t t) {
+            size_t ret = 1;
+            for (size_t k = 1; k <= s; k++) {
+                size_t next = ret * (t + k) / k;
+                if (next < ret) {
+                    return std::numeric_limits<size_t>::max();
+                }
+                ret = next;
+            }
+            return ret;
         }
 
         /**
-         * Return the maximum boundary for this variable. The default value 
-         * is the results of std::numeric_limits<REAL_t>::max().
-         * 
-         * @return 
+         * Reverses steps [from, from + count) given the state at from and 
+         * s free snapshots. adjoint holds the adjoint of the state at 
+         * from + count on entry and of the state at from on return.
          */
-        const REAL_T GetMaxBoundary() {
-            return this->max_boundary_m;
+        void ReverseSegment(const std::vector<REAL_T> &state, size_t from, size_t count,
+                size_t s, std::vector<REAL_T> &adjoint) {
+            if (count == 1) {
+                this->ReverseStep(state, from, adjoint);
+                return;
+            }
+            size_t split;
+            if (s == 0) {
+                split = count - 1;
+            } else {
+                size_t t = 0;
+                while (Beta(s, t) < count) {
+                    t++;
+                }
+                size_t tail = Beta(s - 1, t);
+                split = count > tail ? count - tail : 1;
+                split = std::max<size_t > (1, std::min(split, count - 1));
+            }
+
+            std::vector<REAL_T> snapshot(state);
+            this->Advance(snapshot, from, split);
+            this->stored_m++;
+            this->max_stored_m = std::max(this->max_stored_m, this->stored_m);
+            this->ReverseSegment(snapshot, from + split, count - split, s == 0 ? 0 : s - 1, adjoint);
+            this->stored_m--;
+            std::vector<REAL_T>().swap(snapshot);
+            this->ReverseSegment(state, from, split, s, adjoint);
         }
 
         /**
-         * Make this Variable an independent variable. If set to true,
-         * the Variables unique identifier is registered in the static set
-         * of independent variables. During function evaluations, gradient 
-         * information is accumulated in post-order wrt to variables in the 
-         * static set of independent variables. If set false, this Variables 
-         * unique identifier will be removed from the set, if it existed.
-         * 
-         * 
-         * To access the derivative wrt to a Variable, call function:
-         * 
-         * const REAL_t wrt(const Variable & ind)
-         * 
-         * 
-         * @param is_independent
+         * Records step i from state and replaces adjoint with its product 
+         * with the step's Jacobian w.r.t. the state, accumulating the 
+         * parameter part.
          */
-        void SetAsIndependent(const bool &is_independent) {
-            if (this->iv_id_m == 0) {
-                this->iv_id_m = IDGenerator::instance()->next();
-                if (Variable<REAL_T>::IsSupportingArbitraryOrder()) {
-                    this->statements_m.clear();
-                    this->statements_m.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
-                }
-                //                this->id_m = iv_id_m;
-                //                if (this->iv_min == std::numeric_limits<uint32_t>::max() && this->iv_max == std::numeric_limits<uint32_t>::min()) {
-                //                    this->iv_max = this->GetId();
-                //                    this->iv_min = this->GetId();
-                //                }
+        void ReverseStep(const std::vector<REAL_T> &state, size_t i, std::vector<REAL_T> &adjoint) {
+            size_t n = state.size();
+            variable::SetRecording(true);
+            if (variable::IsUsingAdjointTape()) {
+                variable::GetAdjointTape().Reset();
             }
-            if (this->is_independent_m && !is_independent) {
-                //                Variable::independent_variables_g.erase(this->GetId());
-                this->id_m = 0;
-                this->is_independent_m = false;
+            for (size_t k = 0; k < n; k++) {
+                this->in_m[k].SetValue(state[k]);
             }
+            this->step_m.Evaluate(this->in_m, this->out_m, i);
+            this->evaluations_m++;
 
-            if (!this->is_independent_m && is_independent) {
-                //                Variable::independent_variables_g.insert(this->GetId());
-                this->id_m = this->iv_id_m;
-                this->is_independent_m = true;
+            variable sum = 0.0;
+            for (size_t k = 0; k < n; k++) {
+                if (adjoint[k] != REAL_T(0)) {
+                    sum += adjoint[k] * this->out_m[k];
+                }
+            }
+            for (size_t k = 0; k < n; k++) {
+                adjoint[k] = sum.WRT(this->in_m[k]);
+            }
+            for (size_t j = 0; j < this->parameters_m.size(); j++) {
+                this->parameter_adjoints_m[j] += sum.WRT(*this->parameters_m[j]);
             }
         }
 
-        bool IsIndependent() {
-            return this->is_independent_m;
-        }
+        Step &step_m;
+        size_t steps_m;
+        size_t snapshots_m;
+        std::vector<variable*> parameters_m;
+        std::vector<REAL_T> initial_m;
+        std::vector<REAL_T> parameter_adjoints_m;
+        std::vector<variable> in_m;
+        std::vector<variable> out_m;
+        AdjointTape<REAL_T> tape_m; //records the steps in adjoint tape mode.
+        size_t evaluations_m;
+        size_t stored_m;
+        size_t max_stored_m;
+    };
 
-        /**
-         * Returns the derivative with respect to a variables who's
-         * unique identifier is equal to the parameter id.
-         * 
-         * @param id
-         * @param found
-         * @return 
-         */
-        const REAL_T Derivative(const uint32_t &id, bool &found) const {
 
 
 
-            if (this->Cast().id_m == id) {
-                found = true;
-                return 1.0;
+    /**
+     * Evaluates a comparison of two expressions. While the context of a 
+     * Variable operand records branches, the comparison is recorded there
+     * with both operands compiled, so 
+     * a replayed statement tape can detect that the outcome changed and a 
+     * retape is needed.
+     * 
+     * @param comparison
+     * @param lhs
+     * @param rhs
+     * @return the outcome
+     */
+    template<class REAL_T, class T, class TT>
+    inline int TapeComparison(const Comparison &comparison, const ad::ExpressionBase<REAL_T, T>& lhs,
+            const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        bool outcome = Branch<REAL_T>::Compare(comparison, lhs.GetValue(), rhs.GetValue());
+        if (BranchRecorder<REAL_T>::Recording() == 0) {
+            return outcome;
+        }
+        BranchRecorder<REAL_T> recorder;
+        lhs.PushAdjoints(recorder, static_cast<REAL_T> (1.0));
+        rhs.PushAdjoints(recorder, static_cast<REAL_T> (1.0));
+        if (recorder.branches_m != NULL) {
+            std::vector<Branch<REAL_T> >& branches = *recorder.branches_m;
+            branches.push_back(Branch<REAL_T > ());
+            Branch<REAL_T>& branch = branches.back();
+            branch.comparison_m = comparison;
+            branch.outcome_m = outcome;
+            //operand Variables enter by their node, which is expanded 
+            //rather than linked so the predicate adds no graph nodes
+            ExpressionGraph<REAL_T>& graph = *recorder.graph_m;
+            StatementList<REAL_T> statements;
+            StatementList<REAL_T> expanded;
+            lhs.Push(statements);
+            graph.Expand(statements, expanded);
+            branch.lhs_m.Compile(expanded);
+            statements.clear();
+            rhs.Push(statements);
+            graph.Expand(statements, expanded);
+            branch.rhs_m.Compile(expanded);
+        }
+        return outcome;
+    }
 
-            } else {
+    template<class REAL_T, class T, class TT>
+    inline int operator==(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(EQUAL_TO, lhs, rhs);
+    }
 
-#if defined(USE_HASH_TABLE)
-                HashTable::Cell* entry = this->gradients_m.Lookup(id);
+    template<class REAL_T, class T, class TT>
+    inline int operator!=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(NOT_EQUAL_TO, lhs, rhs);
+    }
 
-                if (entry != NULL) {
-                    return entry->value;
-                } else {
-                    return 0.0;
-                }
+    template<class REAL_T, class T, class TT>
+    inline int operator<(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(LESS, lhs, rhs);
+    }
 
-#else
+    template<class REAL_T, class T, class TT>
+    inline int operator>(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(GREATER, lhs, rhs);
+    }
 
-                //                if(id < this->g.size()){
-                //                    if(g[id] != 0){
-                //                        found = true;
-                //                    }
-                //                    
-                //                    return g[id];
-                //                }
+    template<class REAL_T, class T, class TT>
+    inline int operator<=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(LESS_EQUAL, lhs, rhs);
+    }
 
-                //                std::find(this->ids_m.begin(),this->ids_m.end(),id );
+    template<class REAL_T, class T, class TT>
+    inline int operator>=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
+        return TapeComparison(GREATER_EQUAL, lhs, rhs);
+    }
 
-                //                if (ad::binary_search(ids_m.begin(), ids_m.end(), id)) {
-                //                    found = true;
-                //                    return g[id];
-                //                } else {
-                //                    return 0.0;
-                //                }
-                //                
-                if (id < g.size()) {
-                    if (g[id].first) {
-                        found = true;
-                        return g[id].second;
-                    } else {
-                        return 0.0;
-                    }
-                } else {
-                    return 0.0;
-                }
-                //                if (this->ids_m.find(id) != this->ids_m.end()) {
-                //                    found = true;
-                //                    return g[id].second;
-                //                } else {
-                //                    return 0.0;
-                //                }
+    template<class REAL_T, class T>
+    inline int operator==(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(EQUAL_TO, ad::Constant<REAL_T > (lhs), rhs);
+    }
 
-                //                 const_grads_iterator git = this->gradients_m.find(id);
-                //                if (git != this->gradients_m.end()) {
-                //                    found = true;
-                //                    return git->second;
-                //                } else {
-                //                    Variable<REAL_T>::misses_g++;
-                //                    return 0.0;
-                //                }
-            }
+    template<class REAL_T, class T>
+    inline int operator!=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(NOT_EQUAL_TO, ad::Constant<REAL_T > (lhs), rhs);
+    }
 
-#endif
+    template<class REAL_T, class T>
+    inline int operator<(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(LESS, ad::Constant<REAL_T > (lhs), rhs);
+    }
+
+    template<class REAL_T, class T>
+    inline int operator>(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(GREATER, ad::Constant<REAL_T > (lhs), rhs);
+    }
 
+    template<class REAL_T, class T>
+    inline int operator<=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(LESS_EQUAL, ad::Constant<REAL_T > (lhs), rhs);
+    }
 
-        }
+    template<class REAL_T, class T>
+    inline int operator>=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
+        return TapeComparison(GREATER_EQUAL, ad::Constant<REAL_T > (lhs), rhs);
+    }
 
-        void GetIdRange(uint32_t &min, uint32_t & max) const {
+    template<class REAL_T, class T>
+    inline int operator==(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(EQUAL_TO, lhs, ad::Constant<REAL_T > (rhs));
+    }
 
-            if (this->iv_min < min) {
-                min = this->iv_min;
+    template<class REAL_T, class T>
+    inline int operator!=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(NOT_EQUAL_TO, lhs, ad::Constant<REAL_T > (rhs));
+    }
+
+    template<class REAL_T, class T>
+    inline int operator<(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(LESS, lhs, ad::Constant<REAL_T > (rhs));
+    }
+
+    template<class REAL_T, class T>
+    inline int operator>(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(GREATER, lhs, ad::Constant<REAL_T > (rhs));
+    }
+
+    template<class REAL_T, class T>
+    inline int operator<=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(LESS_EQUAL, lhs, ad::Constant<REAL_T > (rhs));
+    }
+
+    template<class REAL_T, class T>
+    inline int operator>=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
+        return TapeComparison(GREATER_EQUAL, lhs, ad::Constant<REAL_T > (rhs));
+    }
+
+
+}
+
+
+
+namespace ad {
+
+    /**
+     * Array components.
+     *
+     * Vectors and matrices of Variables. An element-wise expression over
+     * arrays is evaluated element by element in one contiguous loop when it
+     * is assigned, and recorded with one pass over the elements. Every element becomes a single statement on the adjoint tape
+     * or the ExpressionGraph, no intermediate Variables are created.
+     */
+    namespace array {
+
+        /**
+         * Base class for array expression types. Elements are addressed by
+         * their flat, row major, index. A Size of zero denotes a scalar that
+         * is broadcast over the elements of the other operand.
+         */
+        template<class REAL_T, class A>
+        struct ArrayExpression {
+
+            const A & Cast() const {
+                return static_cast<const A&> (*this);
             }
 
-            if (this->iv_max > max) {
-                max = this->iv_max;
+            inline size_t Size() const {
+                return Cast().Size();
             }
 
-            if (this->GetId() > 0) {
-                if (this->GetId() < min) {
-                    min = this->GetId();
-                }
+            inline size_t Rows() const {
+                return Cast().Rows();
+            }
 
-                //                if (this->GetId()) {
-                //                    max = this->GetId();
-                //                }
+            inline size_t Columns() const {
+                return Cast().Columns();
             }
-            //
-            //                        if (min == std::numeric_limits<uint32_t>::max()) {
-            //                            min = max;
-            //                        }
 
-            //            std::cout << min << " " << max << "\n";
+            /**
+             * The value of element i.
+             *
+             * @param i
+             * @return
+             */
+            inline const REAL_T Value(const size_t &i) const {
+                return Cast().Value(i);
+            }
 
+            /**
+             * Pushes the partial derivatives of element i w.r.t. its Variable
+             * operands, scaled by coefficient, onto tape. See
+             * ExpressionBase::PushAdjoints.
+             *
+             * @param tape
+             * @param i
+             * @param coefficient
+             */
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                Cast().PushAdjoints(tape, i, coefficient);
+            }
 
+            /**
+             * Pushes the statements of element i.
+             *
+             * @param statements
+             * @param i
+             */
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                Cast().Push(statements, i);
+            }
 
-        }
+        };
 
-        void Push(std::vector<Statement<REAL_T> > &statements) const {
-            statements.insert(statements.end(), this->statements_m.begin(), statements_m.end());
-            //            if (this->statements_m.size() > 0) {
-            //                statements.insert(statements.end(), this->statements_m.begin(), statements_m.end());
-            //            } else {
-            //                statements.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
-            //            }
-        }
+        template<class REAL_T>
+        struct ArrayScalar;
 
-        inline void PushIds(IdsSet &ids) const {
-            if (this->GetId() != 0) {
-                //                uint32_t id = uint32_t
-                ids.insert(this->GetId());
-            } else {
-                ids.insert(this->ids_m.begin(), this->ids_m.end());
+        template<class REAL_T, class EXPR>
+        struct ScalarOperand;
+
+        template<class REAL_T, int group = 0 >
+        class VariableRange;
+
+        template<class REAL_T>
+        class ConstantRange;
+
+        /**
+         * How an array expression holds an operand. Array operands are held
+         * by reference like the scalar expression templates, scalars are
+         * created by the operators themselves and are held by value.
+         */
+        template<class T>
+        struct ArrayOperand {
+            typedef const T& type;
+        };
+
+        template<class REAL_T>
+        struct ArrayOperand<ArrayScalar<REAL_T> > {
+            typedef const ArrayScalar<REAL_T> type;
+        };
+
+        template<class REAL_T, class EXPR>
+        struct ArrayOperand<ScalarOperand<REAL_T, EXPR> > {
+            typedef const ScalarOperand<REAL_T, EXPR> type;
+        };
+
+        template<class REAL_T, int group>
+        struct ArrayOperand<VariableRange<REAL_T, group> > {
+            typedef const VariableRange<REAL_T, group> type;
+        };
+
+        template<class REAL_T>
+        struct ArrayOperand<ConstantRange<REAL_T> > {
+            typedef const ConstantRange<REAL_T> type;
+        };
+
+        /**
+         * A constant broadcast over the elements of an array expression.
+         */
+        template<class REAL_T>
+        struct ArrayScalar : public ArrayExpression<REAL_T, ArrayScalar<REAL_T> > {
+
+            ArrayScalar(const REAL_T &value) : value_m(value) {
+            }
+
+            inline size_t Size() const {
+                return 0;
+            }
+
+            inline size_t Rows() const {
+                return 0;
+            }
+
+            inline size_t Columns() const {
+                return 0;
+            }
+
+            inline const REAL_T Value(const size_t &) const {
+                return value_m;
+            }
+
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &, const size_t &, const REAL_T &) const {
             }
-        }
 
-        inline void PushStorage(VariableStorage<REAL_T> * ids) const {
+            void Push(StatementList<REAL_T> &statements, const size_t &) const {
+                statements.push_back(Statement<REAL_T > (CONSTANT, value_m));
+            }
 
-            if (Variable<REAL_T, group>::IsRecording()) {
+        private:
+            REAL_T value_m;
+        };
 
-                if (this->GetId() != 0) {
-                    ids->AddId(this->GetId());
-                } else {
-                    ids->Merge(this->storage);
-                }
+        /**
+         * A scalar expression template or Variable broadcast over the
+         * elements of an array expression.
+         */
+        template<class REAL_T, class EXPR>
+        struct ScalarOperand : public ArrayExpression<REAL_T, ScalarOperand<REAL_T, EXPR> > {
 
+            ScalarOperand(const ExpressionBase<REAL_T, EXPR> &expr)
+            : expr_m(expr.Cast()), value_m(expr.GetValue()) {
+            }
 
-                for (int i = 0; i < this->storage->DerivativeInfoSize(); i++) {
-                    ids->SetDerivative(this->storage->GetDerivative(i), i);
-                }
+            inline size_t Size() const {
+                return 0;
+            }
 
-                if (Variable<REAL_T, group>::IsSupportingArbitraryOrder()) {
-                    for (int i = 0; i < this->storage->ExpressionSize(); i++) {
-                        ids->AddStatement(this->storage->StatementAt(i));
-                    }
-                }
+            inline size_t Rows() const {
+                return 0;
+            }
 
+            inline size_t Columns() const {
+                return 0;
             }
-        }
 
-        inline void PushIds(std::vector < std::pair<bool, REAL_T> > & ids) const {
-            for (int i = 1; i< this->g.size(); i++) {
-                if (g[i].first) {
-                    ids[i].first = true;
-                }
+            inline const REAL_T Value(const size_t &) const {
+                return value_m;
+            }
+
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &, const REAL_T &coefficient) const {
+                this->expr_m.PushAdjoints(tape, coefficient);
+            }
+
+            void Push(StatementList<REAL_T> &statements, const size_t &) const {
+                this->expr_m.Push(statements);
             }
-        }
+
+        private:
+            const EXPR& expr_m;
+            REAL_T value_m;
+        };
 
         /**
-         * Finds the derivative in the encapsulated gradient map 
-         * w.r.t a variable. 
-         * 
-         * @param ind
-         * @return 
+         * Base class of the array operations. Holds the shape of the 
+         * result; the derived class evaluates an element when its Value is
+         * asked for, so building an expression allocates nothing and 
+         * assigning it evaluates every element in one pass over the 
+         * operands.
          */
-        const REAL_T WRT(const Variable & ind) {
+        template<class REAL_T, class A>
+        struct ArrayNode : public ArrayExpression<REAL_T, A> {
 
-#if defined(USE_HASH_TABLE)
-            HashTable::Cell* entry = this->gradients_m.Lookup(ind.GetId());
+            ArrayNode(const size_t &rows, const size_t &columns)
+            : rows_m(rows), columns_m(columns) {
+            }
 
-            if (entry != NULL) {
-                return entry->value;
-            } else {
-                return 0.0;
+            inline size_t Size() const {
+                return rows_m * columns_m;
             }
-#else
 
-            if (ind.GetId() < g.size()) {
-                if (g[ind.GetId()].first) {
+            inline size_t Rows() const {
+                return rows_m;
+            }
 
-                    return g[ind.GetId()].second;
-                } else {
-                    return 0.0;
-                }
-            } else {
-                return 0.0;
+            inline size_t Columns() const {
+                return columns_m;
             }
-            //            if (this->ids_m.find(ind.GetId()) != this->ids_m.end()) {
-            //                //                found = true;
-            //                return g[ind.GetId()].second;
-            //            } else {
-            //                return 0.0;
-            //            }
 
-            //            const_grads_iterator git = this->gradients_m.find(ind.GetId());
-            //            if (git != this->gradients_m.end()) {
-            //                return git->second;
-            //            } else {
-            //                return 0;
-            //            }
-#endif
+        protected:
+            size_t rows_m;
+            size_t columns_m;
+        };
+
+        /**
+         * Returns true if lhs and rhs can be combined element-wise: they 
+         * have the same shape, or one of them is a broadcast scalar. The 
+         * binary operations assert this.
+         */
+        template<class REAL_T, class LHS, class RHS>
+        inline bool IsConformable(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return lhs.Size() == 0 || rhs.Size() == 0
+                    || (lhs.Rows() == rhs.Rows() && lhs.Columns() == rhs.Columns());
         }
 
         /**
-         * Finds the derivative in the encapsulated gradient map 
-         * w.r.t a variable. 
-         * @param ind
-         * @return 
+         * Rows of the result of a binary operation, taken from the operand
+         * that is not a broadcast scalar.
          */
-        const REAL_T WRT(const Variable & ind) const {
+        template<class REAL_T, class LHS, class RHS>
+        inline size_t BroadcastRows(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return lhs.Size() != 0 ? lhs.Rows() : rhs.Rows();
+        }
 
-#if defined(USE_HASH_TABLE)
-            HashTable::Cell* entry = this->gradients_m.Lookup(ind.GetId());
+        /**
+         * Columns of the result of a binary operation, taken from the
+         * operand that is not a broadcast scalar.
+         */
+        template<class REAL_T, class LHS, class RHS>
+        inline size_t BroadcastColumns(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return lhs.Size() != 0 ? lhs.Columns() : rhs.Columns();
+        }
 
-            if (entry != NULL) {
-                return entry->value;
-            } else {
-                return 0.0;
+        /**
+         * Element-wise addition of two array expressions. Operands must
+         * have the same size unless one of them is a scalar.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayAdd : public ArrayNode<REAL_T, ArrayAdd<REAL_T, LHS, RHS> > {
+
+            ArrayAdd(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : ArrayNode<REAL_T, ArrayAdd<REAL_T, LHS, RHS> >(BroadcastRows(lhs, rhs), BroadcastColumns(lhs, rhs)),
+            lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(IsConformable(lhs, rhs));
             }
-#else
 
-            if (ind.GetId() < g.size()) {
-                if (g[ind.GetId()].first) {
+            inline const REAL_T Value(const size_t &i) const {
+                return lhs_m.Value(i) + rhs_m.Value(i);
+            }
 
-                    return g[ind.GetId()].second;
-                } else {
-                    return 0.0;
-                }
-            } else {
-                return 0.0;
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->lhs_m.PushAdjoints(tape, i, coefficient);
+                this->rhs_m.PushAdjoints(tape, i, coefficient);
             }
-            //            if (this->ids_m.find(ind.GetId()) != this->ids_m.end()) {
-            //                //                found = true;
-            //                return g[ind.GetId()].second;
-            //            } else {
-            //                return 0.0;
-            //            }
-            //            const_grads_iterator git = this->gradients_m.find(ind.GetId());
-            //            if (git != this->gradients_m.end()) {
-            //                return git->second;
-            //            } else {
-            //                return 0;
-            //            }
-#endif
-        }
 
-        void Serialize(std::ostream &out) {
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->lhs_m.Push(statements, i);
+                this->rhs_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (PLUS));
+            }
 
-            bool little_endian = true;
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-            int num = 1;
-            if (*(char *) &num == 1) {
-                little_endian = true;
-            } else {
-                little_endian = false;
+        /**
+         * Element-wise subtraction of two array expressions.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayMinus : public ArrayNode<REAL_T, ArrayMinus<REAL_T, LHS, RHS> > {
+
+            ArrayMinus(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : ArrayNode<REAL_T, ArrayMinus<REAL_T, LHS, RHS> >(BroadcastRows(lhs, rhs), BroadcastColumns(lhs, rhs)),
+            lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(IsConformable(lhs, rhs));
             }
 
-            //id stuff
-            uint32_t id = this->GetId();
+            inline const REAL_T Value(const size_t &i) const {
+                return lhs_m.Value(i) - rhs_m.Value(i);
+            }
 
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->lhs_m.PushAdjoints(tape, i, coefficient);
+                this->rhs_m.PushAdjoints(tape, i, -coefficient);
+            }
 
-            if (!little_endian) {
-                id = SwapBytes<uint32_t > (id);
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->lhs_m.Push(statements, i);
+                this->rhs_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (MINUS));
             }
 
-            out.write(reinterpret_cast<const char*> (&id), sizeof (uint32_t));
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-            //name
-            uint32_t namesize = (uint32_t)this->GetName().size();
+        /**
+         * Element-wise multiplication of two array expressions.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayMultiply : public ArrayNode<REAL_T, ArrayMultiply<REAL_T, LHS, RHS> > {
 
-            if (!little_endian) {
-                namesize = SwapBytes<uint32_t > (namesize);
+            ArrayMultiply(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : ArrayNode<REAL_T, ArrayMultiply<REAL_T, LHS, RHS> >(BroadcastRows(lhs, rhs), BroadcastColumns(lhs, rhs)),
+            lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(IsConformable(lhs, rhs));
             }
-            out.write(reinterpret_cast<const char*> (&namesize), sizeof (uint32_t));
-
 
-            out.write(this->GetName().data(), namesize);
-            //is independent
-            if (this->IsIndependent()) {
-                out << '1';
-            } else {
-                out << '0';
+            inline const REAL_T Value(const size_t &i) const {
+                return lhs_m.Value(i) * rhs_m.Value(i);
             }
-            //value stuff
 
-            //bounded
-            if (this->IsBounded()) {
-                out << '1';
-            } else {
-                out << '0';
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->lhs_m.PushAdjoints(tape, i, coefficient * this->rhs_m.Value(i));
+                this->rhs_m.PushAdjoints(tape, i, coefficient * this->lhs_m.Value(i));
             }
-            //min
-            REAL_T value = this->GetMinBoundary();
-            if (!little_endian) {
-                value = SwapBytes<REAL_T > (value);
+
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->lhs_m.Push(statements, i);
+                this->rhs_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (MULTIPLY));
             }
 
-            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-            //max
-            value = this->GetMaxBoundary();
+        /**
+         * Element-wise division of two array expressions.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayDivide : public ArrayNode<REAL_T, ArrayDivide<REAL_T, LHS, RHS> > {
 
-            if (!little_endian) {
-                value = SwapBytes<REAL_T > (value);
+            ArrayDivide(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : ArrayNode<REAL_T, ArrayDivide<REAL_T, LHS, RHS> >(BroadcastRows(lhs, rhs), BroadcastColumns(lhs, rhs)),
+            lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(IsConformable(lhs, rhs));
             }
-            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
 
-            //actual value
-            value = this->GetValue();
-
-            if (!little_endian) {
-                value = SwapBytes<REAL_T > (value);
+            inline const REAL_T Value(const size_t &i) const {
+                return lhs_m.Value(i) / rhs_m.Value(i);
             }
-            out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
-
-            //derivative info
-            uint32_t dsize = this->g.size();
-
 
-            if (!little_endian) {
-                dsize = SwapBytes<uint32_t > (dsize);
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                const REAL_T inverse = static_cast<REAL_T> (1.0) / this->rhs_m.Value(i);
+                this->lhs_m.PushAdjoints(tape, i, coefficient * inverse);
+                this->rhs_m.PushAdjoints(tape, i, -coefficient * this->lhs_m.Value(i) * inverse * inverse);
             }
-            out.write(reinterpret_cast<const char*> (&dsize), sizeof (dsize));
 
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->lhs_m.Push(statements, i);
+                this->rhs_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (DIVIDE));
+            }
 
-            for (int i = 0; i < this->g.size(); i++) {
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-                bool b = this->g[i].first;
-                value = this->g[i].second;
-                if (b) {
-                    out << '1';
-                } else {
-                    out << '0';
-                }
-                //
-                //                if (!little_endian) {
-                //                    id = SwapBytes<uint32_t > (id);
-                //                }
-                //
-                //                out.write(reinterpret_cast<const char*> (&id), sizeof (id));
-                //                
-                if (!little_endian) {
-                    value = SwapBytes<REAL_T > (value);
-                }
+        /**
+         * Element-wise exp of an array expression.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArrayExp : public ArrayNode<REAL_T, ArrayExp<REAL_T, EXPR> > {
 
-                out.write(reinterpret_cast<const char*> (&value), sizeof ( REAL_T));
+            ArrayExp(const ArrayExpression<REAL_T, EXPR> &expr)
+            : ArrayNode<REAL_T, ArrayExp<REAL_T, EXPR> >(expr.Rows(), expr.Columns()),
+            expr_m(expr.Cast()) {
+            }
 
+            inline const REAL_T Value(const size_t &i) const {
+                return std::exp(expr_m.Value(i));
             }
 
-            //statements
-            uint32_t ssize = this->statements_m.size();
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->expr_m.PushAdjoints(tape, i, coefficient * this->Value(i));
+            }
 
-            if (!little_endian) {
-                ssize = SwapBytes<uint32_t > (ssize);
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->expr_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (EXP));
             }
 
-            out.write(reinterpret_cast<const char*> (&ssize), sizeof (ssize));
+        private:
+            const EXPR& expr_m;
+        };
 
-            uint32_t sid;
-            uint32_t sop;
-            REAL_T sval;
+        /**
+         * Element-wise mfexp of an array expression. See ad::MFExp.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArrayMFExp : public ArrayNode<REAL_T, ArrayMFExp<REAL_T, EXPR> > {
 
-            for (int i = 0; i < this->statements_m.size(); i++) {
-                sid = statements_m[i].id_m;
-                if (!little_endian) {
-                    sid = SwapBytes<uint32_t > (sid);
-                }
-                out.write(reinterpret_cast<const char*> (&sid), sizeof ( uint32_t));
+            ArrayMFExp(const ArrayExpression<REAL_T, EXPR> &expr)
+            : ArrayNode<REAL_T, ArrayMFExp<REAL_T, EXPR> >(expr.Rows(), expr.Columns()),
+            expr_m(expr.Cast()) {
+            }
 
-                sop = statements_m[i].op_m;
-                if (!little_endian) {
-                    sop = SwapBytes<uint32_t > (sop);
+            inline const REAL_T Value(const size_t &i) const {
+                const REAL_T b = REAL_T(60);
+                const REAL_T x = expr_m.Value(i);
+                if (x <= b && x >= REAL_T(-1) * b) {
+                    return std::exp(x);
+                } else if (x > b) {
+                    return std::exp(b)*(REAL_T(1.) + REAL_T(2.) * (x - b)) / (REAL_T(1.) + x - b);
                 }
-                out.write(reinterpret_cast<const char*> (&sop), sizeof ( uint32_t));
+                return std::exp(REAL_T(-1) * b)*(REAL_T(1.) - x - b) / (REAL_T(1.) + REAL_T(2.) * (REAL_T(-1) * x - b));
+            }
 
-                sval = statements_m[i].value_m;
-                if (!little_endian) {
-                    sval = SwapBytes<REAL_T > (sval);
-                }
-                out.write(reinterpret_cast<const char*> (&sval), sizeof ( REAL_T));
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->expr_m.PushAdjoints(tape, i, coefficient * this->Value(i));
             }
 
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->expr_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (MFEXP));
+            }
 
+        private:
+            const EXPR& expr_m;
+        };
 
+        /**
+         * Element-wise natural log of an array expression.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArrayLog : public ArrayNode<REAL_T, ArrayLog<REAL_T, EXPR> > {
 
+            ArrayLog(const ArrayExpression<REAL_T, EXPR> &expr)
+            : ArrayNode<REAL_T, ArrayLog<REAL_T, EXPR> >(expr.Rows(), expr.Columns()),
+            expr_m(expr.Cast()) {
+            }
 
-        }
+            inline const REAL_T Value(const size_t &i) const {
+                return std::log(expr_m.Value(i));
+            }
 
-        const Variable<REAL_T, group> Deserialize(std::istream &in) {
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                this->expr_m.PushAdjoints(tape, i, coefficient / this->expr_m.Value(i));
+            }
 
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->expr_m.Push(statements, i);
+                statements.push_back(Statement<REAL_T > (LOG));
+            }
 
-            Variable v;
+        private:
+            const EXPR& expr_m;
+        };
 
-            bool little_endian = true;
+        /**
+         * Outer product of two vector expressions, element (i,j) of the
+         * result is lhs[i] * rhs[j].
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayOuterProduct : public ArrayNode<REAL_T, ArrayOuterProduct<REAL_T, LHS, RHS> > {
 
-            int num = 1;
-            if (*(char *) &num == 1) {
-                little_endian = true;
-            } else {
-                little_endian = false;
+            ArrayOuterProduct(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : ArrayNode<REAL_T, ArrayOuterProduct<REAL_T, LHS, RHS> >(lhs.Size(), rhs.Size()),
+            lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
             }
 
-            if (!in.good()) {
-                std::cout << "Error in Deserialize(std::istream &in), cannot read stream!";
-                return v;
+            inline const REAL_T Value(const size_t &i) const {
+                return lhs_m.Value(i / this->columns_m) * rhs_m.Value(i % this->columns_m);
             }
 
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                const size_t row = i / this->columns_m;
+                const size_t column = i % this->columns_m;
+                this->lhs_m.PushAdjoints(tape, row, coefficient * this->rhs_m.Value(column));
+                this->rhs_m.PushAdjoints(tape, column, coefficient * this->lhs_m.Value(row));
+            }
 
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                this->lhs_m.Push(statements, i / this->columns_m);
+                this->rhs_m.Push(statements, i % this->columns_m);
+                statements.push_back(Statement<REAL_T > (MULTIPLY));
+            }
 
-            //read id
-            uint32_t* id;
-            char idc[sizeof (uint32_t) ];
-            in.read(idc, sizeof (uint32_t));
-            id = reinterpret_cast<uint32_t*> (idc);
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-            if (!little_endian) {
-                v.id_m = SwapBytes<uint32_t > (*id);
-            } else {
-                v.id_m = *id;
+        template<class REAL_T, int group = 0 >
+        class VariableArray;
+
+        /**
+         * Read access to an element of a VariableArray as a scalar
+         * expression template.
+         */
+        template<class REAL_T, int group = 0 >
+        class ArrayElement : public ExpressionBase<REAL_T, ArrayElement<REAL_T, group> > {
+        public:
+
+            ArrayElement(const VariableArray<REAL_T, group> &array, const size_t &index)
+            : ExpressionBase<REAL_T, ArrayElement<REAL_T, group> >(0), array_m(array), index_m(index) {
             }
 
-            //read name
-            uint32_t* ns;
-            uint32_t name_size;
-            char nsc[sizeof (uint32_t) ];
-            in.read(nsc, sizeof (uint32_t));
-            ns = reinterpret_cast<uint32_t*> (nsc);
+            inline const REAL_T GetValue() const {
+                return array_m.Value(index_m);
+            }
 
-            if (!little_endian) {
-                name_size = SwapBytes<uint32_t > (*ns);
-            } else {
-                name_size = *ns;
+            inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+                REAL_T value;
+                if (index_m < array_m.gradients_m.size()
+                        && array_m.gradients_m[index_m].Find(id, value)) {
+                    found = true;
+                    return value;
+                }
+                return 0.0;
             }
 
-            char namec[name_size + 1];
-            namec[name_size] = '\0';
-            in.read(namec, name_size);
-            v.SetName(std::string(namec));
+            void GetIdRange(uint32_t &min, uint32_t & max) const {
+                if (index_m < array_m.gradients_m.size() && !array_m.gradients_m[index_m].Empty()) {
+                    const SparseGradient<REAL_T> &g = array_m.gradients_m[index_m];
+                    min = std::min(min, g.begin()->first);
+                    max = std::max(max, (g.end() - 1)->first);
+                }
+            }
 
+            void Push(StatementList<REAL_T> &statements) const {
+                array_m.Push(statements, index_m);
+            }
 
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                array_m.PushAdjoints(tape, index_m, coefficient);
+            }
 
+            inline void PushIds(IdsSet & ids) const {
+                if (index_m < array_m.gradients_m.size()) {
+                    typename SparseGradient<REAL_T>::const_iterator it;
+                    for (it = array_m.gradients_m[index_m].begin(); it != array_m.gradients_m[index_m].end(); ++it) {
+                        ids.insert(it->first);
+                    }
+                }
+            }
 
-            //is independent
-            char inde;
-            in >> inde;
+        protected:
+            const VariableArray<REAL_T, group> &array_m;
+            size_t index_m;
+        };
 
-            if (inde == '1') {
-                v.is_independent_m = true;
-            } else {
-                v.is_independent_m = false;
+        /**
+         * Read and write access to an element of a VariableArray.
+         * Assigning an expression records it for that element only.
+         */
+        template<class REAL_T, int group = 0 >
+        class ArrayElementReference : public ArrayElement<REAL_T, group> {
+        public:
+
+            ArrayElementReference(VariableArray<REAL_T, group> &array, const size_t &index)
+            : ArrayElement<REAL_T, group>(array, index) {
             }
 
-            //is bounded
-            char bounded;
-            in >> bounded;
+            template<class T>
+            ArrayElementReference& operator=(const ExpressionBase<REAL_T, T> &expr) {
+                this->Array().AssignElement(this->index_m, expr);
+                return *this;
+            }
 
-            if (bounded == '1') {
-                v.bounded_m = true;
-            } else {
-                v.bounded_m = false;
+            ArrayElementReference& operator=(const ArrayElementReference &other) {
+                this->Array().AssignElement(this->index_m, other);
+                return *this;
             }
 
+            ArrayElementReference& operator=(const REAL_T &value) {
+                this->Array().SetElement(this->index_m, value);
+                return *this;
+            }
 
-            //values min,max,actual
-            REAL_T* value_ptr;
-            REAL_T value;
-            char valc[sizeof (REAL_T)];
-            in.read(valc, sizeof (REAL_T));
-            value_ptr = reinterpret_cast<REAL_T*> (valc);
-            if (!little_endian) {
-                value = SwapBytes<uint32_t > (*value_ptr);
-            } else {
-                value = *value_ptr;
+            template<class T>
+            ArrayElementReference& operator+=(const T &rhs) {
+                return *this = (*this +rhs);
             }
-            v.min_boundary_m = value;
 
-            in.read(valc, sizeof (REAL_T));
-            value_ptr = reinterpret_cast<REAL_T*> (valc);
+            template<class T>
+            ArrayElementReference& operator-=(const T &rhs) {
+                return *this = (*this -rhs);
+            }
 
-            if (!little_endian) {
-                value = SwapBytes<uint32_t > (*value_ptr);
-            } else {
-                value = *value_ptr;
+            template<class T>
+            ArrayElementReference& operator*=(const T &rhs) {
+                return *this = (*this * rhs);
             }
-            v.max_boundary_m = value;
 
+            template<class T>
+            ArrayElementReference& operator/=(const T &rhs) {
+                return *this = (*this / rhs);
+            }
 
-            in.read(valc, sizeof (REAL_T));
-            value_ptr = reinterpret_cast<REAL_T*> (valc);
+        private:
 
-            if (!little_endian) {
-                value = SwapBytes<uint32_t > (*value_ptr);
-            } else {
-                value = *value_ptr;
+            VariableArray<REAL_T, group>& Array() {
+                return const_cast<VariableArray<REAL_T, group>&> (this->array_m);
             }
-            v.value_m = value;
+        };
 
+        /**
+         * A strided, read only, view of the elements of a VariableArray,
+         * used for the rows and columns of a VariableMatrix. The view is a
+         * vector expression of count elements.
+         */
+        template<class REAL_T, int group = 0 >
+        class ArrayView : public ArrayExpression<REAL_T, ArrayView<REAL_T, group> > {
+        public:
 
-            //gradients
-            uint32_t* gsize;
-            uint32_t gs;
-            char gsizec[sizeof (uint32_t) ];
-            in.read(gsizec, sizeof (uint32_t));
-            gsize = reinterpret_cast<uint32_t*> (gsizec);
-            if (!little_endian) {
-                gs = SwapBytes<uint32_t > (*gsize);
-            } else {
-                gs = *gsize;
+            ArrayView(const VariableArray<REAL_T, group> &array, const size_t &offset,
+                    const size_t &stride, const size_t &count)
+            : array_m(array), offset_m(offset), stride_m(stride), count_m(count) {
             }
 
+            inline size_t Size() const {
+                return count_m;
+            }
 
+            inline size_t Rows() const {
+                return count_m;
+            }
 
-            v.g.resize(gs);
+            inline size_t Columns() const {
+                return 1;
+            }
 
+            inline const REAL_T Value(const size_t &i) const {
+                return array_m.Value(offset_m + i * stride_m);
+            }
 
-            for (uint32_t i = 0; i < gs; i++) {
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                array_m.PushAdjoints(tape, offset_m + i * stride_m, coefficient);
+            }
 
-                char c = '0';
-                in >> c;
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                array_m.Push(statements, offset_m + i * stride_m);
+            }
 
-                bool b = false;
-                if (c == '1') {
-                    b = true;
-                }
+            const ArrayElement<REAL_T, group> operator[](const size_t &i) const {
+                return ArrayElement<REAL_T, group > (array_m, offset_m + i * stride_m);
+            }
 
+        private:
+            const VariableArray<REAL_T, group> &array_m;
+            size_t offset_m;
+            size_t stride_m;
+            size_t count_m;
+        };
 
-                in.read(valc, sizeof (REAL_T));
-                value_ptr = reinterpret_cast<REAL_T*> (valc);
-                if (!little_endian) {
-                    value = SwapBytes<uint32_t > (*value_ptr);
-                } else {
-                    value = *value_ptr;
-                }
+        /**
+         * A vector expression over a contiguous range of Variables, such as
+         * a std::vector of parameters, without copying them.
+         */
+        template<class REAL_T, int group>
+        class VariableRange : public ArrayExpression<REAL_T, VariableRange<REAL_T, group> > {
+        public:
 
-                //                std::cout << v[] << "\n";
-                v.g[i] = std::pair<bool, REAL_T > (b, value);
+            VariableRange(const std::vector<Variable<REAL_T, group> > &variables)
+            : data_m(variables.empty() ? NULL : &variables[0]), size_m(variables.size()) {
+            }
 
+            VariableRange(const Variable<REAL_T, group>* data, const size_t &size)
+            : data_m(data), size_m(size) {
             }
 
-            //statements
+            inline size_t Size() const {
+                return size_m;
+            }
 
-            uint32_t* ssize;
-            uint32_t ss;
-            char ssizec[sizeof (uint32_t) ];
-            in.read(ssizec, sizeof (uint32_t));
-            ssize = reinterpret_cast<uint32_t*> (ssizec);
-            if (!little_endian) {
-                ss = SwapBytes<uint32_t > (*ssize);
-            } else {
-                ss = *ssize;
+            inline size_t Rows() const {
+                return size_m;
             }
 
-            v.statements_m.resize(ss);
+            inline size_t Columns() const {
+                return 1;
+            }
 
-            for (uint32_t i = 0; i < ss; i++) {
+            inline const REAL_T Value(const size_t &i) const {
+                return data_m[i].GetValue();
+            }
 
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const size_t &i, const REAL_T &coefficient) const {
+                data_m[i].PushAdjoints(tape, coefficient);
+            }
 
-                uint32_t* sid_ptr;
-                uint32_t sid;
-                char sidc[sizeof (uint32_t) ];
-                in.read(sidc, sizeof (uint32_t));
-                sid_ptr = reinterpret_cast<uint32_t*> (sidc);
-                if (!little_endian) {
-                    sid = SwapBytes<uint32_t > (*sid_ptr);
-                } else {
-                    sid = *sid_ptr;
-                }
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                data_m[i].Push(statements);
+            }
 
+        private:
+            const Variable<REAL_T, group>* data_m;
+            size_t size_m;
+        };
 
-                uint32_t* sop_ptr;
-                uint32_t sop;
-                char sopc[sizeof (uint32_t) ];
-                in.read(sopc, sizeof (uint32_t));
-                sop_ptr = reinterpret_cast<uint32_t*> (sopc);
-                if (!little_endian) {
-                    sop = SwapBytes<uint32_t > (*sop_ptr);
-                } else {
-                    sop = *sop_ptr;
-                }
+        /**
+         * A vector expression over a contiguous range of constants, such as
+         * observed data.
+         */
+        template<class REAL_T>
+        class ConstantRange : public ArrayExpression<REAL_T, ConstantRange<REAL_T> > {
+        public:
 
+            ConstantRange(const std::vector<REAL_T> &values)
+            : data_m(values.empty() ? NULL : &values[0]), size_m(values.size()) {
+            }
 
-                REAL_T* value_ptr;
-                REAL_T value;
-                char valc[sizeof (REAL_T)];
-                in.read(valc, sizeof (REAL_T));
-                value_ptr = reinterpret_cast<REAL_T*> (valc);
-                if (!little_endian) {
-                    value = SwapBytes<uint32_t > (*value_ptr);
-                } else {
-                    value = *value_ptr;
-                }
-                //                Operation op = 
-                v.statements_m[i] = Statement<REAL_T > (static_cast<Operation> (sop), value, sid);
+            ConstantRange(const REAL_T* data, const size_t &size)
+            : data_m(data), size_m(size) {
             }
 
+            inline size_t Size() const {
+                return size_m;
+            }
 
+            inline size_t Rows() const {
+                return size_m;
+            }
 
-            return v;
+            inline size_t Columns() const {
+                return 1;
+            }
 
-        }
+            inline const REAL_T Value(const size_t &i) const {
+                return data_m[i];
+            }
 
-        /**
-         * Set the variable equal to the real type rhs.
-         * 
-         * The gradient map will be cleared.
-         * 
-         * @param rhs
-         * @return 
-         */
-        Variable& operator=(const REAL_T& rhs) {
-            this->SetValue(rhs);
-            //            iv_min = std::numeric_limits<uint32_t>::max();
-            //            iv_max = std::numeric_limits<uint32_t>::min();
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &, const size_t &, const REAL_T &) const {
+            }
 
-#if defined(USE_HASH_TABLE)
-            this->gradients_m.Clear();
-#else
-            //            this->gradients_m.clear();
-            this->g.clear();
-            if (Variable::IsRecording()) {
-                if (Variable::is_supporting_arbitrary_order) {
-                    this->statements_m.clear();
-                    this->statements_m.push_back(Statement<REAL_T > (VARIABLE, this->GetValue(), this->GetId()));
-                }
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                statements.push_back(Statement<REAL_T > (CONSTANT, data_m[i]));
             }
-#endif
 
-            return *this;
-        }
+        private:
+            const REAL_T* data_m;
+            size_t size_m;
+        };
 
         /**
-         * Sets the value of this Variable to that of rhs. Derivatives 
-         * are stored in the encapsulated gradient map.
-         * 
-         * @param rhs
-         * @return 
+         * Storage for an array of Variables. Values are contiguous and row
+         * major. Derivative information is kept per element in the form of
+         * the active recording mode: the statement index on the adjoint
+         * tape, the forward mode gradient, and the ExpressionGraph node for
+         * arbitrary order.
          */
-        Variable& operator=(const Variable& other) {
-            //                        this->id = other.getId();
-            //has_m.resize(IDGenerator::instance()->current() + 1);
-            this->SetValue(other.GetValue());
+        template<class REAL_T, int group>
+        class VariableArray : public ArrayExpression<REAL_T, VariableArray<REAL_T, group> > {
+            size_t rows_m;
+            size_t columns_m;
+            std::vector<REAL_T> values_m;
+            std::vector<uint64_t> tape_index_m; //statement index of each element on the adjoint tape.
+            std::vector<SparseGradient<REAL_T> > gradients_m; //forward mode gradient of each element.
+            std::vector<uint64_t> nodes_m; //node of each element on the ExpressionGraph.
 
-            //            this->gradients.clear();
-            if (ad::Variable<REAL_T>::is_recording_g) {
+            friend class ArrayElement<REAL_T, group>;
 
-#if defined(USE_HASH_TABLE)
-                ind_iterator it;
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = other.Derivative(*it, found);
-                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                }
-#else
-                //                this->gradients.insert(rhs.gradients.begin(), rhs.gradients.end());
-                //                ind_iterator it;
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = other.Derivative(*it, found);
-                //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                //                }
-                // other.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                other.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it].first = true;
-                    this->g[*it].second = other.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
-                }
+        public:
 
+            VariableArray() : rows_m(0), columns_m(0) {
+            }
 
-#endif
+            VariableArray(const size_t &rows, const size_t &columns, const REAL_T &value = REAL_T(0.0))
+            : rows_m(rows), columns_m(columns), values_m(rows * columns, value) {
+            }
 
-                if (Variable::is_supporting_arbitrary_order) {
+            template<class A>
+            VariableArray(const ArrayExpression<REAL_T, A> &expr) : rows_m(0), columns_m(0) {
+                this->Assign(expr);
+            }
 
-                    std::vector<Statement<REAL_T> > temp_stmnt;
-                    other.Push(temp_stmnt);
-                    this->statements_m = temp_stmnt;
-                }
+            inline size_t Size() const {
+                return values_m.size();
+            }
 
+            inline size_t Rows() const {
+                return rows_m;
             }
-            this->is_independent_m = other.is_independent_m;
-            return *this;
-        }
 
-        /**
-         * Set the Variables value to the result of the expression rhs. 
-         * Derivatives are calculated and stored in the encapsulated 
-         * gradient map.
-         * @param rhs
-         * @return 
-         */
-        template<class T>
-        Variable& operator=(const ExpressionBase<REAL_T, T>& expr) {
+            inline size_t Columns() const {
+                return columns_m;
+            }
 
-            //            this->id_m = expr.GetId();
-            //has_m.resize(IDGenerator::instance()->current() + 1);
-            if (Variable::is_recording_g) {
-                //                ind_iterator it; // = this->gradients.lower_bound();
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = expr.Derivative(*it, found);
-                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
+            inline const REAL_T Value(const size_t &i) const {
+                return values_m[i];
+            }
+
+            /**
+             * Contiguous, row major, element values.
+             *
+             * @return
+             */
+            inline const std::vector<REAL_T>& GetValues() const {
+                return values_m;
+            }
+
+            inline void PushAdjoints(AdjointTape<REAL_T> &tape, const size_t &i, const REAL_T &coefficient) const {
+                if (i < this->tape_index_m.size()) {
+                    tape.PushDependent(this->tape_index_m[i], coefficient);
                 }
-#else
-                //                                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                                    bool found = false;
-                //                                    this->gradients_m[(*it)] = expr.Derivative(*it, found);
-                //                                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                //                                }
-#endif
+            }
 
-//                                ids_m.clear();
-                //                ids_m.set_empty_key(NULL);
-                expr.PushIds(ids_m);
-                // expr.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = false;
-                    this->g[*it].first = true;
-                    this->g[*it].second = expr.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
+            inline void PushAdjoints(GradientWorkspace<REAL_T> &workspace, const size_t &i, const REAL_T &coefficient) const {
+                if (i < this->gradients_m.size()) {
+                    typename SparseGradient<REAL_T>::const_iterator it;
+                    for (it = this->gradients_m[i].begin(); it != this->gradients_m[i].end(); ++it) {
+                        workspace.entries_m.PushBack(it->first, coefficient * it->second);
+                    }
                 }
-                //                expr.GetIdRange(this->iv_min, this->iv_max);
-                if (Variable::is_supporting_arbitrary_order) {
-                    std::vector<Statement<REAL_T> > temp_stmnt;
-                    expr.Push(temp_stmnt);
-                    this->statements_m = temp_stmnt;
+            }
+
+            inline void PushAdjoints(BranchRecorder<REAL_T> &recorder, const size_t &, const REAL_T &) const {
+                Context<REAL_T, group>& context = Variable<REAL_T, group>::GetContext();
+                if (context.IsRecordingBranches()) {
+                    recorder.branches_m = &context.GetBranches();
+                    recorder.graph_m = &context.GetExpressionGraph();
                 }
+            }
 
+            void Push(StatementList<REAL_T> &statements, const size_t &i) const {
+                ExpressionGraph<REAL_T>& graph = Variable<REAL_T, group>::GetExpressionGraph();
+                if (i < this->nodes_m.size() && graph.IsLive(this->nodes_m[i])) {
+                    statements.push_back(Statement<REAL_T > (NODE, REAL_T(0), graph.Position(this->nodes_m[i])));
+                    return;
+                }
+                statements.push_back(Statement<REAL_T > (VARIABLE, this->values_m[i], 0));
+            }
 
+            const ArrayElement<REAL_T, group> operator[](const size_t &i) const {
+                return ArrayElement<REAL_T, group > (*this, i);
             }
-            this->SetValue(expr.GetValue());
-            return *this;
-        }
 
-        /**
-         * 
-         * @param rhs
-         * @return 
-         */
-        template<class T>
-        Variable& operator+=(const ExpressionBase<REAL_T, T>& rhs) {
-            //            return *this = (*this +rhs);
-            //has_m.resize(IDGenerator::instance()->current() + 1);
-            if (Variable::is_recording_g) {
+            ArrayElementReference<REAL_T, group> operator[](const size_t &i) {
+                return ArrayElementReference<REAL_T, group > (*this, i);
+            }
 
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value + rhs.Derivative(*it, found);
+            /**
+             * Sets the elements, and the shape, of this array to those of
+             * expr. Values are computed first and every element is then
+             * recorded as one statement, so expr may refer to this array.
+             *
+             * @param expr
+             */
+            template<class A>
+            void Assign(const ArrayExpression<REAL_T, A> &expr) {
+                const size_t size = expr.Size();
+                std::vector<REAL_T> values(size);
+                for (size_t i = 0; i < size; i++) {
+                    values[i] = expr.Value(i);
+                }
+
+                Context<REAL_T, group>& context = Variable<REAL_T, group>::GetContext();
+                if (context.IsRecording()) {
+                    if (context.IsUsingAdjointTape()) {
+                        AdjointTape<REAL_T>& tape = context.GetAdjointTape();
+                        std::vector<uint64_t> indices(size);
+                        for (size_t i = 0; i < size; i++) {
+                            expr.PushAdjoints(tape, i, static_cast<REAL_T> (1.0));
+                            indices[i] = tape.Commit();
+                        }
+                        this->tape_index_m.swap(indices);
+                        this->gradients_m.clear();
+                    } else {
+                        GradientWorkspace<REAL_T>& workspace = context.GetGradientWorkspace();
+                        std::vector<SparseGradient<REAL_T> > gradients(size);
+                        for (size_t i = 0; i < size; i++) {
+                            workspace.entries_m.Clear();
+                            expr.PushAdjoints(workspace, i, static_cast<REAL_T> (1.0));
+                            workspace.entries_m.Consolidate();
+                            gradients[i].Assign(workspace.entries_m);
+                        }
+                        this->gradients_m.swap(gradients);
+                        this->tape_index_m.clear();
+                    }
+
+                    if (context.IsSupportingArbitraryOrder()) {
+                        StatementList<REAL_T>& statements = context.GetGradientWorkspace().statements_m;
+                        ExpressionGraph<REAL_T>& graph = context.GetExpressionGraph();
+                        std::vector<uint64_t> nodes(size);
+                        for (size_t i = 0; i < size; i++) {
+                            statements.clear();
+                            expr.Push(statements, i);
+                            nodes[i] = graph.Link(statements);
+                        }
+                        this->nodes_m.swap(nodes);
+                    } else {
+                        this->nodes_m.clear();
+                    }
+                } else {
+                    this->tape_index_m.clear();
+                    this->gradients_m.clear();
+                    this->nodes_m.clear();
                 }
-#else
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] + rhs.Derivative(*it, found);
-                //                }
-#endif
 
-                // rhs.GetIdRange(this->iv_min, this->iv_max);
+                this->values_m.swap(values);
+                this->rows_m = expr.Rows();
+                this->columns_m = expr.Columns();
+            }
 
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                rhs.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it].first = true;
-                    this->g[*it].second = this->g[*it].second + rhs.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
+            /**
+             * Sets element i to the scalar expression expr. The derivative
+             * information of element i is replaced by that of the active 
+             * recording mode, the slots of the other modes are cleared. 
+             * expr is recorded before, so it may refer to element i.
+             *
+             * @param i
+             * @param expr
+             */
+            template<class T>
+            void AssignElement(const size_t &i, const ExpressionBase<REAL_T, T> &expr) {
+                const REAL_T value = expr.GetValue();
+                Context<REAL_T, group>& context = Variable<REAL_T, group>::GetContext();
+                if (!context.IsRecording()) {
+                    this->SetElement(i, value);
+                    return;
+                }
+                const bool adjoint = context.IsUsingAdjointTape();
+                const bool arbitrary = context.IsSupportingArbitraryOrder();
+                GradientWorkspace<REAL_T>& workspace = context.GetGradientWorkspace();
+                uint64_t index = 0;
+                uint64_t node = 0;
+                if (adjoint) {
+                    AdjointTape<REAL_T>& tape = context.GetAdjointTape();
+                    expr.PushAdjoints(tape, static_cast<REAL_T> (1.0));
+                    index = tape.Commit();
+                } else {
+                    workspace.entries_m.Clear();
+                    expr.PushAdjoints(workspace, static_cast<REAL_T> (1.0));
+                    workspace.entries_m.Consolidate();
+                }
+                if (arbitrary) {
+                    StatementList<REAL_T>& statements = workspace.statements_m;
+                    statements.clear();
+                    expr.Push(statements);
+                    node = context.GetExpressionGraph().Link(statements);
                 }
 
-                if (Variable::is_supporting_arbitrary_order) {
-                    rhs.Push(this->statements_m);
-                    this->statements_m.push_back(Statement<REAL_T > (PLUS));
+                this->SetElement(i, value);
+                if (adjoint) {
+                    this->tape_index_m.resize(this->Size(), 0);
+                    this->tape_index_m[i] = index;
+                } else {
+                    this->gradients_m.resize(this->Size());
+                    this->gradients_m[i].Assign(workspace.entries_m);
+                }
+                if (arbitrary) {
+                    this->nodes_m.resize(this->Size(), 0);
+                    this->nodes_m[i] = node;
                 }
+            }
 
+            /**
+             * Sets element i to the constant value, clearing its derivative
+             * information in every recording mode.
+             *
+             * @param i
+             * @param value
+             */
+            void SetElement(const size_t &i, const REAL_T &value) {
+                if (i < this->tape_index_m.size()) {
+                    this->tape_index_m[i] = 0;
+                }
+                if (i < this->gradients_m.size()) {
+                    this->gradients_m[i].Clear();
+                }
+                if (i < this->nodes_m.size()) {
+                    this->nodes_m[i] = 0;
+                }
+                this->values_m[i] = value;
             }
-            this->value_m += rhs.GetValue();
-            return *this;
-        }
 
-        Variable& operator+=(Variable& rhs) {
-            if (Variable::is_recording_g) {
-                //has_m.resize(IDGenerator::instance()->current() + 1);
+        };
 
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value + rhs.Derivative(*it, found);
-                }
-#else
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] + rhs.Derivative(*it, found);
-                //                }
-#endif
+        /**
+         * A column vector of Variables.
+         */
+        template<class REAL_T, int group = 0 >
+        class VariableVector : public VariableArray<REAL_T, group> {
+        public:
 
-                // rhs.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                rhs.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it].first = true;
-                    this->g[*it].second = this->g[*it].second + rhs.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
+            VariableVector() {
+            }
+
+            explicit VariableVector(const size_t &size, const REAL_T &value = REAL_T(0.0))
+            : VariableArray<REAL_T, group>(size, 1, value) {
+            }
+
+            VariableVector(const std::vector<REAL_T> &values)
+            : VariableArray<REAL_T, group>(values.size(), 1) {
+                for (size_t i = 0; i < values.size(); i++) {
+                    this->SetElement(i, values[i]);
                 }
+            }
 
-                if (Variable::is_supporting_arbitrary_order) {
-                    rhs.Push(this->statements_m);
-                    this->statements_m.push_back(Statement<REAL_T > (PLUS));
+            /**
+             * Records element i as variables[i].
+             *
+             * @param variables
+             */
+            VariableVector(const std::vector<Variable<REAL_T, group> > &variables)
+            : VariableArray<REAL_T, group>(variables.size(), 1) {
+                for (size_t i = 0; i < variables.size(); i++) {
+                    this->AssignElement(i, variables[i]);
                 }
+            }
 
+            template<class A>
+            VariableVector(const ArrayExpression<REAL_T, A> &expr) {
+                this->Assign(expr);
             }
-            //            rhs.GetIdRange(this->iv_min, this->iv_max);
-            this->value_m += rhs.GetValue();
-            return *this;
-        }
 
-        template<class T>
-        Variable& operator-=(const ExpressionBase<REAL_T, T>& rhs) {
-            return *this = (*this -rhs);
-            //            if (Variable::is_recording_g) {
-            //                ind_iterator it;
-            //#if defined(USE_HASH_TABLE)
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m.Insert((*it))->value = (this->gradients_m.Lookup(*it)->value - rhs.Derivative(*it, found));
-            //                }
-            //#else
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] - rhs.Derivative(*it, found));
-            //                }
-            //#endif
-            //                if (Variable::is_supporting_arbitrary_order) {
-            //                    rhs.Push(this->statements_m);
-            //                    this->statements_m.push_back(Statement(MINUS));
-            //                }
-            //            }
-            //            this->value_m -= rhs.GetValue();
-            //            return *this;
-        }
+            template<class A>
+            VariableVector& operator=(const ArrayExpression<REAL_T, A> &expr) {
+                this->Assign(expr);
+                return *this;
+            }
 
-        Variable& operator-=(Variable& rhs) {
-            if (Variable::is_recording_g) {
-                //has_m.resize(IDGenerator::instance()->current() + 1);
+        };
 
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert((*it))->value = (this->gradients_m.Lookup(*it)->value - rhs.Derivative(*it, found));
-                }
-#else
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] - rhs.Derivative(*it, found));
-                //                }
-#endif
-                // rhs.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                rhs.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it] = this->g[*it] - rhs.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
-                }
-                if (Variable::is_supporting_arbitrary_order) {
-                    rhs.Push(this->statements_m);
-                    this->statements_m.push_back(Statement<REAL_T > (MINUS));
-                }
+        /**
+         * A row major matrix of Variables.
+         */
+        template<class REAL_T, int group = 0 >
+        class VariableMatrix : public VariableArray<REAL_T, group> {
+        public:
+
+            VariableMatrix() {
             }
-            this->value_m -= rhs.GetValue();
-            return *this;
-        }
 
-        template<class T>
-        Variable& operator*=(const ExpressionBase<REAL_T, T>& rhs) {
-            return *this = (*this * rhs);
-            //            if (Variable::is_recording_g) {
-            //                ind_iterator it;
-            //#if defined(USE_HASH_TABLE)
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
-            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-            //                }
-            //#else
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
-            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-            //                }
-            //#endif
-            //                if (Variable::is_supporting_arbitrary_order) {
-            //                    rhs.Push(this->statements_m);
-            //                    this->statements_m.push_back(Statement(MULTIPLY));
-            //                }
-            //            }
-            //            this->value_m *= rhs.GetValue();
-            return *this;
-        }
+            VariableMatrix(const size_t &rows, const size_t &columns, const REAL_T &value = REAL_T(0.0))
+            : VariableArray<REAL_T, group>(rows, columns, value) {
+            }
 
-        Variable& operator*=(Variable& rhs) {
-            if (Variable::is_recording_g) {
-                //has_m.resize(IDGenerator::instance()->current() + 1);
+            template<class A>
+            VariableMatrix(const ArrayExpression<REAL_T, A> &expr) {
+                this->Assign(expr);
+            }
 
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = this->gradients_m.Lookup(*it)->value * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
-                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                }
-#else
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = this->gradients_m[(*it)] * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
-                //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                //                }
-#endif
-                //
-                //                rhs.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                rhs.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it] = this->g[*it] * rhs.GetValue() + this->GetValue() * rhs.Derivative(*it, found);
-                    //                    this->gradients_m[*it] = g[*it];
-                }
+            template<class A>
+            VariableMatrix& operator=(const ArrayExpression<REAL_T, A> &expr) {
+                this->Assign(expr);
+                return *this;
+            }
 
-                if (Variable::is_supporting_arbitrary_order) {
-                    rhs.Push(this->statements_m);
-                    this->statements_m.push_back(Statement<REAL_T > (MULTIPLY));
-                }
+            const ArrayElement<REAL_T, group> operator()(const size_t &i, const size_t &j) const {
+                return ArrayElement<REAL_T, group > (*this, i * this->Columns() + j);
             }
-            this->value_m *= rhs.GetValue();
-            return *this;
-        }
 
-        template<class T>
-        Variable& operator/=(const ExpressionBase<REAL_T, T>& rhs) {
-            return *this = (*this / rhs);
-            //            if (Variable::is_recording_g) {
-            //                ind_iterator it;
-            //#if defined(USE_HASH_TABLE)
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m.Insert(*it)->value = (this->gradients_m.Lookup(*it)->value * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
-            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-            //                }
-            //#else
-            //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-            //                    bool found = false;
-            //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
-            //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-            //                }
-            //#endif
-            //                if (Variable::is_supporting_arbitrary_order) {
-            //                    rhs.Push(this->statements_m);
-            //                    this->statements_m.push_back(Statement(DIVIDE));
-            //                }
-            //            }
-            //            this->value_m /= rhs.GetValue();
-            return *this;
-        }
+            ArrayElementReference<REAL_T, group> operator()(const size_t &i, const size_t &j) {
+                return ArrayElementReference<REAL_T, group > (*this, i * this->Columns() + j);
+            }
 
-        Variable& operator/=(Variable& rhs) {
-            if (Variable::is_recording_g) {
-                //has_m.resize(IDGenerator::instance()->current() + 1);
+            /**
+             * View of row i.
+             *
+             * @param i
+             * @return
+             */
+            const ArrayView<REAL_T, group> Row(const size_t &i) const {
+                return ArrayView<REAL_T, group > (*this, i * this->Columns(), 1, this->Columns());
+            }
 
-#if defined(USE_HASH_TABLE)
-                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                    bool found = false;
-                    this->gradients_m.Insert(*it)->value = (this->gradients_m.Lookup(*it)->value * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
-                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                }
-#else
-                //                for (it = Variable::independent_variables_g.begin(); it != Variable::independent_variables_g.end(); ++it) {
-                //                    bool found = false;
-                //                    this->gradients_m[(*it)] = (this->gradients_m[(*it)] * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
-                //                    //                std::cout<<"diff wrt "<<(*it)<<" = " <<rhs.Derivative(*it, found);
-                //                }
-#endif
-                //                rhs.GetIdRange(this->iv_min, this->iv_max);
-                //                for (uint32_t i = this->iv_min; i < this->iv_max + 1; i++) {
-                indepedndent_variables_iterator it;
-                rhs.PushIds(ids_m);
-                g.resize(IDGenerator::instance()->current() + 1);
-                //                for (uint32_t i = this->iv_min; i< this->iv_max + 1; i++) {
-                for (it = this->ids_m.begin(); it != ids_m.end(); ++it) {
-                    bool found = true;
-                    this->g[*it] = (this->g[*it] * rhs.GetValue() - this->GetValue() * rhs.Derivative(*it, found)) / (rhs.GetValue() * rhs.GetValue());
-                    //                    this->gradients_m[*it] = g[*it];
-                }
-                if (Variable::is_supporting_arbitrary_order) {
-                    rhs.Push(this->statements_m);
-                    this->statements_m.push_back(Statement<REAL_T > (DIVIDE));
-                }
+            /**
+             * View of column j.
+             *
+             * @param j
+             * @return
+             */
+            const ArrayView<REAL_T, group> Column(const size_t &j) const {
+                return ArrayView<REAL_T, group > (*this, j, this->Columns(), this->Rows());
             }
-            this->value_m /= rhs.GetValue();
-            return *this;
-        }
 
-        // And likewise for a Constant on the rhs
+        };
 
-        Variable& operator+=(const REAL_T& rhs) {
-            value_m += rhs;
-            if (Variable::IsRecording()) {
-                if (Variable::is_supporting_arbitrary_order) {
-                    this->statements_m.push_back(Statement<REAL_T > (CONSTANT, rhs));
-                    this->statements_m.push_back(Statement<REAL_T > (PLUS));
-                }
+        /**
+         * Base class of the reductions of array expressions to a scalar
+         * expression template. The derived class accumulates value_m in one
+         * pass over the elements and pushes the partials of every element
+         * in a single PushAdjoints call, so the reduction is recorded as one
+         * statement whatever the number of elements.
+         */
+        template <class REAL_T, class A>
+        struct ArrayReduction : public ExpressionBase<REAL_T, A> {
+
+            ArrayReduction() : ExpressionBase<REAL_T, A>(0), value_m(0.0) {
             }
-            return *this;
-        }
 
-        Variable& operator-=(const REAL_T& rhs) {
+            inline const REAL_T GetValue() const {
+                return value_m;
+            }
 
-            if (Variable::IsRecording()) {
-                if (Variable::is_supporting_arbitrary_order) {
-                    this->statements_m.push_back(Statement<REAL_T > (CONSTANT, rhs));
-                    this->statements_m.push_back(Statement<REAL_T > (MINUS));
+            inline const REAL_T Derivative(const uint32_t &id, bool &found) const {
+                GradientWorkspace<REAL_T> workspace;
+                this->Cast().PushAdjoints(workspace, static_cast<REAL_T> (1.0));
+                workspace.entries_m.Consolidate();
+                REAL_T value;
+                if (workspace.entries_m.Find(id, value)) {
+                    found = true;
+                    return value;
                 }
+                return 0.0;
             }
-            value_m -= rhs;
-            return *this;
-        }
 
-        Variable& operator*=(const REAL_T& rhs) {
-            if (Variable::IsRecording()) {
-                if (Variable::is_supporting_arbitrary_order) {
-                    this->statements_m.push_back(Statement<REAL_T > (CONSTANT, rhs));
-                    this->statements_m.push_back(Statement<REAL_T > (MULTIPLY));
+            void GetIdRange(uint32_t &min, uint32_t & max) const {
+                GradientWorkspace<REAL_T> workspace;
+                this->Cast().PushAdjoints(workspace, static_cast<REAL_T> (1.0));
+                workspace.entries_m.Consolidate();
+                if (!workspace.entries_m.Empty()) {
+                    min = std::min(min, workspace.entries_m.begin()->first);
+                    max = std::max(max, (workspace.entries_m.end() - 1)->first);
                 }
             }
-            return *this = (*this * rhs);
-        }
 
-        Variable& operator/=(const REAL_T& rhs) {
-            if (Variable::IsRecording()) {
-                if (Variable::is_supporting_arbitrary_order) {
-                    this->statements_m.push_back(Statement<REAL_T > (CONSTANT, rhs));
-                    this->statements_m.push_back(Statement<REAL_T > (DIVIDE));
+            inline void PushIds(IdsSet & ids) const {
+                GradientWorkspace<REAL_T> workspace;
+                this->Cast().PushAdjoints(workspace, static_cast<REAL_T> (1.0));
+                typename SparseGradient<REAL_T>::const_iterator it;
+                for (it = workspace.entries_m.begin(); it != workspace.entries_m.end(); ++it) {
+                    ids.insert(it->first);
                 }
             }
-            return *this = (*this / rhs);
-        }
 
-        const REAL_T Diff(const Variable &wrt) {
+        protected:
+            REAL_T value_m;
+        };
 
-            if (this->statements_m.size() == 0) {
-                return 0.0;
-            }
-            std::vector<std::pair<REAL_T, REAL_T> > v;
-            v.reserve(this->statements_m.size());
-            std::stack<std::pair<REAL_T, REAL_T>,
-                    std::vector<std::pair<REAL_T, REAL_T> > > stack;
-            //            ad::Stack<std::pair<T, T> > stack;
-            bool found = false;
-            int size = this->statements_m.size();
-            std::pair<REAL_T, REAL_T> lhs = std::pair<REAL_T, REAL_T > (0, 0);
-            std::pair<REAL_T, REAL_T> rhs = std::pair<REAL_T, REAL_T > (0, 0);
+        /**
+         * Sum of the elements of an array expression.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArraySum : public ArrayReduction<REAL_T, ArraySum<REAL_T, EXPR> > {
 
-            //            Statement<REAL_T>* edata = (Statement<REAL_T>*)this->statements_m.data();
-            //            std::cout << this->statements_m.size() << "\n\n";
-            for (int i = 0; i < size; i++) {
+            ArraySum(const ArrayExpression<REAL_T, EXPR> &expr) : expr_m(expr.Cast()) {
+                const size_t size = expr_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    this->value_m += expr_m.Value(i);
+                }
+            }
 
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = expr_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(0.0)));
+                    return;
+                }
+                expr_m.Push(statements, 0);
+                for (size_t i = 1; i < size; i++) {
+                    expr_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (PLUS));
+                }
+            }
 
-                REAL_T temp = 0;
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = expr_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    expr_m.PushAdjoints(tape, i, coefficient);
+                }
+            }
 
+        private:
+            typename ArrayOperand<EXPR>::type expr_m;
+        };
 
+        /**
+         * Dot product of two array expressions of the same size.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArrayDot : public ArrayReduction<REAL_T, ArrayDot<REAL_T, LHS, RHS> > {
+
+            ArrayDot(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(lhs.Size() == rhs.Size());
+                const size_t size = lhs_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    this->value_m += lhs_m.Value(i) * rhs_m.Value(i);
+                }
+            }
 
-                switch (statements_m[i].op_m) {
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = lhs_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(0.0)));
+                    return;
+                }
+                for (size_t i = 0; i < size; i++) {
+                    lhs_m.Push(statements, i);
+                    rhs_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (MULTIPLY));
+                    if (i > 0) {
+                        statements.push_back(Statement<REAL_T > (PLUS));
+                    }
+                }
+            }
 
-                    case CONSTANT:
-                        stack.push(std::pair<REAL_T, REAL_T > (statements_m[i].value_m, 0.0));
-                        break;
-                    case VARIABLE:
-                        if (statements_m[i].id_m == wrt.GetId() && wrt.GetId() > 0) {
-                            found = true;
-                            //f(x) = x
-                            //f'(x) = 1
-                            stack.push(std::pair<REAL_T, REAL_T > (statements_m[i].value_m, 1.0));
-                        } else {//constant
-                            //f(x) = C
-                            //f'(x) = 0
-                            stack.push(std::pair<REAL_T, REAL_T > (statements_m[i].value_m, 0.0));
-                        }
-                        break;
-                    case PLUS:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        stack.push(std::pair<REAL_T, REAL_T > (lhs.first + rhs.first, lhs.second + rhs.second));
-                        // ret = lhs.second + rhs.second;
-                        break;
-                    case MINUS:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        stack.push(std::pair<REAL_T, REAL_T > (lhs.first - rhs.first, lhs.second - rhs.second));
-                        // ret = lhs.second-rhs.second;
-                        break;
-                    case MULTIPLY:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        temp = lhs.second * rhs.first + lhs.first * rhs.second;
-                        //                          std::cout << "* " <<lhs.second <<"*"<< rhs.first<<" +"<< lhs.first<<" * "<<rhs.second << " \n";
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = lhs_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    lhs_m.PushAdjoints(tape, i, coefficient * rhs_m.Value(i));
+                    rhs_m.PushAdjoints(tape, i, coefficient * lhs_m.Value(i));
+                }
+            }
 
-                        stack.push(std::pair<REAL_T, REAL_T > (lhs.first * rhs.first, temp));
-                        // ret =temp;
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-                        break;
-                    case DIVIDE:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        //                        std::cout<<lhs.first<<" "<<rhs.first<<"\n";
-                        //                        temp = (lhs.second * rhs.first - lhs.first * rhs.second) / (rhs.first * rhs.first);
-                        stack.push(std::pair<REAL_T, REAL_T > (lhs.first / rhs.first, 1));
-                        // ret = temp;
-                        break;
+        /**
+         * Sum of the squared elements of an array expression, norm2 in
+         * ADMB.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArrayNorm2 : public ArrayReduction<REAL_T, ArrayNorm2<REAL_T, EXPR> > {
+
+            ArrayNorm2(const ArrayExpression<REAL_T, EXPR> &expr) : expr_m(expr.Cast()) {
+                const size_t size = expr_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    const REAL_T x = expr_m.Value(i);
+                    this->value_m += x * x;
+                }
+            }
 
-                    case SIN:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sin(lhs.first), lhs.second * std::cos(lhs.first)));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sin(lhs.first), 0));
-                        }
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = expr_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(0.0)));
+                    return;
+                }
+                for (size_t i = 0; i < size; i++) {
+                    expr_m.Push(statements, i);
+                    expr_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (MULTIPLY));
+                    if (i > 0) {
+                        statements.push_back(Statement<REAL_T > (PLUS));
+                    }
+                }
+            }
 
-                        break;
-                    case COS:
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = expr_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    expr_m.PushAdjoints(tape, i, static_cast<REAL_T> (2.0) * coefficient * expr_m.Value(i));
+                }
+            }
 
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::cos(lhs.first), lhs.second * (-1.0) * std::sin(lhs.first)));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::cos(lhs.first), 0));
-                        }
+        private:
+            typename ArrayOperand<EXPR>::type expr_m;
+        };
 
-                        break;
-                    case TAN:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * ((1.0 / std::cos(lhs.first))*(1.0 / std::cos(lhs.first)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::tan(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::tan(lhs.first), 0));
-                        }
+        /**
+         * Sum of the squared differences of two array expressions of the
+         * same size.
+         */
+        template <class REAL_T, class LHS, class RHS>
+        struct ArraySumSquares : public ArrayReduction<REAL_T, ArraySumSquares<REAL_T, LHS, RHS> > {
+
+            ArraySumSquares(const ArrayExpression<REAL_T, LHS> &lhs, const ArrayExpression<REAL_T, RHS> &rhs)
+            : lhs_m(lhs.Cast()), rhs_m(rhs.Cast()) {
+                assert(lhs.Size() == rhs.Size());
+                const size_t size = lhs_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    const REAL_T d = lhs_m.Value(i) - rhs_m.Value(i);
+                    this->value_m += d * d;
+                }
+            }
 
-                        break;
-                    case ASIN:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * 1.0 / std::pow((static_cast<REAL_T> (1.0) - std::pow(lhs.first, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::asin(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::asin(lhs.first), 0));
-                        }
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = lhs_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(0.0)));
+                    return;
+                }
+                for (size_t i = 0; i < size; i++) {
+                    lhs_m.Push(statements, i);
+                    rhs_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (MINUS));
+                    lhs_m.Push(statements, i);
+                    rhs_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (MINUS));
+                    statements.push_back(Statement<REAL_T > (MULTIPLY));
+                    if (i > 0) {
+                        statements.push_back(Statement<REAL_T > (PLUS));
+                    }
+                }
+            }
 
-                        break;
-                    case ACOS:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * (-1.0) / std::pow((static_cast<REAL_T> (1.0) - std::pow(lhs.first, static_cast<REAL_T> (2.0))), static_cast<REAL_T> (0.5)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::acos(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::acos(lhs.first), (0)));
-                        }
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = lhs_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    const REAL_T d = static_cast<REAL_T> (2.0) * coefficient * (lhs_m.Value(i) - rhs_m.Value(i));
+                    lhs_m.PushAdjoints(tape, i, d);
+                    rhs_m.PushAdjoints(tape, i, -d);
+                }
+            }
 
-                        break;
-                    case ATAN:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * (1.0) / (lhs.first * lhs.first + (1.0)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::atan(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::atan(lhs.first), (0)));
-                        }
+        private:
+            typename ArrayOperand<LHS>::type lhs_m;
+            typename ArrayOperand<RHS>::type rhs_m;
+        };
 
-                        break;
-                    case ATAN2:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (rhs.first * lhs.second / (lhs.first * lhs.first + (rhs.first * rhs.first)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::atan2(lhs.first, rhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::atan2(lhs.first, rhs.first), (0)));
-                        }
+        /**
+         * log of the sum of the exponentials of the elements of an array
+         * expression, evaluated as m + log(sum exp(x[i] - m)), m being the
+         * largest element, so it does not overflow.
+         */
+        template <class REAL_T, class EXPR>
+        struct ArrayLogSumExp : public ArrayReduction<REAL_T, ArrayLogSumExp<REAL_T, EXPR> > {
 
-                        break;
-                    case SQRT:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * (.5) / std::sqrt(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sqrt(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sqrt(lhs.first), (0)));
-                        }
+            ArrayLogSumExp(const ArrayExpression<REAL_T, EXPR> &expr) : expr_m(expr.Cast()), max_m(0) {
+                const size_t size = expr_m.Size();
+                if (size == 0) {
+                    this->value_m = -std::numeric_limits<REAL_T>::infinity();
+                    return;
+                }
+                for (size_t i = 1; i < size; i++) {
+                    if (expr_m.Value(i) > expr_m.Value(max_m)) {
+                        max_m = i;
+                    }
+                }
+                const REAL_T m = expr_m.Value(max_m);
+                REAL_T sum = 0;
+                for (size_t i = 0; i < size; i++) {
+                    sum += std::exp(expr_m.Value(i) - m);
+                }
+                this->value_m = m + std::log(sum);
+            }
 
-                        break;
-                    case POW:
-                        rhs = stack.top();
-                        stack.pop();
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * rhs.first) *
-                                    std::pow(lhs.first, (rhs.first - static_cast<REAL_T> (1.0)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::pow(lhs.first, rhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::pow(lhs.first, rhs.first), (0)));
-                        }
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = expr_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, this->value_m));
+                    return;
+                }
+                expr_m.Push(statements, max_m);
+                for (size_t i = 0; i < size; i++) {
+                    expr_m.Push(statements, i);
+                    expr_m.Push(statements, max_m);
+                    statements.push_back(Statement<REAL_T > (MINUS));
+                    statements.push_back(Statement<REAL_T > (EXP));
+                    if (i > 0) {
+                        statements.push_back(Statement<REAL_T > (PLUS));
+                    }
+                }
+                statements.push_back(Statement<REAL_T > (LOG));
+                statements.push_back(Statement<REAL_T > (PLUS));
+            }
 
-                        break;
-                    case LOG:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * (1.0)) / lhs.first;
-                            stack.push(std::pair<REAL_T, REAL_T > (std::log(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::log(lhs.first), (0)));
-                        }
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = expr_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    expr_m.PushAdjoints(tape, i, coefficient * std::exp(expr_m.Value(i) - this->value_m));
+                }
+            }
 
-                        break;
-                    case LOG10:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * (1.0)) / (lhs.first * std::log((10.0)));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::log10(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::log10(lhs.first), (0)));
-                        }
+        private:
+            typename ArrayOperand<EXPR>::type expr_m;
+            size_t max_m; //index of the largest element
+        };
 
-                        break;
-                    case EXP:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * std::exp(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::exp(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::exp(lhs.first), (0)));
-                        }
+        /**
+         * Log of the multinomial probability of the counts n given the
+         * cell probabilities p,
+         *
+         * lgamma(N + 1) - sum lgamma(n[i] + 1) + sum n[i] log(p[i]),
+         *
+         * N being the sum of the counts. n[i] log(p[i]) is taken as zero for
+         * n[i] = 0.
+         */
+        template <class REAL_T, class N, class P>
+        struct ArrayDMultinomLog : public ArrayReduction<REAL_T, ArrayDMultinomLog<REAL_T, N, P> > {
+
+            ArrayDMultinomLog(const ArrayExpression<REAL_T, N> &n, const ArrayExpression<REAL_T, P> &p)
+            : n_m(n.Cast()), p_m(p.Cast()), total_m(0) {
+                const size_t size = n_m.Size();
+                for (size_t i = 0; i < size; i++) {
+                    const REAL_T ni = n_m.Value(i);
+                    total_m += ni;
+                    this->value_m -= LogGamma(ni + REAL_T(1));
+                    if (ni != REAL_T(0)) {
+                        this->value_m += ni * std::log(p_m.Value(i));
+                    }
+                }
+                this->value_m += LogGamma(total_m + REAL_T(1));
+            }
 
-                        break;
-                    case SINH:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * std::cosh(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sinh(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::sinh(lhs.first), (0)));
-                        }
+            void Push(StatementList<REAL_T> &statements) const {
+                const size_t size = n_m.Size();
+                if (size == 0) {
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(0.0)));
+                    return;
+                }
+                for (size_t i = 0; i < size; i++) {
+                    n_m.Push(statements, i);
+                    if (i > 0) {
+                        statements.push_back(Statement<REAL_T > (PLUS));
+                    }
+                }
+                statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(1)));
+                statements.push_back(Statement<REAL_T > (PLUS));
+                statements.push_back(Statement<REAL_T > (LGAMMA));
+                for (size_t i = 0; i < size; i++) {
+                    n_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (CONSTANT, REAL_T(1)));
+                    statements.push_back(Statement<REAL_T > (PLUS));
+                    statements.push_back(Statement<REAL_T > (LGAMMA));
+                    statements.push_back(Statement<REAL_T > (MINUS));
+                    n_m.Push(statements, i);
+                    p_m.Push(statements, i);
+                    statements.push_back(Statement<REAL_T > (LOG));
+                    statements.push_back(Statement<REAL_T > (MULTIPLY));
+                    statements.push_back(Statement<REAL_T > (PLUS));
+                }
+            }
 
-                        break;
-                    case COSH:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * std::sinh(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::cosh(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::cosh(lhs.first), (0)));
-                        }
+            template<class TAPE>
+            inline void PushAdjoints(TAPE &tape, const REAL_T &coefficient) const {
+                const size_t size = n_m.Size();
+                const REAL_T digamma_total = Digamma(total_m + REAL_T(1));
+                for (size_t i = 0; i < size; i++) {
+                    const REAL_T ni = n_m.Value(i);
+                    const REAL_T pi = p_m.Value(i);
+                    const REAL_T log_p = ni == REAL_T(0) ? REAL_T(0) : std::log(pi);
+                    n_m.PushAdjoints(tape, i, coefficient * (digamma_total - Digamma(ni + REAL_T(1)) + log_p));
+                    p_m.PushAdjoints(tape, i, coefficient * ni / pi);
+                }
+            }
 
-                        break;
-                    case TANH:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = lhs.second * ((1.0) / std::cosh(lhs.first))*((1.0) / std::cosh(lhs.first));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::tanh(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::tanh(lhs.first), (0)));
-                        }
+        private:
+            typename ArrayOperand<N>::type n_m;
+            typename ArrayOperand<P>::type p_m;
+            REAL_T total_m;
+        };
 
-                        break;
-                    case FABS:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * lhs.first) /
-                                    std::fabs(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::fabs(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::fabs(lhs.first), (0)));
-                        }
+        /**
+         * Sum of the elements of an array expression.
+         *
+         * @param expr
+         * @return
+         */
+        template<class REAL_T, class EXPR>
+        inline const ArraySum<REAL_T, EXPR> Sum(const ArrayExpression<REAL_T, EXPR> &expr) {
+            return ArraySum<REAL_T, EXPR > (expr.Cast());
+        }
 
-                        break;
-                    case ABS:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
-                            temp = (lhs.second * lhs.first) /
-                                    std::fabs(lhs.first);
-                            stack.push(std::pair<REAL_T, REAL_T > (std::fabs(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::fabs(lhs.first), (0)));
-                        }
+        /**
+         * Dot product of the array expressions lhs and rhs.
+         *
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayDot<REAL_T, LHS, RHS> Dot(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayDot<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-                        break;
-                    case FLOOR:
-                        lhs = stack.top();
-                        stack.pop();
-                        if (found) {
+        /**
+         * Sum of the squared elements of an array expression.
+         *
+         * @param expr
+         * @return
+         */
+        template<class REAL_T, class EXPR>
+        inline const ArrayNorm2<REAL_T, EXPR> Norm2(const ArrayExpression<REAL_T, EXPR> &expr) {
+            return ArrayNorm2<REAL_T, EXPR > (expr.Cast());
+        }
 
-                            temp = (0); //lhs.second * T(std::floor(lhs.first));
-                            stack.push(std::pair<REAL_T, REAL_T > (std::floor(lhs.first), temp));
-                        } else {
-                            stack.push(std::pair<REAL_T, REAL_T > (std::floor(lhs.first), (0)));
-                        }
+        /**
+         * Sum of the squared differences of the array expressions lhs and
+         * rhs.
+         *
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArraySumSquares<REAL_T, LHS, RHS> SumSquares(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArraySumSquares<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-                        break;
-                    case NONE:
-                        std::cout << "nothing to do here.\n";
-                        break;
-                    default:
-                        break;
+        /**
+         * log(sum(exp(expr))) over the elements of an array expression,
+         * without overflow.
+         *
+         * @param expr
+         * @return
+         */
+        template<class REAL_T, class EXPR>
+        inline const ArrayLogSumExp<REAL_T, EXPR> log_sum_exp(const ArrayExpression<REAL_T, EXPR> &expr) {
+            return ArrayLogSumExp<REAL_T, EXPR > (expr.Cast());
+        }
 
-                }
+        /**
+         * Log of the multinomial probability of the counts n given the cell
+         * probabilities p.
+         *
+         * @param n
+         * @param p
+         * @return
+         */
+        template<class REAL_T, class N, class P>
+        inline const ArrayDMultinomLog<REAL_T, N, P> dmultinom_log(const ArrayExpression<REAL_T, N> &n,
+                const ArrayExpression<REAL_T, P> &p) {
+            return ArrayDMultinomLog<REAL_T, N, P > (n.Cast(), p.Cast());
+        }
 
+        /**
+         * Outer product of the vector expressions lhs and rhs.
+         *
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayOuterProduct<REAL_T, LHS, RHS> outer_prod(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayOuterProduct<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-            }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayAdd<REAL_T, LHS, RHS> operator+(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayAdd<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
+        template<class REAL_T, class LHS>
+        inline const ArrayAdd<REAL_T, LHS, ArrayScalar<REAL_T> > operator+(const ArrayExpression<REAL_T, LHS> &lhs,
+                const REAL_T &rhs) {
+            return ArrayAdd<REAL_T, LHS, ArrayScalar<REAL_T> >(lhs.Cast(), ArrayScalar<REAL_T > (rhs));
+        }
 
-            return stack.top().second;
+        template<class REAL_T, class RHS>
+        inline const ArrayAdd<REAL_T, ArrayScalar<REAL_T>, RHS> operator+(const REAL_T &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayAdd<REAL_T, ArrayScalar<REAL_T>, RHS > (ArrayScalar<REAL_T > (lhs), rhs.Cast());
         }
 
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayAdd<REAL_T, LHS, ScalarOperand<REAL_T, RHS> > operator+(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ExpressionBase<REAL_T, RHS> &rhs) {
+            return ArrayAdd<REAL_T, LHS, ScalarOperand<REAL_T, RHS> >(lhs.Cast(), ScalarOperand<REAL_T, RHS > (rhs));
+        }
 
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayAdd<REAL_T, ScalarOperand<REAL_T, LHS>, RHS> operator+(const ExpressionBase<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayAdd<REAL_T, ScalarOperand<REAL_T, LHS>, RHS > (ScalarOperand<REAL_T, LHS > (lhs), rhs.Cast());
+        }
 
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMinus<REAL_T, LHS, RHS> operator-(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMinus<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-    };
+        template<class REAL_T, class LHS>
+        inline const ArrayMinus<REAL_T, LHS, ArrayScalar<REAL_T> > operator-(const ArrayExpression<REAL_T, LHS> &lhs,
+                const REAL_T &rhs) {
+            return ArrayMinus<REAL_T, LHS, ArrayScalar<REAL_T> >(lhs.Cast(), ArrayScalar<REAL_T > (rhs));
+        }
 
-    //list of independent variables by unique identifier.
-    //    template<class REAL_T>
-    //    std::set<uint32_t> Variable<REAL_T>::independent_variables_g;
+        template<class REAL_T, class RHS>
+        inline const ArrayMinus<REAL_T, ArrayScalar<REAL_T>, RHS> operator-(const REAL_T &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMinus<REAL_T, ArrayScalar<REAL_T>, RHS > (ArrayScalar<REAL_T > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, int group>
-    uint32_t Variable<REAL_T, group>::misses_g = 0;
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMinus<REAL_T, LHS, ScalarOperand<REAL_T, RHS> > operator-(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ExpressionBase<REAL_T, RHS> &rhs) {
+            return ArrayMinus<REAL_T, LHS, ScalarOperand<REAL_T, RHS> >(lhs.Cast(), ScalarOperand<REAL_T, RHS > (rhs));
+        }
 
-    template<class REAL_T, int group>
-    bool Variable<REAL_T, group>::is_recording_g = true;
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMinus<REAL_T, ScalarOperand<REAL_T, LHS>, RHS> operator-(const ExpressionBase<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMinus<REAL_T, ScalarOperand<REAL_T, LHS>, RHS > (ScalarOperand<REAL_T, LHS > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, int group>
-    bool Variable<REAL_T, group>::is_supporting_arbitrary_order = false;
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMultiply<REAL_T, LHS, RHS> operator*(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMultiply<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator==(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() == rhs.GetValue();
-    }
+        template<class REAL_T, class LHS>
+        inline const ArrayMultiply<REAL_T, LHS, ArrayScalar<REAL_T> > operator*(const ArrayExpression<REAL_T, LHS> &lhs,
+                const REAL_T &rhs) {
+            return ArrayMultiply<REAL_T, LHS, ArrayScalar<REAL_T> >(lhs.Cast(), ArrayScalar<REAL_T > (rhs));
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator!=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() != rhs.GetValue();
-    }
+        template<class REAL_T, class RHS>
+        inline const ArrayMultiply<REAL_T, ArrayScalar<REAL_T>, RHS> operator*(const REAL_T &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMultiply<REAL_T, ArrayScalar<REAL_T>, RHS > (ArrayScalar<REAL_T > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator<(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() < rhs.GetValue();
-    }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMultiply<REAL_T, LHS, ScalarOperand<REAL_T, RHS> > operator*(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ExpressionBase<REAL_T, RHS> &rhs) {
+            return ArrayMultiply<REAL_T, LHS, ScalarOperand<REAL_T, RHS> >(lhs.Cast(), ScalarOperand<REAL_T, RHS > (rhs));
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator>(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() > rhs.GetValue();
-    }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayMultiply<REAL_T, ScalarOperand<REAL_T, LHS>, RHS> operator*(const ExpressionBase<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayMultiply<REAL_T, ScalarOperand<REAL_T, LHS>, RHS > (ScalarOperand<REAL_T, LHS > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator<=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() <= rhs.GetValue();
-    }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayDivide<REAL_T, LHS, RHS> operator/(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayDivide<REAL_T, LHS, RHS > (lhs.Cast(), rhs.Cast());
+        }
 
-    template<class REAL_T, class T, class TT>
-    inline const int operator>=(const ad::ExpressionBase<REAL_T, T>& lhs, const ad::ExpressionBase<REAL_T, TT>& rhs) {
-        return lhs.GetValue() >= rhs.GetValue();
-    }
+        template<class REAL_T, class LHS>
+        inline const ArrayDivide<REAL_T, LHS, ArrayScalar<REAL_T> > operator/(const ArrayExpression<REAL_T, LHS> &lhs,
+                const REAL_T &rhs) {
+            return ArrayDivide<REAL_T, LHS, ArrayScalar<REAL_T> >(lhs.Cast(), ArrayScalar<REAL_T > (rhs));
+        }
 
-    template<class REAL_T, class T>
-    inline const int operator==(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs == rhs.GetValue();
-    }
+        template<class REAL_T, class RHS>
+        inline const ArrayDivide<REAL_T, ArrayScalar<REAL_T>, RHS> operator/(const REAL_T &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayDivide<REAL_T, ArrayScalar<REAL_T>, RHS > (ArrayScalar<REAL_T > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, class T>
-    inline const int operator!=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs != rhs.GetValue();
-    }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayDivide<REAL_T, LHS, ScalarOperand<REAL_T, RHS> > operator/(const ArrayExpression<REAL_T, LHS> &lhs,
+                const ExpressionBase<REAL_T, RHS> &rhs) {
+            return ArrayDivide<REAL_T, LHS, ScalarOperand<REAL_T, RHS> >(lhs.Cast(), ScalarOperand<REAL_T, RHS > (rhs));
+        }
 
-    template<class REAL_T, class T>
-    inline const int operator<(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs < rhs.GetValue();
-    }
+        template<class REAL_T, class LHS, class RHS>
+        inline const ArrayDivide<REAL_T, ScalarOperand<REAL_T, LHS>, RHS> operator/(const ExpressionBase<REAL_T, LHS> &lhs,
+                const ArrayExpression<REAL_T, RHS> &rhs) {
+            return ArrayDivide<REAL_T, ScalarOperand<REAL_T, LHS>, RHS > (ScalarOperand<REAL_T, LHS > (lhs), rhs.Cast());
+        }
 
-    template<class REAL_T, class T>
-    inline const int operator>(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs > rhs.GetValue();
     }
 
-    template<class REAL_T, class T>
-    inline const int operator<=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs <= rhs.GetValue();
+    /**
+     * Sum of a vector of Variables. See array::Sum.
+     *
+     * @param v
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArraySum<REAL_T, array::VariableRange<REAL_T, group> >
+    Sum(const std::vector<Variable<REAL_T, group> > &v) {
+        return array::ArraySum<REAL_T, array::VariableRange<REAL_T, group> >(array::VariableRange<REAL_T, group > (v));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator>=(const REAL_T &lhs, const ad::ExpressionBase<REAL_T, T>& rhs) {
-        return lhs >= rhs.GetValue();
+    /**
+     * Dot product of two vectors of Variables.
+     *
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArrayDot<REAL_T, array::VariableRange<REAL_T, group>, array::VariableRange<REAL_T, group> >
+    Dot(const std::vector<Variable<REAL_T, group> > &lhs, const std::vector<Variable<REAL_T, group> > &rhs) {
+        return array::ArrayDot<REAL_T, array::VariableRange<REAL_T, group>, array::VariableRange<REAL_T, group> >(
+                array::VariableRange<REAL_T, group > (lhs), array::VariableRange<REAL_T, group > (rhs));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator==(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() == rhs;
+    /**
+     * Dot product of a vector of Variables and a vector of constants.
+     *
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArrayDot<REAL_T, array::VariableRange<REAL_T, group>, array::ConstantRange<REAL_T> >
+    Dot(const std::vector<Variable<REAL_T, group> > &lhs, const std::vector<REAL_T> &rhs) {
+        return array::ArrayDot<REAL_T, array::VariableRange<REAL_T, group>, array::ConstantRange<REAL_T> >(
+                array::VariableRange<REAL_T, group > (lhs), array::ConstantRange<REAL_T > (rhs));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator!=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() != rhs;
+    /**
+     * Sum of the squares of a vector of Variables, norm2 in ADMB.
+     *
+     * @param v
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArrayNorm2<REAL_T, array::VariableRange<REAL_T, group> >
+    Norm2(const std::vector<Variable<REAL_T, group> > &v) {
+        return array::ArrayNorm2<REAL_T, array::VariableRange<REAL_T, group> >(array::VariableRange<REAL_T, group > (v));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator<(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() <= rhs;
+    /**
+     * Sum of the squared differences of two vectors of Variables.
+     *
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArraySumSquares<REAL_T, array::VariableRange<REAL_T, group>, array::VariableRange<REAL_T, group> >
+    SumSquares(const std::vector<Variable<REAL_T, group> > &lhs, const std::vector<Variable<REAL_T, group> > &rhs) {
+        return array::ArraySumSquares<REAL_T, array::VariableRange<REAL_T, group>, array::VariableRange<REAL_T, group> >(
+                array::VariableRange<REAL_T, group > (lhs), array::VariableRange<REAL_T, group > (rhs));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator>(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() > rhs;
+    /**
+     * Sum of the squared differences of a vector of Variables and a vector
+     * of constants, e.g. predicted and observed values.
+     *
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArraySumSquares<REAL_T, array::VariableRange<REAL_T, group>, array::ConstantRange<REAL_T> >
+    SumSquares(const std::vector<Variable<REAL_T, group> > &lhs, const std::vector<REAL_T> &rhs) {
+        return array::ArraySumSquares<REAL_T, array::VariableRange<REAL_T, group>, array::ConstantRange<REAL_T> >(
+                array::VariableRange<REAL_T, group > (lhs), array::ConstantRange<REAL_T > (rhs));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator<=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() <= rhs;
+    /**
+     * log(sum(exp(v))) over a vector of Variables, without overflow.
+     *
+     * @param v
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArrayLogSumExp<REAL_T, array::VariableRange<REAL_T, group> >
+    log_sum_exp(const std::vector<Variable<REAL_T, group> > &v) {
+        return array::ArrayLogSumExp<REAL_T, array::VariableRange<REAL_T, group> >(array::VariableRange<REAL_T, group > (v));
     }
 
-    template<class REAL_T, class T>
-    inline const int operator>=(const ad::ExpressionBase<REAL_T, T>& lhs, const REAL_T &rhs) {
-        return lhs.GetValue() >= rhs;
+    /**
+     * Log of the multinomial probability of the observed counts n given the
+     * cell probabilities p.
+     *
+     * @param n
+     * @param p
+     * @return
+     */
+    template<class REAL_T, int group>
+    inline const array::ArrayDMultinomLog<REAL_T, array::ConstantRange<REAL_T>, array::VariableRange<REAL_T, group> >
+    dmultinom_log(const std::vector<REAL_T> &n, const std::vector<Variable<REAL_T, group> > &p) {
+        return array::ArrayDMultinomLog<REAL_T, array::ConstantRange<REAL_T>, array::VariableRange<REAL_T, group> >(
+                array::ConstantRange<REAL_T > (n), array::VariableRange<REAL_T, group > (p));
     }
 
-
 }
 
+namespace std {
 
+    /**
+     * Override for the exp function in namespace std, element-wise over an
+     * array expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::array::ArrayExp<REAL_T, EXPR> exp(const ad::array::ArrayExpression<REAL_T, EXPR>& expr) {
+        return ad::array::ArrayExp<REAL_T, EXPR > (expr.Cast());
+    }
 
-/**
- * Array components.
- */
-
-namespace array {
-
-
-
-
-
+    /**
+     * Override for the mfexp function in namespace std, element-wise over
+     * an array expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::array::ArrayMFExp<REAL_T, EXPR> mfexp(const ad::array::ArrayExpression<REAL_T, EXPR>& expr) {
+        return ad::array::ArrayMFExp<REAL_T, EXPR > (expr.Cast());
+    }
 
+    /**
+     * Override for the log function in namespace std, element-wise over an
+     * array expression.
+     *
+     * @param expr
+     * @return
+     */
+    template<class REAL_T, class EXPR>
+    inline const ad::array::ArrayLog<REAL_T, EXPR> log(const ad::array::ArrayExpression<REAL_T, EXPR>& expr) {
+        return ad::array::ArrayLog<REAL_T, EXPR > (expr.Cast());
+    }
 
 }
 
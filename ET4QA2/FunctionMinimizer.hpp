@@ -13,10 +13,11 @@
 #include <valarray>
 #include <vector>
 #include <iomanip>
-#include <sys/timeb.h>
+#include <sys/time.h>
 #include <sstream>
 #include "BigFloat.hpp"
 #include "ET4AD.hpp"
+#include "Dual.hpp"
 
 #if defined(WIN32) || defined(WIN64)
 
@@ -192,6 +193,8 @@ namespace ad {
         T max_c;
         size_t max_history_m;  
         int unrecorded_calls_m;
+        bool replay_tape_m;
+        std::vector<ad::Branch<T> > branches_m;
 
     public:
 
@@ -207,7 +210,8 @@ namespace ad {
         iprint_m(10),
         max_c(std::numeric_limits<T>::min()),
         max_history_m(1000),
-        unrecorded_calls_m(0) {
+        unrecorded_calls_m(0),
+        replay_tape_m(false) {
 
         }
 
@@ -319,6 +323,65 @@ namespace ad {
             this->verbose_m = verbose;
         }
 
+        /**
+         * Is tape replay on or off.
+         * 
+         * @return 
+         */
+        bool IsReplayingTape() const {
+            return replay_tape_m;
+        }
+
+        /**
+         * If true, LBFGS records the objective function once and evaluates
+         * line search trial points by replaying the recorded statements 
+         * instead of calling the objective function. Comparisons of active
+         * values made by the model are re-checked at each trial point, and
+         * the model is recorded again only if an outcome changes.
+         * Models whose control flow depends on the parameters in other ways
+         * (casts to REAL_T, GetValue()) must not turn this on.
+         * 
+         * @param replay_tape
+         */
+        void SetReplayTape(bool replay_tape) {
+            this->replay_tape_m = replay_tape;
+        }
+
+        /**
+         * Records the objective function at the current parameter values
+         * and writes it to out as a standalone C++ gradient kernel
+         *
+         * void name(const scalar* x, scalar* f, scalar* g)
+         *
+         * with x and g ordered as the registered parameters, all active as
+         * in the last phase. Data enters the kernel as literals and control
+         * flow is fixed at the recorded branch outcomes, so the kernel is 
+         * valid for this data set and for parameter values that take the 
+         * same branches.
+         *
+         * @param out
+         * @param name - function name
+         * @param scalar - C++ type of x, f and g
+         */
+        void GenerateGradientSource(std::ostream &out, const std::string &name = "grad",
+                const std::string &scalar = "double") {
+            if (this->parameters_m.empty()) {
+                this->Initialize();
+            }
+            this->phase_m = 1;
+            for (size_t i = 0; i < this->parameters_m.size(); i++) {
+                this->parameters_m[i]->SetAsIndependent(true);
+                if (this->phases_m[i] > this->phase_m) {
+                    this->phase_m = this->phases_m[i];
+                }
+            }
+            ad::Variable<T> f;
+            ad::StatementTape<T> tape;
+            std::vector<int32_t> index;
+            this->RecordStatementTape(f, this->parameters_m, tape, index);
+            tape.GenerateSource(out, index, this->parameters_m.size(), name, scalar);
+        }
+
         /**
          * Current phase.
          * 
@@ -384,8 +447,40 @@ namespace ad {
          * Abstract function. The function to be minimized.
          * @param f -the value that is minimized.
          */
-        virtual void ObjectiveFunction(ad::Variable<T> &f) {
+        virtual void ObjectiveFunction(ad::Variable<T> &/*f*/) {
+
+        }
+
+        /**
+         * Optional value only version of the objective function, used for 
+         * evaluations that need no derivatives, such as line search trial
+         * points. Models written as a template over their variable type 
+         * implement this with the plain T instantiation and return true, 
+         * so trial points are evaluated with no derivative bookkeeping at
+         * all. The default returns false, in which case ObjectiveFunction 
+         * is called with recording turned off.
+         * 
+         * @param f -the value that is minimized.
+         * @return true if f was computed.
+         */
+        virtual bool ObjectiveFunctionValue(T &/*f*/) {
+            return false;
+        }
 
+        /**
+         * Optional version of the objective function that computes the 
+         * value and the gradient itself, typically by instantiating a
+         * templated objective with ad::Dual (see MakeDual). The gradient 
+         * is sized to, and ordered like, the active parameters. The default
+         * returns false, in which case ObjectiveFunction is recorded and 
+         * differentiated as usual.
+         * 
+         * @param f -the value that is minimized.
+         * @param gradient -derivatives with respect to the active parameters.
+         * @return true if f and gradient were computed.
+         */
+        virtual bool ObjectiveFunctionGradient(T &/*f*/, std::valarray<T> &/*gradient*/) {
+            return false;
         }
 
         /**
@@ -421,7 +516,7 @@ namespace ad {
 
             bool ret = false;
 
-            for (int i = 0; i < parameters_m.size(); i++) {
+            for (size_t i = 0; i < parameters_m.size(); i++) {
                 if (this->is_constrained_m[i]) {
                     this->has_constraints_m = true;
                     if (lower_bounds_m[i] > upper_bounds_m[i]) {
@@ -439,17 +534,17 @@ namespace ad {
             }
 
             //size_t max_phase = 1;
-            for (int i = 0; i < this->phases_m.size(); i++) {
+            for (size_t i = 0; i < this->phases_m.size(); i++) {
                 if (this->phases_m[i] > max_phase_m) {
                     max_phase_m = phases_m[i];
                 }
             }
 
-            for (int p = 0; p < max_phase_m; p++) {
+            for (size_t p = 0; p < max_phase_m; p++) {
                 this->phase_m = (p + 1);
                 this->active_parameters_m.erase(active_parameters_m.begin(), active_parameters_m.end());
 
-                for (int i = 0; i < this->parameters_m.size(); i++) {
+                for (size_t i = 0; i < this->parameters_m.size(); i++) {
                     if (this->phases_m[i] <= (p + 1)) {
                         this->parameters_m[i]->SetAsIndependent(true);
                         this->active_parameters_m.push_back(this->parameters_m[i]);
@@ -463,7 +558,7 @@ namespace ad {
                         ret = this->LBFGS(this->active_parameters_m, this->GetMaxIterations(), this->GetTolerance());
                         break;
                     case NEWTON:
-                        //                        ret = this->Newton(this->active_parameters_m, this->GetMaxIterations(), this->GetTolerance());
+                        ret = this->NewtonCG(this->active_parameters_m, this->GetMaxIterations(), this->GetTolerance());
                         break;
 #ifdef HAVE_ADMB
                     case ADMB_AUTODIFF_MINIMIZER:
@@ -521,6 +616,41 @@ namespace ad {
             return active_parameters_m;
         }
 
+        /**
+         * Returns an ad::Dual holding the value of parameter var, seeded in
+         * the direction of its position among the active parameters. 
+         * Inactive parameters are returned as constants. DUAL must have at
+         * least as many directions as there are active parameters.
+         * 
+         * @param var
+         * @return 
+         */
+        template<class DUAL>
+        const DUAL MakeDual(const ad::Variable<T> &var) const {
+            for (size_t i = 0; i < this->active_parameters_m.size(); i++) {
+                if (this->active_parameters_m[i] == &var) {
+                    return DUAL(var.GetValue(), static_cast<int> (i));
+                }
+            }
+            return DUAL(var.GetValue());
+        }
+
+        /**
+         * Copies the value and the active parameter derivatives out of an 
+         * ad::Dual objective function result.
+         * 
+         * @param fd
+         * @param f
+         * @param gradient
+         */
+        template<class DUAL>
+        void ExtractDual(const DUAL &fd, T &f, std::valarray<T> &gradient) const {
+            f = fd.GetValue();
+            for (size_t i = 0; i < gradient.size(); i++) {
+                gradient[i] = fd.GetGradient(static_cast<int> (i));
+            }
+        }
+
         /**
          * Computes the gradient with respect to active parameters. Also tracks 
          * the number of gradient function calls and the average time spent computing 
@@ -532,7 +662,7 @@ namespace ad {
         virtual void Gradient(const ad::Variable<T> &fx, const std::vector<ad::Variable<T>* > &parameters, std::valarray<T> &gradient) {
 
             //            fx.Gradient(parameters,gradient);
-            for (int i = 0; i < parameters.size(); i++) {
+            for (size_t i = 0; i < parameters.size(); i++) {
                 // std::cout<<"Gradient i = "<<i<<std::endl;
                 gradient[i] = fx.WRT(*parameters[i]);
 
@@ -554,9 +684,10 @@ namespace ad {
         const std::valarray<T> CalculateGradient() {
             std::valarray<T> gradient(this->active_parameters_m.size());
             ad::Variable<T> f;
+            this->ResetAdjointTape();
             this->ObjectiveFunction(f);
 
-            for (int i = 0; i < this->active_parameters_m.size(); i++) {
+            for (size_t i = 0; i < this->active_parameters_m.size(); i++) {
                 gradient[i] = f.WRT(*active_parameters_m[i]);
 
             }
@@ -580,6 +711,172 @@ namespace ad {
             return hessian;
         }
 
+        /**
+         * Exact Hessian of the objective function w.r.t. the active 
+         * parameters by forward-over-reverse differentiation. The objective 
+         * function is recorded once as an arbitrary order statement list, 
+         * then each column of the Hessian is one Hessian-vector product 
+         * in a unit direction, so the cost is O(n) gradient evaluations 
+         * rather than the O(n^2) function evaluations of EstimatedHessian.
+         * 
+         * @return 
+         */
+        const std::valarray<std::valarray<T> > Hessian() {
+            size_t n = this->active_parameters_m.size();
+            std::valarray<std::valarray<T> > hessian(std::valarray<T > (n), n);
+
+            ad::Variable<T> f;
+            ad::StatementTape<T> tape;
+            std::vector<int32_t> index;
+            this->RecordStatementTape(f, this->active_parameters_m, tape, index);
+
+            std::vector<T> v(n, T(0));
+            std::vector<T> hv(n);
+            for (size_t j = 0; j < n; j++) {
+                v[j] = T(1);
+                tape.HessianVectorProduct(index, v, hv);
+                v[j] = T(0);
+                for (size_t i = 0; i < n; i++) {
+                    hessian[i][j] = hv[i];
+                }
+            }
+            return hessian;
+        }
+
+        /**
+         * Standard errors of the active parameters, the square roots of the
+         * diagonal of the inverse of Hessian(). The inverse is computed by 
+         * Gauss-Jordan elimination with partial pivoting. If the Hessian is
+         * singular, or a variance is not positive, the corresponding 
+         * entries are NaN.
+         * 
+         * @return 
+         */
+        const std::valarray<T> StandardErrors() {
+            std::valarray<std::valarray<T> > a = this->Hessian();
+            size_t n = a.size();
+            std::valarray<std::valarray<T> > inverse(std::valarray<T > (n), n);
+            std::valarray<T> errors(std::numeric_limits<T>::quiet_NaN(), n);
+            for (size_t i = 0; i < n; i++) {
+                inverse[i][i] = T(1);
+            }
+            for (size_t c = 0; c < n; c++) {
+                size_t pivot = c;
+                for (size_t r = c + 1; r < n; r++) {
+                    if (std::fabs(a[r][c]) > std::fabs(a[pivot][c])) {
+                        pivot = r;
+                    }
+                }
+                if (a[pivot][c] == T(0)) {
+                    return errors;
+                }
+                std::swap(a[c], a[pivot]);
+                std::swap(inverse[c], inverse[pivot]);
+                T scale = T(1) / a[c][c];
+                a[c] *= scale;
+                inverse[c] *= scale;
+                for (size_t r = 0; r < n; r++) {
+                    if (r != c && a[r][c] != T(0)) {
+                        T factor = a[r][c];
+                        a[r] -= factor * a[c];
+                        inverse[r] -= factor * inverse[c];
+                    }
+                }
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (inverse[i][i] > T(0)) {
+                    errors[i] = std::sqrt(inverse[i][i]);
+                }
+            }
+            return errors;
+        }
+
+        /**
+         * Exact Hessian of the objective function w.r.t. the active 
+         * parameters in CSR form. The sparsity pattern is detected from the
+         * recorded statements and its columns are colored, so the cost is 
+         * one Hessian-vector product per color rather than per parameter.
+         * 
+         * @return 
+         */
+        const ad::CSRMatrix<T> SparseHessian() {
+            ad::Variable<T> f;
+            ad::StatementTape<T> tape;
+            std::vector<int32_t> index;
+            this->RecordStatementTape(f, this->active_parameters_m, tape, index);
+
+            ad::CSRMatrix<T> hessian;
+            size_t colors = tape.SparseHessian(index, this->active_parameters_m.size(), hessian);
+            if (this->IsVerbose()) {
+                std::cout << "Sparse hessian: " << hessian.NonZeros() << " nonzeros, "
+                        << colors << " colors for " << this->active_parameters_m.size() << " parameters\n";
+            }
+            return hessian;
+        }
+
+        /**
+         * Evaluates the objective function at the current values of 
+         * parameters by replaying tape, as recorded by RecordStatementTape.
+         * If a recorded branch takes a different outcome at these values, 
+         * the objective function is recorded and compiled again here 
+         * instead. Either way tape holds the value and adjoints at the 
+         * current values on return.
+         * 
+         * @param f
+         * @param tape
+         * @param index
+         * @param parameters
+         * @param x - scratch, the parameter values
+         * @return the objective function value
+         */
+        const T ReplayStatementTape(ad::Variable<T> &f, ad::StatementTape<T> &tape, std::vector<int32_t> &index,
+                const std::vector<ad::Variable<T>* > &parameters, std::vector<T> &x) {
+            x.resize(parameters.size());
+            for (size_t i = 0; i < parameters.size(); i++) {
+                x[i] = parameters[i]->GetValue();
+            }
+            for (size_t i = 0; i < this->branches_m.size(); i++) {
+                if (!this->branches_m[i].Replay(index, x)) {
+                    this->RecordStatementTape(f, parameters, tape, index);
+                    return tape.GetValue();
+                }
+            }
+            this->function_calls_m++;
+            this->unrecorded_calls_m++;
+            tape.Replay(index, x);
+            return tape.GetValue();
+        }
+
+        /**
+         * Records the objective function as an arbitrary order statement 
+         * list and compiles it into tape. On return, index maps the unique 
+         * identifier of each parameter to its position in parameters.
+         * 
+         * @param f
+         * @param parameters
+         * @param tape
+         * @param index
+         */
+        void RecordStatementTape(ad::Variable<T> &f, const std::vector<ad::Variable<T>* > &parameters,
+                ad::StatementTape<T> &tape, std::vector<int32_t> &index) {
+            bool is_recording = ad::Variable<T>::IsRecording();
+            bool is_arbitrary_order = ad::Variable<T>::IsSupportingArbitraryOrder();
+            ad::Context<T>& context = ad::Variable<T>::GetContext();
+            ad::Variable<T>::SetRecording(true);
+            ad::Variable<T>::SetSupportArbitraryOrder(true);
+            context.GetBranches().clear();
+            context.SetRecordBranches(true);
+            this->CallObjectiveFunction(f);
+            context.SetRecordBranches(false);
+            this->branches_m.swap(context.GetBranches());
+            ad::Variable<T>::SetSupportArbitraryOrder(is_arbitrary_order);
+            ad::Variable<T>::SetRecording(is_recording);
+
+            f.Compile(tape);
+
+            ad::Variable<T>::IndexOf(parameters, index);
+        }
+
     private:
 
         /**
@@ -590,6 +887,7 @@ namespace ad {
             T hh = T(1.0) / h;
             size_t n = active_parameters_m.size();
             T ff;
+            T x = active_parameters_m[column]->GetValue();
 
 
 
@@ -626,32 +924,38 @@ namespace ad {
             for (size_t i = 0; i < n; i++) {
                 active_parameters_m[i]->SetValue(xp2h[i]);
             }
+            this->ResetAdjointTape();
             this->ObjectiveFunction(f); // dfdx(f, xp2h, xiref);
             fp2h = f.WRT(*active_parameters_m[row]);
 
             for (size_t i = 0; i < n; i++) {
                 active_parameters_m[i]->SetValue(xph[i]);
             }
+            this->ResetAdjointTape();
             this->ObjectiveFunction(f); //dfdx(f, xph, xiref);
             fph = f.WRT(*active_parameters_m[row]);
 
             for (size_t i = 0; i < n; i++) {
                 active_parameters_m[i]->SetValue(xm2h[i]);
             }
+            this->ResetAdjointTape();
             this->ObjectiveFunction(f); //dfdx(f, xm2h, xiref);
 
             fm2h = f.WRT(*active_parameters_m[row]);
             for (size_t i = 0; i < n; i++) {
                 active_parameters_m[i]->SetValue(xmh[i]);
             }
+            this->ResetAdjointTape();
             this->ObjectiveFunction(f); //dfdx(f, xmh, xiref);
             fmh = f.WRT(*active_parameters_m[row]);
             //            std::cout<<"here...\n";
 
+            active_parameters_m[column]->SetValue(x);
+
             ff = (-1 * fp2h +
-                    8.0 * fph) -
+                    8.0 * fph -
                     8.0 * fmh +
-                    fm2h / 12.0 * hh;
+                    fm2h) / 12.0 * hh;
 
 
             return ff;
@@ -668,6 +972,21 @@ namespace ad {
             this->average_time_in_grad_calc_m = sum_time_in_grad_calc_m / this->gradient_calls_m;
         }
 
+        /**
+         * When derivatives are computed in reverse mode, starts a new 
+         * recording on the adjoint tape so it only holds the upcoming 
+         * objective function evaluation. Likewise for the expression graph
+         * when arbitrary order is supported.
+         */
+        void ResetAdjointTape() {
+            if (ad::Variable<T>::IsRecording() && ad::Variable<T>::IsUsingAdjointTape()) {
+                ad::Variable<T>::GetAdjointTape().Reset();
+            }
+            if (ad::Variable<T>::IsRecording() && ad::Variable<T>::IsSupportingArbitraryOrder()) {
+                ad::Variable<T>::GetExpressionGraph().Reset();
+            }
+        }
+
         /**
          * Intermediate function to call the ObjectiveFunction.
          * Tracks the amount of objective function calls and the average time 
@@ -678,9 +997,10 @@ namespace ad {
         void CallObjectiveFunction(ad::Variable<T> &f) {
             //std::cout<<"called "<<__func__<<":"<<__LINE__<<std::endl;
             this->function_calls_m++;
-            if (ad::Variable<T>::IsRecording()) {
+            if (!ad::Variable<T>::IsRecording()) {
                 this->unrecorded_calls_m++;
             }
+            this->ResetAdjointTape();
             clock_t start = GetMilliCount();
             this->ObjectiveFunction(f);
             clock_t end = GetMilliCount();
@@ -690,6 +1010,68 @@ namespace ad {
             average_time_in_user_function_m = sum_time_in_user_function_m / function_calls_m;
         }
 
+        /**
+         * Evaluates the objective function and its gradient with respect to
+         * parameters (the active parameters). Dispatches to 
+         * ObjectiveFunctionGradient when the model provides it, in which 
+         * case fx only receives the value. Otherwise records the objective 
+         * function into fx and differentiates it.
+         * 
+         * @param fx
+         * @param parameters
+         * @param gradient
+         */
+        void CallObjectiveFunctionGradient(ad::Variable<T> &fx, std::vector<ad::Variable<T>* > &parameters, std::valarray<T> &gradient) {
+            T f = T(0);
+            clock_t start = GetMilliCount();
+            if (this->ObjectiveFunctionGradient(f, gradient)) {
+                clock_t end = GetMilliCount();
+                this->function_calls_m++;
+                this->gradient_calls_m++;
+                sum_time_in_user_function_m += (end - start);
+                average_time_in_user_function_m = sum_time_in_user_function_m / function_calls_m;
+                this->average_time_in_grad_calc_m = sum_time_in_grad_calc_m / this->gradient_calls_m;
+                fx = f;
+                this->max_c = 0;
+                for (size_t i = 0; i < gradient.size(); i++) {
+                    this->gradient_m[i] = gradient[i];
+                    if (std::fabs(gradient[i]) > max_c) {
+                        max_c = std::fabs(gradient[i]);
+                    }
+                }
+                return;
+            }
+            this->CallObjectiveFunction(fx);
+            this->CallGradient(fx, parameters, gradient);
+        }
+
+        /**
+         * Evaluates the objective function for its value only. Dispatches to
+         * ObjectiveFunctionValue when the model provides it, otherwise calls
+         * ObjectiveFunction with recording turned off.
+         * 
+         * @return the objective function value.
+         */
+        T CallObjectiveFunctionValue() {
+            this->function_calls_m++;
+            this->unrecorded_calls_m++;
+            clock_t start = GetMilliCount();
+            T f = T(0);
+            if (!this->ObjectiveFunctionValue(f)) {
+                bool is_recording = ad::Variable<T>::IsRecording();
+                ad::Variable<T>::SetRecording(false);
+                ad::Variable<T> fx;
+                this->ObjectiveFunction(fx);
+                f = fx.GetValue();
+                ad::Variable<T>::SetRecording(is_recording);
+            }
+            clock_t end = GetMilliCount();
+
+            sum_time_in_user_function_m += (end - start);
+            average_time_in_user_function_m = sum_time_in_user_function_m / function_calls_m;
+            return f;
+        }
+
         /**
          * \ingroup Matrix
          * Returns the determinant of Matrix m.
@@ -1106,8 +1488,8 @@ namespace ad {
         //            return false;
         //        }
 
-        bool NelderMead(std::vector<ad::Variable<T>* > &parameters, size_t iterations = 10000, T tolerance = (T(1e-5))) {
-
+        bool NelderMead(std::vector<ad::Variable<T>* > &/*parameters*/, size_t /*iterations*/ = 10000, T /*tolerance*/ = (T(1e-5))) {
+            return false;
         }
 
         /**
@@ -1143,7 +1525,7 @@ namespace ad {
 
 
             //Call the objective function and collect stats..
-            this->CallObjectiveFunction(fx);
+            this->CallObjectiveFunctionGradient(fx, parameters, g);
             this->function_value_m = fx.GetValue();
             //            ad::Variable<T> nfx(fx);
             //Historical evaluations
@@ -1160,8 +1542,6 @@ namespace ad {
             std::valarray<T> z(parameters.size());
 
 
-            this->CallGradient(fx, parameters, g);
-
 
             T step = 0.1;
             T relative_tolerance;
@@ -1169,7 +1549,18 @@ namespace ad {
             const size_t nop = this->active_parameters_m.size();
             std::valarray<T> p;
             std::valarray<T>a;
-            for (int i = 0; i < iterations; ++i) {
+
+            //tape replay for the line search
+            ad::StatementTape<T> tape;
+            std::vector<int32_t> index;
+            std::vector<T> replay_x;
+            std::vector<T> replay_gradient(nop);
+            ad::Variable<T> recorded_fx;
+            if (this->replay_tape_m) {
+                this->RecordStatementTape(recorded_fx, parameters, tape, index);
+            }
+
+            for (size_t i = 0; i < iterations; ++i) {
 
 
 
@@ -1265,7 +1656,6 @@ namespace ad {
 
 
 
-                ad::Variable<T>::SetRecording(false);
                 for (ls = 0; ls < maxLineSearches_; ++ls) {
                     // Tentative solution, gradient and loss
                     std::valarray<T> nx = x - step * z;
@@ -1277,9 +1667,14 @@ namespace ad {
 
 
 
-                    this->CallObjectiveFunction(fx);
+                    T trial_value;
+                    if (this->replay_tape_m) {
+                        trial_value = this->ReplayStatementTape(recorded_fx, tape, index, parameters, replay_x);
+                    } else {
+                        trial_value = this->CallObjectiveFunctionValue();
+                    }
 
-                    if (fx.GetValue() != fx.GetValue()) {
+                    if (trial_value != trial_value) {
                         return false;
                     }
 
@@ -1289,11 +1684,23 @@ namespace ad {
                     //
 
 
-                    if (fx.GetValue() <= this->function_value_m + tolerance * T(0.0001) * step * descent) { // First Wolfe condition
+                    if (trial_value <= this->function_value_m + tolerance * T(0.0001) * step * descent) { // First Wolfe condition
 
-                        ad::Variable<T>::SetRecording(true);
-                        this->CallObjectiveFunction(fx);
-                        this->CallGradient(fx, parameters, ng);
+                        if (this->replay_tape_m) {
+                            tape.Gradient(index, replay_gradient);
+                            this->gradient_calls_m++;
+                            this->max_c = 0;
+                            for (size_t j = 0; j < nop; j++) {
+                                ng[j] = replay_gradient[j];
+                                this->gradient_m[j] = ng[j];
+                                if (std::fabs(ng[j]) > max_c) {
+                                    max_c = std::fabs(ng[j]);
+                                }
+                            }
+                            fx = trial_value;
+                        } else {
+                            this->CallObjectiveFunctionGradient(fx, parameters, ng);
+                        }
 
                         if (down || (-1.0 * Dot(z, ng) >= 0.9 * descent)) { // Second Wolfe condition
                             x = nx;
@@ -1322,6 +1729,146 @@ namespace ad {
             return false;
         }
 
+        /**
+         * Truncated Newton (Newton-CG) minimizer. Each iteration records 
+         * the objective function once and approximately solves 
+         * H * p = -g by conjugate gradients, where every H * d is an exact
+         * Hessian-vector product from the recorded statements. The Hessian
+         * is never formed. Conjugate gradients stop at a forcing tolerance 
+         * of min(0.5, sqrt(|g|)) * |g| or on negative curvature, and the 
+         * step is taken by a backtracking line search.
+         * 
+         * @param parameters
+         * @param iterations
+         * @param tolerance
+         * @return 
+         */
+        bool NewtonCG(std::vector<ad::Variable<T>* > &parameters, size_t iterations = 10000, T tolerance = (T(1e-4))) {
+            const size_t nop = parameters.size();
+            const size_t max_cg_iterations = std::max<size_t > (10, 2 * nop);
+            int maxLineSearches_ = 1000;
+
+            std::valarray<T> x(nop);
+            std::valarray<T> g(nop);
+            std::valarray<T> p(nop);
+            std::valarray<T> r(nop);
+            std::valarray<T> d(nop);
+            std::valarray<T> hd(nop);
+
+            std::vector<T> direction(nop);
+            std::vector<T> product(nop);
+            std::vector<T> gradient(nop);
+            std::vector<int32_t> index;
+            ad::StatementTape<T> tape;
+            ad::Variable<T> fx;
+
+            T norm_g;
+            T relative_tolerance;
+
+            for (size_t i = 0; i < iterations; ++i) {
+                iteration_m = i + 1;
+
+                this->RecordStatementTape(fx, parameters, tape, index);
+                tape.Gradient(index, gradient);
+                this->gradient_calls_m++;
+                this->function_value_m = fx.GetValue();
+                this->max_c = 0;
+                for (size_t j = 0; j < nop; j++) {
+                    g[j] = gradient[j];
+                    x[j] = parameters[j]->GetValue();
+                    this->gradient_m[j] = g[j];
+                    if (std::fabs(g[j]) > max_c) {
+                        max_c = std::fabs(g[j]);
+                    }
+                }
+
+                norm_g = this->Norm(g);
+                relative_tolerance = tolerance * std::max<T > (T(1.0), norm_g);
+
+                if (this->verbose_m && ((i % this->iprint_m) == 0)) {
+                    this->Print(fx, g, parameters, "Verbose:\nMethod: Newton-CG");
+                }
+
+                if (norm_g < relative_tolerance) {
+                    if (this->verbose_m) {
+                        this->Print(fx, g, parameters, "Successful Convergence!");
+                    }
+                    return true;
+                }
+
+                //inner conjugate gradient solve of H * p = -g
+                T forcing = std::min<T > (T(0.5), std::sqrt(norm_g)) * norm_g;
+                p = T(0);
+                r = g;
+                d = T(-1.0) * g;
+                T rr = this->Dot(r, r);
+
+                for (size_t k = 0; k < max_cg_iterations; k++) {
+                    for (size_t j = 0; j < nop; j++) {
+                        direction[j] = d[j];
+                    }
+                    tape.HessianVectorProduct(index, direction, product);
+                    for (size_t j = 0; j < nop; j++) {
+                        hd[j] = product[j];
+                    }
+
+                    T curvature = this->Dot(d, hd);
+                    if (curvature <= T(0)) {
+                        if (k == 0) {
+                            p = d;
+                        }
+                        break;
+                    }
+
+                    T alpha = rr / curvature;
+                    p += alpha * d;
+                    r += alpha * hd;
+                    T rr_next = this->Dot(r, r);
+                    if (std::sqrt(rr_next) < forcing) {
+                        break;
+                    }
+                    d = (rr_next / rr) * d - r;
+                    rr = rr_next;
+                }
+
+                T descent = this->Dot(p, g);
+                if (descent >= T(0)) {
+                    p = T(-1.0) * g;
+                    descent = T(-1.0) * this->Dot(g, g);
+                }
+
+                T step = 1.0;
+                int ls;
+                for (ls = 0; ls < maxLineSearches_; ++ls) {
+                    std::valarray<T> nx = x + step * p;
+                    for (size_t j = 0; j < nop; j++) {
+                        parameters[j]->SetValue(nx[j]);
+                    }
+
+                    T trial_value = this->CallObjectiveFunctionValue();
+
+                    if (trial_value != trial_value) {
+                        step *= T(0.5);
+                        continue;
+                    }
+
+                    if (trial_value <= this->function_value_m + T(0.0001) * step * descent) { // Armijo condition
+                        break;
+                    }
+                    step *= T(0.5);
+                }
+
+                if (ls == maxLineSearches_) {
+                    for (size_t j = 0; j < nop; j++) {
+                        parameters[j]->SetValue(x[j]);
+                    }
+                    std::cout << "Max line searches!\n";
+                    return false;
+                }
+            }
+            return false;
+        }
+
 
 #ifdef HAVE_ADMB
 
@@ -1342,9 +1889,8 @@ namespace ad {
                 x[i + 1] = parameters[i]->GetValue();
             }
             //            int iteration = this->iteration_m;
-            this->CallObjectiveFunction(fx);
+            this->CallObjectiveFunctionGradient(fx, parameters, gradient);
             f = fx.GetValue();
-            this->CallGradient(fx, parameters, gradient);
 
             for (int i = 0; i < gradient.size(); i++) {
                 g[i + 1] = gradient[i];
@@ -1368,14 +1914,10 @@ namespace ad {
                     }
 
                     if (fmc.ireturn == 1) {
-                        Variable<T>::SetRecording(false);
-                        this->CallObjectiveFunction(fx);
-                        f = fx.GetValue();
+                        f = this->CallObjectiveFunctionValue();
                     } else {
-                        Variable<T>::SetRecording(true);
-                        this->CallObjectiveFunction(fx);
+                        this->CallObjectiveFunctionGradient(fx, parameters, gradient);
                         f = fx.GetValue();
-                        this->Gradient(fx, parameters, gradient);
 
                         for (int i = 0; i < gradient.size(); i++) {
                             g[i + 1] = gradient[i];
@@ -1467,8 +2009,7 @@ namespace ad {
 
             size_t iter = 0;
             int status;
-            this->CallObjectiveFunction(this->function_result_m);
-            this->CallGradient(this->function_result_m, this->active_parameters_m, this->gradient_m);
+            this->CallObjectiveFunctionGradient(this->function_result_m, this->active_parameters_m, this->gradient_m);
             this->Print(this->function_result_m, this->gradient_m, parameters, "Verbose:\nMethod: " + method);
 
             do {
@@ -1547,9 +2088,9 @@ namespace ad {
 #if defined(WIN32) || defined(WIN64) 
             retrun GetTickCount();
 #else
-            timeb tb;
-            ftime(&tb);
-            int nCount = tb.millitm + (tb.time & 0xfffff) * 1000;
+            timeval tv;
+            gettimeofday(&tv, NULL);
+            int nCount = tv.tv_usec / 1000 + (tv.tv_sec & 0xfffff) * 1000;
             return nCount;
 #endif
         }
@@ -1683,7 +2224,7 @@ namespace ad {
 
             std::valarray<T> ret(this->active_parameters_m.size());
 
-            for (int i = 0; i < ret.size(); i++) {
+            for (size_t i = 0; i < ret.size(); i++) {
                 ret[i] = matrix[i][column];
             }
             return ret;
@@ -1710,10 +2251,7 @@ namespace ad {
         for (int i = 0; i < fm->active_parameters_m.size(); i++) {
             fm->active_parameters_m[i]->SetValue(x->data[i]);
         }
-        Variable<double>::SetRecording(false);
-        Variable<double> fx;
-        fm->CallObjectiveFunction(fx);
-        return fx.GetValue();
+        return fm->CallObjectiveFunctionValue();
 
     }
 
@@ -1726,9 +2264,7 @@ namespace ad {
         Variable<double>::SetRecording(true);
         Variable<double> fx;
         std::valarray<double> g(fm->active_parameters_m.size());
-        fm->CallObjectiveFunction(fx);
-
-        fm->CallGradient(fx, fm->active_parameters_m, g);
+        fm->CallObjectiveFunctionGradient(fx, fm->active_parameters_m, g);
 
 
         for (int i = 0; i < fm->active_parameters_m.size(); i++) {
@@ -1747,9 +2283,7 @@ namespace ad {
         Variable<double>::SetRecording(true);
         ad::Variable<double> fx;
         std::valarray<double> g(fm->active_parameters_m.size());
-        fm->CallObjectiveFunction(fx);
-
-        fm->CallGradient(fx, fm->active_parameters_m, g);
+        fm->CallObjectiveFunctionGradient(fx, fm->active_parameters_m, g);
 
         *J = fx.GetValue();
 
@@ -0,0 +1,75 @@
+/*
+ * File:   GradientKernel.cpp
+ *
+ * Writes the objective function of a model, recorded once, as a standalone
+ * C++ gradient kernel
+ *
+ * void grad(const double* x, double* f, double* g)
+ *
+ * to standard output. Built and run by the gradient-kernel target in the
+ * Makefile.
+ *
+ * usage: GradientKernel catage|linear|logarithmic data_file [name [scalar]]
+ */
+
+#include <cstdlib>
+#include <limits>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Regression.hpp"
+#include "CatchAtAge.hpp"
+
+/**
+ * Reads whitespace separated x y pairs.
+ */
+bool ReadPairs(const char* path, std::vector<double> &x, std::vector<double> &y) {
+    std::ifstream in(path);
+    if (!in.good()) {
+        std::cerr << "GradientKernel: unable to open " << path << "\n";
+        return false;
+    }
+    double xi, yi;
+    while (in >> xi >> yi) {
+        x.push_back(xi);
+        y.push_back(yi);
+    }
+    return !x.empty();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: GradientKernel catage|linear|logarithmic data_file [name [scalar]]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string model(argv[1]);
+    std::string name = argc > 3 ? argv[3] : "grad";
+    std::string scalar = argc > 4 ? argv[4] : "double";
+
+    if (model == "catage") {
+        CatchAtAge<double> ca(argv[2]);
+        ca.GenerateGradientSource(std::cout, name, scalar);
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<double> x;
+    std::vector<double> y;
+    if (!ReadPairs(argv[2], x, y)) {
+        return EXIT_FAILURE;
+    }
+
+    if (model == "linear") {
+        ad::LinearRegression<double> regression(x, y);
+        regression.GenerateGradientSource(std::cout, name, scalar);
+    } else if (model == "logarithmic") {
+        ad::LogrithmicRegression<double> regression(x, y);
+        regression.GenerateGradientSource(std::cout, name, scalar);
+    } else {
+        std::cerr << "GradientKernel: unknown model " << model << "\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
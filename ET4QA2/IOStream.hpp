@@ -10,6 +10,8 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -17,6 +19,16 @@
 
 namespace util {
 
+    /**
+     * Predicate for the trim functions.
+     * 
+     * @param c
+     * @return 
+     */
+    static inline bool IsNotSpace(char c) {
+        return !std::isspace(static_cast<unsigned char> (c));
+    }
+
     /**
      * Trim the left side.
      * 
@@ -24,7 +36,7 @@ namespace util {
      * @return 
      */
     static inline std::string& LeftTrim(std::string &s) {
-        s.erase(s.begin(), std::find_if(s.begin(), s.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
+        s.erase(s.begin(), std::find_if(s.begin(), s.end(), IsNotSpace));
         return s;
     }
 
@@ -35,7 +47,7 @@ namespace util {
      * @return 
      */
     static inline std::string& RightTrim(std::string &s) {
-        s.erase(std::find_if(s.rbegin(), s.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
+        s.erase(std::find_if(s.rbegin(), s.rend(), IsNotSpace).base(), s.end());
         return s;
     }
 
@@ -124,7 +136,7 @@ public:
                 line = util::RightTrim(line);
                 util::Tokenize(line, tokens, " \t", true);
 
-                for (int i = 0; i < tokens.size(); i++) {
+                for (size_t i = 0; i < tokens.size(); i++) {
                     if (util::StartsWith(tokens.at(i), "#"))break;
                     this->data_m.push_back(util::StringToNumber<T > (tokens.at(i)));
                 }
@@ -0,0 +1,67 @@
+/*
+ * File:   KernelCheck.cpp
+ *
+ * Compares the gradient of a generated gradient kernel with central 
+ * differences of its own function value, at the parameter values it was
+ * recorded at. Built with -DKERNEL_NAME and -DKERNEL_SCALAR, linked with
+ * the kernel and run by the gradient-kernel target in the Makefile.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#ifndef KERNEL_NAME
+#define KERNEL_NAME grad
+#endif
+
+#ifndef KERNEL_SCALAR
+#define KERNEL_SCALAR double
+#endif
+
+#define KERNEL_PASTE(a, b) a ## b
+#define KERNEL_SYMBOL(a, b) KERNEL_PASTE(a, b)
+
+typedef KERNEL_SCALAR scalar;
+
+void KERNEL_NAME(const scalar* x, scalar* f, scalar* g);
+extern const unsigned int KERNEL_SYMBOL(KERNEL_NAME, _parameters);
+extern const scalar KERNEL_SYMBOL(KERNEL_NAME, _recorded_x)[];
+
+/*
+ *
+ */
+int main() {
+    const unsigned int n = KERNEL_SYMBOL(KERNEL_NAME, _parameters);
+    const scalar* recorded_x = KERNEL_SYMBOL(KERNEL_NAME, _recorded_x);
+    std::vector<scalar> x(recorded_x, recorded_x + n);
+    std::vector<scalar> g(std::max(n, 1u));
+    std::vector<scalar> unused(g.size());
+    scalar f;
+    KERNEL_NAME(&x[0], &f, &g[0]);
+
+    scalar epsilon = std::numeric_limits<scalar>::epsilon();
+    scalar tolerance = std::sqrt(std::sqrt(epsilon));
+    scalar difference = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        scalar h = std::pow(epsilon, scalar(1.0) / scalar(3.0)) * std::max(scalar(1.0), std::fabs(recorded_x[i]));
+        scalar upper, lower;
+        x[i] = recorded_x[i] + h;
+        KERNEL_NAME(&x[0], &upper, &unused[0]);
+        x[i] = recorded_x[i] - h;
+        KERNEL_NAME(&x[0], &lower, &unused[0]);
+        x[i] = recorded_x[i];
+        scalar fd = (upper - lower) / (scalar(2.0) * h);
+        difference = std::max(difference, std::fabs(g[i] - fd) / std::max(scalar(1.0), std::fabs(fd)));
+    }
+    std::cout << "kernel " << n << " parameters, f = " << f
+            << ", largest relative gradient difference " << difference << "\n";
+    if (!(difference <= tolerance)) {
+        std::cout << "FAILED kernel gradient vs central differences\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
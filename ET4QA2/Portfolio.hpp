@@ -36,8 +36,8 @@ public:
             REAL_T volume,
             REAL_T adj) : date_m(date),
     open_m(open),
-    high_m(high),
     low_m(low),
+    high_m(high),
     close_m(close),
     volume_m(volume),
     adj_close_m(adj) {
@@ -136,9 +136,9 @@ public:
 
         std::vector<std::string> lines;
         util::Tokenize(data, lines, "\n");
-        int count =0;
+        uint32_t count =0;
         
-        for (int i = 1; i < lines.size()-1; i++) {
+        for (size_t i = 1; i < lines.size()-1; i++) {
 
             if (count < Quote<REAL_T>::HISTORY_SIZE) {
                 std::vector<std::string> quote;
@@ -65,7 +65,7 @@ namespace ad {
         }
 
         virtual std::string ToString() {
-
+            return std::string();
         }
 
     protected:
@@ -77,7 +77,7 @@ namespace ad {
             REAL_T sstotal = 0;
             REAL_T sse = 0;
             this->residuals_m = std::vector<REAL_T > (x_m.size());
-            for (int i = 0; i< this->residuals_m.size(); i++) {
+            for (size_t i = 0; i < this->residuals_m.size(); i++) {
                 REAL_T eval = this->Evaluate(x_m[i]);
                 this->residuals_m[i] = (eval - y_m[i])*(eval - y_m[i]);
                 sse += this->residuals_m[i];
@@ -121,7 +121,7 @@ namespace ad {
             REAL_T sumY = REAL_T(0); //this->sum_m.Y();
             REAL_T sumXX = REAL_T(0); //this->sum_m.X() * this->sum_m.X();
             REAL_T sumXY = REAL_T(0); //this->sum_m.X() * this->sum_m.Y();
-            for (int i = 0; i <this->x_m.size(); i++) {
+            for (size_t i = 0; i <this->x_m.size(); i++) {
                 REAL_T x = this->x_m[i];
                 REAL_T y = this->y_m[i];
                 sumX += x;
@@ -146,17 +146,39 @@ namespace ad {
             this->SetVerbose(false);
         }
 
-        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+        /**
+         * Sum of squared residuals, written once for both the recorded 
+         * (ad::Variable) and the value only (REAL_T) evaluation.
+         */
+        template<class VARIABLE>
+        void SumOfSquares(VARIABLE &f, const VARIABLE &m, const VARIABLE &b) {
             f = 0.0;
-            ad::Variable<REAL_T> temp;
-            ad::Variable<REAL_T> sum = static_cast<REAL_T> (0);
-            for (int i = 0; i< this->y_m.size(); i++) {
-                temp = this->mp * this->x_m[i] + this->bp;
+            VARIABLE temp;
+            for (size_t i = 0; i< this->y_m.size(); i++) {
+                temp = m * this->x_m[i] + b;
                 f += (temp - this->y_m[i])*(temp - this->y_m[i]);
 
             }
         }
 
+        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+            this->SumOfSquares(f, this->mp, this->bp);
+        }
+
+        bool ObjectiveFunctionValue(REAL_T &f) {
+            this->SumOfSquares(f, this->mp.GetValue(), this->bp.GetValue());
+            return true;
+        }
+
+        bool ObjectiveFunctionGradient(REAL_T &f, std::valarray<REAL_T> &gradient) {
+            typedef ad::Dual<REAL_T, 2> dual;
+            dual fd;
+            this->SumOfSquares(fd, this->template MakeDual<dual>(this->mp),
+                    this->template MakeDual<dual>(this->bp));
+            this->ExtractDual(fd, f, gradient);
+            return true;
+        }
+
         void Finalize() {
             this->m = mp.GetValue();
             this->b = bp.GetValue();
@@ -193,6 +215,9 @@ namespace ad {
     class PolynomialRegression : public RegressionObject<REAL_T> {
         uint32_t order_m;
         std::vector<ad::Variable<REAL_T> > coefficients_m;
+        std::vector<REAL_T> coefficient_values_m;
+        typedef ad::Dual<REAL_T, 8> dual;
+        std::vector<dual> coefficient_duals_m;
     public:
 
         PolynomialRegression(uint32_t order, const std::vector<REAL_T> &x
@@ -265,20 +290,51 @@ namespace ad {
 
         }
 
-        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+        /**
+         * Sum of squared residuals, written once for both the recorded 
+         * (ad::Variable) and the value only (REAL_T) evaluation.
+         */
+        template<class VARIABLE>
+        void SumOfSquares(VARIABLE &f, const std::vector<VARIABLE> &coefficients) {
             f = 0.0;
-            ad::Variable<REAL_T> temp;
-            ad::Variable<REAL_T> sum = static_cast<REAL_T> (0);
-            for (int i = 0; i< this->y_m.size(); i++) {
-                temp = 0;
+            VARIABLE temp;
+            for (size_t i = 0; i< this->y_m.size(); i++) {
+                temp = 0.0;
                 for (int j = 0; j < order_m; j++) {
-                    temp += coefficients_m[j] * std::pow(this->x_m[i], j);
+                    temp += coefficients[j] * std::pow(this->x_m[i], j);
                 }
                 f += (temp - this->y_m[i])*(temp - this->y_m[i]);
             }
             //            f =static_cast<REAL_T>(this->y_m.size())*std::log(f);
         }
 
+        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+            this->SumOfSquares(f, this->coefficients_m);
+        }
+
+        bool ObjectiveFunctionValue(REAL_T &f) {
+            this->coefficient_values_m.resize(this->coefficients_m.size());
+            for (size_t j = 0; j < this->coefficients_m.size(); j++) {
+                this->coefficient_values_m[j] = this->coefficients_m[j].GetValue();
+            }
+            this->SumOfSquares(f, this->coefficient_values_m);
+            return true;
+        }
+
+        bool ObjectiveFunctionGradient(REAL_T &f, std::valarray<REAL_T> &gradient) {
+            if (gradient.size() > dual::Directions) {
+                return false;
+            }
+            this->coefficient_duals_m.resize(this->coefficients_m.size());
+            for (size_t j = 0; j < this->coefficients_m.size(); j++) {
+                this->coefficient_duals_m[j] = this->template MakeDual<dual>(this->coefficients_m[j]);
+            }
+            dual fd;
+            this->SumOfSquares(fd, this->coefficient_duals_m);
+            this->ExtractDual(fd, f, gradient);
+            return true;
+        }
+
         const REAL_T Evaluate(const REAL_T &x) {
             REAL_T temp = 0;
             for (int j = 0; j < order_m; j++) {
@@ -335,7 +391,7 @@ namespace ad {
 
             if (result[0] == 0) {
                 bool found = false;
-                for (int i = 0; i < result.size(); i++) {
+                for (size_t i = 0; i < result.size(); i++) {
                     if (result[i * cols] != 0) {
                         found = true;
                         std::vector<REAL_T> temp(cols); // = Row(m, 0);
@@ -395,19 +451,42 @@ namespace ad {
             this->Register(b);
         }
 
-        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+        /**
+         * Sum of squared residuals, written once for both the recorded 
+         * (ad::Variable) and the value only (REAL_T) evaluation.
+         */
+        template<class VARIABLE>
+        void SumOfSquares(VARIABLE &f, const VARIABLE &a, const VARIABLE &b) {
             f = 0.0;
-            ad::Variable<REAL_T> temp;
+            VARIABLE temp;
             
-            for (int i = 0; i< this->y_m.size(); i++) {
-                temp = this->a +this->b*std::log(this->x_m[i]);
+            for (size_t i = 0; i < this->y_m.size(); i++) {
+                temp = a + b * std::log(this->x_m[i]);
                 f += (temp - this->y_m[i])*(temp - this->y_m[i]);
             }
             //            f =static_cast<REAL_T>(this->y_m.size())*std::log(f);
         }
 
-        const REAL_T Evaluate(const REAL_T &x) {
+        void ObjectiveFunction(ad::Variable<REAL_T> &f) {
+            this->SumOfSquares(f, this->a, this->b);
+        }
+
+        bool ObjectiveFunctionValue(REAL_T &f) {
+            this->SumOfSquares(f, this->a.GetValue(), this->b.GetValue());
+            return true;
+        }
 
+        bool ObjectiveFunctionGradient(REAL_T &f, std::valarray<REAL_T> &gradient) {
+            typedef ad::Dual<REAL_T, 2> dual;
+            dual fd;
+            this->SumOfSquares(fd, this->template MakeDual<dual>(this->a),
+                    this->template MakeDual<dual>(this->b));
+            this->ExtractDual(fd, f, gradient);
+            return true;
+        }
+
+        const REAL_T Evaluate(const REAL_T &x) {
+            return a.GetValue() + b.GetValue() * std::log(x);
         }
 
 
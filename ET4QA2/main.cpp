@@ -99,11 +99,11 @@ class IV : public TestBase < 'y' > {
 
 std::stringstream datastream;
 
-size_t writeCallback(char* buf, size_t size, size_t nmemb, void* up) { //callback must have this declaration
+size_t writeCallback(char* buf, size_t size, size_t nmemb, void* /*up*/) { //callback must have this declaration
     //buf is a pointer to the data that curl has for us
     //size*nmemb is the size of the buffer
     //        std::cout<<
-    for (int c = 0; c < size * nmemb; c++) {
+    for (size_t c = 0; c < size * nmemb; c++) {
         //            sdata.push_back(buf[c]);
         datastream << buf[c];
     }
@@ -163,6 +163,7 @@ int GetData(const std::string &name) {
     }
 
     curl_global_cleanup();
+    return 0;
 
 
 
@@ -214,6 +215,7 @@ int testcurl() {
     }
 
     curl_global_cleanup();
+    return 0;
 
 
 
@@ -257,11 +259,9 @@ void testurl() {
     if (status == -1) std::cout << "connect error";
 
     std::cout << "send()ing message..." << std::endl;
-    char *msg = "GET / HTTP/1.1\nhost: /table.csv?s=aapl&ignore=.csv\n\n";
-    int len;
     ssize_t bytes_sent;
-    len = strlen(msg);
     bytes_sent = send(socketfd, ss.str().c_str(), ss.str().size(), 0);
+    if (bytes_sent == -1) std::cout << "send error";
 
 
     std::cout << "Waiting to recieve data..." << std::endl;
@@ -314,13 +314,18 @@ public:
 
     }
 
-    void ObjectiveFunction(ad::Variable<T>& f) {
+    /**
+     * Objective function written once for both the recorded (ad::Variable) 
+     * and the value only (T) evaluation.
+     */
+    template<class VARIABLE>
+    void SumOfSquares(VARIABLE& f, const VARIABLE& m, const VARIABLE& b) {
         f = 0.0;
-        ad::Variable<T> temp;
-        ad::Variable<T> sum = 0;
+        VARIABLE temp;
+        VARIABLE sum = 0.0;
         for (int i = 0; i< this->y.size(); i++) {
             //            this->predictedY[i] = this->slope * x[i] + this->intercept;
-            temp = this->m * x[i] + this->b;
+            temp = m * x[i] + b;
             sum += (temp - y[i])*(temp - y[i]);
 
         }
@@ -334,6 +339,24 @@ public:
 
     }
 
+    void ObjectiveFunction(ad::Variable<T>& f) {
+        this->SumOfSquares(f, this->m, this->b);
+    }
+
+    bool ObjectiveFunctionValue(T& f) {
+        this->SumOfSquares(f, this->m.GetValue(), this->b.GetValue());
+        return true;
+    }
+
+    bool ObjectiveFunctionGradient(T& f, std::valarray<T>& gradient) {
+        typedef ad::Dual<T, 2> dual;
+        dual fd;
+        this->SumOfSquares(fd, this->template MakeDual<dual>(this->m),
+                this->template MakeDual<dual>(this->b));
+        this->ExtractDual(fd, f, gradient);
+        return true;
+    }
+
     void Finalize() {
         //        std::cout << "x,observed y,predicted y" << std::endl;
         //        for (int i = 0; i < this->numberOfObservations; i++) {
@@ -350,7 +373,7 @@ public:
 /*
  * 
  */
-int main(int argc, char** argv) {
+int main(int /*argc*/, char** /*argv*/) {
     //    Simple<double> s;
     //    s.Run();
     //    exit(0);
@@ -411,7 +434,6 @@ int main(int argc, char** argv) {
 
     exit(0);
 
-    int i = 0;
     std::ifstream in;
     in.open("sp500");
     std::vector<Asset<float> > assets;
@@ -456,8 +478,8 @@ int main(int argc, char** argv) {
 
     std::cout << "g = " << g << "\n";
     std::cout.precision(50);
-    std::cout << std::scientific << "df/deffort_devs[575] = " << ca.GetFunctionValue().WRT(ca.effort_devs[575]) << "\n";
-    std::cout << std::scientific << "dg/deffort_devs[575] = " << g.WRT(ca.effort_devs[575]) << "\n";
+    std::cout << std::scientific << "df/deffort_devs[last] = " << ca.GetFunctionValue().WRT(ca.effort_devs.back()) << "\n";
+    std::cout << std::scientific << "dg/deffort_devs[last] = " << g.WRT(ca.effort_devs.back()) << "\n";
 
     //    ////            }
     //    //               std::cout<<ad::Variable<double>::misses_g<<" map misses!";